@@ -0,0 +1,862 @@
+#include "aeadcipher.h"
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define AEADCIPHER_X86 1
+#include <immintrin.h>
+#include <wmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define AEADCIPHER_TARGET(isa) __attribute__((target(isa)))
+#else
+#define AEADCIPHER_TARGET(isa)
+#endif
+
+namespace {
+
+std::atomic<bool> s_hardwareAesEnabled(true);
+
+inline quint32 loadLittleEndian32(const unsigned char *p)
+{
+    return quint32(p[0]) | (quint32(p[1]) << 8) | (quint32(p[2]) << 16) | (quint32(p[3]) << 24);
+}
+
+inline void storeLittleEndian32(unsigned char *p, quint32 value)
+{
+    p[0] = static_cast<unsigned char>(value);
+    p[1] = static_cast<unsigned char>(value >> 8);
+    p[2] = static_cast<unsigned char>(value >> 16);
+    p[3] = static_cast<unsigned char>(value >> 24);
+}
+
+inline void storeLittleEndian64(unsigned char *p, quint64 value)
+{
+    storeLittleEndian32(p, static_cast<quint32>(value));
+    storeLittleEndian32(p + 4, static_cast<quint32>(value >> 32));
+}
+
+inline quint64 loadBigEndian64(const unsigned char *p)
+{
+    quint64 value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+inline void storeBigEndian64(unsigned char *p, quint64 value)
+{
+    for (int i = 7; i >= 0; --i) {
+        p[i] = static_cast<unsigned char>(value);
+        value >>= 8;
+    }
+}
+
+inline void storeBigEndian32(unsigned char *p, quint32 value)
+{
+    p[0] = static_cast<unsigned char>(value >> 24);
+    p[1] = static_cast<unsigned char>(value >> 16);
+    p[2] = static_cast<unsigned char>(value >> 8);
+    p[3] = static_cast<unsigned char>(value);
+}
+
+bool constantTimeEquals(const unsigned char *a, const unsigned char *b, int size)
+{
+    unsigned char difference = 0;
+    for (int i = 0; i < size; ++i) {
+        difference |= static_cast<unsigned char>(a[i] ^ b[i]);
+    }
+    return difference == 0;
+}
+
+// ---------------------------------------------------------------------------
+// AES-256, portable
+// ---------------------------------------------------------------------------
+
+const unsigned char kSbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+inline unsigned char xtime(unsigned char x)
+{
+    return static_cast<unsigned char>((x << 1) ^ ((x & 0x80) ? 0x1b : 0x00));
+}
+
+// FIPS-197 key expansion; the byte layout is also what AESENC expects
+void aesExpandKey(const unsigned char *key, unsigned char *roundKeys)
+{
+    memcpy(roundKeys, key, 32);
+    unsigned char rcon = 0x01;
+
+    for (int i = 8; i < 60; ++i) {
+        unsigned char temp[4];
+        memcpy(temp, roundKeys + (i - 1) * 4, 4);
+
+        if (i % 8 == 0) {
+            unsigned char first = temp[0];
+            temp[0] = static_cast<unsigned char>(kSbox[temp[1]] ^ rcon);
+            temp[1] = kSbox[temp[2]];
+            temp[2] = kSbox[temp[3]];
+            temp[3] = kSbox[first];
+            rcon = xtime(rcon);
+        } else if (i % 8 == 4) {
+            for (int j = 0; j < 4; ++j) {
+                temp[j] = kSbox[temp[j]];
+            }
+        }
+
+        for (int j = 0; j < 4; ++j) {
+            roundKeys[i * 4 + j] = static_cast<unsigned char>(roundKeys[(i - 8) * 4 + j] ^ temp[j]);
+        }
+    }
+}
+
+void aesEncryptBlockSoftware(const unsigned char *roundKeys, const unsigned char *in, unsigned char *out)
+{
+    unsigned char state[16];
+    for (int i = 0; i < 16; ++i) {
+        state[i] = static_cast<unsigned char>(in[i] ^ roundKeys[i]);
+    }
+
+    for (int round = 1; round <= 14; ++round) {
+        // SubBytes and ShiftRows together: row r rotates left by r columns
+        unsigned char shifted[16];
+        for (int column = 0; column < 4; ++column) {
+            for (int row = 0; row < 4; ++row) {
+                shifted[column * 4 + row] = kSbox[state[((column + row) % 4) * 4 + row]];
+            }
+        }
+
+        if (round < 14) {
+            for (int column = 0; column < 4; ++column) {
+                unsigned char *c = shifted + column * 4;
+                unsigned char a0 = c[0], a1 = c[1], a2 = c[2], a3 = c[3];
+                unsigned char all = static_cast<unsigned char>(a0 ^ a1 ^ a2 ^ a3);
+                c[0] = static_cast<unsigned char>(a0 ^ all ^ xtime(static_cast<unsigned char>(a0 ^ a1)));
+                c[1] = static_cast<unsigned char>(a1 ^ all ^ xtime(static_cast<unsigned char>(a1 ^ a2)));
+                c[2] = static_cast<unsigned char>(a2 ^ all ^ xtime(static_cast<unsigned char>(a2 ^ a3)));
+                c[3] = static_cast<unsigned char>(a3 ^ all ^ xtime(static_cast<unsigned char>(a3 ^ a0)));
+            }
+        }
+
+        const unsigned char *roundKey = roundKeys + round * 16;
+        for (int i = 0; i < 16; ++i) {
+            state[i] = static_cast<unsigned char>(shifted[i] ^ roundKey[i]);
+        }
+    }
+
+    memcpy(out, state, 16);
+}
+
+// Counter blocks are nonce || big-endian 32-bit counter; data starts at 2
+void aesCtrSoftware(const unsigned char *roundKeys, const unsigned char *nonce,
+                    unsigned char *data, qint64 size)
+{
+    unsigned char counter[16];
+    unsigned char keystream[16];
+    memcpy(counter, nonce, 12);
+    quint32 blockNumber = 2;
+
+    for (qint64 offset = 0; offset < size; offset += 16, ++blockNumber) {
+        storeBigEndian32(counter + 12, blockNumber);
+        aesEncryptBlockSoftware(roundKeys, counter, keystream);
+        const qint64 count = qMin<qint64>(16, size - offset);
+        for (qint64 i = 0; i < count; ++i) {
+            data[offset + i] ^= keystream[i];
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// GHASH, portable: bitwise multiply in GF(2^128) with the GCM bit order
+// ---------------------------------------------------------------------------
+
+struct SoftwareGhash
+{
+    quint64 hashKeyHigh;
+    quint64 hashKeyLow;
+    quint64 high = 0;
+    quint64 low = 0;
+
+    explicit SoftwareGhash(const unsigned char *hashKey)
+        : hashKeyHigh(loadBigEndian64(hashKey))
+        , hashKeyLow(loadBigEndian64(hashKey + 8))
+    {
+    }
+
+    void block(const unsigned char *data)
+    {
+        const quint64 xHigh = high ^ loadBigEndian64(data);
+        const quint64 xLow = low ^ loadBigEndian64(data + 8);
+        quint64 zHigh = 0, zLow = 0;
+        quint64 vHigh = hashKeyHigh, vLow = hashKeyLow;
+
+        for (int i = 0; i < 128; ++i) {
+            const quint64 bit = i < 64 ? (xHigh >> (63 - i)) & 1 : (xLow >> (127 - i)) & 1;
+            const quint64 mask = 0 - bit;
+            zHigh ^= vHigh & mask;
+            zLow ^= vLow & mask;
+
+            const quint64 reduce = 0 - (vLow & 1);
+            vLow = (vLow >> 1) | (vHigh << 63);
+            vHigh = (vHigh >> 1) ^ (0xe100000000000000ULL & reduce);
+        }
+
+        high = zHigh;
+        low = zLow;
+    }
+
+    // Whole blocks, then a zero-padded partial block
+    void update(const unsigned char *data, qint64 size)
+    {
+        qint64 offset = 0;
+        for (; offset + 16 <= size; offset += 16) {
+            block(data + offset);
+        }
+        if (offset < size) {
+            unsigned char padded[16] = {0};
+            memcpy(padded, data + offset, static_cast<size_t>(size - offset));
+            block(padded);
+        }
+    }
+
+    void result(unsigned char *out) const
+    {
+        storeBigEndian64(out, high);
+        storeBigEndian64(out + 8, low);
+    }
+};
+
+// ---------------------------------------------------------------------------
+// AES-NI and PCLMULQDQ
+// ---------------------------------------------------------------------------
+
+#ifdef AEADCIPHER_X86
+#define AEADCIPHER_HW_TARGET AEADCIPHER_TARGET("aes,pclmul,ssse3,sse4.1")
+
+AEADCIPHER_HW_TARGET
+inline __m128i byteSwapMask()
+{
+    return _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+}
+
+// 256-bit carry-less product of two byte-reversed field elements
+AEADCIPHER_HW_TARGET
+inline void clmul256(__m128i a, __m128i b, __m128i &low, __m128i &high)
+{
+    __m128i lo = _mm_clmulepi64_si128(a, b, 0x00);
+    __m128i mid = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10), _mm_clmulepi64_si128(a, b, 0x01));
+    __m128i hi = _mm_clmulepi64_si128(a, b, 0x11);
+    low = _mm_xor_si128(lo, _mm_slli_si128(mid, 8));
+    high = _mm_xor_si128(hi, _mm_srli_si128(mid, 8));
+}
+
+// Shift the reflected product left by one and reduce modulo the GCM polynomial
+AEADCIPHER_HW_TARGET
+inline __m128i ghashReduce(__m128i low, __m128i high)
+{
+    __m128i carryLow = _mm_srli_epi32(low, 31);
+    __m128i carryHigh = _mm_srli_epi32(high, 31);
+    low = _mm_slli_epi32(low, 1);
+    high = _mm_slli_epi32(high, 1);
+    __m128i crossCarry = _mm_srli_si128(carryLow, 12);
+    carryHigh = _mm_slli_si128(carryHigh, 4);
+    carryLow = _mm_slli_si128(carryLow, 4);
+    low = _mm_or_si128(low, carryLow);
+    high = _mm_or_si128(high, carryHigh);
+    high = _mm_or_si128(high, crossCarry);
+
+    __m128i a = _mm_slli_epi32(low, 31);
+    __m128i b = _mm_slli_epi32(low, 30);
+    __m128i c = _mm_slli_epi32(low, 25);
+    a = _mm_xor_si128(a, b);
+    a = _mm_xor_si128(a, c);
+    b = _mm_srli_si128(a, 4);
+    a = _mm_slli_si128(a, 12);
+    low = _mm_xor_si128(low, a);
+
+    __m128i d = _mm_srli_epi32(low, 1);
+    __m128i e = _mm_srli_epi32(low, 2);
+    __m128i f = _mm_srli_epi32(low, 7);
+    d = _mm_xor_si128(d, e);
+    d = _mm_xor_si128(d, f);
+    d = _mm_xor_si128(d, b);
+    low = _mm_xor_si128(low, d);
+    return _mm_xor_si128(high, low);
+}
+
+AEADCIPHER_HW_TARGET
+inline __m128i ghashMultiply(__m128i a, __m128i b)
+{
+    __m128i low, high;
+    clmul256(a, b, low, high);
+    return ghashReduce(low, high);
+}
+
+AEADCIPHER_HW_TARGET
+void computeHashPowersHardware(const unsigned char *hashKey, unsigned char powers[4][16])
+{
+    const __m128i h = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(hashKey)), byteSwapMask());
+    __m128i power = h;
+    for (int i = 0; i < 4; ++i) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(powers[i]), power);
+        power = ghashMultiply(power, h);
+    }
+}
+
+struct HardwareGhash
+{
+    __m128i h1, h2, h3, h4;
+    __m128i state;
+    __m128i mask;
+
+    AEADCIPHER_HW_TARGET
+    explicit HardwareGhash(const unsigned char powers[4][16])
+    {
+        h1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(powers[0]));
+        h2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(powers[1]));
+        h3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(powers[2]));
+        h4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(powers[3]));
+        state = _mm_setzero_si128();
+        mask = byteSwapMask();
+    }
+
+    AEADCIPHER_HW_TARGET
+    void update(const unsigned char *data, qint64 size)
+    {
+        qint64 offset = 0;
+
+        // Four blocks per reduction: Y' = (Y^X1)H^4 + X2 H^3 + X3 H^2 + X4 H
+        for (; offset + 64 <= size; offset += 64) {
+            const __m128i *p = reinterpret_cast<const __m128i*>(data + offset);
+            __m128i x1 = _mm_xor_si128(state, _mm_shuffle_epi8(_mm_loadu_si128(p + 0), mask));
+            __m128i x2 = _mm_shuffle_epi8(_mm_loadu_si128(p + 1), mask);
+            __m128i x3 = _mm_shuffle_epi8(_mm_loadu_si128(p + 2), mask);
+            __m128i x4 = _mm_shuffle_epi8(_mm_loadu_si128(p + 3), mask);
+
+            __m128i low, high, partLow, partHigh;
+            clmul256(x1, h4, low, high);
+            clmul256(x2, h3, partLow, partHigh);
+            low = _mm_xor_si128(low, partLow);
+            high = _mm_xor_si128(high, partHigh);
+            clmul256(x3, h2, partLow, partHigh);
+            low = _mm_xor_si128(low, partLow);
+            high = _mm_xor_si128(high, partHigh);
+            clmul256(x4, h1, partLow, partHigh);
+            low = _mm_xor_si128(low, partLow);
+            high = _mm_xor_si128(high, partHigh);
+            state = ghashReduce(low, high);
+        }
+
+        for (; offset + 16 <= size; offset += 16) {
+            __m128i x = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset)), mask);
+            state = ghashMultiply(_mm_xor_si128(state, x), h1);
+        }
+
+        if (offset < size) {
+            unsigned char padded[16] = {0};
+            memcpy(padded, data + offset, static_cast<size_t>(size - offset));
+            __m128i x = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(padded)), mask);
+            state = ghashMultiply(_mm_xor_si128(state, x), h1);
+        }
+    }
+
+    AEADCIPHER_HW_TARGET
+    void result(unsigned char *out) const
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_shuffle_epi8(state, mask));
+    }
+};
+
+AEADCIPHER_HW_TARGET
+inline __m128i aesEncryptBlockHardware(const __m128i *keys, __m128i block)
+{
+    block = _mm_xor_si128(block, keys[0]);
+    for (int round = 1; round < 14; ++round) {
+        block = _mm_aesenc_si128(block, keys[round]);
+    }
+    return _mm_aesenclast_si128(block, keys[14]);
+}
+
+AEADCIPHER_HW_TARGET
+void aesEncryptSingleHardware(const unsigned char *roundKeys, const unsigned char *in, unsigned char *out)
+{
+    __m128i keys[15];
+    for (int i = 0; i < 15; ++i) {
+        keys[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(roundKeys + i * 16));
+    }
+    __m128i block = aesEncryptBlockHardware(keys, _mm_loadu_si128(reinterpret_cast<const __m128i*>(in)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), block);
+}
+
+// Counter in the last four bytes, stored big-endian
+AEADCIPHER_HW_TARGET
+inline __m128i counterBlock(__m128i base, quint32 number, __m128i swap32)
+{
+    return _mm_shuffle_epi8(_mm_insert_epi32(base, static_cast<int>(number), 3), swap32);
+}
+
+AEADCIPHER_HW_TARGET
+void aesCtrHardware(const unsigned char *roundKeys, const unsigned char *nonce,
+                    unsigned char *data, qint64 size)
+{
+    __m128i keys[15];
+    for (int i = 0; i < 15; ++i) {
+        keys[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(roundKeys + i * 16));
+    }
+
+    unsigned char base[16] = {0};
+    memcpy(base, nonce, 12);
+    const __m128i counterBase = _mm_loadu_si128(reinterpret_cast<const __m128i*>(base));
+    const __m128i swap32 = _mm_set_epi8(12, 13, 14, 15, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    quint32 blockNumber = 2;
+
+    qint64 offset = 0;
+    // Eight independent blocks keep the AES units busy
+    for (; offset + 128 <= size; offset += 128, blockNumber += 8) {
+        __m128i b[8];
+        for (int i = 0; i < 8; ++i) {
+            b[i] = _mm_xor_si128(counterBlock(counterBase, blockNumber + i, swap32), keys[0]);
+        }
+        for (int round = 1; round < 14; ++round) {
+            for (int i = 0; i < 8; ++i) {
+                b[i] = _mm_aesenc_si128(b[i], keys[round]);
+            }
+        }
+        __m128i *p = reinterpret_cast<__m128i*>(data + offset);
+        for (int i = 0; i < 8; ++i) {
+            b[i] = _mm_aesenclast_si128(b[i], keys[14]);
+            _mm_storeu_si128(p + i, _mm_xor_si128(_mm_loadu_si128(p + i), b[i]));
+        }
+    }
+
+    for (; offset < size; offset += 16, ++blockNumber) {
+        __m128i keystream = aesEncryptBlockHardware(keys, counterBlock(counterBase, blockNumber, swap32));
+        const qint64 count = qMin<qint64>(16, size - offset);
+        if (count == 16) {
+            __m128i *p = reinterpret_cast<__m128i*>(data + offset);
+            _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), keystream));
+        } else {
+            unsigned char bytes[16];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(bytes), keystream);
+            for (qint64 i = 0; i < count; ++i) {
+                data[offset + i] ^= bytes[i];
+            }
+        }
+    }
+}
+
+bool detectHardwareAes()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    const bool aes = (info[2] & (1 << 25)) != 0;
+    const bool pclmul = (info[2] & (1 << 1)) != 0;
+    const bool ssse3 = (info[2] & (1 << 9)) != 0;
+    const bool sse41 = (info[2] & (1 << 19)) != 0;
+    return aes && pclmul && ssse3 && sse41;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("aes") && __builtin_cpu_supports("pclmul")
+        && __builtin_cpu_supports("ssse3") && __builtin_cpu_supports("sse4.1");
+#endif
+}
+#else
+bool detectHardwareAes()
+{
+    return false;
+}
+#endif
+
+bool cpuHasHardwareAes()
+{
+    static const bool supported = detectHardwareAes();
+    return supported;
+}
+
+// ---------------------------------------------------------------------------
+// ChaCha20 and Poly1305 (RFC 8439)
+// ---------------------------------------------------------------------------
+
+inline quint32 rotateLeft(quint32 value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+#define CHACHA_QUARTER_ROUND(a, b, c, d)             \
+    a += b; d ^= a; d = rotateLeft(d, 16);           \
+    c += d; b ^= c; b = rotateLeft(b, 12);           \
+    a += b; d ^= a; d = rotateLeft(d, 8);            \
+    c += d; b ^= c; b = rotateLeft(b, 7);
+
+void chachaBlock(const quint32 *input, unsigned char *output)
+{
+    quint32 x[16];
+    memcpy(x, input, sizeof(x));
+
+    for (int i = 0; i < 10; ++i) {
+        CHACHA_QUARTER_ROUND(x[0], x[4], x[8], x[12])
+        CHACHA_QUARTER_ROUND(x[1], x[5], x[9], x[13])
+        CHACHA_QUARTER_ROUND(x[2], x[6], x[10], x[14])
+        CHACHA_QUARTER_ROUND(x[3], x[7], x[11], x[15])
+        CHACHA_QUARTER_ROUND(x[0], x[5], x[10], x[15])
+        CHACHA_QUARTER_ROUND(x[1], x[6], x[11], x[12])
+        CHACHA_QUARTER_ROUND(x[2], x[7], x[8], x[13])
+        CHACHA_QUARTER_ROUND(x[3], x[4], x[9], x[14])
+    }
+
+    for (int i = 0; i < 16; ++i) {
+        storeLittleEndian32(output + i * 4, x[i] + input[i]);
+    }
+}
+
+#undef CHACHA_QUARTER_ROUND
+
+void chachaInitState(quint32 *state, const unsigned char *key, const unsigned char *nonce, quint32 counter)
+{
+    state[0] = 0x61707865;
+    state[1] = 0x3320646e;
+    state[2] = 0x79622d32;
+    state[3] = 0x6b206574;
+    for (int i = 0; i < 8; ++i) {
+        state[4 + i] = loadLittleEndian32(key + i * 4);
+    }
+    state[12] = counter;
+    for (int i = 0; i < 3; ++i) {
+        state[13 + i] = loadLittleEndian32(nonce + i * 4);
+    }
+}
+
+// Data uses block counters from 1; block 0 supplies the Poly1305 key
+void chachaXor(const unsigned char *key, const unsigned char *nonce, unsigned char *data, qint64 size)
+{
+    quint32 state[16];
+    chachaInitState(state, key, nonce, 1);
+    unsigned char keystream[64];
+
+    for (qint64 offset = 0; offset < size; offset += 64, ++state[12]) {
+        chachaBlock(state, keystream);
+        const qint64 count = qMin<qint64>(64, size - offset);
+        if (count == 64) {
+            for (int i = 0; i < 64; i += 8) {
+                quint64 value, stream;
+                memcpy(&value, data + offset + i, 8);
+                memcpy(&stream, keystream + i, 8);
+                value ^= stream;
+                memcpy(data + offset + i, &value, 8);
+            }
+        } else {
+            for (qint64 i = 0; i < count; ++i) {
+                data[offset + i] ^= keystream[i];
+            }
+        }
+    }
+}
+
+// 26-bit limbs so every product fits in 64 bits on any compiler
+struct Poly1305
+{
+    quint32 r[5];
+    quint32 h[5];
+    quint32 pad[4];
+
+    explicit Poly1305(const unsigned char *key)
+    {
+        r[0] = loadLittleEndian32(key + 0) & 0x3ffffff;
+        r[1] = (loadLittleEndian32(key + 3) >> 2) & 0x3ffff03;
+        r[2] = (loadLittleEndian32(key + 6) >> 4) & 0x3ffc0ff;
+        r[3] = (loadLittleEndian32(key + 9) >> 6) & 0x3f03fff;
+        r[4] = (loadLittleEndian32(key + 12) >> 8) & 0x00fffff;
+        for (int i = 0; i < 5; ++i) {
+            h[i] = 0;
+        }
+        for (int i = 0; i < 4; ++i) {
+            pad[i] = loadLittleEndian32(key + 16 + i * 4);
+        }
+    }
+
+    void blocks(const unsigned char *m, qint64 size)
+    {
+        const quint32 r0 = r[0], r1 = r[1], r2 = r[2], r3 = r[3], r4 = r[4];
+        const quint32 s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+        quint32 h0 = h[0], h1 = h[1], h2 = h[2], h3 = h[3], h4 = h[4];
+
+        for (; size >= 16; size -= 16, m += 16) {
+            h0 += loadLittleEndian32(m + 0) & 0x3ffffff;
+            h1 += (loadLittleEndian32(m + 3) >> 2) & 0x3ffffff;
+            h2 += (loadLittleEndian32(m + 6) >> 4) & 0x3ffffff;
+            h3 += (loadLittleEndian32(m + 9) >> 6) & 0x3ffffff;
+            h4 += (loadLittleEndian32(m + 12) >> 8) | (1 << 24);
+
+            quint64 d0 = quint64(h0) * r0 + quint64(h1) * s4 + quint64(h2) * s3 + quint64(h3) * s2 + quint64(h4) * s1;
+            quint64 d1 = quint64(h0) * r1 + quint64(h1) * r0 + quint64(h2) * s4 + quint64(h3) * s3 + quint64(h4) * s2;
+            quint64 d2 = quint64(h0) * r2 + quint64(h1) * r1 + quint64(h2) * r0 + quint64(h3) * s4 + quint64(h4) * s3;
+            quint64 d3 = quint64(h0) * r3 + quint64(h1) * r2 + quint64(h2) * r1 + quint64(h3) * r0 + quint64(h4) * s4;
+            quint64 d4 = quint64(h0) * r4 + quint64(h1) * r3 + quint64(h2) * r2 + quint64(h3) * r1 + quint64(h4) * r0;
+
+            quint32 carry = static_cast<quint32>(d0 >> 26); h0 = static_cast<quint32>(d0) & 0x3ffffff;
+            d1 += carry; carry = static_cast<quint32>(d1 >> 26); h1 = static_cast<quint32>(d1) & 0x3ffffff;
+            d2 += carry; carry = static_cast<quint32>(d2 >> 26); h2 = static_cast<quint32>(d2) & 0x3ffffff;
+            d3 += carry; carry = static_cast<quint32>(d3 >> 26); h3 = static_cast<quint32>(d3) & 0x3ffffff;
+            d4 += carry; carry = static_cast<quint32>(d4 >> 26); h4 = static_cast<quint32>(d4) & 0x3ffffff;
+            h0 += carry * 5; carry = h0 >> 26; h0 &= 0x3ffffff;
+            h1 += carry;
+        }
+
+        h[0] = h0; h[1] = h1; h[2] = h2; h[3] = h3; h[4] = h4;
+    }
+
+    // The AEAD construction pads every field to 16 bytes with zeros
+    void updatePadded(const unsigned char *data, qint64 size)
+    {
+        const qint64 whole = size & ~qint64(15);
+        blocks(data, whole);
+        if (whole < size) {
+            unsigned char padded[16] = {0};
+            memcpy(padded, data + whole, static_cast<size_t>(size - whole));
+            blocks(padded, 16);
+        }
+    }
+
+    void finish(unsigned char *mac)
+    {
+        quint32 h0 = h[0], h1 = h[1], h2 = h[2], h3 = h[3], h4 = h[4];
+        quint32 carry;
+
+        carry = h1 >> 26; h1 &= 0x3ffffff;
+        h2 += carry; carry = h2 >> 26; h2 &= 0x3ffffff;
+        h3 += carry; carry = h3 >> 26; h3 &= 0x3ffffff;
+        h4 += carry; carry = h4 >> 26; h4 &= 0x3ffffff;
+        h0 += carry * 5; carry = h0 >> 26; h0 &= 0x3ffffff;
+        h1 += carry;
+
+        // Compute h - p and keep it if it did not underflow
+        quint32 g0 = h0 + 5; carry = g0 >> 26; g0 &= 0x3ffffff;
+        quint32 g1 = h1 + carry; carry = g1 >> 26; g1 &= 0x3ffffff;
+        quint32 g2 = h2 + carry; carry = g2 >> 26; g2 &= 0x3ffffff;
+        quint32 g3 = h3 + carry; carry = g3 >> 26; g3 &= 0x3ffffff;
+        quint32 g4 = h4 + carry - (1u << 26);
+
+        quint32 mask = (g4 >> 31) - 1;
+        g0 &= mask; g1 &= mask; g2 &= mask; g3 &= mask; g4 &= mask;
+        mask = ~mask;
+        h0 = (h0 & mask) | g0;
+        h1 = (h1 & mask) | g1;
+        h2 = (h2 & mask) | g2;
+        h3 = (h3 & mask) | g3;
+        h4 = (h4 & mask) | g4;
+
+        h0 = h0 | (h1 << 26);
+        h1 = (h1 >> 6) | (h2 << 20);
+        h2 = (h2 >> 12) | (h3 << 14);
+        h3 = (h3 >> 18) | (h4 << 8);
+
+        quint64 f = quint64(h0) + pad[0]; h0 = static_cast<quint32>(f);
+        f = quint64(h1) + pad[1] + (f >> 32); h1 = static_cast<quint32>(f);
+        f = quint64(h2) + pad[2] + (f >> 32); h2 = static_cast<quint32>(f);
+        f = quint64(h3) + pad[3] + (f >> 32); h3 = static_cast<quint32>(f);
+
+        storeLittleEndian32(mac + 0, h0);
+        storeLittleEndian32(mac + 4, h1);
+        storeLittleEndian32(mac + 8, h2);
+        storeLittleEndian32(mac + 12, h3);
+    }
+};
+
+} // namespace
+
+AeadCipher::AeadCipher()
+    : m_algorithm(Algorithm::Aes256Gcm)
+    , m_valid(false)
+{
+    memset(m_key, 0, sizeof(m_key));
+    memset(m_roundKeys, 0, sizeof(m_roundKeys));
+    memset(m_hashKey, 0, sizeof(m_hashKey));
+    memset(m_hashPowers, 0, sizeof(m_hashPowers));
+}
+
+AeadCipher::AeadCipher(Algorithm algorithm, const QByteArray &key)
+    : AeadCipher()
+{
+    setKey(algorithm, key);
+}
+
+void AeadCipher::setKey(Algorithm algorithm, const QByteArray &key)
+{
+    m_algorithm = algorithm;
+    m_valid = key.size() == KeySize && isKnownAlgorithm(static_cast<quint8>(algorithm));
+    if (!m_valid) {
+        return;
+    }
+
+    memcpy(m_key, key.constData(), KeySize);
+
+    if (m_algorithm == Algorithm::Aes256Gcm) {
+        aesExpandKey(m_key, m_roundKeys);
+        const unsigned char zero[16] = {0};
+        aesEncryptBlockSoftware(m_roundKeys, zero, m_hashKey);
+#ifdef AEADCIPHER_X86
+        if (cpuHasHardwareAes()) {
+            computeHashPowersHardware(m_hashKey, m_hashPowers);
+        }
+#endif
+    }
+}
+
+void AeadCipher::applyKeystream(const unsigned char *nonce, unsigned char *data, qint64 size) const
+{
+    if (m_algorithm == Algorithm::ChaCha20Poly1305) {
+        chachaXor(m_key, nonce, data, size);
+        return;
+    }
+
+#ifdef AEADCIPHER_X86
+    if (hasHardwareAes()) {
+        aesCtrHardware(m_roundKeys, nonce, data, size);
+        return;
+    }
+#endif
+    aesCtrSoftware(m_roundKeys, nonce, data, size);
+}
+
+void AeadCipher::computeTag(const unsigned char *nonce, const QByteArray &aad,
+                            const unsigned char *data, qint64 size, unsigned char *tag) const
+{
+    const unsigned char *aadBytes = reinterpret_cast<const unsigned char*>(aad.constData());
+    const qint64 aadSize = aad.size();
+
+    if (m_algorithm == Algorithm::ChaCha20Poly1305) {
+        quint32 state[16];
+        unsigned char block[64];
+        chachaInitState(state, m_key, nonce, 0);
+        chachaBlock(state, block);
+
+        Poly1305 mac(block);
+        mac.updatePadded(aadBytes, aadSize);
+        mac.updatePadded(data, size);
+        unsigned char lengths[16];
+        storeLittleEndian64(lengths, static_cast<quint64>(aadSize));
+        storeLittleEndian64(lengths + 8, static_cast<quint64>(size));
+        mac.blocks(lengths, 16);
+        mac.finish(tag);
+        return;
+    }
+
+    unsigned char lengths[16];
+    storeBigEndian64(lengths, static_cast<quint64>(aadSize) * 8);
+    storeBigEndian64(lengths + 8, static_cast<quint64>(size) * 8);
+
+    unsigned char counter[16] = {0};
+    memcpy(counter, nonce, 12);
+    counter[15] = 1;
+    unsigned char encryptedCounter[16];
+
+#ifdef AEADCIPHER_X86
+    if (hasHardwareAes()) {
+        HardwareGhash hash(m_hashPowers);
+        hash.update(aadBytes, aadSize);
+        hash.update(data, size);
+        hash.update(lengths, 16);
+        hash.result(tag);
+        aesEncryptSingleHardware(m_roundKeys, counter, encryptedCounter);
+    } else
+#endif
+    {
+        SoftwareGhash hash(m_hashKey);
+        hash.update(aadBytes, aadSize);
+        hash.update(data, size);
+        hash.update(lengths, 16);
+        hash.result(tag);
+        aesEncryptBlockSoftware(m_roundKeys, counter, encryptedCounter);
+    }
+
+    for (int i = 0; i < 16; ++i) {
+        tag[i] ^= encryptedCounter[i];
+    }
+}
+
+void AeadCipher::encrypt(const unsigned char *nonce, const QByteArray &aad,
+                         unsigned char *data, qint64 size, unsigned char *tag) const
+{
+    if (!m_valid) {
+        memset(tag, 0, TagSize);
+        return;
+    }
+
+    applyKeystream(nonce, data, size);
+    computeTag(nonce, aad, data, size, tag);
+}
+
+bool AeadCipher::decrypt(const unsigned char *nonce, const QByteArray &aad,
+                         unsigned char *data, qint64 size, const unsigned char *tag) const
+{
+    if (!verify(nonce, aad, data, size, tag)) {
+        return false;
+    }
+
+    applyKeystream(nonce, data, size);
+    return true;
+}
+
+bool AeadCipher::verify(const unsigned char *nonce, const QByteArray &aad,
+                        const unsigned char *data, qint64 size, const unsigned char *tag) const
+{
+    if (!m_valid) {
+        return false;
+    }
+
+    unsigned char expected[TagSize];
+    computeTag(nonce, aad, data, size, expected);
+    return constantTimeEquals(expected, tag, TagSize);
+}
+
+bool AeadCipher::hasHardwareAes()
+{
+    return cpuHasHardwareAes() && s_hardwareAesEnabled.load(std::memory_order_relaxed);
+}
+
+void AeadCipher::setHardwareAesEnabled(bool enabled)
+{
+    s_hardwareAesEnabled.store(enabled, std::memory_order_relaxed);
+}
+
+AeadCipher::Algorithm AeadCipher::preferredAlgorithm()
+{
+    return hasHardwareAes() ? Algorithm::Aes256Gcm : Algorithm::ChaCha20Poly1305;
+}
+
+bool AeadCipher::isKnownAlgorithm(quint8 value)
+{
+    return value == static_cast<quint8>(Algorithm::Aes256Gcm)
+        || value == static_cast<quint8>(Algorithm::ChaCha20Poly1305);
+}
+
+QString AeadCipher::algorithmName(Algorithm algorithm)
+{
+    switch (algorithm) {
+        case Algorithm::Aes256Gcm:        return "AES-256-GCM";
+        case Algorithm::ChaCha20Poly1305: return "ChaCha20-Poly1305";
+    }
+    return "Unknown";
+}
@@ -0,0 +1,67 @@
+#ifndef AEADCIPHER_H
+#define AEADCIPHER_H
+
+#include <QByteArray>
+#include <QString>
+
+// Authenticated encryption for one chunk of the backup container.
+// AES-256-GCM runs on AES-NI/PCLMULQDQ when the CPU has them and on a
+// portable implementation otherwise (so any machine can restore); new
+// backups on CPUs without AES-NI use ChaCha20-Poly1305 instead, which is
+// fast in plain C++. All methods are const and thread-safe once the key is
+// set, so chunks can be processed on many threads with one instance.
+class AeadCipher
+{
+public:
+    // Values are stored in the container header; do not renumber
+    enum class Algorithm : quint8 {
+        Aes256Gcm = 1,
+        ChaCha20Poly1305 = 2
+    };
+
+    static const int KeySize = 32;
+    static const int NonceSize = 12;
+    static const int TagSize = 16;
+
+    AeadCipher();
+    AeadCipher(Algorithm algorithm, const QByteArray &key);
+
+    void setKey(Algorithm algorithm, const QByteArray &key);
+    bool isValid() const { return m_valid; }
+    Algorithm algorithm() const { return m_algorithm; }
+
+    // Encrypt size bytes in place and write TagSize bytes of tag
+    void encrypt(const unsigned char *nonce, const QByteArray &aad,
+                 unsigned char *data, qint64 size, unsigned char *tag) const;
+
+    // Check the tag, then decrypt in place. Data is untouched on failure.
+    bool decrypt(const unsigned char *nonce, const QByteArray &aad,
+                 unsigned char *data, qint64 size, const unsigned char *tag) const;
+
+    // Check the tag only; no plaintext is produced
+    bool verify(const unsigned char *nonce, const QByteArray &aad,
+                const unsigned char *data, qint64 size, const unsigned char *tag) const;
+
+    // AES-NI and PCLMULQDQ are both available and enabled
+    static bool hasHardwareAes();
+    static void setHardwareAesEnabled(bool enabled);  // For tests and benchmarks
+
+    // AES-256-GCM when it is hardware accelerated, ChaCha20-Poly1305 otherwise
+    static Algorithm preferredAlgorithm();
+    static bool isKnownAlgorithm(quint8 value);
+    static QString algorithmName(Algorithm algorithm);
+
+private:
+    void computeTag(const unsigned char *nonce, const QByteArray &aad,
+                    const unsigned char *data, qint64 size, unsigned char *tag) const;
+    void applyKeystream(const unsigned char *nonce, unsigned char *data, qint64 size) const;
+
+    Algorithm m_algorithm;
+    bool m_valid;
+    unsigned char m_key[KeySize];
+    unsigned char m_roundKeys[240];     // AES-256 key schedule
+    unsigned char m_hashKey[16];        // GHASH key H = AES(K, 0)
+    unsigned char m_hashPowers[4][16];  // H^1..H^4, byte-reversed for PCLMULQDQ
+};
+
+#endif // AEADCIPHER_H
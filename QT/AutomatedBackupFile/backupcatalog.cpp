@@ -0,0 +1,273 @@
+#include "backupcatalog.h"
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const char kMagic[8] = {'A', 'B', 'F', 'M', 'C', 'A', 'T', 'L'};
+
+// Generation record after its name: size, file count, modification time
+const int RecordSize = 24;
+
+} // namespace
+
+const QString BackupCatalog::GenerationNameFormat = "yyyyMMdd-HHmmss";
+const QString BackupCatalog::DeletingPrefix = ".deleting-";
+const QString BackupCatalog::MarkerFileName = ".backup-generation";
+
+QString BackupCatalog::generationName(const QDateTime &timestamp)
+{
+    return timestamp.toString(GenerationNameFormat);
+}
+
+QDateTime BackupCatalog::timestampOf(const QString &name)
+{
+    if (name.size() != GenerationNameFormat.size()) {
+        return QDateTime();
+    }
+    return QDateTime::fromString(name, GenerationNameFormat);
+}
+
+bool BackupCatalog::markGeneration(const QString &path)
+{
+    QFile marker(QDir(path).filePath(MarkerFileName));
+    if (!marker.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to mark backup generation:" << path << marker.errorString();
+        return false;
+    }
+    return true;
+}
+
+QString BackupCatalog::latestGeneration(const QString &root)
+{
+    QString latest;
+    QDateTime latestTimestamp;
+    QDirIterator it(QDir::cleanPath(root), QDir::Dirs | QDir::NoDotAndDotDot);
+    while (it.hasNext()) {
+        it.next();
+        const QFileInfo info = it.fileInfo();
+        if (!isGeneration(info)) {
+            continue;
+        }
+        const QDateTime timestamp = timestampOf(info.fileName());
+        if (latest.isEmpty() || timestamp > latestTimestamp) {
+            latest = info.fileName();
+            latestTimestamp = timestamp;
+        }
+    }
+    return latest;
+}
+
+bool BackupCatalog::isGeneration(const QFileInfo &info)
+{
+    // Only what BackupWorker wrote: a user's folder that happens to be
+    // named like a timestamp has no marker
+    return !info.isSymLink() && timestampOf(info.fileName()).isValid() &&
+           QFileInfo::exists(info.filePath() + "/" + MarkerFileName);
+}
+
+qint64 BackupCatalog::totalSize() const
+{
+    qint64 total = 0;
+    for (const BackupGeneration &generation : m_generations) {
+        total += generation.size;
+    }
+    return total;
+}
+
+void BackupCatalog::clear()
+{
+    m_root.clear();
+    m_generations.clear();
+    m_leftovers.clear();
+}
+
+bool BackupCatalog::refresh(const QString &root, const std::atomic<bool> *stop)
+{
+    const QString cleanRoot = QDir::cleanPath(root);
+    if (!QFileInfo(cleanRoot).isDir()) {
+        return false;
+    }
+
+    QHash<QString, BackupGeneration> known;
+    if (cleanRoot == m_root) {
+        for (const BackupGeneration &generation : m_generations) {
+            known.insert(generation.name, generation);
+        }
+    }
+
+    QList<BackupGeneration> generations;
+    QStringList leftovers;
+    QDirIterator it(cleanRoot, QDir::Dirs | QDir::NoDotAndDotDot | QDir::Hidden);
+    while (it.hasNext()) {
+        it.next();
+        const QFileInfo info = it.fileInfo();
+        if (info.isSymLink()) {
+            continue;
+        }
+        const QString name = info.fileName();
+        if (name.startsWith(DeletingPrefix)) {
+            leftovers.append(name);
+            continue;
+        }
+
+        if (!isGeneration(info)) {
+            continue;
+        }
+        BackupGeneration generation;
+        generation.name = name;
+        generation.timestamp = timestampOf(name);
+        generation.modifiedMs = info.lastModified().toMSecsSinceEpoch();
+
+        const auto cached = known.constFind(name);
+        if (cached != known.constEnd() && cached->modifiedMs == generation.modifiedMs) {
+            generation.size = cached->size;
+            generation.fileCount = cached->fileCount;
+        } else if (!countGeneration(info.filePath(), generation, stop)) {
+            return false;
+        }
+        generations.append(generation);
+    }
+
+    std::sort(generations.begin(), generations.end(),
+              [](const BackupGeneration &a, const BackupGeneration &b) {
+        return a.timestamp > b.timestamp;
+    });
+    leftovers.sort();
+
+    m_root = cleanRoot;
+    m_generations.swap(generations);
+    m_leftovers.swap(leftovers);
+    return true;
+}
+
+bool BackupCatalog::countGeneration(const QString &path, BackupGeneration &generation,
+                                    const std::atomic<bool> *stop)
+{
+    generation.size = 0;
+    generation.fileCount = 0;
+    const QString markerPath = path + "/" + MarkerFileName;
+    QDirIterator it(path, QDir::Files | QDir::Hidden | QDir::System, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        if (stop && stop->load()) {
+            return false;
+        }
+        if (it.next() == markerPath) {
+            continue;
+        }
+        generation.size += it.fileInfo().size();
+        generation.fileCount++;
+    }
+    return true;
+}
+
+bool BackupCatalog::load(const QString &filePath, const QString &root)
+{
+    clear();
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;  // No catalog yet
+    }
+    const QByteArray data = file.readAll();
+    file.close();
+
+    const uchar *p = reinterpret_cast<const uchar*>(data.constData());
+    if (data.size() < HeaderSize || memcmp(p, kMagic, sizeof(kMagic)) != 0 ||
+        qFromLittleEndian<quint32>(p + 8) != FormatVersion) {
+        qWarning() << "Not a backup catalog, ignored:" << filePath;
+        return false;
+    }
+
+    const quint32 generationCount = qFromLittleEndian<quint32>(p + 12);
+    const quint32 rootLength = qFromLittleEndian<quint32>(p + 16);
+    const QString cleanRoot = QDir::cleanPath(root);
+    if (quint64(HeaderSize) + rootLength > quint64(data.size()) ||
+        QString::fromUtf8(data.constData() + HeaderSize, static_cast<int>(rootLength)) != cleanRoot) {
+        return false;  // Saved for a destination at another path
+    }
+
+    QList<BackupGeneration> generations;
+    qint64 offset = HeaderSize + rootLength;
+    for (quint32 i = 0; i < generationCount; ++i) {
+        if (offset + 4 > data.size()) {
+            break;
+        }
+        const quint32 nameLength = qFromLittleEndian<quint32>(p + offset);
+        if (offset + 4 + nameLength + RecordSize > quint64(data.size())) {
+            break;
+        }
+        BackupGeneration generation;
+        generation.name = QString::fromUtf8(data.constData() + offset + 4, static_cast<int>(nameLength));
+        generation.timestamp = timestampOf(generation.name);
+        offset += 4 + nameLength;
+
+        generation.size = qFromLittleEndian<qint64>(p + offset);
+        generation.fileCount = qFromLittleEndian<qint64>(p + offset + 8);
+        generation.modifiedMs = qFromLittleEndian<qint64>(p + offset + 16);
+        offset += RecordSize;
+
+        if (!generation.timestamp.isValid()) {
+            break;
+        }
+        generations.append(generation);
+    }
+
+    if (offset != data.size() || generations.size() != int(generationCount)) {
+        qWarning() << "Backup catalog is damaged, ignored:" << filePath;
+        return false;
+    }
+
+    std::sort(generations.begin(), generations.end(),
+              [](const BackupGeneration &a, const BackupGeneration &b) {
+        return a.timestamp > b.timestamp;
+    });
+    m_root = cleanRoot;
+    m_generations.swap(generations);
+    return true;
+}
+
+bool BackupCatalog::save(const QString &filePath) const
+{
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to write backup catalog:" << filePath << file.errorString();
+        return false;
+    }
+
+    const QByteArray root = m_root.toUtf8();
+    QByteArray data(HeaderSize, '\0');
+    uchar *h = reinterpret_cast<uchar*>(data.data());
+    memcpy(h, kMagic, sizeof(kMagic));
+    qToLittleEndian<quint32>(FormatVersion, h + 8);
+    qToLittleEndian<quint32>(static_cast<quint32>(m_generations.size()), h + 12);
+    qToLittleEndian<quint32>(static_cast<quint32>(root.size()), h + 16);
+    data.append(root);
+
+    for (const BackupGeneration &generation : m_generations) {
+        const QByteArray name = generation.name.toUtf8();
+        uchar record[4 + RecordSize];
+        qToLittleEndian<quint32>(static_cast<quint32>(name.size()), record);
+        data.append(reinterpret_cast<const char*>(record), 4);
+        data.append(name);
+        qToLittleEndian<qint64>(generation.size, record + 4);
+        qToLittleEndian<qint64>(generation.fileCount, record + 12);
+        qToLittleEndian<qint64>(generation.modifiedMs, record + 20);
+        data.append(reinterpret_cast<const char*>(record + 4), RecordSize);
+    }
+    file.write(data);
+
+    if (!file.commit()) {
+        qWarning() << "Failed to write backup catalog:" << filePath << file.errorString();
+        return false;
+    }
+    return true;
+}
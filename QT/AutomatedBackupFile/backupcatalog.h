@@ -0,0 +1,90 @@
+#ifndef BACKUPCATALOG_H
+#define BACKUPCATALOG_H
+
+#include <QDateTime>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <atomic>
+
+class QFileInfo;
+
+// One complete backup kept on a destination: a directory directly below the
+// destination root named after the time it was taken, holding the marker
+// file BackupWorker writes once the backup in it is complete
+struct BackupGeneration
+{
+    QString name;            // Directory name, e.g. "20240131-220000"
+    QDateTime timestamp;     // Local time, from the name
+    qint64 size = 0;         // Bytes of every file in it
+    qint64 fileCount = 0;
+    qint64 modifiedMs = 0;   // Of the directory when size was counted
+};
+
+// Index of the backup generations on a destination, for retention. Sizes
+// take a walk of the generation to count, and a generation is written
+// once, so they are counted once and reused for as long as the directory's
+// modification time stays the same. Directories named otherwise or
+// without the marker (the "temp_unencrypted" working copy, an unfinished
+// backup, anything a user put there) are never part of the catalog and so
+// never deleted by retention.
+//
+// A generation being deleted is first renamed with DeletingPrefix, so a
+// deletion cut short leaves a directory the catalog lists as a leftover to
+// finish deleting rather than as a damaged generation.
+//
+// The index can be kept in a small binary file between runs:
+//
+//   header (HeaderSize bytes): magic, version, generation count, root length
+//   root: UTF-8
+//   generations: name length, UTF-8 name, size, file count, modification time
+//
+// Numbers are little-endian. Not thread-safe; callers serialize access.
+class BackupCatalog
+{
+public:
+    static const int HeaderSize = 24;
+    static const quint32 FormatVersion = 1;
+    static const QString GenerationNameFormat;
+    static const QString DeletingPrefix;
+    static const QString MarkerFileName;
+
+    // Directory name a generation taken at timestamp gets, and back;
+    // invalid for a name that isn't a generation's
+    static QString generationName(const QDateTime &timestamp);
+    static QDateTime timestampOf(const QString &name);
+
+    // Marks the directory at path as a complete generation
+    static bool markGeneration(const QString &path);
+
+    // Name of the newest generation under root, without counting any;
+    // empty if there is none
+    static QString latestGeneration(const QString &root);
+
+    QString root() const { return m_root; }
+    QList<BackupGeneration> generations() const { return m_generations; }  // Newest first
+    QStringList leftovers() const { return m_leftovers; }  // Names of interrupted deletions
+    int count() const { return m_generations.size(); }
+    qint64 totalSize() const;
+    void clear();
+
+    // List the generations under root again, counting only those that are
+    // new or changed. False, keeping the previous index, if root isn't a
+    // directory or stop was set meanwhile.
+    bool refresh(const QString &root, const std::atomic<bool> *stop = nullptr);
+
+    // False, leaving the catalog empty, if the file is missing, invalid or
+    // was saved for another root
+    bool load(const QString &filePath, const QString &root);
+    bool save(const QString &filePath) const;
+
+private:
+    QString m_root;
+    QList<BackupGeneration> m_generations;
+    QStringList m_leftovers;
+
+    static bool isGeneration(const QFileInfo &info);
+    static bool countGeneration(const QString &path, BackupGeneration &generation, const std::atomic<bool> *stop);
+};
+
+#endif // BACKUPCATALOG_H
@@ -8,6 +8,7 @@ BackupDestination::BackupDestination()
     , m_freeSpace(0)
     , m_totalSpace(0)
     , m_enabled(true)
+    , m_writeThroughput(0)
 {
     generateId();
 }
@@ -19,6 +20,7 @@ BackupDestination::BackupDestination(const QString &path, DestinationType type)
     , m_freeSpace(0)
     , m_totalSpace(0)
     , m_enabled(true)
+    , m_writeThroughput(0)
 {
     generateId();
 }
@@ -88,3 +90,21 @@ bool BackupDestination::isValid() const
 {
     return !m_path.isEmpty() && m_status != DestinationStatus::Error;
 }
+
+ProbeResult BackupDestination::getLatestProbe() const
+{
+    for (int i = static_cast<int>(m_probeHistory.size()) - 1; i >= 0; --i) {
+        if (m_probeHistory[i].isValid()) {
+            return m_probeHistory[i];
+        }
+    }
+    return ProbeResult();
+}
+
+void BackupDestination::addProbeResult(const ProbeResult &result)
+{
+    m_probeHistory.append(result);
+    while (m_probeHistory.size() > MaxProbeHistory) {
+        m_probeHistory.removeFirst();
+    }
+}
@@ -3,6 +3,8 @@
 
 #include <QString>
 #include <QDateTime>
+#include <QList>
+#include "destinationprobe.h"
 
 enum class DestinationType {
     Local,
@@ -20,6 +22,8 @@ enum class DestinationStatus {
 class BackupDestination
 {
 public:
+    static const int MaxProbeHistory = 20;
+    
     BackupDestination();
     BackupDestination(const QString &path, DestinationType type);
     
@@ -34,6 +38,9 @@ public:
     QString getUsername() const { return m_username; }
     QString getPassword() const { return m_password; }
     bool isEnabled() const { return m_enabled; }
+    double getWriteThroughput() const { return m_writeThroughput; }
+    QList<ProbeResult> getProbeHistory() const { return m_probeHistory; }  // Oldest first
+    ProbeResult getLatestProbe() const;  // Latest that succeeded
     
     // Setters
     void setPath(const QString &path) { m_path = path; }
@@ -45,6 +52,8 @@ public:
     void setUsername(const QString &username) { m_username = username; }
     void setPassword(const QString &password) { m_password = password; }
     void setEnabled(bool enabled) { m_enabled = enabled; }
+    void setWriteThroughput(double bytesPerSecond) { m_writeThroughput = bytesPerSecond; }
+    void addProbeResult(const ProbeResult &result);  // Keeps the last MaxProbeHistory
     
     // Utility methods
     QString getTypeString() const;
@@ -64,6 +73,8 @@ private:
     QString m_username;       // for network/cloud destinations
     QString m_password;       // encrypted in real implementation
     bool m_enabled;
+    double m_writeThroughput; // bytes per second backups were written at; 0 if never measured
+    QList<ProbeResult> m_probeHistory;
     
     void generateId();
 };
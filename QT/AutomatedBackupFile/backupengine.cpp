@@ -1,35 +1,143 @@
 #include "backupengine.h"
+#include "backupcatalog.h"
+#include "backupjobqueue.h"
+#include "backupmanifest.h"
 #include <QDebug>
 #include <QCoreApplication>
+#include <QElapsedTimer>
 #include <algorithm>
 
 // BackupWorker Implementation
 // Accepts a vector of (source, destination) pairs
-BackupWorker::BackupWorker(const std::vector<std::pair<QString, QString>>& sourceDestPairs, QObject *parent)
+BackupWorker::BackupWorker(const std::vector<std::pair<QString, QString>>& sourceDestPairs,
+                           const QMap<QString, BackupFilter>& filters,
+                           const BackupPlacement& placement, QObject *parent)
     : QObject(parent)
     , m_sourceDestPairs(sourceDestPairs)
+    , m_filters(filters)
+    , m_placement(placement)
     , m_status(BackupStatus::Idle)
     , m_progress(0)
     , m_totalFiles(0)
     , m_processedFiles(0)
     , m_shouldStop(false)
 {
+    // Direct: the encryptor emits from its pool threads while startBackup
+    // is still blocking this worker's thread
+    connect(&m_encryptor, &FileEncryptor::fileProcessed,
+            this, &BackupWorker::fileProcessed, Qt::DirectConnection);
 }
 
 void BackupWorker::stop()
 {
     m_shouldStop = true;
+    m_encryptor.cancel();
 }
 
-qint64 BackupWorker::countFiles(const QString& path)
+QStringList BackupWorker::selectFiles(const QString& source)
 {
-    qint64 count = 0;
-    QDirIterator it(path, QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
-    while (it.hasNext()) {
-        it.next();
-        count++;
+    // Excluded directories are skipped while listing, not listed and dropped
+    BackupFilter filter = m_filters.value(source);
+    QStringList files = filter.selectFiles(source, &m_shouldStop);
+
+    if (!filter.isEmpty()) {
+        const QList<FilterRuleStats> stats = filter.statistics();
+        for (const FilterRuleStats &rule : stats) {
+            if (rule.files > 0 || rule.directories > 0) {
+                qDebug() << "Filter" << rule.rule << "in" << source << ":"
+                         << rule.files << "files," << rule.directories << "directories,"
+                         << rule.bytes << "bytes";
+            }
+        }
+        emit filterStatistics(source, stats);
+    }
+    return files;
+}
+
+bool BackupWorker::placeFiles()
+{
+    m_pairFiles.assign(m_sourceDestPairs.size(), QStringList());
+    bool complete = true;
+
+    // Pairs by source, in the order the sources first appear
+    QStringList sources;
+    QMap<QString, std::vector<int>> pairsBySource;
+    for (int i = 0; i < static_cast<int>(m_sourceDestPairs.size()); ++i) {
+        const QString& source = m_sourceDestPairs[i].first;
+        if (!pairsBySource.contains(source)) {
+            sources.append(source);
+        }
+        pairsBySource[source].push_back(i);
+    }
+
+    for (const QString& source : sources) {
+        const std::vector<int>& pairs = pairsBySource[source];
+        const QStringList& files = m_selectedFiles[source];
+        if (m_placement.mode == PlacementEngine::Mode::Mirror || pairs.size() < 2) {
+            for (int i : pairs) {
+                m_pairFiles[i] = files;
+            }
+            continue;
+        }
+
+        QVector<PlacementTarget> targets;
+        for (int i : pairs) {
+            targets.append(m_placement.targets.value(m_sourceDestPairs[i].second));
+        }
+        QVector<PlacementFile> sizedFiles;
+        sizedFiles.reserve(files.size());
+        for (const QString& relativePath : files) {
+            sizedFiles.append({relativePath, QFileInfo(source + "/" + relativePath).size()});
+        }
+
+        const Placement placement = PlacementEngine::place(targets, sizedFiles, m_placement.mode);
+        for (int t = 0; t < static_cast<int>(pairs.size()); ++t) {
+            m_pairFiles[pairs[t]] = placement.files[t];
+            qDebug() << "Placing" << placement.files[t].size() << "files," << placement.bytes[t]
+                     << "bytes of" << source << "on" << m_sourceDestPairs[pairs[t]].second;
+        }
+        if (!placement.isComplete()) {
+            qWarning() << placement.unplaced.size() << "files of" << source
+                       << "fit on none of its destinations";
+            complete = false;
+        }
+    }
+    return complete;
+}
+
+bool BackupWorker::recordPlacement(const std::vector<int>& pairs)
+{
+    // Each part's manifest also lists the files of the other parts, so a
+    // restore from any one of them finds the whole backup
+    std::vector<QString> encryptedDirs;
+    std::vector<BackupManifest> manifests(pairs.size());
+    for (size_t p = 0; p < pairs.size(); ++p) {
+        encryptedDirs.push_back(encryptedDirFor(m_sourceDestPairs[pairs[p]].second));
+        manifests[p].load(BackupManifest::filePathFor(encryptedDirs[p]));
     }
-    return count;
+
+    bool success = true;
+    for (size_t p = 0; p < pairs.size(); ++p) {
+        BackupManifest manifest = manifests[p];
+        const QDir encryptedDir(encryptedDirs[p]);
+        for (size_t other = 0; other < pairs.size(); ++other) {
+            if (other == p) {
+                continue;
+            }
+            const QString location = encryptedDir.relativeFilePath(encryptedDirs[other]);
+            for (const QString& path : m_pairFiles[pairs[other]]) {
+                BackupManifestEntry entry = manifests[other].entry(path);
+                entry.path = path;
+                entry.location = location;
+                manifest.insert(entry);
+            }
+        }
+        if (!encryptedDir.mkpath(".") || !manifest.save(BackupManifest::filePathFor(encryptedDirs[p]))) {
+            qWarning() << "Failed to record placement in:" << encryptedDirs[p];
+            success = false;
+        }
+    }
+    return success;
 }
 
 bool BackupWorker::copyFile(const QString& source, const QString& destination)
@@ -67,18 +175,10 @@ bool BackupWorker::deleteDirectory(const QString& dirPath)
     return success;
 }
 
-bool BackupWorker::encryptDirectory(const QString& unencryptedDir, const QString& encryptedDir, const QString& keyFilePath)
+bool BackupWorker::encryptDirectory(const QString& unencryptedDir, const QString& encryptedDir)
 {
-    FileEncryptor encryptor;
-    
-    // Load password from key.txt
-    if (!encryptor.loadPasswordFromFile(keyFilePath)) {
-        qWarning() << "Failed to load encryption password";
-        return false;
-    }
-    
     emit fileProcessed("Encrypting files...");
-    bool success = encryptor.encryptDirectory(unencryptedDir, encryptedDir);
+    bool success = m_encryptor.encryptDirectory(unencryptedDir, encryptedDir);
     
     if (success) {
         qDebug() << "Encryption completed for:" << unencryptedDir;
@@ -89,7 +189,13 @@ bool BackupWorker::encryptDirectory(const QString& unencryptedDir, const QString
     return success;
 }
 
-bool BackupWorker::copyDirectory(const QString& source, const QString& destination)
+QString BackupWorker::encryptedDirFor(const QString& destination) const
+{
+    return destination + "/" + m_generation + "/encrypted";
+}
+
+bool BackupWorker::copyDirectory(const QString& source, const QString& destination, const QStringList& files,
+                                 qint64 *bytesCopied)
 {
     QDir sourceDir(source);
     if (!sourceDir.exists()) {
@@ -101,11 +207,12 @@ bool BackupWorker::copyDirectory(const QString& source, const QString& destinati
         destDir.mkpath(".");
     }
 
-    QDirIterator it(source, QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
-    
-    while (it.hasNext() && !m_shouldStop) {
-        QString sourceFile = it.next();
-        QString relativePath = sourceDir.relativeFilePath(sourceFile);
+    for (const QString& relativePath : files) {
+        if (m_shouldStop) {
+            break;
+        }
+        
+        QString sourceFile = source + "/" + relativePath;
         QString destFile = destination + "/" + relativePath;
 
         m_currentFile = relativePath;
@@ -113,6 +220,8 @@ bool BackupWorker::copyDirectory(const QString& source, const QString& destinati
 
         if (!copyFile(sourceFile, destFile)) {
             qWarning() << "Failed to copy:" << sourceFile;
+        } else if (bytesCopied) {
+            *bytesCopied += QFileInfo(destFile).size();
         }
 
         m_processedFiles++;
@@ -132,11 +241,23 @@ void BackupWorker::startBackup()
     m_processedFiles = 0;
     m_shouldStop = false;
 
-    // Count total files for all pairs
+    // Each run is a generation of its own on every destination, which
+    // retention can later delete as a whole
+    m_generation = BackupCatalog::generationName(QDateTime::currentDateTime());
+
+    // List each source once, however many destinations it goes to; the
+    // copy works from these lists instead of walking the tree again
     emit fileProcessed("Counting files...");
     m_totalFiles = 0;
+    m_selectedFiles.clear();
     for (const auto& pair : m_sourceDestPairs) {
-        m_totalFiles += countFiles(pair.first);
+        if (!m_selectedFiles.contains(pair.first)) {
+            m_selectedFiles.insert(pair.first, selectFiles(pair.first));
+        }
+    }
+    bool allSuccess = placeFiles();
+    for (const QStringList& files : m_pairFiles) {
+        m_totalFiles += files.size();
     }
     if (m_totalFiles == 0) {
         m_status = BackupStatus::Failed;
@@ -146,43 +267,89 @@ void BackupWorker::startBackup()
     }
 
     // Process each pair: Copy -> Encrypt -> Delete unencrypted
-    bool allSuccess = true;
     QString keyFilePath = QCoreApplication::applicationDirPath() + "/key.txt";
     
-    for (const auto& pair : m_sourceDestPairs) {
+    // Key material is derived once for the whole job, not per pair or per file
+    bool keyLoaded = m_encryptor.loadPasswordFromFile(keyFilePath);
+    if (!keyLoaded) {
+        qWarning() << "Failed to load encryption password";
+    }
+    
+    QMap<QString, std::vector<int>> spreadPairs;  // Source -> its pairs, for sources spread over several
+    std::vector<bool> pairSucceeded(m_sourceDestPairs.size(), false);
+    for (int i = 0; i < static_cast<int>(m_sourceDestPairs.size()); ++i) {
         if (m_shouldStop) break;
         
+        const auto& pair = m_sourceDestPairs[i];
         QString source = pair.first;
         QString destination = pair.second;
         QString tempUnencrypted = destination + "/temp_unencrypted";
-        QString encrypted = destination + "/encrypted";
+        QString generationDir = destination + "/" + m_generation;
+        QString encrypted = encryptedDirFor(destination);
+        if (m_placement.mode != PlacementEngine::Mode::Mirror) {
+            spreadPairs[source].push_back(i);
+        }
+        if (m_pairFiles[i].isEmpty()) {
+            pairSucceeded[i] = true;
+            continue;
+        }
         
-        // Step 1: Copy files to temporary location
+        // Step 1: Copy files to temporary location. Whatever an earlier run
+        // left there would be encrypted into this generation too, so it
+        // starts out empty
+        if (!deleteDirectory(tempUnencrypted)) {
+            allSuccess = false;
+            continue;
+        }
         emit fileProcessed("Copying from " + source + "...");
-        if (!copyDirectory(source, tempUnencrypted)) {
+        QElapsedTimer timer;
+        timer.start();
+        qint64 bytesCopied = 0;
+        if (!copyDirectory(source, tempUnencrypted, m_pairFiles[i], &bytesCopied)) {
             qWarning() << "Failed to copy directory:" << source;
+            deleteDirectory(tempUnencrypted);
             allSuccess = false;
             continue;
         }
         
-        if (m_shouldStop) break;
+        if (m_shouldStop) {
+            deleteDirectory(tempUnencrypted);
+            break;
+        }
         
         // Step 2: Encrypt the copied files
         emit fileProcessed("Encrypting files...");
-        if (!encryptDirectory(tempUnencrypted, encrypted, keyFilePath)) {
+        if (!keyLoaded || !encryptDirectory(tempUnencrypted, encrypted)) {
             qWarning() << "Failed to encrypt directory:" << tempUnencrypted;
+            deleteDirectory(tempUnencrypted);
             allSuccess = false;
+            // Never marked, so retention would leave it forever; another
+            // source's finished backup in the same generation stays
+            if (!QFileInfo::exists(generationDir + "/" + BackupCatalog::MarkerFileName)) {
+                QDir(generationDir).removeRecursively();
+            }
             continue;
         }
+        BackupCatalog::markGeneration(generationDir);
+        pairSucceeded[i] = true;
+        emit destinationThroughput(destination, bytesCopied, timer.elapsed());
         
-        if (m_shouldStop) break;
-        
-        // Step 3: Delete unencrypted files
+        // Step 3: Delete unencrypted files, also when stopping
         emit fileProcessed("Cleaning up unencrypted files...");
         if (!deleteDirectory(tempUnencrypted)) {
             qWarning() << "Failed to delete unencrypted directory:" << tempUnencrypted;
             // Continue anyway, encryption is done
         }
+        
+        if (m_shouldStop) break;
+    }
+    
+    for (auto it = spreadPairs.constBegin(); it != spreadPairs.constEnd() && !m_shouldStop; ++it) {
+        const std::vector<int>& pairs = it.value();
+        const bool partsDone = std::all_of(pairs.begin(), pairs.end(), [&](int i) { return pairSucceeded[i]; });
+        if (pairs.size() > 1 && partsDone && !recordPlacement(pairs)) {
+            allSuccess = false;
+        }
     }
 
     if (m_shouldStop) {
@@ -205,9 +372,39 @@ void BackupWorker::startBackup()
 // BackupEngine Implementation
 BackupEngine::BackupEngine(QObject *parent)
     : QObject(parent)
-    , m_thread(nullptr)
-    , m_worker(nullptr)
+    , m_jobQueue(new BackupJobQueue(this))
+    , m_lastStatus(BackupStatus::Idle)
 {
+    connect(m_jobQueue, &BackupJobQueue::jobStarted, this, [this](const QString &jobId) {
+        emit jobStarted(jobId);
+        emit statusChanged(BackupStatus::Running);
+    });
+    connect(m_jobQueue, &BackupJobQueue::jobProgress, this, [this](const QString &, int) {
+        emit progressUpdated(getProgress());
+    });
+    connect(m_jobQueue, &BackupJobQueue::jobFileProcessed, this, [this](const QString &, const QString &filename) {
+        emit fileProcessed(filename);
+    });
+    connect(m_jobQueue, &BackupJobQueue::jobCompleted, this, [this](const QString &jobId) {
+        m_lastStatus = BackupStatus::Completed;
+        emit jobFinished(jobId, true);
+        emit statusChanged(BackupStatus::Completed);
+        emit backupCompleted();
+    });
+    connect(m_jobQueue, &BackupJobQueue::jobFilterStatistics, this,
+            [this](const QString &, const QString &sourcePath, const QList<FilterRuleStats> &stats) {
+        emit filterStatistics(sourcePath, stats);
+    });
+    connect(m_jobQueue, &BackupJobQueue::jobThroughput, this,
+            [this](const QString &, const QString &destinationPath, qint64 bytes, qint64 msecs) {
+        emit throughputMeasured(destinationPath, bytes, msecs);
+    });
+    connect(m_jobQueue, &BackupJobQueue::jobFailed, this, [this](const QString &jobId, const QString &error) {
+        m_lastStatus = BackupStatus::Failed;
+        emit jobFinished(jobId, false);
+        emit statusChanged(BackupStatus::Failed);
+        emit backupFailed(error);
+    });
 }
 
 BackupEngine::~BackupEngine()
@@ -215,65 +412,78 @@ BackupEngine::~BackupEngine()
     stopBackup();
 }
 
-void BackupEngine::startBackup(const std::vector<std::pair<QString, QString>>& sourceDestPairs)
+QString BackupEngine::startBackup(const std::vector<std::pair<QString, QString>>& sourceDestPairs,
+                                  const QMap<QString, BackupFilter>& filters,
+                                  const BackupPlacement& placement)
 {
-    if (m_thread && m_thread->isRunning()) {
-        qWarning() << "Backup already running";
-        return;
-    }
-
-    m_thread = new QThread(this);
-    m_worker = new BackupWorker(sourceDestPairs);
-    m_worker->moveToThread(m_thread);
-
-    connect(m_thread, &QThread::started, m_worker, &BackupWorker::startBackup);
-    connect(m_worker, &BackupWorker::progressUpdated, this, &BackupEngine::progressUpdated);
-    connect(m_worker, &BackupWorker::statusChanged, this, &BackupEngine::statusChanged);
-    connect(m_worker, &BackupWorker::fileProcessed, this, &BackupEngine::fileProcessed);
-    connect(m_worker, &BackupWorker::backupCompleted, this, &BackupEngine::backupCompleted);
-    connect(m_worker, &BackupWorker::backupFailed, this, &BackupEngine::backupFailed);
-    
-    connect(m_worker, &BackupWorker::backupCompleted, m_thread, &QThread::quit);
-    connect(m_worker, &BackupWorker::backupFailed, m_thread, &QThread::quit);
-    connect(m_thread, &QThread::finished, m_worker, &QObject::deleteLater);
-    connect(m_thread, &QThread::finished, m_thread, &QObject::deleteLater);
-
-    m_thread->start();
+    return m_jobQueue->enqueue(sourceDestPairs, filters, placement);
 }
 
 void BackupEngine::stopBackup()
 {
-    if (m_worker) {
-        m_worker->stop();
-    }
-    
-    if (m_thread && m_thread->isRunning()) {
-        m_thread->quit();
-        m_thread->wait();
-    }
+    m_jobQueue->cancelAll();
+}
+
+void BackupEngine::stopJob(const QString &jobId)
+{
+    m_jobQueue->cancelJob(jobId);
 }
 
 BackupStatus BackupEngine::getStatus() const
 {
-    return m_worker ? m_worker->getStatus() : BackupStatus::Idle;
+    if (m_jobQueue->getRunningJobCount() > 0) {
+        return BackupStatus::Running;
+    }
+    return m_lastStatus;
 }
 
 int BackupEngine::getProgress() const
 {
-    return m_worker ? m_worker->getProgress() : 0;
+    QList<const BackupWorker*> workers = m_jobQueue->getRunningWorkers();
+    if (workers.isEmpty()) {
+        return m_lastStatus == BackupStatus::Completed ? 100 : 0;
+    }
+
+    // Weight each running job by its file count
+    qint64 total = 0;
+    qint64 processed = 0;
+    for (const BackupWorker *worker : workers) {
+        total += worker->getTotalFiles();
+        processed += worker->getProcessedFiles();
+    }
+    return total > 0 ? static_cast<int>(processed * 100 / total) : 0;
 }
 
 qint64 BackupEngine::getTotalFiles() const
 {
-    return m_worker ? m_worker->getTotalFiles() : 0;
+    qint64 total = 0;
+    for (const BackupWorker *worker : m_jobQueue->getRunningWorkers()) {
+        total += worker->getTotalFiles();
+    }
+    return total;
 }
 
 qint64 BackupEngine::getProcessedFiles() const
 {
-    return m_worker ? m_worker->getProcessedFiles() : 0;
+    qint64 processed = 0;
+    for (const BackupWorker *worker : m_jobQueue->getRunningWorkers()) {
+        processed += worker->getProcessedFiles();
+    }
+    return processed;
 }
 
 QString BackupEngine::getCurrentFile() const
 {
-    return m_worker ? m_worker->getCurrentFile() : QString();
+    QList<const BackupWorker*> workers = m_jobQueue->getRunningWorkers();
+    return workers.isEmpty() ? QString() : workers.first()->getCurrentFile();
+}
+
+int BackupEngine::getRunningJobCount() const
+{
+    return m_jobQueue->getRunningJobCount();
+}
+
+int BackupEngine::getPendingJobCount() const
+{
+    return m_jobQueue->getPendingJobCount();
 }
@@ -8,10 +8,15 @@
 #include <QFile>
 #include <QFileInfo>
 #include <QDirIterator>
+#include <QMap>
 #include <atomic>
 #include <vector>
 #include <utility>
 #include "fileencryptor.h"
+#include "backupfilter.h"
+#include "placementengine.h"
+
+class BackupJobQueue;
 
 enum class BackupStatus {
     Idle,
@@ -26,7 +31,13 @@ class BackupWorker : public QObject
     Q_OBJECT
 
 public:
-    explicit BackupWorker(const std::vector<std::pair<QString, QString>>& sourceDestPairs, QObject *parent = nullptr);
+    // filters: rules of the sources that have any, by source path
+    // placement: how a source going to several destinations is spread over
+    // them; every destination gets every file by default
+    explicit BackupWorker(const std::vector<std::pair<QString, QString>>& sourceDestPairs,
+                          const QMap<QString, BackupFilter>& filters = QMap<QString, BackupFilter>(),
+                          const BackupPlacement& placement = BackupPlacement(),
+                          QObject *parent = nullptr);
     
     void stop();
     BackupStatus getStatus() const { return m_status; }
@@ -44,20 +55,32 @@ signals:
     void fileProcessed(const QString& filename);
     void backupCompleted();
     void backupFailed(const QString& error);
+    void filterStatistics(const QString& sourcePath, const QList<FilterRuleStats>& stats);
+    void destinationThroughput(const QString& destinationPath, qint64 bytes, qint64 msecs);
 
 private:
     std::vector<std::pair<QString, QString>> m_sourceDestPairs;
+    QMap<QString, BackupFilter> m_filters;
+    BackupPlacement m_placement;
+    QMap<QString, QStringList> m_selectedFiles;  // Source path -> relative paths to copy
+    std::vector<QStringList> m_pairFiles;        // Per pair, the part of its source's files it gets
     std::atomic<BackupStatus> m_status;
     std::atomic<int> m_progress;
     std::atomic<qint64> m_totalFiles;
     std::atomic<qint64> m_processedFiles;
     QString m_currentFile;
     std::atomic<bool> m_shouldStop;
+    FileEncryptor m_encryptor;  // Shared by all pairs so the key is derived once per job
+    QString m_generation;       // Directory below each destination this run's backup goes in
 
-    qint64 countFiles(const QString& path);
-    bool copyDirectory(const QString& source, const QString& destination);
+    QStringList selectFiles(const QString& source);
+    bool placeFiles();
+    bool recordPlacement(const std::vector<int>& pairs);
+    QString encryptedDirFor(const QString& destination) const;
+    bool copyDirectory(const QString& source, const QString& destination, const QStringList& files,
+                       qint64 *bytesCopied = nullptr);
     bool copyFile(const QString& source, const QString& destination);
-    bool encryptDirectory(const QString& unencryptedDir, const QString& encryptedDir, const QString& keyFilePath);
+    bool encryptDirectory(const QString& unencryptedDir, const QString& encryptedDir);
     bool deleteDirectory(const QString& dirPath);
 };
 
@@ -69,14 +92,22 @@ public:
     explicit BackupEngine(QObject *parent = nullptr);
     ~BackupEngine();
 
-    void startBackup(const std::vector<std::pair<QString, QString>>& sourceDestPairs);
+    // Queue a backup job and return its id. Jobs run concurrently as long as
+    // the devices they touch have free stream slots.
+    QString startBackup(const std::vector<std::pair<QString, QString>>& sourceDestPairs,
+                        const QMap<QString, BackupFilter>& filters = QMap<QString, BackupFilter>(),
+                        const BackupPlacement& placement = BackupPlacement());
     void stopBackup();
+    void stopJob(const QString &jobId);
     
     BackupStatus getStatus() const;
     int getProgress() const;
     qint64 getTotalFiles() const;
     qint64 getProcessedFiles() const;
     QString getCurrentFile() const;
+    int getRunningJobCount() const;
+    int getPendingJobCount() const;
+    BackupJobQueue* getJobQueue() const { return m_jobQueue; }
 
 signals:
     void progressUpdated(int progress);
@@ -84,10 +115,14 @@ signals:
     void fileProcessed(const QString& filename);
     void backupCompleted();
     void backupFailed(const QString& error);
+    void jobStarted(const QString& jobId);
+    void jobFinished(const QString& jobId, bool success);
+    void filterStatistics(const QString& sourcePath, const QList<FilterRuleStats>& stats);
+    void throughputMeasured(const QString& destinationPath, qint64 bytes, qint64 msecs);
 
 private:
-    QThread* m_thread;
-    BackupWorker* m_worker;
+    BackupJobQueue* m_jobQueue;
+    BackupStatus m_lastStatus;
 };
 
 #endif // BACKUPENGINE_H
@@ -1,36 +1,105 @@
 #include "backupfilemonitor.h"
+#include "inotifywatcher.h"
+#include "monitorsnapshot.h"
+#include "changejournal.h"
+#include "contenthash.h"
+#include "bandwidthlimiter.h"
 #include <QDir>
 #include <QDirIterator>
-#include <QCryptographicHash>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QFile>
+#include <QFutureWatcher>
+#include <QThread>
+#include <QtConcurrent>
+#include <algorithm>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#endif
+
+bool readFileIdentity(const QString &path, quint64 &device, quint64 &inode)
+{
+#ifdef Q_OS_UNIX
+    struct stat st;
+    if (::stat(QFile::encodeName(path).constData(), &st) == 0) {
+        device = st.st_dev;
+        inode = st.st_ino;
+        return true;
+    }
+#else
+    Q_UNUSED(path);
+#endif
+    device = 0;
+    inode = 0;
+    return false;
+}
 
 BackupFileMonitor::BackupFileMonitor(QObject *parent)
     : QObject(parent)
     , m_fileWatcher(new QFileSystemWatcher(this))
+    , m_treeWatcher(new InotifyWatcher(this))
+    , m_journal(new ChangeJournal())
     , m_scanTimer(new QTimer(this))
     , m_monitoringEnabled(false)
     , m_scanIntervalMinutes(30)  // Default: 30 minutes
+    , m_lastScanId(0)
+    , m_scrubLimiter(new BandwidthLimiter())
+    , m_scrubTimer(new QTimer(this))
+    , m_scrubWindowMinutes(0)
 {
+    // Scans are disk-bound; a few destinations at once is plenty
+    m_scanPool.setMaxThreadCount(qBound(1, QThread::idealThreadCount(), 4));
+    m_scrubPool.setMaxThreadCount(qBound(1, QThread::idealThreadCount(), 4));
+    
     // Connect file system watcher signals
     connect(m_fileWatcher, &QFileSystemWatcher::directoryChanged,
             this, &BackupFileMonitor::onDirectoryChanged);
     connect(m_fileWatcher, &QFileSystemWatcher::fileChanged,
             this, &BackupFileMonitor::onFileChanged);
     
+    // Connect recursive watcher signals
+    connect(m_treeWatcher, &InotifyWatcher::fileChanged,
+            this, &BackupFileMonitor::onWatchedFileChanged);
+    connect(m_treeWatcher, &InotifyWatcher::fileRemoved,
+            this, &BackupFileMonitor::onWatchedFileRemoved);
+    connect(m_treeWatcher, &InotifyWatcher::fileMoved,
+            this, &BackupFileMonitor::onWatchedFileMoved);
+    connect(m_treeWatcher, &InotifyWatcher::directoryAdded,
+            this, &BackupFileMonitor::onWatchedDirectoryAdded);
+    connect(m_treeWatcher, &InotifyWatcher::directoryRemoved,
+            this, &BackupFileMonitor::onWatchedDirectoryRemoved);
+    connect(m_treeWatcher, &InotifyWatcher::directoryMoved,
+            this, &BackupFileMonitor::onWatchedDirectoryMoved);
+    connect(m_treeWatcher, &InotifyWatcher::rescanRequired,
+            this, &BackupFileMonitor::onRescanRequired);
+    
     // Connect scan timer
     connect(m_scanTimer, &QTimer::timeout,
             this, &BackupFileMonitor::onScanTimerTimeout);
     
     // Set timer interval (convert minutes to milliseconds)
     m_scanTimer->setInterval(m_scanIntervalMinutes * 60 * 1000);
+    
+    m_scrubTimer->setSingleShot(true);
+    connect(m_scrubTimer, &QTimer::timeout,
+            this, &BackupFileMonitor::onScrubTimerTimeout);
 }
 
 BackupFileMonitor::~BackupFileMonitor()
 {
     clearAllPaths();
+    m_scanPool.clear();
+    if (m_scrub) {
+        m_scrub->cancelled = true;
+    }
+    m_scrubPool.waitForDone();
+    delete m_scrubLimiter;
+    delete m_journal;
 }
 
 void BackupFileMonitor::addDestinationPath(const QString &destinationId, const QString &path)
@@ -47,13 +116,23 @@ void BackupFileMonitor::addDestinationPath(const QString &destinationId, const Q
         return;
     }
     
-    // Create or update destination info
-    DestinationMonitorInfo destInfo;
-    destInfo.destinationId = destinationId;
-    destInfo.path = path;
-    
-    m_destinations[destinationId] = destInfo;
-    m_pathToDestinationMap[path] = destinationId;
+    // Create or update destination info; one restored by loadState keeps
+    // its files, so the scan below reports what changed in between
+    auto existing = m_destinations.constFind(destinationId);
+    if (existing == m_destinations.constEnd() || existing->path != path) {
+        if (existing != m_destinations.constEnd()) {
+            // Moved: events from the old path no longer belong to it
+            stopWatching(existing->path);
+            m_pathIndex.remove(existing->path);
+        }
+        
+        DestinationMonitorInfo destInfo;
+        destInfo.destinationId = destinationId;
+        destInfo.path = path;
+        
+        m_destinations[destinationId] = destInfo;
+    }
+    m_pathIndex.insert(path, destinationId);
     
     // Start watching the directory
     startWatching(path);
@@ -72,9 +151,10 @@ void BackupFileMonitor::removeDestinationPath(const QString &destinationId)
     
     // Stop watching
     stopWatching(destInfo.path);
+    cancelScanRequest(destinationId);
     
     // Remove from maps
-    m_pathToDestinationMap.remove(destInfo.path);
+    m_pathIndex.remove(destInfo.path);
     m_destinations.remove(destinationId);
 }
 
@@ -87,9 +167,14 @@ void BackupFileMonitor::clearAllPaths()
     if (!m_fileWatcher->files().isEmpty()) {
         m_fileWatcher->removePaths(m_fileWatcher->files());
     }
+    for (const QString &root : m_treeWatcher->roots()) {
+        m_treeWatcher->removePath(root);
+    }
+    qDeleteAll(m_debounceTimers);
+    m_debounceTimers.clear();
     
     m_destinations.clear();
-    m_pathToDestinationMap.clear();
+    m_pathIndex.clear();
 }
 
 void BackupFileMonitor::setMonitoringEnabled(bool enabled)
@@ -133,10 +218,9 @@ void BackupFileMonitor::scanDestination(const QString &destinationId)
         return;
     }
     
-    emit scanStarted(destinationId);
-    
-    DestinationMonitorInfo &destInfo = m_destinations[destinationId];
-    scanDestinationInternal(destInfo);
+    // Asked for explicitly, so skip the debounce window
+    cancelScanRequest(destinationId);
+    startScan(destinationId);
 }
 
 void BackupFileMonitor::scanAllDestinations()
@@ -153,148 +237,480 @@ void BackupFileMonitor::forceRescan()
         it->files.clear();
         it->fileCount = 0;
         it->totalSize = 0;
+        it->snapshot.reset();
+        it->filesLoaded = true;
     }
     
     scanAllDestinations();
 }
 
-void BackupFileMonitor::scanDestinationInternal(DestinationMonitorInfo &destInfo)
+void BackupFileMonitor::requestScan(const QString &destinationId)
+{
+    // Every request restarts the window, so a burst of changes costs one
+    // scan once it has settled
+    QTimer *timer = m_debounceTimers.value(destinationId);
+    if (!timer) {
+        timer = new QTimer(this);
+        timer->setSingleShot(true);
+        timer->setInterval(ScanDebounceMsecs);
+        connect(timer, &QTimer::timeout, this, [this, destinationId]() {
+            cancelScanRequest(destinationId);
+            if (m_destinations.contains(destinationId)) {
+                startScan(destinationId);
+            }
+        });
+        m_debounceTimers.insert(destinationId, timer);
+    }
+    timer->start();
+}
+
+void BackupFileMonitor::cancelScanRequest(const QString &destinationId)
 {
-    QList<BackupFileInfo> currentFiles;
+    QTimer *timer = m_debounceTimers.take(destinationId);
+    if (timer) {
+        timer->stop();
+        timer->deleteLater();
+    }
+}
+
+void BackupFileMonitor::startScan(const QString &destinationId)
+{
+    DestinationMonitorInfo &destInfo = m_destinations[destinationId];
     
-    try {
-        scanDirectory(destInfo.path, currentFiles);
-    } catch (const std::exception &e) {
-        emit scanError(destInfo.destinationId, QString("Scan failed: %1").arg(e.what()));
+    if (destInfo.activeScanId != 0) {
+        // One walk per destination at a time; run again once it is done
+        destInfo.rescanQueued = true;
         return;
     }
     
-    // Detect changes
-    int changeCount = 0;
-    if (!destInfo.files.isEmpty()) {
-        detectChanges(destInfo, currentFiles);
-        changeCount = destInfo.changeHistory.size();
+    destInfo.activeScanId = ++m_lastScanId;
+    destInfo.rescanQueued = false;
+    emit scanStarted(destinationId);
+    
+    const quint64 scanId = destInfo.activeScanId;
+    const QString path = destInfo.path;
+    
+    // Files restored from a snapshot are decoded on the pool as well
+    QSharedPointer<const MonitorSnapshot> snapshot;
+    if (!destInfo.filesLoaded) {
+        snapshot = destInfo.snapshot;
     }
+    const int snapshotIndex = destInfo.snapshotIndex;
     
-    // Update file list
-    destInfo.files.clear();
-    destInfo.fileCount = 0;
-    destInfo.totalSize = 0;
+    watchScan(destinationId, scanId, QtConcurrent::run(&m_scanPool, [path, snapshot, snapshotIndex]() {
+        ScanResult result;
+        if (snapshot) {
+            result.savedFiles.reset(new FileIndex());
+            snapshot->readFiles(snapshotIndex, *result.savedFiles);
+        }
+        scanDirectory(path, result);
+        return result;
+    }));
+}
+
+void BackupFileMonitor::startSubtreeScan(const QString &destinationId, const QString &dirPath)
+{
+    // Independent of the destination's full scan; a directory moved in may
+    // hold a large tree, which is listed off this thread all the same
+    const quint64 scanId = ++m_lastScanId;
+    m_destinations[destinationId].subtreeScans.insert(scanId, {dirPath, false});
+    
+    watchScan(destinationId, scanId, QtConcurrent::run(&m_scanPool, [dirPath]() {
+        ScanResult result;
+        scanDirectory(dirPath, result);
+        return result;
+    }));
+}
+
+void BackupFileMonitor::watchScan(const QString &destinationId, quint64 scanId, const QFuture<ScanResult> &future)
+{
+    QFutureWatcher<ScanResult> *watcher = new QFutureWatcher<ScanResult>(this);
+    connect(watcher, &QFutureWatcher<ScanResult>::finished, this,
+            [this, watcher, destinationId, scanId]() {
+        applyScanResult(destinationId, scanId, watcher->result());
+        watcher->deleteLater();
+    });
+    watcher->setFuture(future);
+}
+
+void BackupFileMonitor::applyScanResult(const QString &destinationId, quint64 scanId, const ScanResult &result)
+{
+    auto destIt = m_destinations.find(destinationId);
+    if (destIt == m_destinations.end()) {
+        return;  // Destination removed while it was scanned
+    }
     
-    for (const BackupFileInfo &fileInfo : currentFiles) {
-        destInfo.files[fileInfo.filePath] = fileInfo;
-        destInfo.fileCount++;
-        destInfo.totalSize += fileInfo.size;
+    DestinationMonitorInfo &destInfo = destIt.value();
+    
+    if (destInfo.subtreeScans.contains(scanId)) {
+        const DestinationMonitorInfo::SubtreeScan scan = destInfo.subtreeScans.take(scanId);
+        if (scan.stale) {
+            // Files listed may since have gone; list what is there now
+            startSubtreeScan(destinationId, scan.path);
+        } else if (!result.error.isEmpty()) {
+            emit scanError(destinationId, result.error);
+        } else {
+            // The rest of the destination is untouched, so this is applied
+            // file by file as events would be rather than diffed
+            ensureFilesLoaded(destInfo);
+            const QDateTime checkTime = QDateTime::currentDateTime();
+            for (const ScannedFile &scanned : result.files) {
+                applyScannedFile(destInfo, scanned, checkTime);
+            }
+        }
+        return;
+    }
+    
+    if (destInfo.activeScanId != scanId) {
+        return;  // Destination replaced while it was scanned
     }
+    destInfo.activeScanId = 0;
     
-    destInfo.lastScan = QDateTime::currentDateTime();
+    if (!destInfo.filesLoaded && result.savedFiles) {
+        destInfo.files.swap(*result.savedFiles);
+        destInfo.filesLoaded = true;
+    }
+    
+    // Changes that arrived meanwhile are already in the index but may be
+    // missing from this listing; diffing it would undo them, only for the
+    // next scan to report them again. Walk again straight away instead.
+    if (destInfo.rescanQueued) {
+        startScan(destinationId);
+        return;
+    }
     
-    emit scanCompleted(destInfo.destinationId, currentFiles.size(), changeCount);
+    if (!result.error.isEmpty()) {
+        emit scanError(destinationId, result.error);
+    } else {
+        // Update the index in place
+        int changeCount = detectChanges(destInfo, result.files);
+        destInfo.lastScan = QDateTime::currentDateTime();
+        
+        emit scanCompleted(destinationId, result.files.size(), changeCount);
+    }
 }
 
-void BackupFileMonitor::scanDirectory(const QString &dirPath, QList<BackupFileInfo> &fileList)
+void BackupFileMonitor::scanDirectory(const QString &dirPath, ScanResult &result)
+{
+    try {
+        scanDirectory(dirPath, result.files);
+    } catch (const std::exception &e) {
+        result.files.clear();
+        result.error = QString("Scan failed: %1").arg(e.what());
+    }
+}
+
+void BackupFileMonitor::scanDirectory(const QString &dirPath, QVector<ScannedFile> &fileList)
 {
     QDirIterator it(dirPath, QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
     
     while (it.hasNext()) {
         QString filePath = it.next();
-        QFileInfo fileInfo(filePath);
         
         // Only process backup files (you can customize this filter)
-        if (isBackupFile(fileInfo.fileName())) {
-            BackupFileInfo info(filePath);
-            if (info.isValid) {
-                fileList.append(info);
-            }
+        if (!isBackupFile(it.fileName())) {
+            continue;
+        }
+        
+        ScannedFile scanned;
+        scanned.filePath = filePath;
+#ifdef Q_OS_LINUX
+        // One stat gives the identity along with size and time
+        struct stat st;
+        if (::stat(QFile::encodeName(filePath).constData(), &st) != 0) {
+            continue;  // Gone since it was listed
         }
+        scanned.size = st.st_size;
+        scanned.modifiedMs = qint64(st.st_mtim.tv_sec) * 1000 + st.st_mtim.tv_nsec / 1000000;
+        scanned.device = st.st_dev;
+        scanned.inode = st.st_ino;
+#else
+        const QFileInfo fileInfo = it.fileInfo();
+        scanned.size = fileInfo.size();
+        scanned.modifiedMs = fileInfo.lastModified().toMSecsSinceEpoch();
+        readFileIdentity(filePath, scanned.device, scanned.inode);
+#endif
+        fileList.append(scanned);
     }
 }
 
-void BackupFileMonitor::detectChanges(DestinationMonitorInfo &destInfo, const QList<BackupFileInfo> &currentFiles)
+int BackupFileMonitor::detectChanges(DestinationMonitorInfo &destInfo, const QVector<ScannedFile> &currentFiles)
 {
-    QMap<QString, BackupFileInfo> currentFilesMap;
+    ensureFilesLoaded(destInfo);
     
-    // Build map of current files
-    for (const BackupFileInfo &fileInfo : currentFiles) {
-        currentFilesMap[fileInfo.filePath] = fileInfo;
+    // The first scan of a destination is its baseline, not a change
+    const bool baseline = destInfo.files.isEmpty();
+    if (baseline && !currentFiles.isEmpty()) {
+        destInfo.snapshot.reset();
     }
+    const QDateTime checkTime = QDateTime::currentDateTime();
+    int changeCount = 0;
+    
+    // New files are only reported once deletions are known, since a new
+    // path and a vanished one may be the same file renamed
+    QVector<int> addedFiles;
+    
+    destInfo.files.reserve(currentFiles.size());
+    destInfo.files.clearSeen();
     
-    // Detect deleted files
-    for (auto it = destInfo.files.begin(); it != destInfo.files.end(); ++it) {
-        const QString &filePath = it.key();
-        const BackupFileInfo &oldInfo = it.value();
+    // Detect new and modified files, marking everything this scan saw
+    for (const ScannedFile &scanned : currentFiles) {
+        int handle = destInfo.files.find(scanned.filePath);
         
-        if (!currentFilesMap.contains(filePath)) {
-            // File was deleted
-            FileChangeRecord change;
-            change.filePath = filePath;
-            change.changeType = FileChangeRecord::Deleted;
-            change.changeTime = QDateTime::currentDateTime();
-            change.oldInfo = oldInfo;
-            change.description = QString("File deleted: %1").arg(oldInfo.fileName);
+        if (handle == FileIndex::NoFile) {
+            const QByteArray encodedPath = scanned.filePath.toUtf8();
+            handle = destInfo.files.insert(encodedPath.constData(), encodedPath.size(), scanned.size,
+                                           scanned.modifiedMs, scanned.device, scanned.inode);
+            if (handle == FileIndex::NoFile) {
+                continue;
+            }
+            destInfo.files.markSeen(handle);
+            destInfo.fileCount++;
+            destInfo.totalSize += scanned.size;
             
-            recordChange(destInfo, change);
-            emit fileDeleted(destInfo.destinationId, filePath, oldInfo);
+            if (!baseline) {
+                addedFiles.append(handle);
+            }
+            continue;
+        }
+        
+        destInfo.files.markSeen(handle);
+        
+        if (destInfo.files.record(handle).modifiedMs != scanned.modifiedMs) {
+            const BackupFileInfo oldInfo = destInfo.files.fileInfo(handle, destInfo.lastScan);
+            destInfo.files.setMetadata(handle, scanned.size, scanned.modifiedMs, scanned.device, scanned.inode);
+            destInfo.totalSize += scanned.size - oldInfo.size;
+            
+            recordModified(destInfo, oldInfo, destInfo.files.fileInfo(handle, checkTime));
+            changeCount++;
         }
     }
     
-    // Detect new and modified files
-    for (auto it = currentFilesMap.begin(); it != currentFilesMap.end(); ++it) {
-        const QString &filePath = it.key();
-        const BackupFileInfo &newInfo = it.value();
+    // Whatever this scan did not reach is gone, or was renamed
+    QList<BackupFileInfo> deletedFiles;
+    QHash<QPair<quint64, quint64>, int> deletedByIdentity;  // (device, inode) -> index in deletedFiles
+    
+    for (int handle = 0; handle < destInfo.files.handleLimit(); ++handle) {
+        if (!destInfo.files.isUsed(handle) || destInfo.files.isSeen(handle)) {
+            continue;
+        }
         
-        if (!destInfo.files.contains(filePath)) {
-            // New file
-            FileChangeRecord change;
-            change.filePath = filePath;
-            change.changeType = FileChangeRecord::Added;
-            change.changeTime = QDateTime::currentDateTime();
-            change.newInfo = newInfo;
-            change.description = QString("New file added: %1 (%2 bytes)")
-                .arg(newInfo.fileName)
-                .arg(newInfo.size);
-            
-            recordChange(destInfo, change);
-            emit fileAdded(destInfo.destinationId, filePath, newInfo);
+        const BackupFileInfo oldInfo = destInfo.files.fileInfo(handle, destInfo.lastScan);
+        if (oldInfo.hasIdentity() && !addedFiles.isEmpty()) {
+            deletedByIdentity.insert(qMakePair(oldInfo.device, oldInfo.inode), deletedFiles.size());
+        }
+        deletedFiles.append(oldInfo);
+        destInfo.fileCount--;
+        destInfo.totalSize -= oldInfo.size;
+        destInfo.files.removeAt(handle);
+    }
+    
+    // Pair new paths with vanished files by identity
+    QVector<bool> renamed(deletedFiles.size(), false);
+    for (int handle : addedFiles) {
+        const BackupFileInfo newInfo = destInfo.files.fileInfo(handle, checkTime);
+        const int index = deletedByIdentity.value(qMakePair(newInfo.device, newInfo.inode), -1);
+        
+        if (index >= 0 && !renamed[index] && deletedFiles[index].isSameFileAs(newInfo)) {
+            renamed[index] = true;
+            recordRenamed(destInfo, deletedFiles[index], newInfo);
         } else {
-            // Check if modified
-            const BackupFileInfo &oldInfo = destInfo.files[filePath];
-            
-            if (oldInfo.lastModified != newInfo.lastModified) {
-                FileChangeRecord change;
-                change.filePath = filePath;
-                change.changeType = FileChangeRecord::Modified;
-                change.changeTime = QDateTime::currentDateTime();
-                change.oldInfo = oldInfo;
-                change.newInfo = newInfo;
-                change.description = QString("File modified: %1 (size: %2 -> %3)")
-                    .arg(newInfo.fileName)
-                    .arg(oldInfo.size)
-                    .arg(newInfo.size);
-                
-                recordChange(destInfo, change);
-                emit fileModified(destInfo.destinationId, filePath, oldInfo, newInfo);
-                
-                if (oldInfo.size != newInfo.size) {
-                    emit sizeChanged(destInfo.destinationId, filePath, oldInfo.size, newInfo.size);
-                }
-            }
+            recordAdded(destInfo, newInfo);
+        }
+        changeCount++;
+    }
+    
+    for (int i = 0; i < deletedFiles.size(); ++i) {
+        if (!renamed[i]) {
+            recordDeleted(destInfo, deletedFiles[i]);
+            changeCount++;
         }
     }
+    
+    return changeCount;
+}
+
+void BackupFileMonitor::ensureFilesLoaded(DestinationMonitorInfo &destInfo)
+{
+    if (destInfo.filesLoaded) {
+        return;
+    }
+    
+    if (!destInfo.snapshot->readFiles(destInfo.snapshotIndex, destInfo.files)) {
+        destInfo.snapshot.reset();  // Damaged; the next scan starts over
+    }
+    destInfo.filesLoaded = true;
 }
 
 void BackupFileMonitor::recordChange(DestinationMonitorInfo &destInfo, const FileChangeRecord &change)
 {
-    destInfo.changeHistory.prepend(change);
+    // Files no longer match the snapshot, so the next save encodes them
+    destInfo.snapshot.reset();
     
-    // Limit history to 1000 records per destination
-    if (destInfo.changeHistory.size() > 1000) {
-        destInfo.changeHistory.removeLast();
+    if (m_journal->isOpen()) {
+        m_journal->append(destInfo.destinationId, change);
+    } else {
+        destInfo.changeHistory.prepend(change);
+        
+        // Limit history to 1000 records per destination
+        if (destInfo.changeHistory.size() > 1000) {
+            destInfo.changeHistory.removeLast();
+        }
     }
     
     emit changeDetected(destInfo.destinationId, change);
 }
 
+void BackupFileMonitor::recordAdded(DestinationMonitorInfo &destInfo, const BackupFileInfo &newInfo)
+{
+    FileChangeRecord change;
+    change.filePath = newInfo.filePath;
+    change.changeType = FileChangeRecord::Added;
+    change.changeTime = QDateTime::currentDateTime();
+    change.newInfo = newInfo;
+    change.description = QString("New file added: %1 (%2 bytes)")
+        .arg(newInfo.fileName)
+        .arg(newInfo.size);
+    
+    recordChange(destInfo, change);
+    emit fileAdded(destInfo.destinationId, newInfo.filePath, newInfo);
+}
+
+void BackupFileMonitor::recordModified(DestinationMonitorInfo &destInfo, const BackupFileInfo &oldInfo, const BackupFileInfo &newInfo)
+{
+    FileChangeRecord change;
+    change.filePath = newInfo.filePath;
+    change.changeType = FileChangeRecord::Modified;
+    change.changeTime = QDateTime::currentDateTime();
+    change.oldInfo = oldInfo;
+    change.newInfo = newInfo;
+    change.description = QString("File modified: %1 (size: %2 -> %3)")
+        .arg(newInfo.fileName)
+        .arg(oldInfo.size)
+        .arg(newInfo.size);
+    
+    recordChange(destInfo, change);
+    emit fileModified(destInfo.destinationId, newInfo.filePath, oldInfo, newInfo);
+    
+    if (oldInfo.size != newInfo.size) {
+        emit sizeChanged(destInfo.destinationId, newInfo.filePath, oldInfo.size, newInfo.size);
+    }
+}
+
+void BackupFileMonitor::recordDeleted(DestinationMonitorInfo &destInfo, const BackupFileInfo &oldInfo)
+{
+    FileChangeRecord change;
+    change.filePath = oldInfo.filePath;
+    change.changeType = FileChangeRecord::Deleted;
+    change.changeTime = QDateTime::currentDateTime();
+    change.oldInfo = oldInfo;
+    change.description = QString("File deleted: %1").arg(oldInfo.fileName);
+    
+    recordChange(destInfo, change);
+    emit fileDeleted(destInfo.destinationId, oldInfo.filePath, oldInfo);
+}
+
+void BackupFileMonitor::recordRenamed(DestinationMonitorInfo &destInfo, const BackupFileInfo &oldInfo, const BackupFileInfo &newInfo)
+{
+    FileChangeRecord change;
+    change.filePath = newInfo.filePath;
+    change.changeType = FileChangeRecord::Renamed;
+    change.changeTime = QDateTime::currentDateTime();
+    change.oldInfo = oldInfo;
+    change.newInfo = newInfo;
+    change.description = QString("File renamed: %1 -> %2")
+        .arg(oldInfo.filePath)
+        .arg(newInfo.filePath);
+    
+    recordChange(destInfo, change);
+    emit fileRenamed(destInfo.destinationId, oldInfo.filePath, newInfo.filePath);
+}
+
+void BackupFileMonitor::applyFileChange(DestinationMonitorInfo &destInfo, const QString &filePath)
+{
+    if (!isBackupFile(QFileInfo(filePath).fileName())) {
+        return;
+    }
+    
+    BackupFileInfo newInfo(filePath);
+    if (!newInfo.isValid) {
+        // Gone again before we got to it; the removal event follows
+        return;
+    }
+    
+    const int handle = destInfo.files.find(filePath);
+    if (handle == FileIndex::NoFile) {
+        recordAdded(destInfo, newInfo);
+        destInfo.files.insert(newInfo);
+        destInfo.fileCount++;
+        destInfo.totalSize += newInfo.size;
+    } else if (destInfo.files.record(handle).modifiedMs != newInfo.lastModified.toMSecsSinceEpoch() ||
+               destInfo.files.record(handle).size != newInfo.size) {
+        const BackupFileInfo oldInfo = destInfo.files.fileInfo(handle, destInfo.lastScan);
+        recordModified(destInfo, oldInfo, newInfo);
+        destInfo.totalSize += newInfo.size - oldInfo.size;
+        destInfo.files.insert(newInfo);
+    }
+}
+
+void BackupFileMonitor::applyScannedFile(DestinationMonitorInfo &destInfo, const ScannedFile &scanned, const QDateTime &checkTime)
+{
+    int handle = destInfo.files.find(scanned.filePath);
+    if (handle == FileIndex::NoFile) {
+        const QByteArray encodedPath = scanned.filePath.toUtf8();
+        handle = destInfo.files.insert(encodedPath.constData(), encodedPath.size(), scanned.size,
+                                       scanned.modifiedMs, scanned.device, scanned.inode);
+        if (handle == FileIndex::NoFile) {
+            return;
+        }
+        destInfo.fileCount++;
+        destInfo.totalSize += scanned.size;
+        recordAdded(destInfo, destInfo.files.fileInfo(handle, checkTime));
+    } else if (destInfo.files.record(handle).modifiedMs != scanned.modifiedMs ||
+               destInfo.files.record(handle).size != scanned.size) {
+        const BackupFileInfo oldInfo = destInfo.files.fileInfo(handle, destInfo.lastScan);
+        destInfo.files.setMetadata(handle, scanned.size, scanned.modifiedMs, scanned.device, scanned.inode);
+        destInfo.totalSize += scanned.size - oldInfo.size;
+        recordModified(destInfo, oldInfo, destInfo.files.fileInfo(handle, checkTime));
+    }
+}
+
+void BackupFileMonitor::applyFileRemoval(DestinationMonitorInfo &destInfo, const QString &filePath)
+{
+    const int handle = destInfo.files.find(filePath);
+    if (handle == FileIndex::NoFile) {
+        return;
+    }
+    
+    const BackupFileInfo oldInfo = destInfo.files.fileInfo(handle, destInfo.lastScan);
+    destInfo.files.removeAt(handle);
+    destInfo.fileCount--;
+    destInfo.totalSize -= oldInfo.size;
+    recordDeleted(destInfo, oldInfo);
+}
+
+void BackupFileMonitor::applyFileMove(DestinationMonitorInfo &destInfo, const QString &oldPath, const QString &newPath)
+{
+    const int handle = destInfo.files.find(oldPath);
+    if (handle == FileIndex::NoFile) {
+        // Renamed into something that looks like a backup
+        applyFileChange(destInfo, newPath);
+        return;
+    }
+    
+    BackupFileInfo newInfo(newPath);
+    if (!newInfo.isValid || !isBackupFile(newInfo.fileName)) {
+        applyFileRemoval(destInfo, oldPath);
+        return;
+    }
+    
+    const BackupFileInfo oldInfo = destInfo.files.fileInfo(handle, destInfo.lastScan);
+    destInfo.files.removeAt(handle);
+    destInfo.files.insert(newInfo);
+    destInfo.totalSize += newInfo.size - oldInfo.size;
+    recordRenamed(destInfo, oldInfo, newInfo);
+}
+
 QList<BackupFileInfo> BackupFileMonitor::getFilesInDestination(const QString &destinationId) const
 {
     if (!m_destinations.contains(destinationId)) {
@@ -302,7 +718,25 @@ QList<BackupFileInfo> BackupFileMonitor::getFilesInDestination(const QString &de
     }
     
     const DestinationMonitorInfo &destInfo = m_destinations[destinationId];
-    return destInfo.files.values();
+    QList<BackupFileInfo> files;
+    if (!destInfo.filesLoaded) {
+        FileIndex savedFiles;
+        destInfo.snapshot->readFiles(destInfo.snapshotIndex, savedFiles);
+        files = savedFiles.values(destInfo.lastScan);
+    } else {
+        files = destInfo.files.values(destInfo.lastScan);
+    }
+    
+    // Checksums of files a scrub has read, as long as they are unchanged
+    if (m_hashCache.size() > 0) {
+        for (BackupFileInfo &info : files) {
+            HashCacheEntry entry;
+            if (m_hashCache.lookup(hashCacheKey(info), entry)) {
+                info.checksum = ContentHash::toHex(entry.hash);
+            }
+        }
+    }
+    return files;
 }
 
 QList<FileChangeRecord> BackupFileMonitor::getChangeHistory(const QString &destinationId, int maxRecords) const
@@ -311,6 +745,10 @@ QList<FileChangeRecord> BackupFileMonitor::getChangeHistory(const QString &desti
         return QList<FileChangeRecord>();
     }
     
+    if (m_journal->isOpen()) {
+        return m_journal->history(destinationId, maxRecords);
+    }
+    
     const DestinationMonitorInfo &destInfo = m_destinations[destinationId];
     
     if (maxRecords <= 0 || maxRecords >= destInfo.changeHistory.size()) {
@@ -325,6 +763,10 @@ QList<FileChangeRecord> BackupFileMonitor::getRecentChanges(int minutes) const
     QList<FileChangeRecord> recentChanges;
     QDateTime threshold = QDateTime::currentDateTime().addSecs(-minutes * 60);
     
+    if (m_journal->isOpen()) {
+        return m_journal->changesBetween(threshold, QDateTime::currentDateTime());
+    }
+    
     for (auto it = m_destinations.begin(); it != m_destinations.end(); ++it) {
         const DestinationMonitorInfo &destInfo = it.value();
         
@@ -338,6 +780,29 @@ QList<FileChangeRecord> BackupFileMonitor::getRecentChanges(int minutes) const
     return recentChanges;
 }
 
+bool BackupFileMonitor::openChangeJournal(const QString &directory)
+{
+    if (!m_journal->open(directory)) {
+        emit error(QString("Failed to open change journal: %1").arg(directory));
+        return false;
+    }
+    
+    // Changes kept in memory so far move to the journal, oldest first
+    for (auto it = m_destinations.begin(); it != m_destinations.end(); ++it) {
+        for (int i = it->changeHistory.size() - 1; i >= 0; --i) {
+            m_journal->append(it->destinationId, it->changeHistory.at(i));
+        }
+        it->changeHistory.clear();
+    }
+    return true;
+}
+
+void BackupFileMonitor::setHistoryRetention(qint64 maxRecords, int maxAgeDays)
+{
+    m_journal->setMaxRecords(maxRecords);
+    m_journal->setMaxAgeDays(maxAgeDays);
+}
+
 int BackupFileMonitor::getTotalFilesMonitored() const
 {
     int total = 0;
@@ -380,6 +845,24 @@ QDateTime BackupFileMonitor::getLastScanTime(const QString &destinationId) const
     return m_destinations[destinationId].lastScan;
 }
 
+qint64 BackupFileMonitor::getIndexMemoryUsage() const
+{
+    qint64 total = 0;
+    for (auto it = m_destinations.begin(); it != m_destinations.end(); ++it) {
+        total += it->files.memoryUsage();
+    }
+    return total;
+}
+
+double BackupFileMonitor::getIndexBytesPerFile() const
+{
+    qint64 files = 0;
+    for (auto it = m_destinations.begin(); it != m_destinations.end(); ++it) {
+        files += it->files.size();
+    }
+    return files > 0 ? double(getIndexMemoryUsage()) / files : 0.0;
+}
+
 bool BackupFileMonitor::verifyFileIntegrity(const QString &filePath)
 {
     QFileInfo fileInfo(filePath);
@@ -394,12 +877,19 @@ bool BackupFileMonitor::verifyFileIntegrity(const QString &filePath)
     }
     
     const DestinationMonitorInfo &destInfo = m_destinations[destinationId];
-    if (!destInfo.files.contains(filePath)) {
-        return false;
+    BackupFileInfo storedInfo;
+    if (!destInfo.filesLoaded) {
+        // One lookup in the snapshot rather than loading the destination
+        if (!destInfo.snapshot->findFile(destInfo.snapshotIndex, filePath, storedInfo)) {
+            return false;
+        }
+    } else {
+        storedInfo = destInfo.files.value(filePath, destInfo.lastScan);
+        if (!storedInfo.isValid) {
+            return false;
+        }
     }
     
-    const BackupFileInfo &storedInfo = destInfo.files[filePath];
-    
     // Check if file still has the same size and modification date
     if (fileInfo.size() != storedInfo.size ||
         fileInfo.lastModified() != storedInfo.lastModified) {
@@ -417,21 +907,293 @@ QStringList BackupFileMonitor::findCorruptedFiles(const QString &destinationId)
         return corruptedFiles;
     }
     
-    const DestinationMonitorInfo &destInfo = m_destinations[destinationId];
+    DestinationMonitorInfo &destInfo = m_destinations[destinationId];
+    ensureFilesLoaded(destInfo);
     
-    for (auto it = destInfo.files.begin(); it != destInfo.files.end(); ++it) {
-        const QString &filePath = it.key();
+    ScrubRun run;
+    for (const QString &filePath : destInfo.files.filePaths()) {
         
         if (!verifyFileIntegrity(filePath)) {
             corruptedFiles.append(filePath);
             emit corruptedFileFound(filePath, "File integrity check failed");
+            continue;
         }
+        
+        ScrubItem item;
+        item.destinationId = destinationId;
+        item.filePath = filePath;
+        run.items.append(item);
+    }
+    
+    // Read the rest back and compare them with their cached hashes
+    BandwidthLimiter *limiter = m_scrubLimiter;
+    const std::atomic<bool> &cancelled = run.cancelled;
+    QtConcurrent::blockingMap(run.items, [limiter, &cancelled](ScrubItem &item) {
+        item.outcome = hashFileForScrub(item, limiter, cancelled);
+    });
+    applyScrubResults(run, &corruptedFiles);
+    if (!m_hashCachePath.isEmpty()) {
+        m_hashCache.save(m_hashCachePath);
     }
     
     return corruptedFiles;
 }
 
+bool BackupFileMonitor::openHashCache(const QString &filePath)
+{
+    if (m_scrub) {
+        emit error("Cannot change the hash cache while a scrub is running");
+        return false;
+    }
+    
+    m_hashCachePath = filePath;
+    if (!m_hashCache.load(filePath) && QFileInfo::exists(filePath)) {
+        // Unreadable; it is rebuilt by the next pass
+        emit error(QString("Failed to load hash cache: %1").arg(filePath));
+        return false;
+    }
+    return true;
+}
+
+void BackupFileMonitor::setScrubWindow(const QTime &start, int maxMinutes)
+{
+    m_scrubWindowStart = start;
+    m_scrubWindowMinutes = qMax(0, maxMinutes);
+    armScrubTimer();
+}
+
+void BackupFileMonitor::setScrubRateLimit(qint64 bytesPerSecond)
+{
+    m_scrubLimiter->setLimit(bytesPerSecond);
+}
+
+void BackupFileMonitor::setScrubThreadCount(int threadCount)
+{
+    m_scrubPool.setMaxThreadCount(qMax(1, threadCount));
+}
+
+void BackupFileMonitor::startScrub(qint64 timeLimitMsecs)
+{
+    if (m_scrub) {
+        return;  // One at a time
+    }
+    
+    // Files are scrubbed in destination id and path order, starting after
+    // the last one the previous scrub finished
+    const QString cursorDestination = m_hashCache.cursorDestination();
+    const QString cursorPath = m_hashCache.cursorPath();
+    if (cursorDestination.isEmpty()) {
+        m_hashCache.setPassStartedMs(QDateTime::currentMSecsSinceEpoch());
+    }
+    
+    QSharedPointer<ScrubRun> run(new ScrubRun());
+    for (auto it = m_destinations.lowerBound(cursorDestination); it != m_destinations.end(); ++it) {
+        DestinationMonitorInfo &destInfo = it.value();
+        ensureFilesLoaded(destInfo);
+        
+        QStringList paths = destInfo.files.filePaths();
+        std::sort(paths.begin(), paths.end());
+        auto first = paths.constBegin();
+        if (it.key() == cursorDestination) {
+            first = std::upper_bound(paths.constBegin(), paths.constEnd(), cursorPath);
+        }
+        
+        for (auto path = first; path != paths.constEnd(); ++path) {
+            ScrubItem item;
+            item.destinationId = it.key();
+            item.filePath = *path;
+            run->items.append(item);
+        }
+    }
+    run->budgetMs = qMax<qint64>(0, timeLimitMsecs);
+    
+    m_scrub = run;
+    emit scrubStarted();
+    startScrubWorkers(run);
+}
+
+void BackupFileMonitor::stopScrub()
+{
+    if (m_scrub) {
+        m_scrub->cancelled = true;  // Finished once the workers return
+    }
+}
+
+void BackupFileMonitor::startScrubWorkers(const QSharedPointer<ScrubRun> &run)
+{
+    run->workers = qMax(1, m_scrubPool.maxThreadCount());
+    run->clock.start();
+    
+    BandwidthLimiter *limiter = m_scrubLimiter;
+    for (int i = 0; i < run->workers; ++i) {
+        QFutureWatcher<void> *watcher = new QFutureWatcher<void>(this);
+        connect(watcher, &QFutureWatcher<void>::finished, this, [this, watcher, run]() {
+            watcher->deleteLater();
+            if (++run->finishedWorkers == run->workers && m_scrub == run) {
+                finishScrub();
+            }
+        });
+        watcher->setFuture(QtConcurrent::run(&m_scrubPool, [run, limiter]() {
+            runScrubWorker(run.data(), limiter);
+        }));
+    }
+}
+
+void BackupFileMonitor::runScrubWorker(ScrubRun *run, BandwidthLimiter *limiter)
+{
+    // Files already started are finished when time runs out, so every run
+    // makes progress however large the files are
+    while (!run->cancelled) {
+        if (run->budgetMs > 0 && run->clock.elapsed() >= run->budgetMs) {
+            return;
+        }
+        const int index = run->next.fetch_add(1);
+        if (index >= run->items.size()) {
+            return;
+        }
+        ScrubItem &item = run->items[index];
+        item.outcome = hashFileForScrub(item, limiter, run->cancelled);
+    }
+}
+
+void BackupFileMonitor::finishScrub()
+{
+    const QSharedPointer<ScrubRun> run = m_scrub;
+    m_scrub.reset();
+    
+    // The next scrub starts after the files finished in order; any finished
+    // after a gap are simply read again
+    int finished = 0;
+    int checked = 0;
+    for (const ScrubItem &item : run->items) {
+        if (item.outcome == ScrubOutcome::Pending || item.outcome == ScrubOutcome::Cancelled) {
+            break;
+        }
+        ++finished;
+    }
+    for (const ScrubItem &item : run->items) {
+        if (item.outcome == ScrubOutcome::Hashed || item.outcome == ScrubOutcome::ReadFailed) {
+            ++checked;
+        }
+    }
+    
+    const int corrupted = applyScrubResults(*run);
+    const bool passCompleted = finished == run->items.size();
+    if (passCompleted) {
+        // Hashes not confirmed in the whole pass belong to files that are
+        // gone or were rewritten
+        m_hashCache.removeVerifiedBefore(m_hashCache.passStartedMs());
+        m_hashCache.setCursor(QString(), QString());
+    } else if (finished > 0) {
+        const ScrubItem &last = run->items.at(finished - 1);
+        m_hashCache.setCursor(last.destinationId, last.filePath);
+    }
+    
+    if (!m_hashCachePath.isEmpty()) {
+        m_hashCache.save(m_hashCachePath);
+    }
+    
+    emit scrubFinished(checked, corrupted, passCompleted);
+}
+
+int BackupFileMonitor::applyScrubResults(const ScrubRun &run, QStringList *corruptedFiles)
+{
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+    int corrupted = 0;
+    
+    for (const ScrubItem &item : run.items) {
+        QString reason;
+        if (item.outcome == ScrubOutcome::ReadFailed) {
+            reason = QString("Read error: %1").arg(item.error);
+        } else if (item.outcome == ScrubOutcome::Hashed) {
+            HashCacheEntry entry;
+            if (m_hashCache.lookup(item.key, entry)) {
+                entry.mismatch = entry.hash != item.hash;
+            } else {
+                entry.hash = item.hash;  // First read at this size and time
+            }
+            entry.verifiedMs = now;
+            m_hashCache.insert(item.key, entry);
+            
+            if (entry.mismatch) {
+                reason = "Contents changed but size and modification time did not";
+            }
+        }
+        
+        if (!reason.isEmpty()) {
+            ++corrupted;
+            if (corruptedFiles) {
+                corruptedFiles->append(item.filePath);
+            }
+            emit corruptedFileFound(item.filePath, reason);
+        }
+    }
+    
+    return corrupted;
+}
+
+void BackupFileMonitor::armScrubTimer()
+{
+    if (!m_scrubWindowStart.isValid()) {
+        m_scrubTimer->stop();
+        return;
+    }
+    
+    const QDateTime now = QDateTime::currentDateTime();
+    QDateTime next(now.date(), m_scrubWindowStart);
+    if (next <= now) {
+        next = next.addDays(1);
+    }
+    m_scrubTimer->start(static_cast<int>(qMin<qint64>(now.msecsTo(next), 24 * 60 * 60 * 1000)));
+}
+
+void BackupFileMonitor::onScrubTimerTimeout()
+{
+    startScrub(qint64(m_scrubWindowMinutes) * 60 * 1000);
+    armScrubTimer();
+}
+
 bool BackupFileMonitor::saveState(const QString &filePath)
+{
+    // Destinations still matching the snapshot they came from are copied
+    // from it; only the others are encoded
+    QList<MonitorSnapshotDestination> destinations;
+    for (auto it = m_destinations.constBegin(); it != m_destinations.constEnd(); ++it) {
+        MonitorSnapshotDestination destination;
+        destination.id = it->destinationId;
+        destination.path = it->path;
+        destination.fileCount = it->fileCount;
+        destination.totalSize = it->totalSize;
+        destination.lastScan = it->lastScan;
+        
+        if (it->snapshot) {
+            destination.source = it->snapshot.data();
+            destination.sourceIndex = it->snapshotIndex;
+        } else {
+            destination.files = &it->files;
+        }
+        destinations.append(destination);
+    }
+    
+    if (!MonitorSnapshot::save(filePath, m_monitoringEnabled, m_scanIntervalMinutes, destinations)) {
+        emit error(QString("Failed to save state: %1").arg(filePath));
+        return false;
+    }
+    
+    // The next save copies from the file just written
+    QSharedPointer<MonitorSnapshot> snapshot(new MonitorSnapshot());
+    if (snapshot->open(filePath)) {
+        int index = 0;
+        for (auto it = m_destinations.begin(); it != m_destinations.end(); ++it, ++index) {
+            it->snapshot = snapshot;
+            it->snapshotIndex = index;
+        }
+    }
+    
+    return true;
+}
+
+bool BackupFileMonitor::exportStateJson(const QString &filePath)
 {
     QJsonObject root;
     root["version"] = "1.0";
@@ -441,7 +1203,8 @@ bool BackupFileMonitor::saveState(const QString &filePath)
     
     QJsonArray destinationsArray;
     for (auto it = m_destinations.begin(); it != m_destinations.end(); ++it) {
-        const DestinationMonitorInfo &destInfo = it.value();
+        DestinationMonitorInfo &destInfo = it.value();
+        ensureFilesLoaded(destInfo);
         
         QJsonObject destObj;
         destObj["destination_id"] = destInfo.destinationId;
@@ -452,8 +1215,7 @@ bool BackupFileMonitor::saveState(const QString &filePath)
         
         // Save file list
         QJsonArray filesArray;
-        for (auto fileIt = destInfo.files.begin(); fileIt != destInfo.files.end(); ++fileIt) {
-            const BackupFileInfo &fileInfo = fileIt.value();
+        for (const BackupFileInfo &fileInfo : destInfo.files.values(destInfo.lastScan)) {
             
             QJsonObject fileObj;
             fileObj["path"] = fileInfo.filePath;
@@ -461,6 +1223,8 @@ bool BackupFileMonitor::saveState(const QString &filePath)
             fileObj["size"] = QString::number(fileInfo.size);
             fileObj["last_modified"] = fileInfo.lastModified.toString(Qt::ISODate);
             fileObj["last_checked"] = fileInfo.lastChecked.toString(Qt::ISODate);
+            fileObj["device"] = QString::number(fileInfo.device);
+            fileObj["inode"] = QString::number(fileInfo.inode);
             
             filesArray.append(fileObj);
         }
@@ -485,6 +1249,56 @@ bool BackupFileMonitor::saveState(const QString &filePath)
 }
 
 bool BackupFileMonitor::loadState(const QString &filePath)
+{
+    if (!MonitorSnapshot::isSnapshotFile(filePath)) {
+        return loadStateJson(filePath);
+    }
+    
+    QSharedPointer<MonitorSnapshot> snapshot(new MonitorSnapshot());
+    if (!snapshot->open(filePath)) {
+        emit error("Invalid state file format");
+        return false;
+    }
+    
+    // Restore settings
+    m_monitoringEnabled = snapshot->monitoringEnabled();
+    m_scanIntervalMinutes = snapshot->scanIntervalMinutes();
+    
+    // Restore destinations; their files stay in the snapshot until needed
+    for (int i = 0; i < snapshot->destinationCount(); ++i) {
+        const MonitorSnapshotDestination saved = snapshot->destination(i);
+        
+        // Check if path still exists
+        if (!QDir(saved.path).exists()) {
+            continue;
+        }
+        
+        DestinationMonitorInfo destInfo;
+        destInfo.destinationId = saved.id;
+        destInfo.path = saved.path;
+        destInfo.fileCount = static_cast<int>(saved.fileCount);
+        destInfo.totalSize = saved.totalSize;
+        destInfo.lastScan = saved.lastScan;
+        destInfo.snapshot = snapshot;
+        destInfo.snapshotIndex = i;
+        destInfo.filesLoaded = false;
+        
+        m_destinations[saved.id] = destInfo;
+        m_pathIndex.insert(saved.path, saved.id);
+        
+        // Start watching
+        startWatching(saved.path);
+    }
+    
+    // Start timer if monitoring was enabled
+    if (m_monitoringEnabled) {
+        m_scanTimer->start();
+    }
+    
+    return true;
+}
+
+bool BackupFileMonitor::loadStateJson(const QString &filePath)
 {
     QFile file(filePath);
     if (!file.open(QIODevice::ReadOnly)) {
@@ -537,13 +1351,15 @@ bool BackupFileMonitor::loadState(const QString &filePath)
             fileInfo.size = fileObj["size"].toString().toLongLong();
             fileInfo.lastModified = QDateTime::fromString(fileObj["last_modified"].toString(), Qt::ISODate);
             fileInfo.lastChecked = QDateTime::fromString(fileObj["last_checked"].toString(), Qt::ISODate);
-            fileInfo.isValid = QFileInfo::exists(fileInfo.filePath);
+            fileInfo.device = fileObj["device"].toString().toULongLong();
+            fileInfo.inode = fileObj["inode"].toString().toULongLong();
+            fileInfo.isValid = true;  // Confirmed or dropped by the next scan
             
-            destInfo.files[fileInfo.filePath] = fileInfo;
+            destInfo.files.insert(fileInfo);
         }
         
         m_destinations[destinationId] = destInfo;
-        m_pathToDestinationMap[path] = destinationId;
+        m_pathIndex.insert(path, destinationId);
         
         // Start watching
         startWatching(path);
@@ -557,50 +1373,120 @@ bool BackupFileMonitor::loadState(const QString &filePath)
     return true;
 }
 
-QString BackupFileMonitor::calculateChecksum(const QString &filePath)
+BackupFileMonitor::ScrubOutcome BackupFileMonitor::hashFileForScrub(ScrubItem &item, BandwidthLimiter *limiter,
+                                                                   const std::atomic<bool> &cancelled)
 {
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly)) {
-        return QString();
+    HashCacheKey before;
+    if (!readHashCacheKey(item.filePath, before)) {
+        return ScrubOutcome::Skipped;
     }
     
-    QCryptographicHash hash(QCryptographicHash::Sha256);
-    if (hash.addData(&file)) {
-        return QString(hash.result().toHex());
+    QFile file(item.filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) {
+        return ScrubOutcome::Skipped;
     }
     
-    return QString();
+    ContentHash hash;
+    QByteArray buffer(ScrubReadSize, Qt::Uninitialized);
+    for (;;) {
+        if (cancelled) {
+            return ScrubOutcome::Cancelled;
+        }
+        limiter->acquire(ScrubReadSize);
+        const qint64 bytesRead = file.read(buffer.data(), buffer.size());
+        if (bytesRead < 0) {
+            item.error = file.errorString();
+            return ScrubOutcome::ReadFailed;
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+        hash.addData(buffer.constData(), bytesRead);
+    }
+    
+#ifdef Q_OS_LINUX
+    // A nightly read of every backup shouldn't push everything else out of the page cache
+    ::posix_fadvise(file.handle(), 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    
+    // Written to while it was read: neither hash is meaningful
+    HashCacheKey after;
+    if (!readHashCacheKey(item.filePath, after) || !(after == before)) {
+        return ScrubOutcome::Skipped;
+    }
+    
+    item.key = before;
+    item.hash = hash.result();
+    return ScrubOutcome::Hashed;
+}
+
+bool BackupFileMonitor::readHashCacheKey(const QString &filePath, HashCacheKey &key)
+{
+    // Same sources as scanDirectory, so keys match the indexed metadata
+    BackupFileInfo info;
+    info.filePath = filePath;
+#ifdef Q_OS_LINUX
+    struct stat st;
+    if (::stat(QFile::encodeName(filePath).constData(), &st) != 0) {
+        return false;
+    }
+    info.size = st.st_size;
+    info.lastModified = QDateTime::fromMSecsSinceEpoch(
+        qint64(st.st_mtim.tv_sec) * 1000 + st.st_mtim.tv_nsec / 1000000);
+    info.device = st.st_dev;
+    info.inode = st.st_ino;
+#else
+    const QFileInfo fileInfo(filePath);
+    if (!fileInfo.exists()) {
+        return false;
+    }
+    info.size = fileInfo.size();
+    info.lastModified = fileInfo.lastModified();
+    readFileIdentity(filePath, info.device, info.inode);
+#endif
+    key = hashCacheKey(info);
+    return true;
+}
+
+HashCacheKey BackupFileMonitor::hashCacheKey(const BackupFileInfo &info)
+{
+    HashCacheKey key;
+    key.device = info.device;
+    // Without an inode the path stands in for it; a renamed file is then hashed anew
+    key.inode = info.hasIdentity() ? info.inode : ContentHash::hash(info.filePath.toUtf8());
+    key.size = info.size;
+    key.modifiedMs = info.lastModified.toMSecsSinceEpoch();
+    return key;
 }
 
-bool BackupFileMonitor::isBackupFile(const QString &fileName) const
+bool BackupFileMonitor::isBackupFile(const QString &fileName)
 {
     // Filter backup files by extension or pattern
     // Customize this based on your backup file naming convention
-    QString lower = fileName.toLower();
-    
-    return lower.endsWith(".zip") ||
-           lower.endsWith(".7z") ||
-           lower.endsWith(".tar.gz") ||
-           lower.endsWith(".tar") ||
-           lower.endsWith(".bak") ||
-           lower.endsWith(".backup") ||
-           lower.contains("backup");
+    // Runs for every file of a scan, so it compares without lowercasing copies
+    return fileName.endsWith(".zip", Qt::CaseInsensitive) ||
+           fileName.endsWith(".7z", Qt::CaseInsensitive) ||
+           fileName.endsWith(".tar.gz", Qt::CaseInsensitive) ||
+           fileName.endsWith(".tar", Qt::CaseInsensitive) ||
+           fileName.endsWith(".bak", Qt::CaseInsensitive) ||
+           fileName.endsWith(".backup", Qt::CaseInsensitive) ||
+           fileName.contains("backup", Qt::CaseInsensitive);
 }
 
 QString BackupFileMonitor::findDestinationIdByPath(const QString &path) const
 {
-    // Try exact match first
-    for (auto it = m_destinations.begin(); it != m_destinations.end(); ++it) {
-        if (path.startsWith(it->path)) {
-            return it.key();
-        }
-    }
-    
-    return QString();
+    // Innermost destination containing path, by whole path components
+    return m_pathIndex.value(path);
 }
 
 void BackupFileMonitor::startWatching(const QString &path)
 {
+    // The recursive watcher reports each change itself, so the tree only
+    // needs a full rescan after overflows and on the periodic timer
+    if (m_treeWatcher->isSupported() && m_treeWatcher->addPath(path)) {
+        return;
+    }
+    
     if (!m_fileWatcher->directories().contains(path)) {
         m_fileWatcher->addPath(path);
     }
@@ -608,6 +1494,8 @@ void BackupFileMonitor::startWatching(const QString &path)
 
 void BackupFileMonitor::stopWatching(const QString &path)
 {
+    m_treeWatcher->removePath(path);
+    
     if (m_fileWatcher->directories().contains(path)) {
         m_fileWatcher->removePath(path);
     }
@@ -615,17 +1503,10 @@ void BackupFileMonitor::stopWatching(const QString &path)
 
 void BackupFileMonitor::onDirectoryChanged(const QString &path)
 {
-    QString destinationId = m_pathToDestinationMap.value(path);
-    if (destinationId.isEmpty()) {
-        // Try to find by prefix
-        destinationId = findDestinationIdByPath(path);
-    }
+    QString destinationId = findDestinationIdByPath(path);
     
     if (!destinationId.isEmpty() && m_monitoringEnabled) {
-        // Schedule a scan
-        QTimer::singleShot(1000, this, [this, destinationId]() {
-            scanDestination(destinationId);
-        });
+        requestScan(destinationId);
     }
 }
 
@@ -634,10 +1515,7 @@ void BackupFileMonitor::onFileChanged(const QString &path)
     QString destinationId = findDestinationIdByPath(path);
     
     if (!destinationId.isEmpty() && m_monitoringEnabled) {
-        // Schedule a scan
-        QTimer::singleShot(1000, this, [this, destinationId]() {
-            scanDestination(destinationId);
-        });
+        requestScan(destinationId);
     }
 }
 
@@ -647,3 +1525,132 @@ void BackupFileMonitor::onScanTimerTimeout()
         scanAllDestinations();
     }
 }
+
+BackupFileMonitor::DestinationMonitorInfo *BackupFileMonitor::watchedDestination(const QString &path)
+{
+    if (!m_monitoringEnabled) {
+        return nullptr;
+    }
+    
+    QString destinationId = findDestinationIdByPath(path);
+    if (destinationId.isEmpty()) {
+        return nullptr;
+    }
+    
+    DestinationMonitorInfo &destInfo = m_destinations[destinationId];
+    if (destInfo.activeScanId != 0) {
+        // The listing being taken may predate this event
+        destInfo.rescanQueued = true;
+    }
+    const QString cleanPath = QDir::cleanPath(path);
+    for (DestinationMonitorInfo::SubtreeScan &scan : destInfo.subtreeScans) {
+        // Likewise for a new directory the event is in, or contains
+        if (cleanPath == scan.path || cleanPath.startsWith(scan.path + "/") ||
+            scan.path.startsWith(cleanPath + "/")) {
+            scan.stale = true;
+        }
+    }
+    ensureFilesLoaded(destInfo);
+    return &destInfo;
+}
+
+QStringList BackupFileMonitor::filesBelow(const DestinationMonitorInfo &destInfo, const QString &dirPath)
+{
+    // A linear pass; directories only disappear or move now and then
+    return destInfo.files.filePathsBelow(dirPath);
+}
+
+void BackupFileMonitor::onWatchedFileChanged(const QString &path)
+{
+    if (DestinationMonitorInfo *destInfo = watchedDestination(path)) {
+        applyFileChange(*destInfo, path);
+    }
+}
+
+void BackupFileMonitor::onWatchedFileRemoved(const QString &path)
+{
+    if (DestinationMonitorInfo *destInfo = watchedDestination(path)) {
+        applyFileRemoval(*destInfo, path);
+    }
+}
+
+void BackupFileMonitor::onWatchedFileMoved(const QString &oldPath, const QString &newPath)
+{
+    DestinationMonitorInfo *oldDestInfo = watchedDestination(oldPath);
+    DestinationMonitorInfo *newDestInfo = watchedDestination(newPath);
+    
+    if (oldDestInfo && oldDestInfo == newDestInfo) {
+        applyFileMove(*newDestInfo, oldPath, newPath);
+        return;
+    }
+    
+    // Moved from one destination to another
+    if (oldDestInfo) {
+        applyFileRemoval(*oldDestInfo, oldPath);
+    }
+    if (newDestInfo) {
+        applyFileChange(*newDestInfo, newPath);
+    }
+}
+
+void BackupFileMonitor::onWatchedDirectoryAdded(const QString &path)
+{
+    DestinationMonitorInfo *destInfo = watchedDestination(path);
+    if (!destInfo) {
+        return;
+    }
+    
+    // Only the new directory is listed, not the whole destination; files
+    // written to it from now on are reported by the watcher
+    startSubtreeScan(destInfo->destinationId, QDir::cleanPath(path));
+}
+
+void BackupFileMonitor::onWatchedDirectoryRemoved(const QString &path)
+{
+    DestinationMonitorInfo *destInfo = watchedDestination(path);
+    if (!destInfo) {
+        return;
+    }
+    
+    if (path == QDir::cleanPath(destInfo->path)) {
+        emit scanError(destInfo->destinationId, QString("Destination path was removed: %1").arg(path));
+    }
+    
+    for (const QString &filePath : filesBelow(*destInfo, path)) {
+        applyFileRemoval(*destInfo, filePath);
+    }
+}
+
+void BackupFileMonitor::onWatchedDirectoryMoved(const QString &oldPath, const QString &newPath)
+{
+    DestinationMonitorInfo *oldDestInfo = watchedDestination(oldPath);
+    DestinationMonitorInfo *newDestInfo = watchedDestination(newPath);
+    
+    if (!oldDestInfo || oldDestInfo != newDestInfo) {
+        // Moved from one destination to another
+        onWatchedDirectoryRemoved(oldPath);
+        onWatchedDirectoryAdded(newPath);
+        return;
+    }
+    
+    for (const QString &filePath : filesBelow(*newDestInfo, oldPath)) {
+        applyFileMove(*newDestInfo, filePath, newPath + filePath.mid(oldPath.size()));
+    }
+    
+    // A new directory still being listed is listed again where it went
+    for (DestinationMonitorInfo::SubtreeScan &scan : newDestInfo->subtreeScans) {
+        if (scan.path == oldPath || scan.path.startsWith(oldPath + "/")) {
+            scan.path = newPath + scan.path.mid(oldPath.size());
+        }
+    }
+}
+
+void BackupFileMonitor::onRescanRequired(const QString &path)
+{
+    // Events were lost; only a full scan can tell what changed. Overflows
+    // come in bursts, so wait for the burst to settle.
+    QString destinationId = findDestinationIdByPath(path);
+    if (!destinationId.isEmpty() && m_monitoringEnabled) {
+        requestScan(destinationId);
+    }
+}
@@ -4,11 +4,31 @@
 #include <QObject>
 #include <QFileSystemWatcher>
 #include <QTimer>
+#include <QThreadPool>
+#include <QFuture>
 #include <QMap>
+#include <QHash>
+#include <QVector>
 #include <QDateTime>
+#include <QElapsedTimer>
 #include <QFileInfo>
 #include <QString>
 #include <QList>
+#include <QSharedPointer>
+#include <QTime>
+#include <atomic>
+#include "fileindex.h"
+#include "hashcache.h"
+#include "pathtrie.h"
+
+class InotifyWatcher;
+class MonitorSnapshot;
+class ChangeJournal;
+class BandwidthLimiter;
+
+// Device and inode of path (st_dev, st_ino), following symlinks like
+// QFileInfo. False, leaving both 0, where the platform has no such notion.
+bool readFileIdentity(const QString &path, quint64 &device, quint64 &inode);
 
 // Structure to hold file information
 struct BackupFileInfo {
@@ -17,14 +37,16 @@ struct BackupFileInfo {
     qint64 size;
     QDateTime lastModified;
     QDateTime lastChecked;
-    QString checksum;  // MD5 or SHA256
+    QString checksum;  // ContentHash in hex, once a scrub has read the file
     bool isValid;
+    quint64 device;  // File identity, survives renames; 0 if unknown
+    quint64 inode;
     
     BackupFileInfo() 
-        : size(0), isValid(false) {}
+        : size(0), isValid(false), device(0), inode(0) {}
     
     BackupFileInfo(const QString &path)
-        : filePath(path), size(0), isValid(false) 
+        : filePath(path), size(0), isValid(false), device(0), inode(0) 
     {
         QFileInfo info(path);
         if (info.exists()) {
@@ -33,12 +55,23 @@ struct BackupFileInfo {
             lastModified = info.lastModified();
             lastChecked = QDateTime::currentDateTime();
             isValid = true;
+            readFileIdentity(path, device, inode);
         }
     }
     
     bool operator==(const BackupFileInfo &other) const {
         return filePath == other.filePath;
     }
+    
+    bool hasIdentity() const { return inode != 0; }
+    
+    // Same file under another name: same inode, and untouched since.
+    // Size and time guard against the inode having been reused.
+    bool isSameFileAs(const BackupFileInfo &other) const {
+        return hasIdentity() && device == other.device && inode == other.inode &&
+               size == other.size &&
+               lastModified.toSecsSinceEpoch() == other.lastModified.toSecsSinceEpoch();
+    }
 };
 
 // Structure to track changes
@@ -93,6 +126,11 @@ public:
     QList<FileChangeRecord> getChangeHistory(const QString &destinationId, int maxRecords = 100) const;
     QList<FileChangeRecord> getRecentChanges(int minutes = 60) const;
     
+    // Keep change history on disk (see ChangeJournal) instead of the last
+    // 1000 changes per destination in memory
+    bool openChangeJournal(const QString &directory);
+    void setHistoryRetention(qint64 maxRecords, int maxAgeDays = 0);
+    
     // Statistics
     int getTotalFilesMonitored() const;
     int getFileCountInDestination(const QString &destinationId) const;
@@ -100,13 +138,34 @@ public:
     qint64 getSizeInDestination(const QString &destinationId) const;
     QDateTime getLastScanTime(const QString &destinationId) const;
     
+    // Heap bytes of the in-memory file indexes, in all and per file;
+    // destinations still only in the state snapshot take none
+    qint64 getIndexMemoryUsage() const;
+    double getIndexBytesPerFile() const;
+    
     // File validation
     bool verifyFileIntegrity(const QString &filePath);
-    QStringList findCorruptedFiles(const QString &destinationId);
+    QStringList findCorruptedFiles(const QString &destinationId);  // Reads every file; blocks
+    
+    // Scrubbing: files are read back and hashed in parallel, and contents
+    // that changed while size and modification time did not are reported
+    // as corrupted. Hashes are kept in a HashCache file across restarts; a
+    // scrub that runs out of time continues where it stopped next time.
+    bool openHashCache(const QString &filePath);
+    void setScrubWindow(const QTime &start, int maxMinutes);  // Daily; an invalid start disables it
+    void setScrubRateLimit(qint64 bytesPerSecond);  // Over all threads; 0 is unlimited
+    void setScrubThreadCount(int threadCount);
+    void startScrub(qint64 timeLimitMsecs = 0);  // No new files are started after timeLimitMsecs; 0 runs the whole pass
+    void stopScrub();
+    bool isScrubbing() const { return !m_scrub.isNull(); }
     
-    // Persistence
+    // Persistence. State is kept in a binary snapshot (see MonitorSnapshot);
+    // loadState also reads the JSON state of older versions.
     bool saveState(const QString &filePath);
     bool loadState(const QString &filePath);
+    
+    // Readable dump of the same state, for debugging
+    bool exportStateJson(const QString &filePath);
 
 signals:
     void fileAdded(const QString &destinationId, const QString &filePath, const BackupFileInfo &info);
@@ -123,6 +182,9 @@ signals:
     void changeDetected(const QString &destinationId, const FileChangeRecord &change);
     void corruptedFileFound(const QString &filePath, const QString &reason);
     
+    void scrubStarted();
+    void scrubFinished(int filesChecked, int corruptedFiles, bool passCompleted);
+    
     void monitoringStateChanged(bool enabled);
     void error(const QString &errorMessage);
 
@@ -130,36 +192,157 @@ private slots:
     void onDirectoryChanged(const QString &path);
     void onFileChanged(const QString &path);
     void onScanTimerTimeout();
+    void onScrubTimerTimeout();
+
+    // Events from the recursive watcher, applied without rescanning
+    void onWatchedFileChanged(const QString &path);
+    void onWatchedFileRemoved(const QString &path);
+    void onWatchedFileMoved(const QString &oldPath, const QString &newPath);
+    void onWatchedDirectoryAdded(const QString &path);
+    void onWatchedDirectoryRemoved(const QString &path);
+    void onWatchedDirectoryMoved(const QString &oldPath, const QString &newPath);
+    void onRescanRequired(const QString &path);
 
 private:
     struct DestinationMonitorInfo {
         QString destinationId;
         QString path;
-        QMap<QString, BackupFileInfo> files;  // filePath -> info
-        QList<FileChangeRecord> changeHistory;
+        FileIndex files;
+        QList<FileChangeRecord> changeHistory;  // Only used without a change journal
         QDateTime lastScan;
         int fileCount;
         qint64 totalSize;
+        quint64 activeScanId;  // Scan running on the pool, 0 if none
+        bool rescanQueued;     // Asked for again while that scan ran
+        
+        // Directories that appeared, being listed on the pool: scan id -> directory
+        struct SubtreeScan {
+            QString path;
+            bool stale;  // Events below it arrived meanwhile; list it again
+        };
+        QHash<quint64, SubtreeScan> subtreeScans;
         
-        DestinationMonitorInfo() : fileCount(0), totalSize(0) {}
+        // Snapshot the files were loaded from, while they still match it;
+        // until filesLoaded is set, files is empty and they are only there
+        QSharedPointer<const MonitorSnapshot> snapshot;
+        int snapshotIndex;
+        bool filesLoaded;
+        
+        DestinationMonitorInfo()
+            : fileCount(0), totalSize(0), activeScanId(0), rescanQueued(false)
+            , snapshotIndex(-1), filesLoaded(true) {}
+    };
+    
+    // What a scan learns about a file; the rest of BackupFileInfo is only
+    // filled in for files that are new to the index
+    struct ScannedFile {
+        QString filePath;
+        qint64 size;
+        qint64 modifiedMs;
+        quint64 device;
+        quint64 inode;
     };
     
-    QFileSystemWatcher *m_fileWatcher;
+    struct ScanResult {
+        QVector<ScannedFile> files;
+        QString error;
+        QSharedPointer<FileIndex> savedFiles;  // Decoded from the snapshot, if not loaded yet
+    };
+    
+    enum class ScrubOutcome {
+        Pending,
+        Hashed,
+        Skipped,    // Gone, or changed while it was read
+        ReadFailed,
+        Cancelled
+    };
+    
+    struct ScrubItem {
+        QString destinationId;
+        QString filePath;
+        ScrubOutcome outcome = ScrubOutcome::Pending;
+        HashCacheKey key;  // Metadata the hash was taken at
+        quint64 hash = 0;
+        QString error;
+    };
+    
+    // Files of one scrub, claimed in order by the workers
+    struct ScrubRun {
+        QVector<ScrubItem> items;
+        std::atomic<int> next{0};
+        std::atomic<bool> cancelled{false};
+        QElapsedTimer clock;
+        qint64 budgetMs = 0;  // No new files after this; 0 for none
+        int workers = 0;
+        int finishedWorkers = 0;
+    };
+    
+    // Bytes read from a file at a time while scrubbing
+    static const int ScrubReadSize = 1024 * 1024;
+    
+    // Quiet period after the last change before a destination is rescanned
+    static const int ScanDebounceMsecs = 1000;
+    
+    QFileSystemWatcher *m_fileWatcher;  // Top level only; used where inotify isn't available
+    InotifyWatcher *m_treeWatcher;
+    ChangeJournal *m_journal;
     QTimer *m_scanTimer;
     bool m_monitoringEnabled;
     int m_scanIntervalMinutes;
     
     QMap<QString, DestinationMonitorInfo> m_destinations;  // destinationId -> monitor info
-    QMap<QString, QString> m_pathToDestinationMap;  // path -> destinationId
+    PathTrie<QString> m_pathIndex;  // Destination path -> destinationId, for events below it
+    
+    // Scans walk the tree on the pool and are applied on this object's thread
+    QThreadPool m_scanPool;
+    QMap<QString, QTimer*> m_debounceTimers;  // destinationId -> pending scan
+    quint64 m_lastScanId;
+    
+    // Scrubbing
+    HashCache m_hashCache;
+    QString m_hashCachePath;
+    QSharedPointer<ScrubRun> m_scrub;  // Running scrub, if any
+    QThreadPool m_scrubPool;
+    BandwidthLimiter *m_scrubLimiter;
+    QTimer *m_scrubTimer;
+    QTime m_scrubWindowStart;
+    int m_scrubWindowMinutes;
     
     // Internal methods
-    void scanDestinationInternal(DestinationMonitorInfo &destInfo);
-    void scanDirectory(const QString &dirPath, QList<BackupFileInfo> &fileList);
-    void detectChanges(DestinationMonitorInfo &destInfo, const QList<BackupFileInfo> &currentFiles);
+    void requestScan(const QString &destinationId);
+    void cancelScanRequest(const QString &destinationId);
+    void startScan(const QString &destinationId);
+    void startSubtreeScan(const QString &destinationId, const QString &dirPath);
+    void watchScan(const QString &destinationId, quint64 scanId, const QFuture<ScanResult> &future);
+    void applyScanResult(const QString &destinationId, quint64 scanId, const ScanResult &result);
+    static void scanDirectory(const QString &dirPath, QVector<ScannedFile> &fileList);
+    static void scanDirectory(const QString &dirPath, ScanResult &result);
+    void applyScannedFile(DestinationMonitorInfo &destInfo, const ScannedFile &scanned, const QDateTime &checkTime);
+    int detectChanges(DestinationMonitorInfo &destInfo, const QVector<ScannedFile> &currentFiles);
+    void ensureFilesLoaded(DestinationMonitorInfo &destInfo);
+    bool loadStateJson(const QString &filePath);
     void recordChange(DestinationMonitorInfo &destInfo, const FileChangeRecord &change);
+    void recordAdded(DestinationMonitorInfo &destInfo, const BackupFileInfo &newInfo);
+    void recordModified(DestinationMonitorInfo &destInfo, const BackupFileInfo &oldInfo, const BackupFileInfo &newInfo);
+    void recordDeleted(DestinationMonitorInfo &destInfo, const BackupFileInfo &oldInfo);
+    void recordRenamed(DestinationMonitorInfo &destInfo, const BackupFileInfo &oldInfo, const BackupFileInfo &newInfo);
+    
+    // Bring one file of the in-memory listing up to date
+    void applyFileChange(DestinationMonitorInfo &destInfo, const QString &filePath);
+    void applyFileRemoval(DestinationMonitorInfo &destInfo, const QString &filePath);
+    void applyFileMove(DestinationMonitorInfo &destInfo, const QString &oldPath, const QString &newPath);
+    DestinationMonitorInfo *watchedDestination(const QString &path);
+    static QStringList filesBelow(const DestinationMonitorInfo &destInfo, const QString &dirPath);
     
-    QString calculateChecksum(const QString &filePath);
-    bool isBackupFile(const QString &fileName) const;
+    void startScrubWorkers(const QSharedPointer<ScrubRun> &run);
+    void finishScrub();
+    int applyScrubResults(const ScrubRun &run, QStringList *corruptedFiles = nullptr);
+    void armScrubTimer();
+    static void runScrubWorker(ScrubRun *run, BandwidthLimiter *limiter);
+    static ScrubOutcome hashFileForScrub(ScrubItem &item, BandwidthLimiter *limiter, const std::atomic<bool> &cancelled);
+    static bool readHashCacheKey(const QString &filePath, HashCacheKey &key);
+    static HashCacheKey hashCacheKey(const BackupFileInfo &info);
+    static bool isBackupFile(const QString &fileName);
     QString findDestinationIdByPath(const QString &path) const;
     
     void startWatching(const QString &path);
@@ -0,0 +1,467 @@
+#include "backupfilter.h"
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+
+namespace {
+
+#ifdef Q_OS_WIN
+const QRegularExpression::PatternOptions kPatternOptions = QRegularExpression::CaseInsensitiveOption;
+
+QString foldCase(const QString &name)
+{
+    return name.toCaseFolded();
+}
+#else
+const QRegularExpression::PatternOptions kPatternOptions = QRegularExpression::NoPatternOption;
+
+const QString &foldCase(const QString &name)
+{
+    return name;
+}
+#endif
+
+bool hasWildcard(const QString &glob)
+{
+    for (QChar c : glob) {
+        if (c == '*' || c == '?' || c == '[' || c == '\\') {
+            return true;
+        }
+    }
+    return false;
+}
+
+// .gitignore wildcards: * and ? stay within a component, "**" as a whole
+// component spans any number of them, [...] is a character class and a
+// backslash escapes the next character
+QString globToRegularExpression(const QString &glob)
+{
+    QString expression;
+    expression.reserve(glob.size() * 2 + 8);
+
+    const int length = glob.size();
+    for (int i = 0; i < length; ++i) {
+        const QChar c = glob.at(i);
+        if (c == '*') {
+            const bool wholeComponent = (i == 0 || glob.at(i - 1) == '/') &&
+                                        i + 1 < length && glob.at(i + 1) == '*' &&
+                                        (i + 2 == length || glob.at(i + 2) == '/');
+            if (wholeComponent && i + 2 == length) {
+                expression += ".*";
+                i += 1;
+            } else if (wholeComponent) {
+                expression += "(?:.*/)?";
+                i += 2;
+            } else {
+                expression += "[^/]*";
+                while (i + 1 < length && glob.at(i + 1) == '*') {
+                    ++i;
+                }
+            }
+        } else if (c == '?') {
+            expression += "[^/]";
+        } else if (c == '[') {
+            int end = i + 1;
+            if (end < length && (glob.at(end) == '!' || glob.at(end) == '^')) {
+                ++end;
+            }
+            if (end < length && glob.at(end) == ']') {
+                ++end;
+            }
+            while (end < length && glob.at(end) != ']') {
+                ++end;
+            }
+            if (end >= length) {
+                expression += "\\[";  // Unterminated: a literal bracket
+                continue;
+            }
+            QString set = glob.mid(i + 1, end - i - 1);
+            if (set.startsWith('!')) {
+                set[0] = '^';
+            }
+            set.replace("\\", "\\\\");
+            expression += '[' + set + ']';
+            i = end;
+        } else if (c == '\\' && i + 1 < length) {
+            expression += QRegularExpression::escape(QString(glob.at(++i)));
+        } else {
+            expression += QRegularExpression::escape(QString(c));
+        }
+    }
+
+    return "\\A(?:" + expression + ")\\z";
+}
+
+} // namespace
+
+FilterRule FilterRule::glob(const QString &pattern, bool include)
+{
+    FilterRule rule;
+    rule.type = Type::Glob;
+    rule.pattern = pattern;
+    rule.include = include;
+    return rule;
+}
+
+FilterRule FilterRule::regex(const QString &pattern, bool include)
+{
+    FilterRule rule;
+    rule.type = Type::Regex;
+    rule.pattern = pattern;
+    rule.include = include;
+    return rule;
+}
+
+FilterRule FilterRule::largerThan(qint64 bytes)
+{
+    FilterRule rule;
+    rule.type = Type::LargerThan;
+    rule.limit = bytes;
+    return rule;
+}
+
+FilterRule FilterRule::olderThan(int days)
+{
+    FilterRule rule;
+    rule.type = Type::OlderThan;
+    rule.limit = days;
+    return rule;
+}
+
+QString FilterRule::toString() const
+{
+    switch (type) {
+        case Type::Glob:
+            return (include ? "!" : "") + pattern;
+        case Type::Regex:
+            return QString(include ? "!regex:" : "regex:") + pattern;
+        case Type::LargerThan:
+            return QString("larger than %1 bytes").arg(limit);
+        case Type::OlderThan:
+            return QString("older than %1 days").arg(limit);
+    }
+    return QString();
+}
+
+QJsonObject FilterRule::toJson() const
+{
+    QJsonObject json;
+    switch (type) {
+        case Type::Glob:
+            json["type"] = "glob";
+            break;
+        case Type::Regex:
+            json["type"] = "regex";
+            break;
+        case Type::LargerThan:
+            json["type"] = "largerThan";
+            break;
+        case Type::OlderThan:
+            json["type"] = "olderThan";
+            break;
+    }
+    if (type == Type::Glob || type == Type::Regex) {
+        json["pattern"] = pattern;
+        json["include"] = include;
+    } else {
+        json["limit"] = QString::number(limit);
+    }
+    return json;
+}
+
+FilterRule FilterRule::fromJson(const QJsonObject &json)
+{
+    const QString type = json["type"].toString();
+    if (type == "regex") {
+        return regex(json["pattern"].toString(), json["include"].toBool());
+    }
+    if (type == "largerThan") {
+        return largerThan(json["limit"].toString().toLongLong());
+    }
+    if (type == "olderThan") {
+        return olderThan(json["limit"].toString().toInt());
+    }
+    return glob(json["pattern"].toString(), json["include"].toBool());
+}
+
+void BackupFilter::Layer::addGlob(const QString &glob, bool include, int slot)
+{
+    QString text = glob;
+    Pattern pattern;
+    pattern.slot = slot;
+    pattern.include = include;
+
+    if (text.endsWith('/')) {
+        pattern.directoryOnly = true;
+        text.chop(1);
+    }
+    if (text.startsWith('/')) {
+        pattern.matchesPath = true;
+        text.remove(0, 1);
+    } else if (text.contains('/')) {
+        pattern.matchesPath = true;
+    }
+    if (text.isEmpty()) {
+        return;
+    }
+
+    const int index = patterns.size();
+    if (!pattern.matchesPath && !hasWildcard(text)) {
+        (pattern.directoryOnly ? dirNames : names).insert(foldCase(text), index);
+    } else if (!pattern.matchesPath && !pattern.directoryOnly && text.startsWith("*.") &&
+               !hasWildcard(text.mid(2)) && !text.mid(2).contains('.')) {
+        extensions.insert(foldCase(text.mid(2)), index);
+    } else {
+        pattern.expression = QRegularExpression(globToRegularExpression(text), kPatternOptions);
+        pattern.expression.optimize();
+        expressions.append(index);
+    }
+    patterns.append(pattern);
+}
+
+void BackupFilter::Layer::addRegex(const QString &regex, bool include, int slot)
+{
+    Pattern pattern;
+    pattern.slot = slot;
+    pattern.include = include;
+    pattern.matchesPath = true;
+    pattern.expression = QRegularExpression(regex, kPatternOptions);
+    if (!pattern.expression.isValid()) {
+        qWarning() << "Invalid filter expression ignored:" << regex << pattern.expression.errorString();
+        return;
+    }
+    pattern.expression.optimize();
+
+    expressions.append(patterns.size());
+    patterns.append(pattern);
+}
+
+int BackupFilter::Layer::match(const QString &relativePath, const QString &name, bool isDirectory) const
+{
+    // Last matching pattern wins; hash hits give candidates, expressions
+    // only need to be run while they could still beat the best one
+    int best = -1;
+    if (!names.isEmpty() || !dirNames.isEmpty()) {
+        const QString &key = foldCase(name);
+        best = qMax(best, names.value(key, -1));
+        if (isDirectory) {
+            best = qMax(best, dirNames.value(key, -1));
+        }
+    }
+    if (!extensions.isEmpty() && !isDirectory) {
+        const int dot = name.lastIndexOf('.');
+        if (dot >= 0) {
+            best = qMax(best, extensions.value(foldCase(name.mid(dot + 1)), -1));
+        }
+    }
+
+    if (expressions.isEmpty() || expressions.last() < best) {
+        return best;
+    }
+
+    const QString path = base.isEmpty() ? relativePath : relativePath.mid(base.size());
+    for (int i = expressions.size() - 1; i >= 0 && expressions.at(i) > best; --i) {
+        const Pattern &pattern = patterns.at(expressions.at(i));
+        if (pattern.directoryOnly && !isDirectory) {
+            continue;
+        }
+        if (pattern.expression.match(pattern.matchesPath ? path : name).hasMatch()) {
+            return expressions.at(i);
+        }
+    }
+    return best;
+}
+
+BackupFilter::BackupFilter(const QList<FilterRule> &rules, const QString &ignoreFileName)
+    : m_ignoreFileName(ignoreFileName)
+{
+    QSharedPointer<Layer> layer(new Layer());
+
+    for (const FilterRule &rule : rules) {
+        const int slot = m_stats.size();
+        FilterRuleStats stats;
+        stats.rule = rule.toString();
+        m_stats.append(stats);
+
+        switch (rule.type) {
+            case FilterRule::Type::Glob:
+                layer->addGlob(rule.pattern, rule.include, slot);
+                break;
+            case FilterRule::Type::Regex:
+                layer->addRegex(rule.pattern, rule.include, slot);
+                break;
+            case FilterRule::Type::LargerThan:
+            case FilterRule::Type::OlderThan:
+                m_limits.append({rule.type, rule.limit, slot});
+                break;
+        }
+    }
+
+    m_ruleCount = m_stats.size();
+    if (!layer->patterns.isEmpty()) {
+        m_layer = layer;
+    }
+}
+
+QSharedPointer<const BackupFilter::Layer> BackupFilter::loadIgnoreFile(const QString &filePath, const QString &base)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        qWarning() << "Failed to read ignore file:" << filePath;
+        return QSharedPointer<const Layer>();
+    }
+
+    QSharedPointer<Layer> layer(new Layer());
+    layer->base = base;
+
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        QString line = in.readLine();
+        while (line.endsWith(' ') && !line.endsWith("\\ ")) {
+            line.chop(1);
+        }
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+
+        const bool include = line.startsWith('!');
+        const QString glob = include ? line.mid(1) : line;
+
+        FilterRuleStats stats;
+        stats.rule = base + m_ignoreFileName + ": " + line;
+        m_stats.append(stats);
+        layer->addGlob(glob, include, m_stats.size() - 1);
+    }
+
+    if (layer->patterns.isEmpty()) {
+        return QSharedPointer<const Layer>();
+    }
+    return layer;
+}
+
+const BackupFilter::Pattern *BackupFilter::decide(const LayerStack &layers, const QString &relativePath,
+                                                  const QString &name, bool isDirectory)
+{
+    // Deeper layers come later, so the first one with a match has the last word
+    for (int i = layers.size() - 1; i >= 0; --i) {
+        const Layer &layer = *layers.at(i);
+        const int index = layer.match(relativePath, name, isDirectory);
+        if (index >= 0) {
+            return &layer.patterns.at(index);
+        }
+    }
+    return nullptr;
+}
+
+QStringList BackupFilter::selectFiles(const QString &root, const std::atomic<bool> *stop)
+{
+    while (m_stats.size() > m_ruleCount) {
+        m_stats.removeLast();
+    }
+    for (FilterRuleStats &stats : m_stats) {
+        stats.files = 0;
+        stats.directories = 0;
+        stats.bytes = 0;
+    }
+
+    const qint64 nowMs = QDateTime::currentMSecsSinceEpoch();
+
+    struct Directory {
+        QString relativePath;  // With trailing '/', empty for root
+        LayerStack layers;
+    };
+
+    QStringList files;
+    QVector<Directory> pending;
+    Directory top;
+    if (m_layer) {
+        top.layers.append(m_layer);
+    }
+    pending.append(top);
+
+    while (!pending.isEmpty()) {
+        if (stop && *stop) {
+            break;
+        }
+
+        Directory directory = pending.takeLast();
+        const QString absolutePath = root + "/" + directory.relativePath;
+
+        if (!m_ignoreFileName.isEmpty()) {
+            const QString ignoreFile = absolutePath + m_ignoreFileName;
+            if (QFile::exists(ignoreFile)) {
+                QSharedPointer<const Layer> layer = loadIgnoreFile(ignoreFile, directory.relativePath);
+                if (layer) {
+                    directory.layers.append(layer);
+                }
+            }
+        }
+
+        // Symlinked directories are listed but, as before filters existed, not followed
+        QDirIterator it(absolutePath, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+        while (it.hasNext()) {
+            it.next();
+            const QFileInfo info = it.fileInfo();
+            const bool isDirectory = info.isDir();
+            if (isDirectory && info.isSymLink()) {
+                continue;
+            }
+
+            const QString name = it.fileName();
+            const QString relativePath = directory.relativePath + name;
+
+            const Pattern *pattern = directory.layers.isEmpty()
+                ? nullptr : decide(directory.layers, relativePath, name, isDirectory);
+            if (pattern && !pattern->include) {
+                FilterRuleStats &stats = m_stats[pattern->slot];
+                if (isDirectory) {
+                    ++stats.directories;
+                } else {
+                    ++stats.files;
+                    stats.bytes += info.size();
+                }
+                continue;
+            }
+
+            if (isDirectory) {
+                Directory child;
+                child.relativePath = relativePath + "/";
+                child.layers = directory.layers;
+                pending.append(child);
+                if (pattern) {
+                    ++m_stats[pattern->slot].directories;
+                }
+                continue;
+            }
+
+            const Limit *excludedBy = nullptr;
+            for (const Limit &limit : m_limits) {
+                if ((limit.type == FilterRule::Type::LargerThan && info.size() > limit.limit) ||
+                    (limit.type == FilterRule::Type::OlderThan &&
+                     info.lastModified().toMSecsSinceEpoch() < nowMs - limit.limit * 24 * 3600 * 1000)) {
+                    excludedBy = &limit;
+                    break;
+                }
+            }
+            if (excludedBy) {
+                FilterRuleStats &stats = m_stats[excludedBy->slot];
+                ++stats.files;
+                stats.bytes += info.size();
+                continue;
+            }
+
+            if (pattern) {
+                FilterRuleStats &stats = m_stats[pattern->slot];
+                ++stats.files;
+                stats.bytes += info.size();
+            }
+            files.append(relativePath);
+        }
+    }
+
+    return files;
+}
@@ -0,0 +1,117 @@
+#ifndef BACKUPFILTER_H
+#define BACKUPFILTER_H
+
+#include <QHash>
+#include <QJsonObject>
+#include <QList>
+#include <QMetaType>
+#include <QRegularExpression>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <atomic>
+
+// One include/exclude rule of a backup source
+struct FilterRule
+{
+    enum class Type {
+        Glob,        // .gitignore syntax, e.g. "node_modules/", "*.o", "/build", "docs/**/*.tmp"
+        Regex,       // Searched in the path relative to the source root
+        LargerThan,  // Files of more than limit bytes
+        OlderThan    // Files not modified in the last limit days
+    };
+
+    Type type = Type::Glob;
+    bool include = false;  // Globs and regexes: keep what matches ("!pattern") instead of excluding it
+    QString pattern;
+    qint64 limit = 0;
+
+    static FilterRule glob(const QString &pattern, bool include = false);
+    static FilterRule regex(const QString &pattern, bool include = false);
+    static FilterRule largerThan(qint64 bytes);
+    static FilterRule olderThan(int days);
+
+    QString toString() const;
+    QJsonObject toJson() const;
+    static FilterRule fromJson(const QJsonObject &json);
+};
+
+// What a rule kept out of (or, for include rules, let into) the last walk.
+// Directories count the directories skipped whole; their contents are
+// never listed, so their files and bytes are not known.
+struct FilterRuleStats
+{
+    QString rule;
+    qint64 files = 0;
+    qint64 directories = 0;
+    qint64 bytes = 0;
+};
+
+Q_DECLARE_METATYPE(FilterRuleStats)
+
+// A source's rules compiled for enumeration. Globs and regexes are tried
+// in order and the last one matching a path decides, as in .gitignore;
+// patterns of ignore files found during the walk (ignoreFileName) follow
+// the source's own rules and apply below their directory. Literal names
+// and "*.ext" patterns are hash lookups, so the per-file cost stays flat
+// however many of them there are. An excluded directory is not listed at
+// all. Size and age limits apply to files the patterns keep.
+class BackupFilter
+{
+public:
+    BackupFilter() = default;
+    explicit BackupFilter(const QList<FilterRule> &rules, const QString &ignoreFileName = QString());
+
+    bool isEmpty() const { return m_layer.isNull() && m_limits.isEmpty() && m_ignoreFileName.isEmpty(); }
+
+    // Relative paths, with '/' separators, of the files below root to back
+    // up. Stops early, returning what it has, once stop is set.
+    QStringList selectFiles(const QString &root, const std::atomic<bool> *stop = nullptr);
+
+    // Hits of each rule in the last selectFiles(), source rules first in
+    // their order, then ignore file patterns as they were found
+    QList<FilterRuleStats> statistics() const { return m_stats; }
+
+private:
+    struct Pattern {
+        int slot = -1;               // Index into m_stats
+        bool include = false;
+        bool directoryOnly = false;
+        bool matchesPath = false;    // Relative path (below the layer's base) rather than name
+        QRegularExpression expression;
+    };
+
+    // Patterns of one rule list or ignore file, matched below base
+    struct Layer {
+        QString base;                   // Relative directory with trailing '/', empty at the root
+        QVector<Pattern> patterns;
+        QHash<QString, int> names;      // Literal name -> last pattern with it
+        QHash<QString, int> dirNames;   // Same, for directory-only patterns
+        QHash<QString, int> extensions; // "*.ext" -> last pattern with it
+        QVector<int> expressions;       // Patterns that need their expression run
+
+        void addGlob(const QString &glob, bool include, int slot);
+        void addRegex(const QString &regex, bool include, int slot);
+        int match(const QString &relativePath, const QString &name, bool isDirectory) const;
+    };
+    typedef QVector<QSharedPointer<const Layer>> LayerStack;
+
+    struct Limit {
+        FilterRule::Type type;
+        qint64 limit;
+        int slot;
+    };
+
+    QSharedPointer<const Layer> m_layer;  // Null without pattern rules
+    QVector<Limit> m_limits;
+    QString m_ignoreFileName;
+    QList<FilterRuleStats> m_stats;
+    int m_ruleCount = 0;                  // Stats slots of the source's own rules
+
+    QSharedPointer<const Layer> loadIgnoreFile(const QString &filePath, const QString &base);
+    static const Pattern *decide(const LayerStack &layers, const QString &relativePath,
+                                 const QString &name, bool isDirectory);
+};
+
+#endif // BACKUPFILTER_H
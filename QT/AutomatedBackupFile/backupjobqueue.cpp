@@ -0,0 +1,288 @@
+#include "backupjobqueue.h"
+#include <QDebug>
+#include <QDir>
+#include <QDateTime>
+
+namespace {
+
+// Whether one folder is the other or inside it, on whole path components:
+// /mnt/disk holds /mnt/disk/sub but not /mnt/disk2
+bool pathsOverlap(const QString &a, const QString &b)
+{
+    if (a == b) {
+        return true;
+    }
+    const QString &shorter = a.size() < b.size() ? a : b;
+    const QString &longer = a.size() < b.size() ? b : a;
+    return longer.startsWith(shorter.endsWith('/') ? shorter : shorter + '/');
+}
+
+} // namespace
+
+BackupJobQueue::BackupJobQueue(QObject *parent)
+    : QObject(parent)
+    , m_maxConcurrentJobs(qMax(2, QThread::idealThreadCount()))
+    , m_nextJobNumber(1)
+{
+    // Workers report filter statistics from their own threads
+    qRegisterMetaType<QList<FilterRuleStats>>("QList<FilterRuleStats>");
+}
+
+BackupJobQueue::~BackupJobQueue()
+{
+    cancelAll();
+}
+
+QString BackupJobQueue::enqueue(const std::vector<std::pair<QString, QString>>& sourceDestPairs,
+                                const QMap<QString, BackupFilter>& filters,
+                                const BackupPlacement& placement)
+{
+    BackupJob job;
+    job.id = QString("job-%1-%2")
+        .arg(QDateTime::currentDateTime().toString("yyyyMMddhhmmss"))
+        .arg(m_nextJobNumber++);
+    job.sourceDestPairs = sourceDestPairs;
+    job.filters = filters;
+    job.placement = placement;
+
+    // Resolve the devices behind every path up front so admission is cheap
+    for (const auto& pair : sourceDestPairs) {
+        StorageDeviceInfo sourceDevice = StorageDeviceResolver::resolve(pair.first);
+        StorageDeviceInfo destDevice = StorageDeviceResolver::resolve(pair.second);
+
+        for (const StorageDeviceInfo &device : {sourceDevice, destDevice}) {
+            if (!job.deviceIds.contains(device.deviceId)) {
+                job.deviceIds.append(device.deviceId);
+            }
+            if (!m_deviceLimits.contains(device.deviceId)) {
+                m_deviceLimits[device.deviceId] = device.maxConcurrentStreams;
+            }
+        }
+
+        job.destinationDeviceIds.append(destDevice.deviceId);
+        job.destinationPaths.append(QDir::cleanPath(QDir(pair.second).absolutePath()));
+    }
+
+    qDebug() << "Queued backup job" << job.id << "on devices" << job.deviceIds;
+
+    m_pending.append(job);
+    emit jobQueued(job.id);
+
+    dispatch();
+    return job.id;
+}
+
+void BackupJobQueue::cancelJob(const QString &jobId)
+{
+    for (int i = 0; i < m_pending.size(); ++i) {
+        if (m_pending[i].id == jobId) {
+            m_pending.removeAt(i);
+            emit jobFailed(jobId, "Backup cancelled by user");
+            if (isIdle()) {
+                emit queueIdle();
+            }
+            return;
+        }
+    }
+
+    auto it = m_running.find(jobId);
+    if (it != m_running.end()) {
+        // The worker reports the cancellation and the thread finishes normally
+        it->worker->stop();
+    }
+}
+
+void BackupJobQueue::cancelAll()
+{
+    QList<BackupJob> pending = m_pending;
+    m_pending.clear();
+    for (const BackupJob &job : pending) {
+        emit jobFailed(job.id, "Backup cancelled by user");
+    }
+
+    for (auto it = m_running.begin(); it != m_running.end(); ++it) {
+        it->worker->stop();
+    }
+
+    // Wait for every worker to unwind, then clean up here instead of in the
+    // queued finished handler, which may never run if we are being destroyed
+    QMap<QString, RunningJob> running = m_running;
+    m_running.clear();
+    for (auto it = running.begin(); it != running.end(); ++it) {
+        it->thread->quit();
+        it->thread->wait();
+        releaseJob(it.value());
+    }
+}
+
+void BackupJobQueue::setMaxConcurrentJobs(int count)
+{
+    m_maxConcurrentJobs = qMax(1, count);
+    dispatch();
+}
+
+void BackupJobQueue::setDeviceStreamLimit(const QString &deviceId, int limit)
+{
+    m_deviceLimits[deviceId] = qMax(1, limit);
+    dispatch();
+}
+
+int BackupJobQueue::getDeviceStreamLimit(const QString &deviceId) const
+{
+    return m_deviceLimits.value(deviceId, 1);
+}
+
+QStringList BackupJobQueue::getPendingJobIds() const
+{
+    QStringList ids;
+    for (const BackupJob &job : m_pending) {
+        ids.append(job.id);
+    }
+    return ids;
+}
+
+QList<const BackupWorker*> BackupJobQueue::getRunningWorkers() const
+{
+    QList<const BackupWorker*> workers;
+    for (auto it = m_running.begin(); it != m_running.end(); ++it) {
+        workers.append(it->worker);
+    }
+    return workers;
+}
+
+bool BackupJobQueue::canAdmit(const BackupJob &job) const
+{
+    if (m_running.size() >= m_maxConcurrentJobs) {
+        return false;
+    }
+
+    for (const QString &deviceId : job.deviceIds) {
+        if (m_activeStreams.value(deviceId, 0) >= getDeviceStreamLimit(deviceId)) {
+            return false;
+        }
+    }
+
+    // Two jobs writing into the same destination folder, or one into the
+    // other's, would clobber each other's temporary and encrypted trees
+    for (auto it = m_running.begin(); it != m_running.end(); ++it) {
+        for (const QString &path : job.destinationPaths) {
+            for (const QString &runningPath : it->job.destinationPaths) {
+                if (pathsOverlap(path, runningPath)) {
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
+void BackupJobQueue::dispatch()
+{
+    // Jobs are started in queue order, but a job whose devices are busy does
+    // not hold back later jobs that only touch idle devices
+    for (int i = 0; i < m_pending.size() && m_running.size() < m_maxConcurrentJobs; ) {
+        if (canAdmit(m_pending[i])) {
+            BackupJob job = m_pending.takeAt(i);
+            startJob(job);
+        } else {
+            ++i;
+        }
+    }
+}
+
+void BackupJobQueue::startJob(const BackupJob &job)
+{
+    // A destination shares its device's throughput with the jobs already
+    // writing to it
+    BackupPlacement placement = job.placement;
+    for (int i = 0; i < job.destinationDeviceIds.size(); ++i) {
+        auto target = placement.targets.find(job.sourceDestPairs[i].second);
+        if (target != placement.targets.end()) {
+            target->activeStreams = m_activeStreams.value(job.destinationDeviceIds[i], 0);
+        }
+    }
+
+    RunningJob running;
+    running.job = job;
+    running.thread = new QThread();
+    running.worker = new BackupWorker(job.sourceDestPairs, job.filters, placement);
+    running.worker->moveToThread(running.thread);
+
+    for (const QString &deviceId : job.deviceIds) {
+        m_activeStreams[deviceId]++;
+    }
+
+    const QString jobId = job.id;
+    BackupWorker *worker = running.worker;
+    QThread *thread = running.thread;
+
+    connect(thread, &QThread::started, worker, &BackupWorker::startBackup);
+    connect(worker, &BackupWorker::progressUpdated, this, [this, jobId](int progress) {
+        emit jobProgress(jobId, progress);
+    });
+    connect(worker, &BackupWorker::fileProcessed, this, [this, jobId](const QString &filename) {
+        emit jobFileProcessed(jobId, filename);
+    });
+    connect(worker, &BackupWorker::filterStatistics, this,
+            [this, jobId](const QString &sourcePath, const QList<FilterRuleStats> &stats) {
+        emit jobFilterStatistics(jobId, sourcePath, stats);
+    });
+    connect(worker, &BackupWorker::destinationThroughput, this,
+            [this, jobId](const QString &destinationPath, qint64 bytes, qint64 msecs) {
+        emit jobThroughput(jobId, destinationPath, bytes, msecs);
+    });
+    connect(worker, &BackupWorker::backupCompleted, this, [this, jobId]() {
+        emit jobCompleted(jobId);
+    });
+    connect(worker, &BackupWorker::backupFailed, this, [this, jobId](const QString &error) {
+        emit jobFailed(jobId, error);
+    });
+
+    connect(worker, &BackupWorker::backupCompleted, thread, &QThread::quit);
+    connect(worker, &BackupWorker::backupFailed, thread, &QThread::quit);
+    connect(thread, &QThread::finished, this, [this, jobId]() {
+        finishJob(jobId);
+    }, Qt::QueuedConnection);
+
+    m_running.insert(jobId, running);
+
+    qDebug() << "Starting backup job" << jobId
+             << "(" << m_running.size() << "running," << m_pending.size() << "pending)";
+
+    emit jobStarted(jobId);
+    thread->start();
+}
+
+void BackupJobQueue::finishJob(const QString &jobId)
+{
+    auto it = m_running.find(jobId);
+    if (it == m_running.end()) {
+        return;  // Already cleaned up by cancelAll()
+    }
+
+    RunningJob running = it.value();
+    m_running.erase(it);
+
+    running.thread->wait();
+    releaseJob(running);
+
+    dispatch();
+
+    if (isIdle()) {
+        emit queueIdle();
+    }
+}
+
+void BackupJobQueue::releaseJob(RunningJob &running)
+{
+    for (const QString &deviceId : running.job.deviceIds) {
+        int &streams = m_activeStreams[deviceId];
+        streams = qMax(0, streams - 1);
+    }
+
+    delete running.worker;
+    running.worker = nullptr;
+    delete running.thread;
+    running.thread = nullptr;
+}
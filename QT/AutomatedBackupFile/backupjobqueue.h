@@ -0,0 +1,94 @@
+#ifndef BACKUPJOBQUEUE_H
+#define BACKUPJOBQUEUE_H
+
+#include <QObject>
+#include <QThread>
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QMap>
+#include <vector>
+#include <utility>
+#include "backupengine.h"
+#include "storagedevice.h"
+
+// A queued backup run: one or more (source, destination) pairs plus the
+// physical devices they touch
+struct BackupJob {
+    QString id;
+    std::vector<std::pair<QString, QString>> sourceDestPairs;
+    QMap<QString, BackupFilter> filters;  // By source path
+    BackupPlacement placement;
+    QStringList deviceIds;         // Distinct devices behind all sources and destinations
+    QStringList destinationDeviceIds;  // Per pair
+    QStringList destinationPaths;  // Used to keep two jobs out of the same directory
+};
+
+// Runs several backup jobs at once. A job is admitted only when every device
+// it touches has a free stream slot, so jobs on separate disks overlap while
+// jobs on the same spindle wait their turn.
+class BackupJobQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit BackupJobQueue(QObject *parent = nullptr);
+    ~BackupJobQueue();
+
+    // Queue a job and start it immediately if its devices are free
+    QString enqueue(const std::vector<std::pair<QString, QString>>& sourceDestPairs,
+                    const QMap<QString, BackupFilter>& filters = QMap<QString, BackupFilter>(),
+                    const BackupPlacement& placement = BackupPlacement());
+    void cancelJob(const QString &jobId);
+    void cancelAll();
+
+    // Admission limits
+    void setMaxConcurrentJobs(int count);
+    int getMaxConcurrentJobs() const { return m_maxConcurrentJobs; }
+    void setDeviceStreamLimit(const QString &deviceId, int limit);
+    int getDeviceStreamLimit(const QString &deviceId) const;
+    int getActiveStreams(const QString &deviceId) const { return m_activeStreams.value(deviceId, 0); }
+
+    // Queue state
+    int getRunningJobCount() const { return m_running.size(); }
+    int getPendingJobCount() const { return m_pending.size(); }
+    QStringList getRunningJobIds() const { return m_running.keys(); }
+    QStringList getPendingJobIds() const;
+    QList<const BackupWorker*> getRunningWorkers() const;
+    bool isIdle() const { return m_running.isEmpty() && m_pending.isEmpty(); }
+
+signals:
+    void jobQueued(const QString &jobId);
+    void jobStarted(const QString &jobId);
+    void jobProgress(const QString &jobId, int progress);
+    void jobFileProcessed(const QString &jobId, const QString &filename);
+    void jobCompleted(const QString &jobId);
+    void jobFailed(const QString &jobId, const QString &error);
+    void jobFilterStatistics(const QString &jobId, const QString &sourcePath, const QList<FilterRuleStats> &stats);
+    void jobThroughput(const QString &jobId, const QString &destinationPath, qint64 bytes, qint64 msecs);
+    void queueIdle();
+
+private:
+    struct RunningJob {
+        BackupJob job;
+        QThread *thread;
+        BackupWorker *worker;
+
+        RunningJob() : thread(nullptr), worker(nullptr) {}
+    };
+
+    QList<BackupJob> m_pending;
+    QMap<QString, RunningJob> m_running;           // jobId -> running job
+    QMap<QString, int> m_activeStreams;            // deviceId -> streams in use
+    QMap<QString, int> m_deviceLimits;             // deviceId -> stream limit
+    int m_maxConcurrentJobs;
+    int m_nextJobNumber;
+
+    void dispatch();
+    bool canAdmit(const BackupJob &job) const;
+    void startJob(const BackupJob &job);
+    void finishJob(const QString &jobId);
+    void releaseJob(RunningJob &running);
+};
+
+#endif // BACKUPJOBQUEUE_H
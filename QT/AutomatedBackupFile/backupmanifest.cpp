@@ -0,0 +1,286 @@
+#include "backupmanifest.h"
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QSaveFile>
+
+namespace {
+
+const QByteArray kHeader("AutomatedBackupFile manifest 1");
+const QByteArray kHeaderWithLocations("AutomatedBackupFile manifest 2");
+
+} // namespace
+
+const QString BackupManifest::FileName = "manifest.txt";
+
+QByteArray BackupManifest::encodePath(const QString& path)
+{
+    QByteArray utf8 = path.toUtf8();
+    if (!utf8.contains('\\') && !utf8.contains('\n')) {
+        return utf8;
+    }
+
+    QByteArray escaped;
+    escaped.reserve(utf8.size() + 8);
+    for (char c : utf8) {
+        if (c == '\\') {
+            escaped.append("\\\\");
+        } else if (c == '\n') {
+            escaped.append("\\n");
+        } else {
+            escaped.append(c);
+        }
+    }
+    return escaped;
+}
+
+QString BackupManifest::decodePath(const QByteArray& encoded)
+{
+    if (!encoded.contains('\\')) {
+        return QString::fromUtf8(encoded);
+    }
+
+    QByteArray utf8;
+    utf8.reserve(encoded.size());
+    for (int i = 0; i < encoded.size(); ++i) {
+        if (encoded[i] == '\\' && i + 1 < encoded.size()) {
+            ++i;
+            utf8.append(encoded[i] == 'n' ? '\n' : encoded[i] == 't' ? '\t' : encoded[i]);
+        } else {
+            utf8.append(encoded[i]);
+        }
+    }
+    return QString::fromUtf8(utf8);
+}
+
+QByteArray BackupManifest::encodeLocation(const QString& location)
+{
+    return encodePath(location).replace('\t', "\\t");
+}
+
+QString BackupManifest::filePathFor(const QString& encryptedBackupDir)
+{
+    return encryptedBackupDir + "/" + FileName;
+}
+
+bool BackupManifest::load(const QString& filePath)
+{
+    m_entries.clear();
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;  // No manifest yet
+    }
+
+    const QByteArray header = file.readLine().trimmed();
+    const bool withLocations = header == kHeaderWithLocations;
+    if (header != kHeader && !withLocations) {
+        qWarning() << "Not a backup manifest:" << filePath;
+        return false;
+    }
+
+    while (!file.atEnd()) {
+        QByteArray line = file.readLine();
+        if (line.endsWith('\n')) {
+            line.chop(1);
+        }
+        if (line.isEmpty()) {
+            continue;
+        }
+
+        const int sizeEnd = line.indexOf('\t');
+        const int timeEnd = sizeEnd < 0 ? -1 : line.indexOf('\t', sizeEnd + 1);
+        const int locationEnd = timeEnd < 0 || !withLocations ? timeEnd : line.indexOf('\t', timeEnd + 1);
+        if (locationEnd < 0) {
+            qWarning() << "Malformed backup manifest line in" << filePath;
+            m_entries.clear();
+            return false;
+        }
+
+        BackupManifestEntry entry;
+        entry.size = line.left(sizeEnd).toLongLong();
+        const qint64 modified = line.mid(sizeEnd + 1, timeEnd - sizeEnd - 1).toLongLong();
+        if (modified != 0) {
+            entry.lastModified = QDateTime::fromMSecsSinceEpoch(modified);
+        }
+        if (locationEnd > timeEnd) {
+            entry.location = decodePath(line.mid(timeEnd + 1, locationEnd - timeEnd - 1));
+        }
+        entry.path = decodePath(line.mid(locationEnd + 1));
+        m_entries.insert(entry.path, entry);
+    }
+
+    return true;
+}
+
+bool BackupManifest::save(const QString& filePath) const
+{
+    // QSaveFile only replaces the old manifest once the new one is complete
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to write backup manifest:" << filePath << file.errorString();
+        return false;
+    }
+
+    // Version 1 unless the backup is spread, so older readers still read it
+    bool withLocations = false;
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd() && !withLocations; ++it) {
+        withLocations = !it->location.isEmpty();
+    }
+    file.write(withLocations ? kHeaderWithLocations : kHeader);
+    file.write("\n");
+
+    QByteArray line;
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        const BackupManifestEntry &entry = it.value();
+        line.clear();
+        line.append(QByteArray::number(entry.size));
+        line.append('\t');
+        line.append(QByteArray::number(entry.lastModified.isValid() ? entry.lastModified.toMSecsSinceEpoch() : 0));
+        line.append('\t');
+        if (withLocations) {
+            line.append(encodeLocation(entry.location));
+            line.append('\t');
+        }
+        line.append(encodePath(entry.path));
+        line.append('\n');
+        file.write(line);
+    }
+
+    if (!file.commit()) {
+        qWarning() << "Failed to write backup manifest:" << filePath << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+BackupManifest BackupManifest::scan(const QString& encryptedBackupDir)
+{
+    BackupManifest manifest;
+    QDir encryptedDir(encryptedBackupDir);
+
+    QDirIterator it(encryptedBackupDir, QStringList() << "*.enc", QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        QString encryptedFile = it.next();
+
+        // Earlier full decryptions land inside the backup directory
+        if (encryptedFile.contains("/decrypted/")) {
+            continue;
+        }
+
+        BackupManifestEntry entry;
+        entry.path = encryptedDir.relativeFilePath(encryptedFile);
+        entry.path.chop(4);
+        entry.lastModified = it.fileInfo().lastModified();
+        manifest.insert(entry);
+    }
+
+    return manifest;
+}
+
+void BackupManifest::insert(const BackupManifestEntry& entry)
+{
+    m_entries.insert(entry.path, entry);
+}
+
+void BackupManifest::remove(const QString& path)
+{
+    m_entries.remove(path);
+}
+
+QStringList BackupManifest::localPaths() const
+{
+    QStringList paths;
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        if (it->location.isEmpty()) {
+            paths.append(it.key());
+        }
+    }
+    return paths;
+}
+
+QString BackupManifest::encryptedFilePath(const QString& encryptedBackupDir, const QString& path) const
+{
+    const auto it = m_entries.constFind(path);
+    if (it == m_entries.constEnd() || it->location.isEmpty()) {
+        return encryptedBackupDir + "/" + path + ".enc";
+    }
+    return QDir::cleanPath(QDir(encryptedBackupDir).filePath(it->location)) + "/" + path + ".enc";
+}
+
+QStringList BackupManifest::resolve(const QStringList& patterns) const
+{
+    QStringList result;
+    QSet<QString> seen;
+
+    for (const QString &pattern : patterns) {
+        const QString normalized = normalizedPattern(pattern);
+
+        if (normalized.contains('*') || normalized.contains('?') || normalized.contains('[')) {
+            appendWildcardMatches(normalized, result, seen);
+        } else if (m_entries.contains(normalized)) {
+            if (!seen.contains(normalized)) {
+                seen.insert(normalized);
+                result.append(normalized);
+            }
+        } else {
+            // A directory, or the whole backup for an empty pattern
+            appendPrefixRange(normalized.isEmpty() ? QString() : normalized + "/", result, seen);
+        }
+    }
+
+    return result;
+}
+
+QString BackupManifest::normalizedPattern(const QString& pattern)
+{
+    QString normalized = QDir::cleanPath(QDir::fromNativeSeparators(pattern.trimmed()));
+    while (normalized.startsWith("/")) {
+        normalized.remove(0, 1);
+    }
+    if (normalized == ".") {
+        normalized.clear();
+    } else if (normalized.startsWith("./")) {
+        normalized.remove(0, 2);
+    }
+    return normalized;
+}
+
+void BackupManifest::appendPrefixRange(const QString& prefix, QStringList& result, QSet<QString>& seen) const
+{
+    for (auto it = m_entries.lowerBound(prefix); it != m_entries.constEnd() && it.key().startsWith(prefix); ++it) {
+        if (!seen.contains(it.key())) {
+            seen.insert(it.key());
+            result.append(it.key());
+        }
+    }
+}
+
+void BackupManifest::appendWildcardMatches(const QString& pattern, QStringList& result, QSet<QString>& seen) const
+{
+    // Every match starts with the text before the first wildcard
+    int literalLength = pattern.size();
+    for (QChar wildcard : {QChar('*'), QChar('?'), QChar('[')}) {
+        const int index = pattern.indexOf(wildcard);
+        if (index >= 0) {
+            literalLength = qMin(literalLength, index);
+        }
+    }
+    const QString prefix = pattern.left(literalLength);
+
+    const QRegularExpression expression(QRegularExpression::wildcardToRegularExpression(pattern));
+    if (!expression.isValid()) {
+        qWarning() << "Invalid restore pattern:" << pattern;
+        return;
+    }
+
+    for (auto it = m_entries.lowerBound(prefix); it != m_entries.constEnd() && it.key().startsWith(prefix); ++it) {
+        if (!seen.contains(it.key()) && expression.match(it.key()).hasMatch()) {
+            seen.insert(it.key());
+            result.append(it.key());
+        }
+    }
+}
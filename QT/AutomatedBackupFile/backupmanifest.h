@@ -0,0 +1,80 @@
+#ifndef BACKUPMANIFEST_H
+#define BACKUPMANIFEST_H
+
+#include <QString>
+#include <QStringList>
+#include <QDateTime>
+#include <QMap>
+#include <QSet>
+
+struct BackupManifestEntry
+{
+    QString path;            // Relative to the backup root, without ".enc"
+    qint64 size = -1;        // Plaintext size; -1 if unknown
+    QDateTime lastModified;  // Of the source file when it was backed up
+    QString location;        // Encrypted backup directory holding the file, relative to this one; empty for this one
+};
+
+// Index of the files in an encrypted backup, written next to them by
+// FileEncryptor::encryptDirectory. Restores resolve what to decrypt here
+// instead of walking a tree that may hold millions of files.
+//
+// Stored as one "size<TAB>mtime<TAB>path" line per file, sorted by path,
+// so it can be written and read in a single streaming pass whatever the
+// backup size. When a job spreads a source over several destinations, the
+// manifest of each part lists the files of the others too, with where they
+// went; such manifests are version 2, "size<TAB>mtime<TAB>location<TAB>path"
+// with an empty location for the files of this part.
+class BackupManifest
+{
+public:
+    static const QString FileName;
+
+    // Where the manifest of an encrypted backup directory lives
+    static QString filePathFor(const QString& encryptedBackupDir);
+
+    bool load(const QString& filePath);
+    bool save(const QString& filePath) const;
+
+    // Rebuild the file list of a backup written before manifests existed.
+    // Walks the tree once; sizes stay unknown.
+    static BackupManifest scan(const QString& encryptedBackupDir);
+
+    void insert(const BackupManifestEntry& entry);
+    void remove(const QString& path);
+    void clear() { m_entries.clear(); }
+
+    bool contains(const QString& path) const { return m_entries.contains(path); }
+    BackupManifestEntry entry(const QString& path) const { return m_entries.value(path); }
+    QStringList paths() const { return m_entries.keys(); }
+    QStringList localPaths() const;  // Held in this backup directory
+
+    // Where the encrypted copy of path is, for a manifest kept in
+    // encryptedBackupDir
+    QString encryptedFilePath(const QString& encryptedBackupDir, const QString& path) const;
+    int count() const { return static_cast<int>(m_entries.size()); }
+    bool isEmpty() const { return m_entries.isEmpty(); }
+
+    // Files selected by a list of patterns, in the order they were asked
+    // for: everything matched by the first pattern, then the new matches of
+    // the second, and so on. A pattern is a file path, a directory path
+    // (everything below it) or a wildcard where * and ? stay within one
+    // path component. Lookups only touch the part of the index sharing the
+    // pattern's literal prefix.
+    QStringList resolve(const QStringList& patterns) const;
+
+    // Paths are the last field of a line, so only line breaks and the
+    // escape character itself are escaped; locations also escape tabs
+    static QByteArray encodePath(const QString& path);
+    static QString decodePath(const QByteArray& encoded);
+    static QByteArray encodeLocation(const QString& location);
+
+private:
+    QMap<QString, BackupManifestEntry> m_entries;  // By path, so prefixes form ranges
+
+    static QString normalizedPattern(const QString& pattern);
+    void appendPrefixRange(const QString& prefix, QStringList& result, QSet<QString>& seen) const;
+    void appendWildcardMatches(const QString& pattern, QStringList& result, QSet<QString>& seen) const;
+};
+
+#endif // BACKUPMANIFEST_H
@@ -2,6 +2,7 @@
 #include <QUuid>
 #include <QFileInfo>
 #include <QDir>
+#include <QJsonArray>
 
 BackupSource::BackupSource(const QString &path, SourceType type)
     : m_path(path)
@@ -95,6 +96,12 @@ QJsonObject BackupSource::toJson() const
     json["requiresAuth"] = m_requiresAuth;
     json["totalSize"] = QString::number(m_totalSize);
     json["fileCount"] = m_fileCount;
+    QJsonArray filterRules;
+    for (const FilterRule &rule : m_filterRules) {
+        filterRules.append(rule.toJson());
+    }
+    json["filterRules"] = filterRules;
+    json["ignoreFileName"] = m_ignoreFileName;
     // Note: Password is not saved for security reasons
     return json;
 }
@@ -114,5 +121,9 @@ BackupSource* BackupSource::fromJson(const QJsonObject &json)
     source->m_requiresAuth = json["requiresAuth"].toBool();
     source->m_totalSize = json["totalSize"].toString().toLongLong();
     source->m_fileCount = json["fileCount"].toInt();
+    for (const QJsonValue &rule : json["filterRules"].toArray()) {
+        source->m_filterRules.append(FilterRule::fromJson(rule.toObject()));
+    }
+    source->m_ignoreFileName = json["ignoreFileName"].toString();
     return source;
 }
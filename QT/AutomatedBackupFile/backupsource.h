@@ -4,6 +4,8 @@
 #include <QString>
 #include <QDateTime>
 #include <QJsonObject>
+#include <QList>
+#include "backupfilter.h"
 
 enum class SourceType {
     Local,
@@ -39,6 +41,8 @@ public:
     bool requiresAuthentication() const { return m_requiresAuth; }
     qint64 getTotalSize() const { return m_totalSize; }
     int getFileCount() const { return m_fileCount; }
+    QList<FilterRule> getFilterRules() const { return m_filterRules; }
+    QString getIgnoreFileName() const { return m_ignoreFileName; }
 
     // Setters
     void setPath(const QString &path) { m_path = path; }
@@ -53,12 +57,15 @@ public:
     void setRequiresAuthentication(bool required) { m_requiresAuth = required; }
     void setTotalSize(qint64 size) { m_totalSize = size; }
     void setFileCount(int count) { m_fileCount = count; }
+    void setFilterRules(const QList<FilterRule> &rules) { m_filterRules = rules; }
+    void setIgnoreFileName(const QString &fileName) { m_ignoreFileName = fileName; }
 
     // Utility methods
     QString getTypeString() const;
     QString getStatusString() const;
     bool isValid() const;
     QString getDisplayPath() const;
+    BackupFilter createFilter() const { return BackupFilter(m_filterRules, m_ignoreFileName); }
 
     // Serialization
     QJsonObject toJson() const;
@@ -78,6 +85,8 @@ private:
     bool m_requiresAuth;
     qint64 m_totalSize;
     int m_fileCount;
+    QList<FilterRule> m_filterRules;  // In order; the last matching pattern decides
+    QString m_ignoreFileName;         // e.g. ".backupignore"; empty to not look for one
 
     void generateId();
 };
@@ -0,0 +1,36 @@
+#include "bandwidthlimiter.h"
+#include <QMutexLocker>
+#include <QThread>
+
+BandwidthLimiter::BandwidthLimiter(qint64 bytesPerSecond)
+    : m_bytesPerSecond(bytesPerSecond)
+    , m_nextFreeNs(0)
+{
+    m_clock.start();
+}
+
+void BandwidthLimiter::setLimit(qint64 bytesPerSecond)
+{
+    m_bytesPerSecond = bytesPerSecond;
+}
+
+void BandwidthLimiter::acquire(qint64 bytes)
+{
+    const qint64 bytesPerSecond = m_bytesPerSecond;
+    if (bytesPerSecond <= 0 || bytes <= 0) {
+        return;
+    }
+
+    qint64 waitNs = 0;
+    {
+        QMutexLocker locker(&m_mutex);
+        const qint64 now = m_clock.nsecsElapsed();
+        const qint64 start = qMax(now, m_nextFreeNs);
+        m_nextFreeNs = start + static_cast<qint64>(double(bytes) * 1e9 / double(bytesPerSecond));
+        waitNs = start - now;
+    }
+
+    if (waitNs > 0) {
+        QThread::usleep(static_cast<unsigned long>(waitNs / 1000));
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef BANDWIDTHLIMITER_H
+#define BANDWIDTHLIMITER_H
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <atomic>
+
+// Caps the combined rate of transfers made by any number of threads. Each
+// caller books its bytes into the next free slot of a shared timeline and
+// sleeps until that slot starts, so threads take turns rather than racing,
+// and idle time is not saved up into a burst.
+class BandwidthLimiter
+{
+public:
+    explicit BandwidthLimiter(qint64 bytesPerSecond = 0);
+
+    // Zero or less means unlimited
+    void setLimit(qint64 bytesPerSecond);
+    qint64 limit() const { return m_bytesPerSecond; }
+
+    // Wait until bytes may be transferred without exceeding the limit
+    void acquire(qint64 bytes);
+
+private:
+    std::atomic<qint64> m_bytesPerSecond;
+    QMutex m_mutex;
+    QElapsedTimer m_clock;
+    qint64 m_nextFreeNs;  // On m_clock; when the booked transfers are done
+};
+
+#endif // BANDWIDTHLIMITER_H
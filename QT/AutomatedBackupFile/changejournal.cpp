@@ -0,0 +1,498 @@
+#include "changejournal.h"
+#include <QDebug>
+#include <QDir>
+#include <QtEndian>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+const char kMagic[8] = {'A', 'B', 'F', 'M', 'J', 'R', 'N', 'L'};
+const quint32 kFormatVersion = 1;
+const qint64 kHeaderSize = 16;
+
+// Fixed part of a record:
+//   0  u32 length of the whole record
+//   4  u32 change type
+//   8  i64 change time (ms since the epoch)
+//  16  i64 offset of the previous record of the destination, -1 if none
+//  24  old file: i64 size, i64 modified (ms, 0 if unknown), u64 device, u64 inode
+//  56  new file: the same
+// followed by the destination id, file path, old path, new path and
+// description, each as u32 length + UTF-8.
+const int kFixedRecordSize = 88;
+const int kStringCount = 5;
+const qint64 kMaxRecordSize = 1024 * 1024;
+
+void putFile(uchar *p, const BackupFileInfo &info)
+{
+    qToLittleEndian<qint64>(info.size, p);
+    qToLittleEndian<qint64>(info.lastModified.isValid() ? info.lastModified.toMSecsSinceEpoch() : 0, p + 8);
+    qToLittleEndian<quint64>(info.device, p + 16);
+    qToLittleEndian<quint64>(info.inode, p + 24);
+}
+
+void getFile(const uchar *p, const QString &filePath, BackupFileInfo &info)
+{
+    info.filePath = filePath;
+    info.fileName = filePath.mid(filePath.lastIndexOf('/') + 1);
+    info.size = qFromLittleEndian<qint64>(p);
+    const qint64 modified = qFromLittleEndian<qint64>(p + 8);
+    if (modified != 0) {
+        info.lastModified = QDateTime::fromMSecsSinceEpoch(modified);
+    }
+    info.device = qFromLittleEndian<quint64>(p + 16);
+    info.inode = qFromLittleEndian<quint64>(p + 24);
+    info.isValid = !filePath.isEmpty();
+}
+
+void appendString(QByteArray &bytes, const QString &value)
+{
+    const QByteArray utf8 = value.toUtf8();
+    uchar length[4];
+    qToLittleEndian<quint32>(utf8.size(), length);
+    bytes.append(reinterpret_cast<const char*>(length), 4);
+    bytes.append(utf8);
+}
+
+} // namespace
+
+ChangeJournal::ChangeJournal()
+    : m_lastTime(0)
+    , m_segmentSize(DefaultSegmentSize)
+    , m_maxRecords(DefaultMaxRecords)
+    , m_maxAgeDays(0)
+{
+}
+
+ChangeJournal::~ChangeJournal()
+{
+    close();
+}
+
+QString ChangeJournal::segmentPath(quint64 number) const
+{
+    return QDir(m_directory).filePath(QString("changes-%1.log").arg(number, 8, 10, QChar('0')));
+}
+
+bool ChangeJournal::open(const QString &directory)
+{
+    close();
+
+    QDir dir(directory);
+    if (!dir.exists() && !dir.mkpath(".")) {
+        qWarning() << "Failed to create change journal directory:" << directory;
+        return false;
+    }
+    m_directory = dir.absolutePath();
+
+    QList<quint64> numbers;
+    for (const QString &name : dir.entryList(QStringList() << "changes-*.log", QDir::Files)) {
+        bool ok = false;
+        const quint64 number = name.mid(8, name.size() - 12).toULongLong(&ok);
+        if (ok) {
+            numbers.append(number);
+        }
+    }
+    std::sort(numbers.begin(), numbers.end());
+
+    for (int i = 0; i < numbers.size(); ++i) {
+        Segment segment;
+        segment.number = numbers[i];
+        segment.path = segmentPath(segment.number);
+        if (loadSegment(segment, i == numbers.size() - 1)) {
+            m_segments.append(segment);
+        }
+    }
+
+    // Keep appending to the last segment unless it is full
+    if (!m_segments.isEmpty() && m_segments.last().size < m_segmentSize) {
+        m_active.setFileName(m_segments.last().path);
+        if (!m_active.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            qWarning() << "Failed to open change journal:" << m_active.fileName() << m_active.errorString();
+            close();
+            return false;
+        }
+    } else if (!startSegment(numbers.isEmpty() ? 1 : numbers.last() + 1)) {
+        close();
+        return false;
+    }
+
+    applyRetention();
+    return true;
+}
+
+void ChangeJournal::close()
+{
+    m_active.close();
+    m_segments.clear();
+    m_lastTime = 0;
+}
+
+bool ChangeJournal::loadSegment(Segment &segment, bool isLast)
+{
+    QFile file(segment.path);
+    if (!file.open(isLast ? QIODevice::ReadWrite : QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open change journal segment:" << segment.path << file.errorString();
+        return false;
+    }
+
+    const QByteArray header = file.read(kHeaderSize);
+    if (header.size() != kHeaderSize || memcmp(header.constData(), kMagic, sizeof(kMagic)) != 0 ||
+        qFromLittleEndian<quint32>(header.constData() + 8) != kFormatVersion) {
+        qWarning() << "Not a change journal segment, skipped:" << segment.path;
+        return false;
+    }
+    segment.firstTime = m_lastTime;
+    segment.lastTime = m_lastTime;
+
+    // Segments are small, so the index is rebuilt from one pass over each
+    const QByteArray data = file.readAll();
+    qint64 position = 0;
+    while (position < data.size()) {
+        DecodedRecord record;
+        const qint64 remaining = data.size() - position;
+        const qint64 length = remaining >= 4 ? qFromLittleEndian<quint32>(data.constData() + position) : 0;
+        if (length < kFixedRecordSize || length > remaining ||
+            !decode(QByteArray::fromRawData(data.constData() + position, static_cast<int>(length)), record)) {
+            break;
+        }
+        indexRecord(segment, record.destinationId, record.time, kHeaderSize + position, length);
+        position += length;
+    }
+
+    segment.size = kHeaderSize + position;
+    if (position < data.size()) {
+        if (isLast) {
+            // Most likely a write cut short; later appends go after the last good record
+            qWarning() << "Dropping incomplete record at the end of" << segment.path;
+            file.resize(segment.size);
+        } else {
+            qWarning() << "Change journal segment is damaged after offset" << segment.size << ":" << segment.path;
+        }
+    }
+    return true;
+}
+
+bool ChangeJournal::startSegment(quint64 number)
+{
+    m_active.close();
+
+    Segment segment;
+    segment.number = number;
+    segment.path = segmentPath(number);
+    segment.size = kHeaderSize;
+    segment.firstTime = m_lastTime;  // Keeps the segments ordered by time while this one is empty
+    segment.lastTime = m_lastTime;
+
+    m_active.setFileName(segment.path);
+    if (!m_active.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Failed to create change journal segment:" << segment.path << m_active.errorString();
+        return false;
+    }
+
+    QByteArray header(kHeaderSize, '\0');
+    memcpy(header.data(), kMagic, sizeof(kMagic));
+    qToLittleEndian<quint32>(kFormatVersion, header.data() + 8);
+    if (m_active.write(header) != kHeaderSize || !m_active.flush()) {
+        qWarning() << "Failed to write change journal segment:" << segment.path << m_active.errorString();
+        m_active.close();
+        return false;
+    }
+
+    m_segments.append(segment);
+    return true;
+}
+
+void ChangeJournal::indexRecord(Segment &segment, const QString &destinationId, qint64 time, qint64 offset, qint64 size)
+{
+    m_lastTime = qMax(m_lastTime, time);
+
+    if (segment.recordCount == 0) {
+        segment.firstTime = m_lastTime;
+    }
+    segment.lastTime = m_lastTime;
+    if (segment.recordCount % IndexInterval == 0) {
+        segment.index.append(IndexEntry{m_lastTime, offset});
+    }
+    segment.recordCount++;
+    segment.size = offset + size;
+
+    DestinationChain &chain = segment.destinations[destinationId];
+    if (chain.count % IndexInterval == 0) {
+        chain.index.append(IndexEntry{m_lastTime, offset});
+    }
+    chain.lastOffset = offset;
+    chain.count++;
+}
+
+bool ChangeJournal::append(const QString &destinationId, const FileChangeRecord &change)
+{
+    if (!m_active.isOpen()) {
+        return false;
+    }
+
+    if (m_segments.last().size >= m_segmentSize) {
+        if (!startSegment(m_segments.last().number + 1)) {
+            return false;
+        }
+        applyRetention();
+    }
+
+    Segment &segment = m_segments.last();
+    const qint64 time = change.changeTime.toMSecsSinceEpoch();
+    const qint64 previousOffset = segment.destinations.value(destinationId).lastOffset;
+    const QByteArray bytes = encode(destinationId, time, previousOffset, change);
+
+    // One write per record; a crash in the middle leaves a short tail that
+    // open() drops
+    if (m_active.write(bytes) != bytes.size() || !m_active.flush()) {
+        qWarning() << "Failed to append to change journal:" << m_active.errorString();
+        return false;
+    }
+
+    indexRecord(segment, destinationId, time, segment.size, bytes.size());
+    return true;
+}
+
+void ChangeJournal::setMaxRecords(qint64 maxRecords)
+{
+    m_maxRecords = qMax<qint64>(maxRecords, 0);
+    applyRetention();
+}
+
+void ChangeJournal::setMaxAgeDays(int days)
+{
+    m_maxAgeDays = qMax(days, 0);
+    applyRetention();
+}
+
+void ChangeJournal::applyRetention()
+{
+    qint64 total = recordCount();
+    const qint64 oldestKept = m_maxAgeDays > 0
+        ? QDateTime::currentDateTime().addDays(-m_maxAgeDays).toMSecsSinceEpoch()
+        : 0;
+
+    // The segment being written to always stays
+    while (m_segments.size() > 1) {
+        const Segment &oldest = m_segments.first();
+        const bool enoughNewer = m_maxRecords > 0 && total - oldest.recordCount >= m_maxRecords;
+        const bool tooOld = m_maxAgeDays > 0 && oldest.lastTime < oldestKept;
+        if (!enoughNewer && !tooOld) {
+            break;
+        }
+
+        if (!QFile::remove(oldest.path)) {
+            qWarning() << "Failed to remove change journal segment:" << oldest.path;
+            break;
+        }
+        total -= oldest.recordCount;
+        m_segments.removeFirst();
+    }
+}
+
+qint64 ChangeJournal::recordCount() const
+{
+    qint64 total = 0;
+    for (const Segment &segment : m_segments) {
+        total += segment.recordCount;
+    }
+    return total;
+}
+
+QByteArray ChangeJournal::encode(const QString &destinationId, qint64 time, qint64 previousOffset, const FileChangeRecord &change)
+{
+    QByteArray bytes(kFixedRecordSize, '\0');
+    appendString(bytes, destinationId);
+    appendString(bytes, change.filePath);
+    appendString(bytes, change.oldInfo.filePath);
+    appendString(bytes, change.newInfo.filePath);
+    appendString(bytes, change.description);
+
+    uchar *p = reinterpret_cast<uchar*>(bytes.data());
+    qToLittleEndian<quint32>(bytes.size(), p);
+    qToLittleEndian<quint32>(change.changeType, p + 4);
+    qToLittleEndian<qint64>(time, p + 8);
+    qToLittleEndian<qint64>(previousOffset, p + 16);
+    putFile(p + 24, change.oldInfo);
+    putFile(p + 56, change.newInfo);
+    return bytes;
+}
+
+bool ChangeJournal::decode(const QByteArray &bytes, DecodedRecord &record)
+{
+    const uchar *p = reinterpret_cast<const uchar*>(bytes.constData());
+    const qint64 size = bytes.size();
+    if (size < kFixedRecordSize) {
+        return false;
+    }
+
+    QString strings[kStringCount];
+    qint64 position = kFixedRecordSize;
+    for (QString &value : strings) {
+        if (size - position < 4) {
+            return false;
+        }
+        const qint64 length = qFromLittleEndian<quint32>(p + position);
+        position += 4;
+        if (length > size - position) {
+            return false;
+        }
+        value = QString::fromUtf8(bytes.constData() + position, static_cast<int>(length));
+        position += length;
+    }
+
+    const quint32 type = qFromLittleEndian<quint32>(p + 4);
+    if (type > FileChangeRecord::SizeChanged) {
+        return false;
+    }
+
+    record.length = size;
+    record.time = qFromLittleEndian<qint64>(p + 8);
+    record.previousOffset = qFromLittleEndian<qint64>(p + 16);
+    record.destinationId = strings[0];
+
+    FileChangeRecord &change = record.change;
+    change.changeType = static_cast<FileChangeRecord::ChangeType>(type);
+    change.changeTime = QDateTime::fromMSecsSinceEpoch(record.time);
+    change.filePath = strings[1];
+    getFile(p + 24, strings[2], change.oldInfo);
+    getFile(p + 56, strings[3], change.newInfo);
+    change.description = strings[4];
+    return true;
+}
+
+bool ChangeJournal::readRecord(QFile &file, qint64 offset, DecodedRecord &record)
+{
+    if (!file.seek(offset)) {
+        return false;
+    }
+
+    const QByteArray lengthBytes = file.read(4);
+    if (lengthBytes.size() != 4) {
+        return false;
+    }
+    const qint64 length = qFromLittleEndian<quint32>(lengthBytes.constData());
+    if (length < kFixedRecordSize || length > kMaxRecordSize) {
+        return false;
+    }
+
+    const QByteArray bytes = lengthBytes + file.read(length - 4);
+    return bytes.size() == length && decode(bytes, record);
+}
+
+qint64 ChangeJournal::startOffset(const QVector<IndexEntry> &index, qint64 from)
+{
+    // Last indexed record before the range; everything ahead of it is older
+    auto it = std::lower_bound(index.constBegin(), index.constEnd(), from,
+                               [](const IndexEntry &entry, qint64 time) { return entry.time < time; });
+    return it == index.constBegin() ? kHeaderSize : (it - 1)->offset;
+}
+
+QList<FileChangeRecord> ChangeJournal::history(const QString &destinationId, int maxRecords) const
+{
+    QList<FileChangeRecord> changes;
+
+    for (int i = m_segments.size() - 1; i >= 0; --i) {
+        const Segment &segment = m_segments[i];
+        const qint64 lastOffset = segment.destinations.value(destinationId).lastOffset;
+        if (lastOffset < 0) {
+            continue;
+        }
+
+        QFile file(segment.path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+
+        DecodedRecord record;
+        for (qint64 offset = lastOffset; offset >= 0; offset = record.previousOffset) {
+            if (maxRecords > 0 && changes.size() >= maxRecords) {
+                return changes;
+            }
+            if (!readRecord(file, offset, record)) {
+                break;
+            }
+            changes.append(record.change);
+        }
+    }
+
+    return changes;
+}
+
+QList<FileChangeRecord> ChangeJournal::changesBetween(const QDateTime &from, const QDateTime &to) const
+{
+    const qint64 fromMs = from.toMSecsSinceEpoch();
+    const qint64 toMs = to.toMSecsSinceEpoch();
+    QList<FileChangeRecord> changes;
+
+    // Segments are in time order too; skip to the first one reaching the range
+    auto first = std::lower_bound(m_segments.constBegin(), m_segments.constEnd(), fromMs,
+                                  [](const Segment &segment, qint64 time) { return segment.lastTime < time; });
+
+    for (auto it = first; it != m_segments.constEnd() && it->firstTime <= toMs; ++it) {
+        if (it->recordCount == 0) {
+            continue;
+        }
+
+        QFile file(it->path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+
+        DecodedRecord record;
+        for (qint64 offset = startOffset(it->index, fromMs); offset < it->size; offset += record.length) {
+            if (!readRecord(file, offset, record) || record.time > toMs) {
+                break;
+            }
+            if (record.time >= fromMs) {
+                changes.append(record.change);
+            }
+        }
+    }
+
+    std::reverse(changes.begin(), changes.end());
+    return changes;
+}
+
+QList<FileChangeRecord> ChangeJournal::changesBetween(const QString &destinationId, const QDateTime &from, const QDateTime &to) const
+{
+    const qint64 fromMs = from.toMSecsSinceEpoch();
+    const qint64 toMs = to.toMSecsSinceEpoch();
+    QList<FileChangeRecord> changes;
+
+    for (int i = m_segments.size() - 1; i >= 0 && m_segments[i].lastTime >= fromMs; --i) {
+        const Segment &segment = m_segments[i];
+        if (segment.firstTime > toMs) {
+            continue;
+        }
+
+        auto chain = segment.destinations.constFind(destinationId);
+        if (chain == segment.destinations.constEnd()) {
+            continue;
+        }
+
+        // Start from the first indexed record past the range and walk back
+        auto after = std::upper_bound(chain->index.constBegin(), chain->index.constEnd(), toMs,
+                                      [](qint64 time, const IndexEntry &entry) { return time < entry.time; });
+        const qint64 start = after == chain->index.constEnd() ? chain->lastOffset : after->offset;
+
+        QFile file(segment.path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+
+        DecodedRecord record;
+        for (qint64 offset = start; offset >= 0; offset = record.previousOffset) {
+            if (!readRecord(file, offset, record) || record.time < fromMs) {
+                break;
+            }
+            if (record.time <= toMs) {
+                changes.append(record.change);
+            }
+        }
+    }
+
+    return changes;
+}
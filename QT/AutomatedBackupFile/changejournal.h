@@ -0,0 +1,115 @@
+#ifndef CHANGEJOURNAL_H
+#define CHANGEJOURNAL_H
+
+#include <QDateTime>
+#include <QFile>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QVector>
+#include "backupfilemonitor.h"
+
+// Change history of BackupFileMonitor, kept on disk.
+//
+// Changes are appended to segment files in a directory
+// ("changes-<number>.log"); a segment is closed once it reaches
+// segmentSize() bytes and a new one is started. Retention drops whole
+// segments, oldest first, once the records after them are enough to
+// satisfy maxRecords, or once all their records are older than maxAgeDays.
+//
+// Each record holds the offset of the previous record of the same
+// destination in its segment, so a destination's history is read without
+// touching the others. In memory there is only a sparse index per segment:
+// the time of every IndexInterval-th record, overall and per destination.
+// Time-range queries binary search it and read at most IndexInterval
+// records outside the range per segment.
+class ChangeJournal
+{
+public:
+    static const int IndexInterval = 64;
+    static const qint64 DefaultSegmentSize = 1024 * 1024;
+    static const qint64 DefaultMaxRecords = 100000;
+
+    ChangeJournal();
+    ~ChangeJournal();
+
+    // Open or create the journal in directory; a record cut short by a crash
+    // at the end of the last segment is dropped
+    bool open(const QString &directory);
+    void close();
+    bool isOpen() const { return m_active.isOpen(); }
+    QString directory() const { return m_directory; }
+
+    void setSegmentSize(qint64 bytes) { m_segmentSize = qMax<qint64>(bytes, 4096); }
+    qint64 segmentSize() const { return m_segmentSize; }
+
+    // Records kept at least; 0 keeps everything. Applied as segments close.
+    void setMaxRecords(qint64 maxRecords);
+    qint64 maxRecords() const { return m_maxRecords; }
+
+    // Age in days after which records may go; 0 keeps them regardless of age
+    void setMaxAgeDays(int days);
+    int maxAgeDays() const { return m_maxAgeDays; }
+
+    bool append(const QString &destinationId, const FileChangeRecord &change);
+
+    qint64 recordCount() const;
+    int segmentCount() const { return m_segments.size(); }
+
+    // Newest first. maxRecords <= 0 returns everything retained.
+    QList<FileChangeRecord> history(const QString &destinationId, int maxRecords) const;
+    QList<FileChangeRecord> changesBetween(const QDateTime &from, const QDateTime &to) const;
+    QList<FileChangeRecord> changesBetween(const QString &destinationId, const QDateTime &from, const QDateTime &to) const;
+
+private:
+    struct IndexEntry {
+        qint64 time;    // Milliseconds since the epoch; never decreasing within a segment
+        qint64 offset;
+    };
+
+    struct DestinationChain {
+        qint64 lastOffset = -1;
+        qint64 count = 0;
+        QVector<IndexEntry> index;  // Every IndexInterval-th record of the destination
+    };
+
+    struct Segment {
+        quint64 number = 0;
+        QString path;
+        qint64 size = 0;
+        qint64 recordCount = 0;
+        qint64 firstTime = 0;
+        qint64 lastTime = 0;
+        QVector<IndexEntry> index;  // Every IndexInterval-th record
+        QHash<QString, DestinationChain> destinations;
+    };
+
+    struct DecodedRecord {
+        QString destinationId;
+        qint64 length = 0;
+        qint64 time = 0;
+        qint64 previousOffset = -1;
+        FileChangeRecord change;
+    };
+
+    QString m_directory;
+    QList<Segment> m_segments;  // Oldest first; the last one is written to
+    QFile m_active;
+    qint64 m_lastTime;  // Latest index time, so the index never goes back when the clock does
+    qint64 m_segmentSize;
+    qint64 m_maxRecords;
+    int m_maxAgeDays;
+
+    QString segmentPath(quint64 number) const;
+    bool startSegment(quint64 number);
+    bool loadSegment(Segment &segment, bool isLast);
+    void indexRecord(Segment &segment, const QString &destinationId, qint64 time, qint64 offset, qint64 size);
+    void applyRetention();
+
+    static QByteArray encode(const QString &destinationId, qint64 time, qint64 previousOffset, const FileChangeRecord &change);
+    static bool decode(const QByteArray &bytes, DecodedRecord &record);
+    static bool readRecord(QFile &file, qint64 offset, DecodedRecord &record);
+    static qint64 startOffset(const QVector<IndexEntry> &index, qint64 from);
+};
+
+#endif // CHANGEJOURNAL_H
@@ -880,6 +880,8 @@ CloudProvider* CloudProviderFactory::createProvider(CloudProvider::CloudProvider
             return new OneDriveProvider(parent);
         case CloudProvider::AmazonS3:
             return new AmazonS3Provider(parent);
+        case CloudProvider::Custom:
+            return new MockCloudProvider(parent);
         default:
             return nullptr;
     }
@@ -904,3 +906,25 @@ QStringList CloudProviderFactory::getAvailableProviders()
 {
     return QStringList() << "Google Drive" << "Dropbox" << "OneDrive" << "Amazon S3";
 }
+
+CloudProvider* CloudProviderFactory::createAuthenticated(CloudProvider::CloudProviderType type,
+                                                         const QMap<QString, QString> &credentials,
+                                                         QString *error)
+{
+    CloudProvider *provider = createProvider(type);
+    if (!provider) {
+        if (error) {
+            *error = "Unsupported cloud provider";
+        }
+        return nullptr;
+    }
+    
+    if (!provider->authenticate(credentials)) {
+        if (error) {
+            *error = provider->getLastError();
+        }
+        delete provider;
+        return nullptr;
+    }
+    return provider;
+}
@@ -49,6 +49,7 @@ public:
     ConnectionStatus getStatus() const { return m_status; }
     QString getLastError() const { return m_lastError; }
     bool isAuthenticated() const { return m_authenticated; }
+    QMap<QString, QString> getCredentials() const { return m_credentials; }
 
 signals:
     void connectionStatusChanged(ConnectionStatus status);
@@ -226,6 +227,13 @@ public:
     static CloudProvider* createProvider(CloudProvider::CloudProviderType type, QObject *parent = nullptr);
     static CloudProvider* createProvider(const QString &providerName, QObject *parent = nullptr);
     static QStringList getAvailableProviders();
+
+    // A provider of its own for work on another thread, since providers
+    // can only be used on the thread they were created on. Signed in with
+    // credentials; nullptr, with the reason in error, if that fails.
+    static CloudProvider* createAuthenticated(CloudProvider::CloudProviderType type,
+                                              const QMap<QString, QString> &credentials,
+                                              QString *error = nullptr);
 };
 
 #endif // CLOUDPROVIDER_H
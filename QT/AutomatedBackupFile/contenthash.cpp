@@ -0,0 +1,491 @@
+#include "contenthash.h"
+#include <QtEndian>
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CONTENTHASH_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define CONTENTHASH_TARGET(isa) __attribute__((target(isa)))
+#else
+#define CONTENTHASH_TARGET(isa)
+#endif
+
+namespace {
+
+const quint32 Prime32_1 = 0x9E3779B1U;
+const quint32 Prime32_2 = 0x85EBCA77U;
+const quint32 Prime32_3 = 0xC2B2AE3DU;
+const quint64 Prime64_1 = 0x9E3779B185EBCA87ULL;
+const quint64 Prime64_2 = 0xC2B2AE3D27D4EB4FULL;
+const quint64 Prime64_3 = 0x165667B19E3779F9ULL;
+const quint64 Prime64_4 = 0x85EBCA77C2B2AE63ULL;
+const quint64 Prime64_5 = 0x27D4EB2F165667C5ULL;
+const quint64 PrimeMx1 = 0x165667919E3779F9ULL;
+const quint64 PrimeMx2 = 0x9FB21C651E98DF25ULL;
+
+const int SecretSize = 192;
+const int SecretLastStripeStart = 7;  // Offset from the scramble key of the last stripe's key
+const int SecretMergeStart = 11;
+
+alignas(64) const unsigned char kSecret[SecretSize] = {
+    0xb8, 0xfe, 0x6c, 0x39, 0x23, 0xa4, 0x4b, 0xbe, 0x7c, 0x01, 0x81, 0x2c, 0xf7, 0x21, 0xad, 0x1c,
+    0xde, 0xd4, 0x6d, 0xe9, 0x83, 0x90, 0x97, 0xdb, 0x72, 0x40, 0xa4, 0xa4, 0xb7, 0xb3, 0x67, 0x1f,
+    0xcb, 0x79, 0xe6, 0x4e, 0xcc, 0xc0, 0xe5, 0x78, 0x82, 0x5a, 0xd0, 0x7d, 0xcc, 0xff, 0x72, 0x21,
+    0xb8, 0x08, 0x46, 0x74, 0xf7, 0x43, 0x24, 0x8e, 0xe0, 0x35, 0x90, 0xe6, 0x81, 0x3a, 0x26, 0x4c,
+    0x3c, 0x28, 0x52, 0xbb, 0x91, 0xc3, 0x00, 0xcb, 0x88, 0xd0, 0x65, 0x8b, 0x1b, 0x53, 0x2e, 0xa3,
+    0x71, 0x64, 0x48, 0x97, 0xa2, 0x0d, 0xf9, 0x4e, 0x38, 0x19, 0xef, 0x46, 0xa9, 0xde, 0xac, 0xd8,
+    0xa8, 0xfa, 0x76, 0x3f, 0xe3, 0x9c, 0x34, 0x3f, 0xf9, 0xdc, 0xbb, 0xc7, 0xc7, 0x0b, 0x4f, 0x1d,
+    0x8a, 0x51, 0xe0, 0x4b, 0xcd, 0xb4, 0x59, 0x31, 0xc8, 0x9f, 0x7e, 0xc9, 0xd9, 0x78, 0x73, 0x64,
+    0xea, 0xc5, 0xac, 0x83, 0x34, 0xd3, 0xeb, 0xc3, 0xc5, 0x81, 0xa0, 0xff, 0xfa, 0x13, 0x63, 0xeb,
+    0x17, 0x0d, 0xdd, 0x51, 0xb7, 0xf0, 0xda, 0x49, 0xd3, 0x16, 0x55, 0x26, 0x29, 0xd4, 0x68, 0x9e,
+    0x2b, 0x16, 0xbe, 0x58, 0x7d, 0x47, 0xa1, 0xfc, 0x8f, 0xf8, 0xb8, 0xd1, 0x7a, 0xd0, 0x31, 0xce,
+    0x45, 0xcb, 0x3a, 0x8f, 0x95, 0x16, 0x04, 0x28, 0xaf, 0xd7, 0xfb, 0xca, 0xbb, 0x4b, 0x40, 0x7e,
+};
+
+typedef void (*AccumulateFunction)(quint64 *accumulators, const unsigned char *data,
+                                   const unsigned char *secret, size_t stripes);
+
+std::atomic<int> s_activeImplementation(-1);
+
+inline quint64 read64(const unsigned char *p)
+{
+    return qFromLittleEndian<quint64>(p);
+}
+
+inline quint32 read32(const unsigned char *p)
+{
+    return qFromLittleEndian<quint32>(p);
+}
+
+inline quint64 rotl64(quint64 value, int bits)
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline quint64 swap64(quint64 value)
+{
+    return qbswap(value);
+}
+
+// Low and high halves of the 128-bit product, XORed together
+inline quint64 multiplyFold64(quint64 a, quint64 b)
+{
+#if defined(__SIZEOF_INT128__)
+    const unsigned __int128 product = static_cast<unsigned __int128>(a) * b;
+    return static_cast<quint64>(product) ^ static_cast<quint64>(product >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    quint64 high;
+    const quint64 low = _umul128(a, b, &high);
+    return low ^ high;
+#else
+    const quint64 loLo = (a & 0xFFFFFFFFULL) * (b & 0xFFFFFFFFULL);
+    const quint64 hiLo = (a >> 32) * (b & 0xFFFFFFFFULL);
+    const quint64 loHi = (a & 0xFFFFFFFFULL) * (b >> 32);
+    const quint64 hiHi = (a >> 32) * (b >> 32);
+    const quint64 cross = (loLo >> 32) + (hiLo & 0xFFFFFFFFULL) + loHi;
+    const quint64 high = (hiLo >> 32) + (cross >> 32) + hiHi;
+    const quint64 low = (cross << 32) | (loLo & 0xFFFFFFFFULL);
+    return low ^ high;
+#endif
+}
+
+quint64 xxh64Avalanche(quint64 h)
+{
+    h ^= h >> 33;
+    h *= Prime64_2;
+    h ^= h >> 29;
+    h *= Prime64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+quint64 avalanche(quint64 h)
+{
+    h ^= h >> 37;
+    h *= PrimeMx1;
+    h ^= h >> 32;
+    return h;
+}
+
+quint64 rrmxmx(quint64 h, quint64 length)
+{
+    h ^= rotl64(h, 49) ^ rotl64(h, 24);
+    h *= PrimeMx2;
+    h ^= (h >> 35) + length;
+    h *= PrimeMx2;
+    h ^= h >> 28;
+    return h;
+}
+
+inline quint64 mix16(const unsigned char *data, const unsigned char *secret)
+{
+    return multiplyFold64(read64(data) ^ read64(secret), read64(data + 8) ^ read64(secret + 8));
+}
+
+// Inputs of up to 240 bytes never reach the stripe loop
+quint64 hashShort(const unsigned char *data, size_t length)
+{
+    const unsigned char *secret = kSecret;
+
+    if (length == 0) {
+        return xxh64Avalanche(read64(secret + 56) ^ read64(secret + 64));
+    }
+    if (length <= 3) {
+        const quint32 combined = (quint32(data[0]) << 16) | (quint32(data[length >> 1]) << 24) |
+                                 quint32(data[length - 1]) | (quint32(length) << 8);
+        const quint64 bitflip = read32(secret) ^ read32(secret + 4);
+        return xxh64Avalanche(quint64(combined) ^ bitflip);
+    }
+    if (length <= 8) {
+        const quint64 input = read32(data + length - 4) + (quint64(read32(data)) << 32);
+        const quint64 bitflip = read64(secret + 8) ^ read64(secret + 16);
+        return rrmxmx(input ^ bitflip, length);
+    }
+    if (length <= 16) {
+        const quint64 low = read64(data) ^ (read64(secret + 24) ^ read64(secret + 32));
+        const quint64 high = read64(data + length - 8) ^ (read64(secret + 40) ^ read64(secret + 48));
+        return avalanche(length + swap64(low) + high + multiplyFold64(low, high));
+    }
+
+    quint64 acc = length * Prime64_1;
+    if (length <= 128) {
+        if (length > 32) {
+            if (length > 64) {
+                if (length > 96) {
+                    acc += mix16(data + 48, secret + 96);
+                    acc += mix16(data + length - 64, secret + 112);
+                }
+                acc += mix16(data + 32, secret + 64);
+                acc += mix16(data + length - 48, secret + 80);
+            }
+            acc += mix16(data + 16, secret + 32);
+            acc += mix16(data + length - 32, secret + 48);
+        }
+        acc += mix16(data, secret);
+        acc += mix16(data + length - 16, secret + 16);
+        return avalanche(acc);
+    }
+
+    const int rounds = static_cast<int>(length / 16);
+    for (int i = 0; i < 8; ++i) {
+        acc += mix16(data + 16 * i, secret + 16 * i);
+    }
+    acc = avalanche(acc);
+    for (int i = 8; i < rounds; ++i) {
+        acc += mix16(data + 16 * i, secret + 16 * (i - 8) + 3);
+    }
+    acc += mix16(data + length - 16, secret + 136 - 17);
+    return avalanche(acc);
+}
+
+void accumulateScalar(quint64 *accumulators, const unsigned char *data,
+                      const unsigned char *secret, size_t stripes)
+{
+    for (size_t stripe = 0; stripe < stripes; ++stripe, data += 64, secret += 8) {
+        for (int i = 0; i < 8; ++i) {
+            const quint64 value = read64(data + 8 * i);
+            const quint64 keyed = value ^ read64(secret + 8 * i);
+            accumulators[i ^ 1] += value;
+            accumulators[i] += (keyed & 0xFFFFFFFFULL) * (keyed >> 32);
+        }
+    }
+}
+
+void scramble(quint64 *accumulators, const unsigned char *secret)
+{
+    for (int i = 0; i < 8; ++i) {
+        quint64 acc = accumulators[i];
+        acc ^= acc >> 47;
+        acc ^= read64(secret + 8 * i);
+        acc *= Prime32_1;
+        accumulators[i] = acc;
+    }
+}
+
+quint64 mergeAccumulators(const quint64 *accumulators, quint64 length)
+{
+    const unsigned char *secret = kSecret + SecretMergeStart;
+    quint64 result = length * Prime64_1;
+    for (int i = 0; i < 4; ++i) {
+        result += multiplyFold64(accumulators[2 * i] ^ read64(secret + 16 * i),
+                                 accumulators[2 * i + 1] ^ read64(secret + 16 * i + 8));
+    }
+    return avalanche(result);
+}
+
+#ifdef CONTENTHASH_X86
+// Each 64-bit lane gains the 32x32 product of its keyed halves, and the
+// neighbouring lane gains its plain value
+CONTENTHASH_TARGET("sse2")
+void accumulateSse2(quint64 *accumulators, const unsigned char *data,
+                    const unsigned char *secret, size_t stripes)
+{
+    __m128i *accPointer = reinterpret_cast<__m128i*>(accumulators);
+    __m128i acc[4];
+    for (int i = 0; i < 4; ++i) {
+        acc[i] = _mm_loadu_si128(accPointer + i);
+    }
+
+    for (size_t stripe = 0; stripe < stripes; ++stripe, data += 64, secret += 8) {
+        for (int i = 0; i < 4; ++i) {
+            const __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data) + i);
+            const __m128i key = _mm_loadu_si128(reinterpret_cast<const __m128i*>(secret) + i);
+            const __m128i keyed = _mm_xor_si128(value, key);
+            const __m128i product = _mm_mul_epu32(keyed, _mm_shuffle_epi32(keyed, _MM_SHUFFLE(0, 3, 0, 1)));
+            const __m128i swapped = _mm_shuffle_epi32(value, _MM_SHUFFLE(1, 0, 3, 2));
+            acc[i] = _mm_add_epi64(acc[i], _mm_add_epi64(product, swapped));
+        }
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        _mm_storeu_si128(accPointer + i, acc[i]);
+    }
+}
+
+CONTENTHASH_TARGET("avx2")
+void accumulateAvx2(quint64 *accumulators, const unsigned char *data,
+                    const unsigned char *secret, size_t stripes)
+{
+    __m256i *accPointer = reinterpret_cast<__m256i*>(accumulators);
+    __m256i acc0 = _mm256_loadu_si256(accPointer);
+    __m256i acc1 = _mm256_loadu_si256(accPointer + 1);
+
+    for (size_t stripe = 0; stripe < stripes; ++stripe, data += 64, secret += 8) {
+        const __m256i value0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+        const __m256i value1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data) + 1);
+        const __m256i keyed0 = _mm256_xor_si256(value0, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(secret)));
+        const __m256i keyed1 = _mm256_xor_si256(value1, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(secret) + 1));
+        const __m256i product0 = _mm256_mul_epu32(keyed0, _mm256_shuffle_epi32(keyed0, _MM_SHUFFLE(0, 3, 0, 1)));
+        const __m256i product1 = _mm256_mul_epu32(keyed1, _mm256_shuffle_epi32(keyed1, _MM_SHUFFLE(0, 3, 0, 1)));
+        acc0 = _mm256_add_epi64(acc0, _mm256_add_epi64(product0, _mm256_shuffle_epi32(value0, _MM_SHUFFLE(1, 0, 3, 2))));
+        acc1 = _mm256_add_epi64(acc1, _mm256_add_epi64(product1, _mm256_shuffle_epi32(value1, _MM_SHUFFLE(1, 0, 3, 2))));
+    }
+
+    _mm256_storeu_si256(accPointer, acc0);
+    _mm256_storeu_si256(accPointer + 1, acc1);
+}
+
+// Bit 0: SSE2, bit 1: AVX2, including the OS check that the wider register
+// state is saved across context switches
+int detectCpuFeatures()
+{
+    int features = 0;
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    const bool sse2 = (info[3] & (1 << 26)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+
+    bool avx2 = false;
+    if (maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+
+    if (sse2) features |= 1;
+    if (avx2 && (xcr0 & 0x6) == 0x6) features |= 2;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) features |= 1;
+    if (__builtin_cpu_supports("avx2")) features |= 2;
+#endif
+    return features;
+}
+#else
+int detectCpuFeatures()
+{
+    return 0;
+}
+#endif
+
+int cpuFeatures()
+{
+    static const int features = detectCpuFeatures();
+    return features;
+}
+
+AccumulateFunction kernelFor(ContentHash::Implementation implementation)
+{
+    switch (implementation) {
+#ifdef CONTENTHASH_X86
+        case ContentHash::Implementation::SSE2: return accumulateSse2;
+        case ContentHash::Implementation::AVX2: return accumulateAvx2;
+#endif
+        default: return accumulateScalar;
+    }
+}
+
+} // namespace
+
+ContentHash::ContentHash()
+{
+    reset();
+}
+
+void ContentHash::reset()
+{
+    static const quint64 initial[8] = {
+        Prime32_3, Prime64_1, Prime64_2, Prime64_3, Prime64_4, Prime32_2, Prime64_5, Prime32_1
+    };
+    memcpy(m_accumulators, initial, sizeof(m_accumulators));
+    memset(m_lastStripe, 0, sizeof(m_lastStripe));
+    m_bufferedSize = 0;
+    m_stripesInBlock = 0;
+    m_totalSize = 0;
+}
+
+void ContentHash::consumeStripes(quint64 *accumulators, int &stripesInBlock,
+                                 const unsigned char *data, qint64 stripes) const
+{
+    const AccumulateFunction accumulate = kernelFor(activeImplementation());
+
+    while (stripes > 0) {
+        const qint64 count = qMin<qint64>(stripes, StripesPerBlock - stripesInBlock);
+        accumulate(accumulators, data, kSecret + stripesInBlock * 8, static_cast<size_t>(count));
+        data += count * StripeSize;
+        stripes -= count;
+        stripesInBlock += static_cast<int>(count);
+
+        if (stripesInBlock == StripesPerBlock) {
+            scramble(accumulators, kSecret + SecretSize - StripeSize);
+            stripesInBlock = 0;
+        }
+    }
+}
+
+void ContentHash::addData(const char *data, qint64 size)
+{
+    if (size <= 0) {
+        return;
+    }
+
+    const unsigned char *input = reinterpret_cast<const unsigned char*>(data);
+    m_totalSize += static_cast<quint64>(size);
+
+    if (m_bufferedSize + size <= BufferSize) {
+        memcpy(m_buffer + m_bufferedSize, input, static_cast<size_t>(size));
+        m_bufferedSize += static_cast<int>(size);
+        return;
+    }
+
+    // The last stripe of the input is hashed with its own key, so stripes
+    // are only consumed while at least one more byte follows them
+    if (m_bufferedSize > 0) {
+        const int fill = BufferSize - m_bufferedSize;
+        memcpy(m_buffer + m_bufferedSize, input, fill);
+        input += fill;
+        size -= fill;
+        consumeStripes(m_accumulators, m_stripesInBlock, m_buffer, BufferSize / StripeSize);
+        memcpy(m_lastStripe, m_buffer + BufferSize - StripeSize, StripeSize);
+        m_bufferedSize = 0;
+    }
+
+    if (size > BufferSize) {
+        const qint64 stripes = (size - 1) / StripeSize;
+        consumeStripes(m_accumulators, m_stripesInBlock, input, stripes);
+        input += stripes * StripeSize;
+        size -= stripes * StripeSize;
+        memcpy(m_lastStripe, input - StripeSize, StripeSize);
+    }
+
+    memcpy(m_buffer, input, static_cast<size_t>(size));
+    m_bufferedSize = static_cast<int>(size);
+}
+
+quint64 ContentHash::result() const
+{
+    if (m_totalSize <= MidSizeMax) {
+        return hashShort(m_buffer, static_cast<size_t>(m_totalSize));
+    }
+
+    quint64 accumulators[8];
+    memcpy(accumulators, m_accumulators, sizeof(accumulators));
+    int stripesInBlock = m_stripesInBlock;
+
+    const unsigned char *lastStripe;
+    unsigned char joined[StripeSize];
+    if (m_bufferedSize >= StripeSize) {
+        consumeStripes(accumulators, stripesInBlock, m_buffer, (m_bufferedSize - 1) / StripeSize);
+        lastStripe = m_buffer + m_bufferedSize - StripeSize;
+    } else {
+        // The last 64 bytes start in the stripe consumed before the buffer
+        const int carried = StripeSize - m_bufferedSize;
+        memcpy(joined, m_lastStripe + StripeSize - carried, carried);
+        memcpy(joined + carried, m_buffer, m_bufferedSize);
+        lastStripe = joined;
+    }
+
+    accumulateScalar(accumulators, lastStripe, kSecret + SecretSize - StripeSize - SecretLastStripeStart, 1);
+    return mergeAccumulators(accumulators, m_totalSize);
+}
+
+quint64 ContentHash::hash(const char *data, qint64 size)
+{
+    if (size <= MidSizeMax) {
+        return hashShort(reinterpret_cast<const unsigned char*>(data), static_cast<size_t>(qMax<qint64>(size, 0)));
+    }
+    ContentHash hasher;
+    hasher.addData(data, size);
+    return hasher.result();
+}
+
+QString ContentHash::toHex(quint64 hash)
+{
+    return QString("%1").arg(hash, 16, 16, QChar('0'));
+}
+
+ContentHash::Implementation ContentHash::bestSupportedImplementation()
+{
+    if (isSupported(Implementation::AVX2)) return Implementation::AVX2;
+    if (isSupported(Implementation::SSE2)) return Implementation::SSE2;
+    return Implementation::Scalar;
+}
+
+bool ContentHash::isSupported(Implementation implementation)
+{
+    switch (implementation) {
+        case Implementation::Scalar: return true;
+        case Implementation::SSE2:   return (cpuFeatures() & 1) != 0;
+        case Implementation::AVX2:   return (cpuFeatures() & 2) != 0;
+    }
+    return false;
+}
+
+ContentHash::Implementation ContentHash::activeImplementation()
+{
+    int active = s_activeImplementation.load(std::memory_order_relaxed);
+    if (active < 0) {
+        active = static_cast<int>(bestSupportedImplementation());
+        s_activeImplementation.store(active, std::memory_order_relaxed);
+    }
+    return static_cast<Implementation>(active);
+}
+
+void ContentHash::setActiveImplementation(Implementation implementation)
+{
+    if (!isSupported(implementation)) {
+        implementation = bestSupportedImplementation();
+    }
+    s_activeImplementation.store(static_cast<int>(implementation), std::memory_order_relaxed);
+}
+
+QString ContentHash::implementationName(Implementation implementation)
+{
+    switch (implementation) {
+        case Implementation::Scalar: return "Scalar";
+        case Implementation::SSE2:   return "SSE2";
+        case Implementation::AVX2:   return "AVX2";
+    }
+    return "Unknown";
+}
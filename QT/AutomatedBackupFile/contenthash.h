@@ -0,0 +1,61 @@
+#ifndef CONTENTHASH_H
+#define CONTENTHASH_H
+
+#include <QByteArray>
+#include <QString>
+
+// Incremental 64-bit XXH3 (seed 0, default secret), for telling whether a
+// backup's contents have changed. Not a cryptographic hash: it guards
+// against bit rot, not tampering. The stripe loop has SSE2 and AVX2 kernels
+// picked at runtime from cpuid and a portable scalar fallback; results are
+// identical to the reference XXH3_64bits() in every case.
+class ContentHash
+{
+public:
+    enum class Implementation {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    ContentHash();
+
+    void reset();
+    void addData(const char *data, qint64 size);
+    void addData(const QByteArray &data) { addData(data.constData(), data.size()); }
+
+    // Hash of everything added since the last reset; adding more afterwards
+    // continues the same input
+    quint64 result() const;
+
+    static quint64 hash(const char *data, qint64 size);
+    static quint64 hash(const QByteArray &data) { return hash(data.constData(), data.size()); }
+
+    // Sixteen lowercase hex digits, as stored in BackupFileInfo::checksum
+    static QString toHex(quint64 hash);
+
+    // Runtime dispatch
+    static Implementation bestSupportedImplementation();
+    static bool isSupported(Implementation implementation);
+    static Implementation activeImplementation();
+    static void setActiveImplementation(Implementation implementation);  // For tests and benchmarks
+    static QString implementationName(Implementation implementation);
+
+private:
+    static const int StripeSize = 64;
+    static const int StripesPerBlock = 16;  // Scrambled after every block
+    static const int BufferSize = 256;      // Inputs up to 240 bytes are hashed whole
+    static const int MidSizeMax = 240;
+
+    quint64 m_accumulators[8];
+    unsigned char m_buffer[BufferSize];
+    unsigned char m_lastStripe[StripeSize];  // End of the input consumed so far
+    int m_bufferedSize;
+    int m_stripesInBlock;
+    quint64 m_totalSize;
+
+    void consumeStripes(quint64 *accumulators, int &stripesInBlock,
+                        const unsigned char *data, qint64 stripes) const;
+};
+
+#endif // CONTENTHASH_H
@@ -1,20 +1,103 @@
 #include "destinationmanager.h"
+#include "backupcatalog.h"
+#include <QDebug>
 #include <QDir>
+#include <QDirIterator>
+#include <QFutureWatcher>
+#include <QThread>
+#include <QtConcurrent>
 #include <QStorageInfo>
 #include <QFileInfo>
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QFile>
-#include <QtConcurrent>
+#include <functional>
+
+namespace {
+
+// Runs on health check threads
+HealthCheckResult probeStorage(const QString &path, bool network)
+{
+    HealthCheckResult result;
+    const QFileInfo info(path);
+    if (!info.exists() || !info.isDir()) {
+        result.outcome = HealthCheckResult::Outcome::Unavailable;
+        result.error = network ? "Network path not accessible" : "Directory not found";
+        return result;
+    }
+
+    QStorageInfo storage(path);
+    if (storage.isValid() && storage.isReady()) {
+        result.outcome = HealthCheckResult::Outcome::Available;
+        result.freeSpace = storage.bytesAvailable();
+        result.totalSpace = storage.bytesTotal();
+    } else {
+        result.outcome = HealthCheckResult::Outcome::Error;
+        result.error = "Storage not ready";
+    }
+    return result;
+}
+
+QJsonObject probeToJson(const ProbeResult &probe)
+{
+    QJsonObject obj;
+    obj["timestamp"] = probe.timestamp.toString(Qt::ISODate);
+    if (!probe.error.isEmpty()) {
+        obj["error"] = probe.error;
+    }
+    obj["writeBytesPerSecond"] = probe.writeBytesPerSecond;
+    obj["readBytesPerSecond"] = probe.readBytesPerSecond;
+    obj["createsPerSecond"] = probe.createsPerSecond;
+    obj["fsyncMsecs"] = probe.fsyncMsecs;
+    obj["roundTripMsecs"] = probe.roundTripMsecs;
+    obj["uploadBytesPerSecond"] = probe.uploadBytesPerSecond;
+    obj["elapsedMsecs"] = probe.elapsedMsecs;
+    return obj;
+}
+
+ProbeResult probeFromJson(const QJsonObject &obj)
+{
+    ProbeResult probe;
+    probe.timestamp = QDateTime::fromString(obj["timestamp"].toString(), Qt::ISODate);
+    probe.error = obj["error"].toString();
+    probe.writeBytesPerSecond = obj["writeBytesPerSecond"].toDouble(0);
+    probe.readBytesPerSecond = obj["readBytesPerSecond"].toDouble(0);
+    probe.createsPerSecond = obj["createsPerSecond"].toDouble(0);
+    probe.fsyncMsecs = obj["fsyncMsecs"].toDouble(-1);
+    probe.roundTripMsecs = obj["roundTripMsecs"].toDouble(-1);
+    probe.uploadBytesPerSecond = obj["uploadBytesPerSecond"].toDouble(0);
+    probe.elapsedMsecs = static_cast<qint64>(obj["elapsedMsecs"].toDouble(0));
+    return probe;
+}
+
+} // namespace
 
 DestinationManager::DestinationManager(QObject *parent)
     : QObject(parent)
+    , m_healthChecks(new HealthCheckRunner(this))
+    , m_placementMode(PlacementEngine::Mode::Mirror)
+    , m_retentionLimiter(new BandwidthLimiter(DefaultRetentionDeleteRate))
 {
+    m_retentionPool.setMaxThreadCount(qBound(1, QThread::idealThreadCount(), 4));
+    m_probePool.setMaxThreadCount(1);
+    qRegisterMetaType<ProbeResult>("ProbeResult");
+    connect(m_healthChecks, &HealthCheckRunner::finished,
+            this, &DestinationManager::onHealthCheckFinished);
 }
 
 DestinationManager::~DestinationManager()
 {
+    // Deletions cut short are finished by the next run
+    for (const auto &run : m_retentionRuns) {
+        run->cancelled = true;
+    }
+    for (const auto &stop : m_probes) {
+        *stop = true;
+    }
+    m_retentionPool.waitForDone();
+    m_probePool.waitForDone();
+    delete m_retentionLimiter;
     qDeleteAll(m_destinations);
     m_destinations.clear();
 }
@@ -48,6 +131,11 @@ bool DestinationManager::removeDestination(const QString &destinationId)
     for (int i = 0; i < m_destinations.size(); ++i) {
         if (m_destinations[i]->getId() == destinationId) {
             BackupDestination *dest = m_destinations.takeAt(i);
+            m_healthChecks->cancel(destinationId);
+            cancelRetention(destinationId);
+            m_retentionRuns.remove(destinationId);
+            cancelProbe(destinationId);
+            m_probes.remove(destinationId);
             emit destinationRemoved(destinationId);
             delete dest;
             return true;
@@ -79,47 +167,17 @@ int DestinationManager::getDestinationCount() const
 void DestinationManager::checkDestination(const QString &destinationId)
 {
     BackupDestination *dest = getDestination(destinationId);
-    if (!dest) {
-        return;
+    if (dest) {
+        startCheck(dest, true);
     }
-    
-    dest->setStatus(DestinationStatus::Checking);
-    emit destinationStatusChanged(destinationId, DestinationStatus::Checking);
-    
-    // Run check asynchronously (ignore return value as we don't need the QFuture)
-    (void)QtConcurrent::run([this, dest, destinationId]() {
-        bool success = false;
-        
-        switch (dest->getType()) {
-            case DestinationType::Local:
-                checkLocalDestination(dest);
-                success = dest->getStatus() == DestinationStatus::Available;
-                break;
-            case DestinationType::Network:
-                checkNetworkDestination(dest);
-                success = dest->getStatus() == DestinationStatus::Available;
-                break;
-            case DestinationType::Cloud:
-                checkCloudDestination(dest);
-                success = dest->getStatus() == DestinationStatus::Available;
-                break;
-        }
-        
-        dest->setLastChecked(QDateTime::currentDateTime());
-        
-        // Emit signals on main thread
-        QMetaObject::invokeMethod(this, [this, destinationId, success, dest]() {
-            emit destinationStatusChanged(destinationId, dest->getStatus());
-            emit checkCompleted(destinationId, success);
-            emit destinationUpdated(destinationId);
-        }, Qt::QueuedConnection);
-    });
 }
 
 void DestinationManager::checkAllDestinations()
 {
-    for (const auto *dest : m_destinations) {
-        checkDestination(dest->getId());
+    // All at once; destinations already checked keep their last status
+    // until their result is in
+    for (auto *dest : m_destinations) {
+        startCheck(dest, !dest->getLastChecked().isValid());
     }
 }
 
@@ -199,6 +257,143 @@ BackupDestination* DestinationManager::findBestDestination(qint64 requiredSpace)
     return best;
 }
 
+BackupPlacement DestinationManager::createPlacement(const QStringList &destinationPaths) const
+{
+    BackupPlacement placement;
+    placement.mode = m_placementMode;
+    for (const QString &path : destinationPaths) {
+        PlacementTarget target;
+        if (const BackupDestination *dest = destinationForPath(path)) {
+            // Files are staged unencrypted next to their encrypted copies,
+            // so a part takes up about twice its size until it is done
+            if (dest->getStatus() == DestinationStatus::Available) {
+                target.freeSpace = dest->getFreeSpace() / 2;
+            }
+            // A probe's raw write rate until backups were measured
+            target.throughput = dest->getWriteThroughput() > 0 ? dest->getWriteThroughput()
+                                                               : dest->getLatestProbe().writeBytesPerSecond;
+        }
+        placement.targets.insert(path, target);
+    }
+    return placement;
+}
+
+void DestinationManager::recordThroughput(const QString &destinationPath, qint64 bytes, qint64 msecs)
+{
+    BackupDestination *dest = destinationForPath(destinationPath);
+    if (!dest || bytes < MinThroughputSample || msecs <= 0) {
+        return;
+    }
+
+    const double rate = bytes * 1000.0 / msecs;
+    const double previous = dest->getWriteThroughput();
+    dest->setWriteThroughput(previous > 0 ? 0.7 * previous + 0.3 * rate : rate);
+    emit destinationUpdated(dest->getId());
+}
+
+BackupDestination* DestinationManager::destinationForPath(const QString &path) const
+{
+    // The destination whose directory holds path; the deepest if nested
+    const QString cleanPath = QDir::cleanPath(path);
+    BackupDestination *best = nullptr;
+    int bestLength = -1;
+    for (auto *dest : m_destinations) {
+        const QString root = QDir::cleanPath(dest->getPath());
+        if (root.isEmpty() || root.size() <= bestLength) {
+            continue;
+        }
+        if (cleanPath == root || cleanPath.startsWith(root.endsWith('/') ? root : root + "/")) {
+            best = dest;
+            bestLength = root.size();
+        }
+    }
+    return best;
+}
+
+bool DestinationManager::probeDestination(const QString &destinationId, const ProbeBudget &budget)
+{
+    BackupDestination *dest = getDestination(destinationId);
+    if (!dest || m_probes.contains(destinationId)) {
+        return false;
+    }
+    
+    // Like health checks, the probe gets copies, not the destination
+    std::function<ProbeResult(const std::atomic<bool> *)> probe;
+    if (dest->getType() == DestinationType::Cloud) {
+        CloudProvider *provider = m_cloudProviders.value(destinationId, nullptr);
+        if (!provider) {
+            emit error("No cloud provider configured for destination: " + dest->getPath());
+            return false;
+        }
+        // Signed in anew on the pool thread, like health checks: the
+        // configured provider belongs to this thread and may be deleted
+        // while the probe runs
+        const CloudProvider::CloudProviderType providerType = provider->getProviderType();
+        const QMap<QString, QString> credentials = provider->getCredentials();
+        probe = [providerType, credentials, budget](const std::atomic<bool> *stop) {
+            QString error;
+            CloudProvider *probeProvider =
+                CloudProviderFactory::createAuthenticated(providerType, credentials, &error);
+            if (!probeProvider) {
+                ProbeResult result;
+                result.timestamp = QDateTime::currentDateTime();
+                result.error = error;
+                return result;
+            }
+            const ProbeResult result = DestinationProbe::probeCloud(probeProvider, budget, stop);
+            delete probeProvider;
+            return result;
+        };
+    } else {
+        const QString path = dest->getPath();
+        probe = [path, budget](const std::atomic<bool> *stop) {
+            return DestinationProbe::probeDirectory(path, budget, stop);
+        };
+    }
+    
+    QSharedPointer<std::atomic<bool>> stop(new std::atomic<bool>(false));
+    m_probes.insert(destinationId, stop);
+    
+    auto *watcher = new QFutureWatcher<ProbeResult>(this);
+    connect(watcher, &QFutureWatcher<ProbeResult>::finished, this, [this, watcher, destinationId, stop]() {
+        watcher->deleteLater();
+        if (m_probes.value(destinationId) != stop) {
+            return;  // Destination removed meanwhile
+        }
+        m_probes.remove(destinationId);
+        
+        const ProbeResult result = watcher->result();
+        BackupDestination *dest = getDestination(destinationId);
+        if (!dest || *stop) {
+            return;
+        }
+        dest->addProbeResult(result);
+        if (!result.isValid()) {
+            qWarning() << "Probing" << dest->getPath() << "failed:" << result.error;
+        }
+        emit probeFinished(destinationId, result);
+        emit destinationUpdated(destinationId);
+    });
+    watcher->setFuture(QtConcurrent::run(&m_probePool, [probe, stop]() {
+        return probe(stop.data());
+    }));
+    return true;
+}
+
+void DestinationManager::cancelProbe(const QString &destinationId)
+{
+    const QSharedPointer<std::atomic<bool>> stop = m_probes.value(destinationId);
+    if (stop) {
+        *stop = true;
+    }
+}
+
+double DestinationManager::estimateBackupSeconds(const QString &destinationId, qint64 bytes, qint64 files) const
+{
+    const BackupDestination *dest = getDestination(destinationId);
+    return dest ? dest->getLatestProbe().estimateSeconds(bytes, files) : -1;
+}
+
 void DestinationManager::setRetentionPolicy(const RetentionPolicy &policy)
 {
     m_retentionPolicy = policy;
@@ -209,16 +404,188 @@ RetentionPolicy DestinationManager::getRetentionPolicy() const
     return m_retentionPolicy;
 }
 
-void DestinationManager::applyRetentionPolicy(const QString &destinationId)
+bool DestinationManager::applyRetentionPolicy(const QString &destinationId, bool dryRun)
 {
-    // Placeholder for retention policy application
-    // Would scan backup files and delete old ones based on policy
     BackupDestination *dest = getDestination(destinationId);
-    if (!dest) {
-        return;
+    if (!dest || m_retentionRuns.contains(destinationId)) {
+        return false;
+    }
+    if (dest->getType() == DestinationType::Cloud) {
+        emit error("Retention is not supported for cloud destinations: " + dest->getPath());
+        return false;
+    }
+    
+    QSharedPointer<RetentionRun> run(new RetentionRun());
+    run->destinationId = destinationId;
+    run->root = dest->getPath();
+    if (!m_catalogDirectory.isEmpty()) {
+        run->catalogPath = QDir(m_catalogDirectory).filePath(destinationId + ".catalog");
+    }
+    run->policy = m_retentionPolicy;
+    run->dryRun = dryRun;
+    m_retentionRuns.insert(destinationId, run);
+    
+    auto *watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcher<bool>::finished, this, [this, watcher, run]() {
+        watcher->deleteLater();
+        if (m_retentionRuns.value(run->destinationId) != run) {
+            return;  // Destination removed meanwhile
+        }
+        if (!watcher->result()) {
+            if (!run->cancelled) {
+                emit error("Failed to list backups in: " + run->root);
+            }
+            finishRetention(run);
+            return;
+        }
+        
+        emit retentionPlanned(run->destinationId, run->plan, run->dryRun);
+        if (run->dryRun || run->removals.isEmpty() || run->cancelled) {
+            finishRetention(run);
+        } else {
+            startRetentionWorkers(run);
+        }
+    });
+    watcher->setFuture(QtConcurrent::run(&m_retentionPool, [run]() {
+        return planRetention(run.data());
+    }));
+    return true;
+}
+
+void DestinationManager::cancelRetention(const QString &destinationId)
+{
+    const QSharedPointer<RetentionRun> run = m_retentionRuns.value(destinationId);
+    if (run) {
+        run->cancelled = true;  // Finished once its jobs return
+    }
+}
+
+void DestinationManager::setCatalogDirectory(const QString &directory)
+{
+    m_catalogDirectory = directory;
+    if (!directory.isEmpty() && !QDir().mkpath(directory)) {
+        qWarning() << "Failed to create backup catalog directory:" << directory;
+    }
+}
+
+void DestinationManager::setRetentionThreadCount(int threadCount)
+{
+    m_retentionPool.setMaxThreadCount(qMax(1, threadCount));
+}
+
+void DestinationManager::setRetentionDeleteRate(qint64 filesPerSecond)
+{
+    m_retentionLimiter->setLimit(filesPerSecond);
+}
+
+bool DestinationManager::planRetention(RetentionRun *run)
+{
+    BackupCatalog catalog;
+    if (!run->catalogPath.isEmpty()) {
+        catalog.load(run->catalogPath, run->root);
+    }
+    if (!catalog.refresh(run->root, &run->cancelled)) {
+        return false;
+    }
+    if (!run->catalogPath.isEmpty()) {
+        catalog.save(run->catalogPath);
+    }
+    
+    run->plan = run->policy.plan(catalog.generations(), QDateTime::currentDateTime());
+    if (run->dryRun) {
+        return true;
+    }
+    for (const QString &name : catalog.leftovers()) {
+        RetentionRemoval removal;
+        removal.name = name;
+        run->removals.append(removal);
+    }
+    for (const BackupGeneration &generation : run->plan.toDelete()) {
+        RetentionRemoval removal;
+        removal.name = generation.name;
+        removal.size = generation.size;
+        run->removals.append(removal);
+    }
+    return true;
+}
+
+void DestinationManager::startRetentionWorkers(const QSharedPointer<RetentionRun> &run)
+{
+    run->workers = qBound(1, m_retentionPool.maxThreadCount(), static_cast<int>(run->removals.size()));
+    
+    BandwidthLimiter *limiter = m_retentionLimiter;
+    for (int i = 0; i < run->workers; ++i) {
+        auto *watcher = new QFutureWatcher<void>(this);
+        connect(watcher, &QFutureWatcher<void>::finished, this, [this, watcher, run]() {
+            watcher->deleteLater();
+            if (++run->finishedWorkers == run->workers && m_retentionRuns.value(run->destinationId) == run) {
+                finishRetention(run);
+            }
+        });
+        watcher->setFuture(QtConcurrent::run(&m_retentionPool, [run, limiter]() {
+            runRetentionWorker(run.data(), limiter);
+        }));
+    }
+}
+
+void DestinationManager::runRetentionWorker(RetentionRun *run, BandwidthLimiter *limiter)
+{
+    while (!run->cancelled) {
+        const int index = run->next.fetch_add(1);
+        if (index >= run->removals.size()) {
+            return;
+        }
+        const RetentionRemoval &removal = run->removals.at(index);
+        if (deleteGeneration(run->root, removal.name, limiter, run->cancelled)) {
+            if (!removal.name.startsWith(BackupCatalog::DeletingPrefix)) {
+                run->deleted++;
+            }
+            run->reclaimed += removal.size;
+        }
+    }
+}
+
+bool DestinationManager::deleteGeneration(const QString &root, const QString &name,
+                                          BandwidthLimiter *limiter, const std::atomic<bool> &cancelled)
+{
+    // Out of the catalog before the first file goes, so a deletion cut
+    // short never leaves what looks like a generation
+    QDir rootDir(root);
+    QString deletingName = name;
+    if (!name.startsWith(BackupCatalog::DeletingPrefix)) {
+        deletingName = BackupCatalog::DeletingPrefix + name;
+        if (!rootDir.rename(name, deletingName)) {
+            qWarning() << "Failed to delete backup:" << rootDir.filePath(name);
+            return false;
+        }
     }
     
-    // TODO: Implement actual file cleanup based on retention policy
+    // File by file, so the rate limit also holds within a large generation;
+    // the emptied directories go at the end
+    const QString path = rootDir.filePath(deletingName);
+    QDirIterator it(path, QDir::Files | QDir::Hidden | QDir::System, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        if (cancelled) {
+            return false;
+        }
+        limiter->acquire(1);
+        QFile::remove(it.next());
+    }
+    if (!QDir(path).removeRecursively()) {
+        qWarning() << "Failed to delete backup:" << path;
+        return false;
+    }
+    qDebug() << "Retention deleted backup:" << rootDir.filePath(name);
+    return true;
+}
+
+void DestinationManager::finishRetention(const QSharedPointer<RetentionRun> &run)
+{
+    m_retentionRuns.remove(run->destinationId);
+    emit retentionFinished(run->destinationId, run->deleted, run->reclaimed);
+    if (run->deleted > 0) {
+        checkDestination(run->destinationId);  // Free space changed
+    }
 }
 
 bool DestinationManager::saveToFile(const QString &filePath)
@@ -234,6 +601,12 @@ bool DestinationManager::saveToFile(const QString &filePath)
         obj["username"] = dest->getUsername();
         // Note: In production, password should be encrypted
         obj["password"] = dest->getPassword();
+        obj["writeThroughput"] = dest->getWriteThroughput();
+        QJsonArray probesArray;
+        for (const ProbeResult &probe : dest->getProbeHistory()) {
+            probesArray.append(probeToJson(probe));
+        }
+        obj["probes"] = probesArray;
         destinationsArray.append(obj);
     }
     
@@ -244,7 +617,12 @@ bool DestinationManager::saveToFile(const QString &filePath)
     policyObj["retentionDays"] = m_retentionPolicy.getRetentionDays();
     policyObj["autoCleanup"] = m_retentionPolicy.isAutoCleanupEnabled();
     policyObj["maxBackupCount"] = m_retentionPolicy.getMaxBackupCount();
+    policyObj["maxStorageSize"] = m_retentionPolicy.getMaxStorageSize();
+    policyObj["keepDaily"] = m_retentionPolicy.isKeepDailyBackups();
+    policyObj["keepWeekly"] = m_retentionPolicy.isKeepWeeklyBackups();
+    policyObj["keepMonthly"] = m_retentionPolicy.isKeepMonthlyBackups();
     root["retentionPolicy"] = policyObj;
+    root["placementMode"] = PlacementEngine::modeToString(m_placementMode);
     
     QJsonDocument doc(root);
     
@@ -294,6 +672,10 @@ bool DestinationManager::loadFromFile(const QString &filePath)
         dest->setEnabled(obj["enabled"].toBool());
         dest->setUsername(obj["username"].toString());
         dest->setPassword(obj["password"].toString());
+        dest->setWriteThroughput(obj["writeThroughput"].toDouble(0));
+        for (const QJsonValue &probe : obj["probes"].toArray()) {
+            dest->addProbeResult(probeFromJson(probe.toObject()));
+        }
         
         m_destinations.append(dest);
     }
@@ -304,92 +686,115 @@ bool DestinationManager::loadFromFile(const QString &filePath)
         m_retentionPolicy.setRetentionDays(policyObj["retentionDays"].toInt(30));
         m_retentionPolicy.setAutoCleanup(policyObj["autoCleanup"].toBool());
         m_retentionPolicy.setMaxBackupCount(policyObj["maxBackupCount"].toInt(0));
+        m_retentionPolicy.setMaxStorageSize(static_cast<qint64>(policyObj["maxStorageSize"].toDouble(0)));
+        m_retentionPolicy.setKeepDailyBackups(policyObj["keepDaily"].toBool(true));
+        m_retentionPolicy.setKeepWeeklyBackups(policyObj["keepWeekly"].toBool(true));
+        m_retentionPolicy.setKeepMonthlyBackups(policyObj["keepMonthly"].toBool(true));
     }
+    m_placementMode = PlacementEngine::modeFromString(root["placementMode"].toString());
     
     return true;
 }
 
-void DestinationManager::onCheckCompleted()
+void DestinationManager::onHealthCheckFinished(const QString &destinationId, const HealthCheckResult &result)
 {
-    // Handle check completion if needed
-}
-
-void DestinationManager::checkLocalDestination(BackupDestination *destination)
-{
-    QDir dir(destination->getPath());
-    
-    if (!dir.exists()) {
-        destination->setStatus(DestinationStatus::Unavailable);
+    BackupDestination *dest = getDestination(destinationId);
+    if (!dest) {
         return;
     }
-    
-    // Get storage information
-    QStorageInfo storage(destination->getPath());
-    
-    if (storage.isValid() && storage.isReady()) {
-        destination->setFreeSpace(storage.bytesAvailable());
-        destination->setTotalSpace(storage.bytesTotal());
-        destination->setStatus(DestinationStatus::Available);
-    } else {
-        destination->setStatus(DestinationStatus::Error);
+
+    switch (result.outcome) {
+        case HealthCheckResult::Outcome::Available:
+            dest->setStatus(DestinationStatus::Available);
+            break;
+        case HealthCheckResult::Outcome::Unavailable:
+        case HealthCheckResult::Outcome::TimedOut:
+            dest->setStatus(DestinationStatus::Unavailable);
+            break;
+        case HealthCheckResult::Outcome::Error:
+            dest->setStatus(DestinationStatus::Error);
+            break;
     }
-}
+    if (result.freeSpace >= 0) {
+        dest->setFreeSpace(result.freeSpace);
+        dest->setTotalSpace(result.totalSpace);
+    }
+    dest->setLastChecked(QDateTime::currentDateTime());
 
-void DestinationManager::checkNetworkDestination(BackupDestination *destination)
-{
-    // Check if network path is accessible
-    QFileInfo info(destination->getPath());
-    
-    if (!info.exists() || !info.isDir()) {
-        destination->setStatus(DestinationStatus::Unavailable);
-        return;
+    const bool success = result.outcome == HealthCheckResult::Outcome::Available;
+    if (!success && dest->getType() == DestinationType::Cloud) {
+        emit error("Cloud connection failed: " + result.error);
     }
+    emit destinationStatusChanged(destinationId, dest->getStatus());
+    emit checkCompleted(destinationId, success);
+    emit destinationUpdated(destinationId);
     
-    // Try to get storage info
-    QStorageInfo storage(destination->getPath());
-    
-    if (storage.isValid() && storage.isReady()) {
-        destination->setFreeSpace(storage.bytesAvailable());
-        destination->setTotalSpace(storage.bytesTotal());
-        destination->setStatus(DestinationStatus::Available);
-    } else {
-        destination->setStatus(DestinationStatus::Error);
+    if (success && dest->getType() != DestinationType::Cloud && m_retentionPolicy.isAutoCleanupEnabled()) {
+        applyRetentionPolicy(destinationId);
     }
 }
 
-void DestinationManager::checkCloudDestination(BackupDestination *destination)
+void DestinationManager::startCheck(BackupDestination *destination, bool showChecking)
 {
-    if (!destination) {
-        return;
+    const QString destinationId = destination->getId();
+    if (m_healthChecks->isRunning(destinationId)) {
+        return;  // Its result is still to come
     }
-    
-    // Get the cloud provider for this destination
-    CloudProvider *provider = m_cloudProviders.value(destination->getId(), nullptr);
-    
-    if (!provider) {
-        destination->setStatus(DestinationStatus::Error);
-        destination->setFreeSpace(0);
-        destination->setTotalSpace(0);
-        emit error("No cloud provider configured for destination: " + destination->getPath());
-        return;
+
+    // Probes run on the health check pool: they get copies, not the destination
+    const QString path = destination->getPath();
+    HealthCheckRunner::Probe probe;
+    switch (destination->getType()) {
+        case DestinationType::Local:
+            probe = [path]() { return probeStorage(path, false); };
+            break;
+        case DestinationType::Network:
+            probe = [path]() { return probeStorage(path, true); };
+            break;
+        case DestinationType::Cloud: {
+            CloudProvider *provider = m_cloudProviders.value(destinationId, nullptr);
+            if (!provider) {
+                destination->setStatus(DestinationStatus::Error);
+                destination->setFreeSpace(0);
+                destination->setTotalSpace(0);
+                destination->setLastChecked(QDateTime::currentDateTime());
+                emit error("No cloud provider configured for destination: " + path);
+                emit destinationStatusChanged(destinationId, DestinationStatus::Error);
+                emit checkCompleted(destinationId, false);
+                emit destinationUpdated(destinationId);
+                return;
+            }
+            // The probe signs in with a provider of its own: this one lives on
+            // this thread, and may be replaced or deleted while a probe past
+            // its deadline is still waiting on the network
+            const CloudProvider::CloudProviderType providerType = provider->getProviderType();
+            const QMap<QString, QString> credentials = provider->getCredentials();
+            probe = [providerType, credentials]() {
+                HealthCheckResult result;
+                QString error;
+                CloudProvider *probeProvider =
+                    CloudProviderFactory::createAuthenticated(providerType, credentials, &error);
+                if (probeProvider && probeProvider->testConnection()) {
+                    result.outcome = HealthCheckResult::Outcome::Available;
+                    result.freeSpace = probeProvider->getAvailableSpace();
+                    result.totalSpace = probeProvider->getTotalSpace();
+                } else {
+                    result.outcome = HealthCheckResult::Outcome::Unavailable;
+                    result.error = probeProvider ? probeProvider->getLastError() : error;
+                    result.freeSpace = 0;
+                    result.totalSpace = 0;
+                }
+                delete probeProvider;
+                return result;
+            };
+            break;
+        }
     }
-    
-    // Test connection
-    if (provider->testConnection()) {
-        destination->setStatus(DestinationStatus::Available);
-        
-        // Get space information
-        qint64 freeSpace = provider->getAvailableSpace();
-        qint64 totalSpace = provider->getTotalSpace();
-        
-        destination->setFreeSpace(freeSpace);
-        destination->setTotalSpace(totalSpace);
-        destination->setLastChecked(QDateTime::currentDateTime());
-    } else {
-        destination->setStatus(DestinationStatus::Unavailable);
-        destination->setFreeSpace(0);
-        destination->setTotalSpace(0);
-        emit error("Cloud connection failed: " + provider->getLastError());
+
+    m_healthChecks->start(destinationId, probe);
+    if (showChecking) {
+        destination->setStatus(DestinationStatus::Checking);
+        emit destinationStatusChanged(destinationId, DestinationStatus::Checking);
     }
 }
 
@@ -5,15 +5,24 @@
 #include <QList>
 #include <QString>
 #include <QMap>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <atomic>
 #include "backupdestination.h"
+#include "bandwidthlimiter.h"
 #include "retentionpolicy.h"
 #include "cloudprovider.h"
+#include "healthcheckrunner.h"
+#include "placementengine.h"
 
 class DestinationManager : public QObject
 {
     Q_OBJECT
     
 public:
+    static const qint64 DefaultRetentionDeleteRate = 1000;  // Files per second
+    static const qint64 MinThroughputSample = 1024 * 1024;  // Bytes; smaller copies mostly measure overhead
+    
     explicit DestinationManager(QObject *parent = nullptr);
     ~DestinationManager();
     
@@ -24,9 +33,12 @@ public:
     QList<BackupDestination*> getAllDestinations() const;
     int getDestinationCount() const;
     
-    // Destination operations
+    // Destination operations. Checks run concurrently and report through
+    // checkCompleted(); a destination still being checked, e.g. a dead
+    // share past its deadline, isn't checked again until that one returns.
     void checkDestination(const QString &destinationId);
     void checkAllDestinations();
+    void setCheckTimeout(int msecs) { m_healthChecks->setTimeout(msecs); }
     bool testConnection(BackupDestination *destination);
     void updateDestinationStatus(const QString &destinationId, DestinationStatus status);
     
@@ -35,10 +47,44 @@ public:
     qint64 getTotalUsedSpace() const;
     BackupDestination* findBestDestination(qint64 requiredSpace) const;
     
-    // Retention policy
+    // Retention policy. A run lists the backup generations of a local or
+    // network destination (BackupCatalog, kept in the catalog directory
+    // between runs), plans over all of them at once and reports the plan
+    // through retentionPlanned(). Unless it is a dry run, the generations to
+    // go are then deleted on worker threads, no more than the delete rate of
+    // files per second over all of them, and retentionFinished() follows.
+    // One run per destination at a time; with auto-cleanup, a run follows
+    // every successful check.
     void setRetentionPolicy(const RetentionPolicy &policy);
     RetentionPolicy getRetentionPolicy() const;
-    void applyRetentionPolicy(const QString &destinationId);
+    bool applyRetentionPolicy(const QString &destinationId, bool dryRun = false);
+    void cancelRetention(const QString &destinationId);
+    bool isApplyingRetention(const QString &destinationId) const { return m_retentionRuns.contains(destinationId); }
+    void setCatalogDirectory(const QString &directory);
+    void setRetentionThreadCount(int threadCount);
+    void setRetentionDeleteRate(qint64 filesPerSecond);  // 0 is unlimited
+    
+    // Placement. A job sending a source to several destinations spreads
+    // its files over them by the placement mode (see PlacementEngine).
+    // createPlacement() describes the destinations behind the job's
+    // destination paths; each destination's throughput is a moving average
+    // of the write rates its backups were measured at.
+    void setPlacementMode(PlacementEngine::Mode mode) { m_placementMode = mode; }
+    PlacementEngine::Mode getPlacementMode() const { return m_placementMode; }
+    BackupPlacement createPlacement(const QStringList &destinationPaths) const;
+    void recordThroughput(const QString &destinationPath, qint64 bytes, qint64 msecs);
+    
+    // Performance probes (DestinationProbe), one destination at a time so
+    // they don't measure each other. Results go into the destination's
+    // history, are saved with it and reported through probeFinished(); the
+    // latest stands in for a throughput placement hasn't measured yet.
+    bool probeDestination(const QString &destinationId, const ProbeBudget &budget = ProbeBudget());
+    void cancelProbe(const QString &destinationId);
+    bool isProbing(const QString &destinationId) const { return m_probes.contains(destinationId); }
+    
+    // Expected seconds to write a backup of this size to a destination, by
+    // its latest probe; -1 if it was never probed
+    double estimateBackupSeconds(const QString &destinationId, qint64 bytes, qint64 files) const;
     
     // Persistence
     bool saveToFile(const QString &filePath);
@@ -56,19 +102,59 @@ signals:
     void destinationStatusChanged(const QString &destinationId, DestinationStatus status);
     void checkCompleted(const QString &destinationId, bool success);
     void error(const QString &message);
+    void retentionPlanned(const QString &destinationId, const RetentionPlan &plan, bool dryRun);
+    void retentionFinished(const QString &destinationId, int generationsDeleted, qint64 bytesReclaimed);
+    void probeFinished(const QString &destinationId, const ProbeResult &result);
     
 private slots:
-    void onCheckCompleted();
+    void onHealthCheckFinished(const QString &destinationId, const HealthCheckResult &result);
     
 private:
     QList<BackupDestination*> m_destinations;
     RetentionPolicy m_retentionPolicy;
     QMap<QString, CloudProvider*> m_cloudProviders; // Maps destination ID to cloud provider
+    HealthCheckRunner *m_healthChecks;
+    PlacementEngine::Mode m_placementMode;
+    
+    // A directory retention deletes, with what its generation was counted at
+    struct RetentionRemoval {
+        QString name;
+        qint64 size = 0;
+    };
+    
+    // One destination's retention, shared with its worker threads
+    struct RetentionRun {
+        QString destinationId;
+        QString root;
+        QString catalogPath;
+        RetentionPolicy policy;
+        bool dryRun = false;
+        RetentionPlan plan;                // Filled in by the planning job
+        QList<RetentionRemoval> removals;  // Interrupted deletions first, then the plan's, oldest first
+        std::atomic<int> next{0};
+        std::atomic<int> deleted{0};
+        std::atomic<qint64> reclaimed{0};
+        std::atomic<bool> cancelled{false};
+        int workers = 0;
+        int finishedWorkers = 0;
+    };
+    
+    QMap<QString, QSharedPointer<RetentionRun>> m_retentionRuns;  // By destination id
+    QThreadPool m_retentionPool;
+    BandwidthLimiter *m_retentionLimiter;
+    QString m_catalogDirectory;
+    QMap<QString, QSharedPointer<std::atomic<bool>>> m_probes;  // Stop flags, by destination id
+    QThreadPool m_probePool;
     
-    void checkLocalDestination(BackupDestination *destination);
-    void checkNetworkDestination(BackupDestination *destination);
-    void checkCloudDestination(BackupDestination *destination);
+    BackupDestination* destinationForPath(const QString &path) const;
+    void startCheck(BackupDestination *destination, bool showChecking);
     bool validateDestination(BackupDestination *destination) const;
+    void startRetentionWorkers(const QSharedPointer<RetentionRun> &run);
+    void finishRetention(const QSharedPointer<RetentionRun> &run);
+    static bool planRetention(RetentionRun *run);
+    static void runRetentionWorker(RetentionRun *run, BandwidthLimiter *limiter);
+    static bool deleteGeneration(const QString &root, const QString &name,
+                                 BandwidthLimiter *limiter, const std::atomic<bool> &cancelled);
 };
 
 #endif // DESTINATIONMANAGER_H
@@ -0,0 +1,334 @@
+#include "destinationprobe.h"
+#include "cloudprovider.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QLocale>
+#include <QRandomGenerator>
+#include <QStorageInfo>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QVector>
+#include <algorithm>
+#include <cstring>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+#ifdef Q_OS_LINUX
+#include <fcntl.h>
+#endif
+#ifdef Q_OS_WIN
+#include <io.h>
+#endif
+
+namespace {
+
+bool syncFile(QFile &file)
+{
+    if (!file.flush()) {
+        return false;
+    }
+#if defined(Q_OS_WIN)
+    return _commit(file.handle()) == 0;
+#elif defined(Q_OS_UNIX)
+    return ::fsync(file.handle()) == 0;
+#else
+    return true;
+#endif
+}
+
+double median(QVector<double> values)
+{
+    if (values.isEmpty()) {
+        return -1;
+    }
+    std::sort(values.begin(), values.end());
+    const int middle = static_cast<int>(values.size() / 2);
+    return values.size() % 2 ? values[middle] : (values[middle - 1] + values[middle]) / 2;
+}
+
+double perSecond(qint64 amount, qint64 nsecs)
+{
+    return nsecs > 0 ? amount * 1e9 / nsecs : 0;
+}
+
+// Incompressible, so compressing file systems and providers don't flatter
+// the figures
+QByteArray randomData(int size)
+{
+    QByteArray data(size, Qt::Uninitialized);
+    QRandomGenerator generator(0x5eed);
+    generator.fillRange(reinterpret_cast<quint32*>(data.data()), size / int(sizeof(quint32)));
+    return data;
+}
+
+bool stopped(const std::atomic<bool> *stop)
+{
+    return stop && stop->load();
+}
+
+} // namespace
+
+double ProbeResult::estimateSeconds(qint64 bytes, qint64 files) const
+{
+    const double writeRate = writeBytesPerSecond > 0 ? writeBytesPerSecond : uploadBytesPerSecond;
+    if (!isValid() || writeRate <= 0) {
+        return -1;
+    }
+    double seconds = bytes / writeRate;
+    if (createsPerSecond > 0) {
+        seconds += files / createsPerSecond;
+    } else if (roundTripMsecs > 0) {
+        seconds += files * roundTripMsecs / 1000;  // A request per file
+    }
+    return seconds;
+}
+
+QString ProbeResult::summary() const
+{
+    if (!timestamp.isValid()) {
+        return "Not measured";
+    }
+    if (!error.isEmpty()) {
+        return "Failed: " + error;
+    }
+
+    QLocale locale;
+    QStringList parts;
+    if (writeBytesPerSecond > 0) {
+        parts.append(QString("write %1/s").arg(locale.formattedDataSize(qint64(writeBytesPerSecond))));
+    }
+    if (readBytesPerSecond > 0) {
+        parts.append(QString("read %1/s").arg(locale.formattedDataSize(qint64(readBytesPerSecond))));
+    }
+    if (createsPerSecond > 0) {
+        parts.append(QString("%1 files/s").arg(qRound(createsPerSecond)));
+    }
+    if (fsyncMsecs >= 0) {
+        parts.append(QString("fsync %1 ms").arg(fsyncMsecs, 0, 'f', 1));
+    }
+    if (uploadBytesPerSecond > 0) {
+        parts.append(QString("upload %1/s").arg(locale.formattedDataSize(qint64(uploadBytesPerSecond))));
+    }
+    if (roundTripMsecs >= 0) {
+        parts.append(QString("round trip %1 ms").arg(qRound(roundTripMsecs)));
+    }
+    return parts.join(", ");
+}
+
+ProbeResult DestinationProbe::probeDirectory(const QString &path, const ProbeBudget &budget,
+                                             const std::atomic<bool> *stop)
+{
+    ProbeResult result;
+    result.timestamp = QDateTime::currentDateTime();
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!QFileInfo(path).isDir()) {
+        result.error = "Directory not found";
+        return result;
+    }
+
+    // Never fill the destination: the sequential file takes at most half
+    // of what is free
+    qint64 sequentialBytes = budget.sequentialBytes;
+    const QStorageInfo storage(path);
+    if (storage.isValid() && storage.isReady()) {
+        const qint64 usable = storage.bytesAvailable() / 2;
+        if (usable < ChunkSize) {
+            result.error = "Not enough free space in the destination";
+            return result;
+        }
+        sequentialBytes = qMin(sequentialBytes, usable);
+    }
+    QTemporaryDir dir(QDir(path).filePath(".abfm-probe-XXXXXX"));
+    if (!dir.isValid()) {
+        result.error = "Cannot create files in the destination";
+        return result;
+    }
+
+    QByteArray chunk = randomData(ChunkSize);
+    const QByteArray block = chunk.left(SmallFileSize);
+    QElapsedTimer stage;
+
+    // What a durable commit of a small write costs
+    {
+        QFile file(dir.filePath("fsync"));
+        if (!file.open(QIODevice::WriteOnly)) {
+            result.error = "Cannot create files in the destination";
+            return result;
+        }
+        QVector<double> samples;
+        for (int i = 0; i < budget.fsyncSamples && (i == 0 || timer.elapsed() < budget.timeLimitMsecs / 4); ++i) {
+            if (stopped(stop)) {
+                result.error = "Cancelled";
+                return result;
+            }
+            file.write(block);
+            stage.start();
+            if (!syncFile(file)) {
+                break;
+            }
+            samples.append(stage.nsecsElapsed() / 1e6);
+        }
+        result.fsyncMsecs = median(samples);
+    }
+
+    // Sequential write, until half the time is gone; the fsync at the end
+    // counts, or the figure would be the page cache's
+    const QString sequentialPath = dir.filePath("sequential");
+    qint64 written = 0;
+    {
+        QFile file(sequentialPath);
+        if (!file.open(QIODevice::WriteOnly)) {
+            result.error = "Cannot create files in the destination";
+            return result;
+        }
+        stage.start();
+        while (written < sequentialBytes && (written == 0 || timer.elapsed() < budget.timeLimitMsecs / 2)) {
+            if (stopped(stop)) {
+                result.error = "Cancelled";
+                return result;
+            }
+            // No two chunks alike for deduplicating file systems either
+            memcpy(chunk.data(), &written, sizeof(written));
+            const qint64 size = qMin<qint64>(chunk.size(), sequentialBytes - written);
+            if (file.write(chunk.constData(), size) != size) {
+                result.error = "Write failed: " + file.errorString();
+                return result;
+            }
+            written += size;
+        }
+        if (!syncFile(file)) {
+            result.error = "Write failed: " + file.errorString();
+            return result;
+        }
+        result.writeBytesPerSecond = perSecond(written, stage.nsecsElapsed());
+#ifdef Q_OS_LINUX
+        // Read back from the device rather than the page cache; elsewhere
+        // the read figure may be the cache's
+        ::posix_fadvise(file.handle(), 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    }
+
+    // Sequential read of the same, until three quarters of the time is gone
+    {
+        QFile file(sequentialPath);
+        if (!file.open(QIODevice::ReadOnly)) {
+            result.error = "Read failed: " + file.errorString();
+            return result;
+        }
+        qint64 bytesRead = 0;
+        stage.start();
+        while (bytesRead < written && (bytesRead == 0 || timer.elapsed() < budget.timeLimitMsecs * 3 / 4)) {
+            if (stopped(stop)) {
+                result.error = "Cancelled";
+                return result;
+            }
+            const qint64 size = file.read(chunk.data(), chunk.size());
+            if (size <= 0) {
+                break;
+            }
+            bytesRead += size;
+        }
+        result.readBytesPerSecond = perSecond(bytesRead, stage.nsecsElapsed());
+    }
+
+    // Small files, as most of a backup's files are, with the rest of the time
+    {
+        const QString filesPath = dir.filePath("files");
+        if (!QDir().mkpath(filesPath)) {
+            result.error = "Cannot create files in the destination";
+            return result;
+        }
+        int created = 0;
+        stage.start();
+        while (created < budget.smallFiles && (created == 0 || timer.elapsed() < budget.timeLimitMsecs)) {
+            if (stopped(stop)) {
+                result.error = "Cancelled";
+                return result;
+            }
+            QFile file(filesPath + "/" + QString::number(created));
+            if (!file.open(QIODevice::WriteOnly) || file.write(block) != block.size()) {
+                result.error = "Cannot create files in the destination";
+                return result;
+            }
+            file.close();
+            ++created;
+        }
+        result.createsPerSecond = perSecond(created, stage.nsecsElapsed());
+    }
+
+    result.elapsedMsecs = timer.elapsed();
+    return result;
+}
+
+ProbeResult DestinationProbe::probeCloud(CloudProvider *provider, const ProbeBudget &budget,
+                                         const std::atomic<bool> *stop)
+{
+    ProbeResult result;
+    result.timestamp = QDateTime::currentDateTime();
+    QElapsedTimer timer;
+    timer.start();
+
+    if (!provider) {
+        result.error = "No cloud provider configured";
+        return result;
+    }
+
+    QElapsedTimer stage;
+    QVector<double> samples;
+    for (int i = 0; i < budget.roundTripSamples && (i == 0 || timer.elapsed() < budget.timeLimitMsecs / 2); ++i) {
+        if (stopped(stop)) {
+            result.error = "Cancelled";
+            return result;
+        }
+        stage.start();
+        if (!provider->testConnection()) {
+            result.error = provider->getLastError();
+            return result;
+        }
+        samples.append(stage.nsecsElapsed() / 1e6);
+    }
+    result.roundTripMsecs = median(samples);
+
+    // One upload of the budgeted size, deleted again
+    QTemporaryDir dir;
+    const QString localPath = dir.filePath("probe.bin");
+    QFile file(localPath);
+    if (!dir.isValid() || !file.open(QIODevice::WriteOnly)) {
+        result.error = "Cannot create the upload file";
+        return result;
+    }
+    const QByteArray chunk = randomData(ChunkSize);
+    for (qint64 written = 0; written < budget.uploadBytes; written += chunk.size()) {
+        const qint64 size = qMin<qint64>(chunk.size(), budget.uploadBytes - written);
+        if (file.write(chunk.constData(), size) != size) {
+            result.error = "Cannot create the upload file: " + file.errorString();
+            return result;
+        }
+    }
+    if (!file.flush()) {
+        result.error = "Cannot create the upload file: " + file.errorString();
+        return result;
+    }
+    file.close();
+
+    if (stopped(stop)) {
+        result.error = "Cancelled";
+        return result;
+    }
+    const QString remotePath = QString("/.abfm-probe-%1.bin").arg(QDateTime::currentMSecsSinceEpoch());
+    stage.start();
+    if (!provider->uploadFile(localPath, remotePath)) {
+        result.error = provider->getLastError();
+        return result;
+    }
+    result.uploadBytesPerSecond = perSecond(budget.uploadBytes, stage.nsecsElapsed());
+    provider->deleteFile(remotePath);
+
+    result.elapsedMsecs = timer.elapsed();
+    return result;
+}
@@ -0,0 +1,67 @@
+#ifndef DESTINATIONPROBE_H
+#define DESTINATIONPROBE_H
+
+#include <QDateTime>
+#include <QMetaType>
+#include <QString>
+#include <atomic>
+
+class CloudProvider;
+
+// How much a probe may write and how long it may take. Every measurement
+// stops early once the time is spent, and rates come from what was done.
+struct ProbeBudget
+{
+    qint64 sequentialBytes = 64 * 1024 * 1024;  // Written, then read back
+    int smallFiles = 500;
+    int fsyncSamples = 8;
+    qint64 uploadBytes = 4 * 1024 * 1024;       // Cloud
+    int roundTripSamples = 3;                   // Cloud
+    int timeLimitMsecs = 10000;
+};
+
+// What a destination was measured at. Rates are 0 and latencies -1 where
+// not measured: upload and round trip for local and network destinations,
+// the file system figures for cloud ones.
+struct ProbeResult
+{
+    QDateTime timestamp;
+    QString error;                     // Why the probe failed; empty if it didn't
+    double writeBytesPerSecond = 0;    // Sequential, including the final fsync
+    double readBytesPerSecond = 0;     // Sequential, of what was written
+    double createsPerSecond = 0;       // Small files created, written and closed
+    double fsyncMsecs = -1;            // Median
+    double roundTripMsecs = -1;        // Median
+    double uploadBytesPerSecond = 0;
+    qint64 elapsedMsecs = 0;
+
+    bool isValid() const { return timestamp.isValid() && error.isEmpty(); }
+
+    // Expected time to write a backup of this many bytes and files; -1 if
+    // there is no write rate
+    double estimateSeconds(qint64 bytes, qint64 files) const;
+
+    QString summary() const;
+};
+
+Q_DECLARE_METATYPE(ProbeResult)
+
+// Measures how fast a destination takes writes. A directory gets a hidden
+// temporary directory for the probe's files, removed when it is done, and
+// never more than half its free space; a cloud provider gets one upload,
+// deleted again. Blocks for up to the budget's time limit (plus what a slow
+// provider keeps it waiting), so run it off the GUI thread, and with a
+// provider created on that thread (CloudProviderFactory::createAuthenticated).
+class DestinationProbe
+{
+public:
+    static const int SmallFileSize = 4096;
+    static const int ChunkSize = 1024 * 1024;
+
+    static ProbeResult probeDirectory(const QString &path, const ProbeBudget &budget = ProbeBudget(),
+                                      const std::atomic<bool> *stop = nullptr);
+    static ProbeResult probeCloud(CloudProvider *provider, const ProbeBudget &budget = ProbeBudget(),
+                                  const std::atomic<bool> *stop = nullptr);
+};
+
+#endif // DESTINATIONPROBE_H
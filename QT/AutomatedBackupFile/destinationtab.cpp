@@ -2,12 +2,32 @@
 #include "ui_destinationtab.h"
 #include "cloudprovider.h"
 #include "cloudauthdialog.h"
+#include "backupcatalog.h"
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QInputDialog>
 #include <QTableWidgetItem>
 #include <QDebug>
 #include <QCoreApplication>
+#include <QProgressDialog>
+#include <QFutureWatcher>
+#include <QSharedPointer>
+#include <QtConcurrent>
+
+namespace {
+
+// The newest backup on a destination. Destinations written before each
+// run got a generation of its own have a single "encrypted" directory.
+QString latestEncryptedDir(const QString &destinationPath)
+{
+    const QString generation = BackupCatalog::latestGeneration(destinationPath);
+    if (generation.isEmpty()) {
+        return destinationPath + "/encrypted";
+    }
+    return destinationPath + "/" + generation + "/encrypted";
+}
+
+} // namespace
 
 DestinationTab::DestinationTab(QWidget *parent)
     : QWidget(parent)
@@ -29,8 +49,14 @@ DestinationTab::DestinationTab(QWidget *parent)
     ui->tableDestinations->horizontalHeader()->setStretchLastSection(true);
     
     // Load saved destinations and file monitor state
+    m_destinationManager->setCatalogDirectory("backup_catalogs");
     m_destinationManager->loadFromFile("destinations.json");
-    m_backupFileMonitor->loadState("file_monitor.json");
+    ui->comboPlacement->setCurrentIndex(static_cast<int>(m_destinationManager->getPlacementMode()));
+    m_backupFileMonitor->openChangeJournal("file_monitor_journal");
+    m_backupFileMonitor->openHashCache("file_monitor_hashes.cache");
+    if (!m_backupFileMonitor->loadState("file_monitor.state")) {
+        m_backupFileMonitor->loadState("file_monitor.json");  // Saved by older versions
+    }
     
     // Check all loaded destinations to update their status
     m_destinationManager->checkAllDestinations();
@@ -43,15 +69,28 @@ DestinationTab::DestinationTab(QWidget *parent)
         }
     }
     
+    // Read the backups back for bit rot each night, at most an hour at a time
+    m_backupFileMonitor->setScrubWindow(QTime(2, 0), 60);
+    
     refreshDestinationTable();
     updateMonitoringStatus();
 }
 
 DestinationTab::~DestinationTab()
 {
+    // Workers still use their decryptors, which are our children: stop them
+    // and wait before those go
+    for (auto it = m_decryptRuns.begin(); it != m_decryptRuns.end(); ++it) {
+        it.value()->cancel();
+    }
+    for (auto it = m_decryptRuns.begin(); it != m_decryptRuns.end(); ++it) {
+        disconnect(it.key(), nullptr, this, nullptr);
+        it.key()->waitForFinished();
+    }
+    
     // Save destinations and file monitor state before destroying
     m_destinationManager->saveToFile("destinations.json");
-    m_backupFileMonitor->saveState("file_monitor.json");
+    m_backupFileMonitor->saveState("file_monitor.state");
     delete ui;
 }
 
@@ -62,6 +101,7 @@ void DestinationTab::setupConnections()
     connect(ui->btnAddCloudDest, &QPushButton::clicked, this, &DestinationTab::onAddCloudDestination);
     connect(ui->btnRemoveDestination, &QPushButton::clicked, this, &DestinationTab::onRemoveDestination);
     connect(ui->spinRetentionDays, QOverload<int>::of(&QSpinBox::valueChanged), this, &DestinationTab::onRetentionDaysChanged);
+    connect(ui->comboPlacement, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &DestinationTab::onPlacementModeChanged);
     connect(ui->chkAutoCleanup, &QCheckBox::toggled, this, &DestinationTab::onAutoCleanupToggled);
     
     // Connect new monitoring UI controls
@@ -73,6 +113,10 @@ void DestinationTab::setupConnections()
             this, [this]() { m_backupFileMonitor->scanAllDestinations(); });
     connect(ui->btnDecryptBackup, &QPushButton::clicked,
             this, &DestinationTab::onDecryptBackup);
+    connect(ui->btnVerifyBackup, &QPushButton::clicked,
+            this, &DestinationTab::onVerifyBackup);
+    connect(ui->btnBenchmarkDestination, &QPushButton::clicked,
+            this, &DestinationTab::onBenchmarkDestination);
     
     // Manager connections
     connect(m_destinationManager, &DestinationManager::destinationAdded, this, &DestinationTab::onDestinationAdded);
@@ -81,6 +125,7 @@ void DestinationTab::setupConnections()
     connect(m_destinationManager, &DestinationManager::destinationStatusChanged, this, &DestinationTab::onDestinationStatusChanged);
     connect(m_destinationManager, &DestinationManager::checkCompleted, this, &DestinationTab::onCheckCompleted);
     connect(m_destinationManager, &DestinationManager::error, this, &DestinationTab::onError);
+    connect(m_destinationManager, &DestinationManager::probeFinished, this, &DestinationTab::onProbeFinished);
 }
 
 void DestinationTab::setupFileMonitorConnections()
@@ -98,6 +143,8 @@ void DestinationTab::setupFileMonitorConnections()
             this, &DestinationTab::onChangeDetected);
     connect(m_backupFileMonitor, &BackupFileMonitor::monitoringStateChanged,
             this, &DestinationTab::onMonitoringStateChanged);
+    connect(m_backupFileMonitor, &BackupFileMonitor::corruptedFileFound,
+            this, &DestinationTab::onCorruptedFileFound);
 }
 
 void DestinationTab::onAddLocalDestination()
@@ -308,6 +355,34 @@ void DestinationTab::onAutoCleanupToggled(bool enabled)
     updateRetentionPolicy();
 }
 
+void DestinationTab::onPlacementModeChanged(int index)
+{
+    // Items are in the order of PlacementEngine::Mode
+    m_destinationManager->setPlacementMode(static_cast<PlacementEngine::Mode>(index));
+}
+
+void DestinationTab::onBenchmarkDestination()
+{
+    QString destinationId = getSelectedDestinationId();
+    if (destinationId.isEmpty()) {
+        QMessageBox::warning(this, "No Selection", "Please select a destination to benchmark.");
+        return;
+    }
+    
+    if (m_destinationManager->probeDestination(destinationId)) {
+        refreshDestinationTable();
+    }
+}
+
+void DestinationTab::onProbeFinished(const QString &destinationId, const ProbeResult &result)
+{
+    if (!result.isValid()) {
+        BackupDestination *dest = m_destinationManager->getDestination(destinationId);
+        QMessageBox::warning(this, "Benchmark Failed",
+            "Could not measure " + (dest ? dest->getPath() : destinationId) + ":\n" + result.error);
+    }
+}
+
 void DestinationTab::onDestinationAdded(const QString &destinationId)
 {
     refreshDestinationTable();
@@ -382,6 +457,18 @@ void DestinationTab::refreshDestinationTable()
         }
         
         ui->tableDestinations->setItem(i, 3, statusItem);
+        
+        // Performance: the latest probe, with the earlier ones in the tooltip
+        const QList<ProbeResult> history = dest->getProbeHistory();
+        QString performance = m_destinationManager->isProbing(dest->getId()) ? "Measuring..."
+            : history.isEmpty() ? "Not measured" : history.last().summary();
+        auto *performanceItem = new QTableWidgetItem(performance);
+        QStringList lines;
+        for (int p = static_cast<int>(history.size()) - 1; p >= 0; --p) {
+            lines.append(history[p].timestamp.toString("yyyy-MM-dd HH:mm") + "  " + history[p].summary());
+        }
+        performanceItem->setToolTip(lines.join("\n"));
+        ui->tableDestinations->setItem(i, 4, performanceItem);
     }
     
     // Resize columns to content
@@ -457,6 +544,11 @@ void DestinationTab::onChangeDetected(const QString &destinationId, const FileCh
     qDebug() << "Change detected:" << changeType << "-" << change.description;
 }
 
+void DestinationTab::onCorruptedFileFound(const QString &filePath, const QString &reason)
+{
+    qWarning() << "Corrupted backup file:" << filePath << "-" << reason;
+}
+
 void DestinationTab::onMonitoringStateChanged(bool enabled)
 {
     updateMonitoringStatus();
@@ -578,7 +670,7 @@ void DestinationTab::onDecryptBackup()
         return;
     }
     
-    QString encryptedDir = dest->getPath() + "/encrypted";
+    QString encryptedDir = latestEncryptedDir(dest->getPath());
     
     if (!QDir(encryptedDir).exists()) {
         QMessageBox::warning(this, "Directory Not Found", 
@@ -588,35 +680,144 @@ void DestinationTab::onDecryptBackup()
     }
     
     QString keyFilePath = QCoreApplication::applicationDirPath() + "/key.txt";
-    FileDecryptor decryptor;
+    FileDecryptor *decryptor = new FileDecryptor(this);
     
-    if (!decryptor.loadPasswordFromFile(keyFilePath)) {
+    if (!decryptor->loadPasswordFromFile(keyFilePath)) {
+        decryptor->deleteLater();
         QMessageBox::critical(this, "Decryption Failed", 
             "Failed to load password from key.txt\n\nPlease ensure key.txt exists in the application directory.");
         return;
     }
     
-    // Show progress message
-    QMessageBox progressMsg(this);
-    progressMsg.setWindowTitle("Decrypting...");
-    progressMsg.setText("Decrypting backup files, please wait...");
-    progressMsg.setStandardButtons(QMessageBox::NoButton);
-    progressMsg.setModal(false);
-    progressMsg.show();
-    QCoreApplication::processEvents();
+    // Decrypt in the background so the window stays responsive
+    QProgressDialog *progressDialog = new QProgressDialog("Decrypting backup files...", "Cancel", 0, 100, this);
+    progressDialog->setWindowTitle("Decrypting...");
+    progressDialog->setAutoClose(false);
+    progressDialog->setAutoReset(false);
+    progressDialog->setMinimumDuration(0);
+    progressDialog->setValue(0);
+    
+    connect(decryptor, &FileDecryptor::progressUpdated, progressDialog, &QProgressDialog::setValue);
+    connect(progressDialog, &QProgressDialog::canceled, decryptor, [decryptor]() { decryptor->cancel(); });
+    
+    ui->btnDecryptBackup->setEnabled(false);
+    
+    QFutureWatcher<bool> *watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcher<bool>::finished, this,
+            [this, watcher, decryptor, progressDialog, encryptedDir]() {
+        const bool success = watcher->result();
+        const bool cancelled = decryptor->isCancelled();
+        progressDialog->close();
+        progressDialog->deleteLater();
+        decryptor->deleteLater();
+        watcher->deleteLater();
+        m_decryptRuns.remove(watcher);
+        ui->btnDecryptBackup->setEnabled(true);
+        
+        if (cancelled) {
+            QMessageBox::information(this, "Decryption Cancelled", 
+                "Decryption was cancelled. Files that were not finished have been removed.");
+            return;
+        }
+        
+        if (success) {
+            QString decryptedPath = encryptedDir + "/decrypted";
+            QMessageBox::information(this, "Decryption Complete", 
+                "All files decrypted successfully!\n\nDecrypted files location:\n" + decryptedPath);
+            qDebug() << "Backup decrypted successfully to:" << decryptedPath;
+        } else {
+            QMessageBox::critical(this, "Decryption Failed", 
+                "Failed to decrypt backup files.\n\nCheck the log for details.");
+        }
+    });
+    m_decryptRuns.insert(watcher, decryptor);
+    watcher->setFuture(QtConcurrent::run([decryptor, encryptedDir]() {
+        return decryptor->decryptDirectory(encryptedDir);
+    }));
+}
+
+void DestinationTab::onVerifyBackup()
+{
+    QString destinationId = getSelectedDestinationId();
     
-    bool success = decryptor.decryptDirectory(encryptedDir);
+    if (destinationId.isEmpty()) {
+        QMessageBox::warning(this, "No Selection", "Please select a destination to verify.");
+        return;
+    }
+    
+    BackupDestination* dest = m_destinationManager->getDestination(destinationId);
+    if (!dest) {
+        QMessageBox::warning(this, "Invalid Destination", "Selected destination not found.");
+        return;
+    }
     
-    progressMsg.close();
+    QString encryptedDir = latestEncryptedDir(dest->getPath());
     
-    if (success) {
-        QString decryptedPath = encryptedDir + "/decrypted";
-        QMessageBox::information(this, "Decryption Complete", 
-            "All files decrypted successfully!\n\nDecrypted files location:\n" + decryptedPath);
-        qDebug() << "Backup decrypted successfully to:" << decryptedPath;
-    } else {
-        QMessageBox::critical(this, "Decryption Failed", 
-            "Failed to decrypt backup files.\n\nCheck the log for details.");
+    if (!QDir(encryptedDir).exists()) {
+        QMessageBox::warning(this, "Directory Not Found", 
+            "Encrypted directory not found: " + encryptedDir + 
+            "\n\nMake sure a backup has been created first.");
+        return;
+    }
+    
+    QString keyFilePath = QCoreApplication::applicationDirPath() + "/key.txt";
+    FileDecryptor *decryptor = new FileDecryptor(this);
+    
+    if (!decryptor->loadPasswordFromFile(keyFilePath)) {
+        decryptor->deleteLater();
+        QMessageBox::critical(this, "Verification Failed", 
+            "Failed to load password from key.txt\n\nPlease ensure key.txt exists in the application directory.");
+        return;
     }
+    
+    QProgressDialog *progressDialog = new QProgressDialog("Verifying backup files...", "Cancel", 0, 100, this);
+    progressDialog->setWindowTitle("Verifying...");
+    progressDialog->setAutoClose(false);
+    progressDialog->setAutoReset(false);
+    progressDialog->setMinimumDuration(0);
+    progressDialog->setValue(0);
+    
+    connect(decryptor, &FileDecryptor::progressUpdated, progressDialog, &QProgressDialog::setValue);
+    connect(progressDialog, &QProgressDialog::canceled, decryptor, [decryptor]() { decryptor->cancel(); });
+    
+    ui->btnVerifyBackup->setEnabled(false);
+    
+    // Shared with the worker; read once it has finished
+    QSharedPointer<BackupVerifyReport> report(new BackupVerifyReport);
+    
+    QFutureWatcher<bool> *watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcher<bool>::finished, this,
+            [this, watcher, decryptor, progressDialog, report]() {
+        const bool cancelled = decryptor->isCancelled();
+        progressDialog->close();
+        progressDialog->deleteLater();
+        decryptor->deleteLater();
+        watcher->deleteLater();
+        m_decryptRuns.remove(watcher);
+        ui->btnVerifyBackup->setEnabled(true);
+        
+        if (cancelled) {
+            QMessageBox::information(this, "Verification Paused", 
+                "Verification was cancelled. The next run continues where this one stopped.");
+            return;
+        }
+        
+        QString summary = QString("Verified files: %1").arg(report->verifiedFiles);
+        if (report->legacyFiles > 0) {
+            summary += QString("\nOlder files without integrity data: %1").arg(report->legacyFiles);
+        }
+        
+        if (report->failedFiles.isEmpty()) {
+            QMessageBox::information(this, "Verification Complete", 
+                "The backup can be restored.\n\n" + summary);
+        } else {
+            QMessageBox::critical(this, "Verification Failed", 
+                summary + QString("\nDamaged or missing files: %1\n\n").arg(report->failedFiles.size()) +
+                report->failedFiles.mid(0, 20).join("\n"));
+        }
+    });
+    m_decryptRuns.insert(watcher, decryptor);
+    watcher->setFuture(QtConcurrent::run([decryptor, encryptedDir, report]() {
+        return decryptor->verifyBackup(encryptedDir, *report);
+    }));
 }
-
@@ -3,6 +3,8 @@
 
 #include <QWidget>
 #include <QPushButton>
+#include <QFutureWatcher>
+#include <QHash>
 #include "destinationmanager.h"
 #include "backupfilemonitor.h"
 #include "filedecryptor.h"
@@ -36,6 +38,9 @@ private slots:
     void onRefreshDestinations();
     void onRetentionDaysChanged(int days);
     void onAutoCleanupToggled(bool enabled);
+    void onPlacementModeChanged(int index);
+    void onBenchmarkDestination();
+    void onProbeFinished(const QString &destinationId, const ProbeResult &result);
     
     // Manager signals
     void onDestinationAdded(const QString &destinationId);
@@ -52,15 +57,18 @@ private slots:
     void onFileDeleted(const QString &destinationId, const QString &filePath, const BackupFileInfo &info);
     void onScanCompleted(const QString &destinationId, int filesFound, int changesDetected);
     void onChangeDetected(const QString &destinationId, const FileChangeRecord &change);
+    void onCorruptedFileFound(const QString &filePath, const QString &reason);
     void onMonitoringStateChanged(bool enabled);
     void onViewChangeHistory();
     void onToggleMonitoring(bool enabled);
     void onDecryptBackup();
+    void onVerifyBackup();
 
 private:
     Ui::DestinationTab *ui;
     DestinationManager *m_destinationManager;
     BackupFileMonitor *m_backupFileMonitor;
+    QHash<QFutureWatcher<bool>*, FileDecryptor*> m_decryptRuns;  // Restores and verifications in progress
     
     void setupConnections();
     void setupFileMonitorConnections();
@@ -0,0 +1,181 @@
+#include "encryptedcontainer.h"
+#include <QFile>
+#include <QMessageAuthenticationCode>
+#include <QPasswordDigestor>
+#include <QRandomGenerator>
+#include <QThread>
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+
+const char kMagic[8] = {'A', 'B', 'F', 'C', 'R', 'Y', 'P', 'T'};
+const quint8 kKdfPbkdf2Sha256 = 1;
+
+} // namespace
+
+QByteArray EncryptedContainerHeader::toBytes() const
+{
+    QByteArray bytes(EncryptedContainer::HeaderSize, '\0');
+    unsigned char *p = reinterpret_cast<unsigned char*>(bytes.data());
+
+    memcpy(p, kMagic, sizeof(kMagic));
+    p[8] = EncryptedContainer::FormatVersion;
+    p[9] = static_cast<quint8>(algorithm);
+    p[10] = kKdfPbkdf2Sha256;
+    p[11] = 0;
+    qToBigEndian<quint32>(kdfIterations, p + 12);
+    qToBigEndian<quint32>(chunkSize, p + 16);
+    memcpy(p + 20, kdfSalt.constData(), EncryptedContainer::SaltSize);
+    memcpy(p + 36, fileSalt.constData(), EncryptedContainer::SaltSize);
+
+    return bytes;
+}
+
+bool EncryptedContainerHeader::fromBytes(const QByteArray &bytes, EncryptedContainerHeader &header)
+{
+    if (bytes.size() < EncryptedContainer::HeaderSize || !EncryptedContainer::hasMagic(bytes)) {
+        return false;
+    }
+
+    const unsigned char *p = reinterpret_cast<const unsigned char*>(bytes.constData());
+    if (p[8] != EncryptedContainer::FormatVersion || p[10] != kKdfPbkdf2Sha256 || p[11] != 0) {
+        return false;
+    }
+    if (!AeadCipher::isKnownAlgorithm(p[9])) {
+        return false;
+    }
+
+    header.algorithm = static_cast<AeadCipher::Algorithm>(p[9]);
+    header.kdfIterations = qFromBigEndian<quint32>(p + 12);
+    header.chunkSize = qFromBigEndian<quint32>(p + 16);
+    header.kdfSalt = bytes.mid(20, EncryptedContainer::SaltSize);
+    header.fileSalt = bytes.mid(36, EncryptedContainer::SaltSize);
+
+    // Bounds keep a corrupt header from forcing a huge allocation or KDF run
+    if (header.kdfIterations == 0 || header.kdfIterations > EncryptedContainer::MaxKdfIterations) {
+        return false;
+    }
+    if (header.chunkSize < EncryptedContainer::MinChunkSize || header.chunkSize > EncryptedContainer::MaxChunkSize) {
+        return false;
+    }
+
+    return true;
+}
+
+QByteArray EncryptedContainer::magic()
+{
+    return QByteArray(kMagic, sizeof(kMagic));
+}
+
+bool EncryptedContainer::hasMagic(const QByteArray &prefix)
+{
+    return prefix.size() >= static_cast<int>(sizeof(kMagic))
+        && memcmp(prefix.constData(), kMagic, sizeof(kMagic)) == 0;
+}
+
+bool EncryptedContainer::isContainer(QIODevice &device)
+{
+    return hasMagic(device.peek(sizeof(kMagic)));
+}
+
+bool EncryptedContainer::isContainerFile(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    return isContainer(file);
+}
+
+QByteArray EncryptedContainer::deriveMasterKey(const QString &password, const QByteArray &salt, quint32 iterations)
+{
+    return QPasswordDigestor::deriveKeyPbkdf2(QCryptographicHash::Sha256, password.toUtf8(), salt,
+                                              static_cast<int>(iterations), AeadCipher::KeySize);
+}
+
+QByteArray EncryptedContainer::deriveFileKey(const QByteArray &masterKey, const EncryptedContainerHeader &header)
+{
+    // HKDF extract and a single expand block, since the key is one hash long
+    QByteArray pseudoRandomKey = QMessageAuthenticationCode::hash(masterKey, header.fileSalt, QCryptographicHash::Sha256);
+
+    QByteArray info("AutomatedBackupFile container v1");
+    info.append(static_cast<char>(header.algorithm));
+    info.append(static_cast<char>(0x01));
+
+    return QMessageAuthenticationCode::hash(info, pseudoRandomKey, QCryptographicHash::Sha256);
+}
+
+QByteArray EncryptedContainer::randomSalt()
+{
+    QByteArray salt(SaltSize, Qt::Uninitialized);
+    QRandomGenerator::system()->fillRange(reinterpret_cast<quint32*>(salt.data()), SaltSize / 4);
+    return salt;
+}
+
+void EncryptedContainer::chunkNonce(quint64 chunkIndex, bool finalChunk, unsigned char *nonce)
+{
+    memset(nonce, 0, AeadCipher::NonceSize);
+    qToBigEndian<quint64>(chunkIndex, nonce);
+    nonce[11] = finalChunk ? 1 : 0;
+}
+
+qint64 EncryptedContainer::readFully(QIODevice &device, char *data, qint64 size)
+{
+    qint64 total = 0;
+    while (total < size) {
+        const qint64 bytesRead = device.read(data + total, size - total);
+        if (bytesRead < 0) {
+            return -1;
+        }
+        if (bytesRead == 0) {
+            break;
+        }
+        total += bytesRead;
+    }
+    return total;
+}
+
+int EncryptedContainer::batchChunkCount(quint32 chunkSize)
+{
+    const qint64 slotSize = qint64(chunkSize) + AeadCipher::TagSize;
+    const int memoryLimit = static_cast<int>(qMax<qint64>(1, MaxBatchBytes / slotSize));
+    return qBound(1, QThread::idealThreadCount(), memoryLimit);
+}
+
+qint64 EncryptedContainer::encryptedSize(qint64 plaintextSize, quint32 chunkSize)
+{
+    // An empty file still has one (empty) final chunk
+    const qint64 chunks = qMax<qint64>(1, (plaintextSize + chunkSize - 1) / chunkSize);
+    return HeaderSize + plaintextSize + chunks * AeadCipher::TagSize;
+}
+
+qint64 EncryptedContainer::plaintextSize(qint64 containerSize, quint32 chunkSize)
+{
+    const qint64 slotSize = qint64(chunkSize) + AeadCipher::TagSize;
+    const qint64 body = containerSize - HeaderSize;
+    if (chunkSize == 0 || body < AeadCipher::TagSize) {
+        return -1;
+    }
+    
+    // Only the last slot may be short, and it still carries a tag
+    const qint64 chunks = (body + slotSize - 1) / slotSize;
+    if (body - (chunks - 1) * slotSize < AeadCipher::TagSize) {
+        return -1;
+    }
+    return body - chunks * AeadCipher::TagSize;
+}
+
+quint64 EncryptedContainer::chunkCount(qint64 containerSize, quint32 chunkSize)
+{
+    if (plaintextSize(containerSize, chunkSize) < 0) {
+        return 0;
+    }
+    const qint64 slotSize = qint64(chunkSize) + AeadCipher::TagSize;
+    return quint64((containerSize - HeaderSize + slotSize - 1) / slotSize);
+}
+
+qint64 EncryptedContainer::chunkOffset(quint64 chunkIndex, quint32 chunkSize)
+{
+    return HeaderSize + qint64(chunkIndex) * (qint64(chunkSize) + AeadCipher::TagSize);
+}
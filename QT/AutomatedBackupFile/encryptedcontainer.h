@@ -0,0 +1,99 @@
+#ifndef ENCRYPTEDCONTAINER_H
+#define ENCRYPTEDCONTAINER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QIODevice>
+#include "aeadcipher.h"
+
+// On-disk layout of an encrypted backup file:
+//
+//   header (HeaderSize bytes)
+//   chunk 0: ciphertext (chunkSize bytes) | tag (16 bytes)
+//   chunk 1: ...
+//   last chunk: ciphertext (0..chunkSize bytes) | tag
+//
+// Every chunk is sealed independently with a per-file key, so chunks can be
+// processed on any number of threads and checked without decrypting. The
+// nonce carries the chunk index and a final-chunk flag, and the header is
+// authenticated with every chunk, so reordering, truncation and header
+// edits are all detected.
+//
+// All chunks but the last are exactly chunkSize bytes, so the container is
+// its own chunk index: chunk i starts at HeaderSize + i * (chunkSize + 16)
+// and any plaintext byte range can be read by seeking straight to it.
+struct EncryptedContainerHeader
+{
+    AeadCipher::Algorithm algorithm = AeadCipher::Algorithm::Aes256Gcm;
+    quint32 kdfIterations = 0;
+    quint32 chunkSize = 0;
+    QByteArray kdfSalt;   // Salt for the password KDF, shared by a whole backup run
+    QByteArray fileSalt;  // Random per file; the file key is derived from it
+
+    QByteArray toBytes() const;
+    static bool fromBytes(const QByteArray &bytes, EncryptedContainerHeader &header);
+};
+
+// One chunk inside a batch buffer; the tag follows the data directly
+struct EncryptedChunk
+{
+    char *data = nullptr;
+    qint64 size = 0;
+    quint64 index = 0;
+    bool finalChunk = false;
+    bool authenticated = false;
+};
+
+class EncryptedContainer
+{
+public:
+    static constexpr int HeaderSize = 52;
+    static constexpr int SaltSize = 16;
+    static constexpr quint8 FormatVersion = 1;
+    static constexpr quint32 DefaultChunkSize = 1024 * 1024;
+    static constexpr quint32 DefaultKdfIterations = 200000;
+    static constexpr quint32 MaxKdfIterations = 10000000;  // Refuse headers that would stall the KDF
+    static constexpr quint32 MinChunkSize = 4096;
+    static constexpr quint32 MaxChunkSize = 64 * 1024 * 1024;
+    static constexpr qint64 MaxBatchBytes = 256 * 1024 * 1024;
+
+    // Start of every container; legacy XOR files have no header at all
+    static QByteArray magic();
+    static bool hasMagic(const QByteArray &prefix);
+    static bool isContainer(QIODevice &device);  // Peeks without consuming
+    static bool isContainerFile(const QString &filePath);
+
+    // PBKDF2-HMAC-SHA256 of the password; run once per backup run
+    static QByteArray deriveMasterKey(const QString &password, const QByteArray &salt, quint32 iterations);
+
+    // HKDF-SHA256 of the master key with the file salt
+    static QByteArray deriveFileKey(const QByteArray &masterKey, const EncryptedContainerHeader &header);
+
+    static QByteArray randomSalt();
+
+    // Chunk index (big-endian) in bytes 0-7, final flag in byte 11
+    static void chunkNonce(quint64 chunkIndex, bool finalChunk, unsigned char *nonce);
+
+    // Read until size bytes or end of input; -1 on error
+    static qint64 readFully(QIODevice &device, char *data, qint64 size);
+
+    // Chunks per parallel batch: one per core, capped so a batch of large
+    // chunks stays within MaxBatchBytes
+    static int batchChunkCount(quint32 chunkSize);
+
+    // Size of the container holding plaintextSize bytes
+    static qint64 encryptedSize(qint64 plaintextSize, quint32 chunkSize);
+    
+    // Inverse of encryptedSize; -1 if no container can have that size
+    static qint64 plaintextSize(qint64 containerSize, quint32 chunkSize);
+    
+    // Chunks in a container of that size, counting the empty final chunk
+    // encryptStream() adds when sequential input ends on a chunk boundary;
+    // 0 if no container can have that size
+    static quint64 chunkCount(qint64 containerSize, quint32 chunkSize);
+    
+    // Position of a chunk relative to the start of the container
+    static qint64 chunkOffset(quint64 chunkIndex, quint32 chunkSize);
+};
+
+#endif // ENCRYPTEDCONTAINER_H
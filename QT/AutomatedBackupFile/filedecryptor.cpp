@@ -1,11 +1,47 @@
 #include "filedecryptor.h"
+#include "backupmanifest.h"
 #include <QDebug>
+#include <QBuffer>
 #include <QDir>
 #include <QFileInfo>
 #include <QDirIterator>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QPair>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrent>
+#include <cstring>
+#include <limits>
 
-FileDecryptor::FileDecryptor()
+namespace {
+
+// Where a backup path is restored under targetDir; empty for one that would
+// land outside it, as the "../" and absolute paths of a tampered manifest
+QString restoreTarget(const QString& targetDir, const QString& path)
+{
+    const QString cleaned = QDir::cleanPath(path);
+    if (cleaned.isEmpty() || cleaned == "." || cleaned == ".." || cleaned.startsWith("../")
+        || QDir::isAbsolutePath(cleaned)) {
+        return QString();
+    }
+    const QString root = QDir::cleanPath(QDir(targetDir).absolutePath());
+    const QString target = QDir::cleanPath(root + "/" + cleaned);
+    return target.startsWith(root.endsWith('/') ? root : root + "/") ? target : QString();
+}
+
+} // namespace
+
+FileDecryptor::FileDecryptor(QObject *parent)
+    : QObject(parent)
+    , m_memoryMapping(true)
+    , m_cancelled(false)
+    , m_activeFiles(0)
+    , m_totalBytes(0)
+    , m_processedBytes(0)
+    , m_lastPercentage(0)
 {
+    m_threadPool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
 }
 
 bool FileDecryptor::loadPasswordFromFile(const QString& keyFilePath)
@@ -18,6 +54,8 @@ bool FileDecryptor::loadPasswordFromFile(const QString& keyFilePath)
     
     m_password = keyFile.readAll().trimmed();
     keyFile.close();
+    m_keystream.setKey(generateKey());
+    m_masterKeys.clear();
     
     if (m_password.isEmpty()) {
         qWarning() << "Password is empty in key file";
@@ -31,6 +69,49 @@ bool FileDecryptor::loadPasswordFromFile(const QString& keyFilePath)
 void FileDecryptor::setPassword(const QString& password)
 {
     m_password = password;
+    m_keystream.setKey(generateKey());
+    QMutexLocker locker(&m_masterKeyMutex);
+    m_masterKeys.clear();
+}
+
+void FileDecryptor::setThreadCount(int threadCount)
+{
+    m_threadPool.setMaxThreadCount(qMax(1, threadCount));
+}
+
+int FileDecryptor::getThreadCount() const
+{
+    return m_threadPool.maxThreadCount();
+}
+
+void FileDecryptor::cancel()
+{
+    m_cancelled = true;
+}
+
+void FileDecryptor::beginProgress(qint64 totalBytes)
+{
+    m_totalBytes = totalBytes;
+    m_processedBytes = 0;
+    m_lastPercentage = 0;
+}
+
+void FileDecryptor::addProcessedBytes(qint64 bytes)
+{
+    if (m_totalBytes <= 0 || bytes <= 0) {
+        return;
+    }
+    
+    // Emit each percentage once, whichever thread gets there first
+    const qint64 processed = m_processedBytes.fetch_add(bytes) + bytes;
+    const int percentage = static_cast<int>(qMin<qint64>(100, processed * 100 / m_totalBytes));
+    int last = m_lastPercentage.load();
+    while (percentage > last) {
+        if (m_lastPercentage.compare_exchange_weak(last, percentage)) {
+            emit progressUpdated(percentage);
+            break;
+        }
+    }
 }
 
 QByteArray FileDecryptor::generateKey()
@@ -41,21 +122,41 @@ QByteArray FileDecryptor::generateKey()
     return key;
 }
 
-QByteArray FileDecryptor::decryptData(const QByteArray& data)
+QByteArray FileDecryptor::masterKeyFor(const EncryptedContainerHeader& header)
 {
-    QByteArray key = generateKey();
-    QByteArray decrypted;
-    decrypted.resize(data.size());
+    QByteArray cacheKey = header.kdfSalt;
+    cacheKey.append(reinterpret_cast<const char*>(&header.kdfIterations), sizeof(header.kdfIterations));
     
-    // XOR decryption (same as encryption)
-    for (int i = 0; i < data.size(); ++i) {
-        decrypted[i] = data[i] ^ key[i % key.size()];
+    // Held across the derivation so parallel files of one run wait for the
+    // first one instead of all running the KDF
+    QMutexLocker locker(&m_masterKeyMutex);
+    if (m_masterKeys.contains(cacheKey)) {
+        return m_masterKeys.value(cacheKey);
     }
     
-    return decrypted;
+    QByteArray masterKey = EncryptedContainer::deriveMasterKey(m_password, header.kdfSalt, header.kdfIterations);
+    m_masterKeys.insert(cacheKey, masterKey);
+    return masterKey;
 }
 
-bool FileDecryptor::decryptFile(const QString& encryptedFilePath, const QString& decryptedFilePath)
+bool FileDecryptor::decryptStream(QIODevice& input, QIODevice& output)
+{
+    if (EncryptedContainer::isContainer(input)) {
+        return processContainer(input, &output);
+    }
+    return decryptLegacyStream(input, output);
+}
+
+bool FileDecryptor::verifyStream(QIODevice& input)
+{
+    if (!EncryptedContainer::isContainer(input)) {
+        qWarning() << "Legacy encrypted file has no authentication tags to verify";
+        return false;
+    }
+    return processContainer(input, nullptr);
+}
+
+bool FileDecryptor::verifyFile(const QString& encryptedFilePath)
 {
     QFile encryptedFile(encryptedFilePath);
     if (!encryptedFile.open(QIODevice::ReadOnly)) {
@@ -63,10 +164,399 @@ bool FileDecryptor::decryptFile(const QString& encryptedFilePath, const QString&
         return false;
     }
     
-    QByteArray encryptedData = encryptedFile.readAll();
-    encryptedFile.close();
+    bool valid = verifyStream(encryptedFile);
+    if (!valid) {
+        qWarning() << "Verification failed:" << encryptedFilePath;
+    }
+    return valid;
+}
+
+bool FileDecryptor::isLegacyFile(const QString& encryptedFilePath)
+{
+    return !EncryptedContainer::isContainerFile(encryptedFilePath);
+}
+
+bool FileDecryptor::decryptRange(QIODevice& input, qint64 offset, qint64 length, QIODevice& output)
+{
+    if (input.isSequential()) {
+        qWarning() << "Range decryption needs a seekable input";
+        return false;
+    }
+    if (offset < 0 || length < 0) {
+        qWarning() << "Invalid decryption range:" << offset << length;
+        return false;
+    }
+    
+    if (EncryptedContainer::isContainer(input)) {
+        return processContainer(input, &output, offset, length);
+    }
+    return decryptLegacyStream(input, output, offset, length);
+}
+
+bool FileDecryptor::decryptRange(const QString& encryptedFilePath, qint64 offset, qint64 length, QByteArray& data)
+{
+    QFile encryptedFile(encryptedFilePath);
+    if (!encryptedFile.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open encrypted file:" << encryptedFilePath;
+        return false;
+    }
+    
+    data.clear();
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    if (!decryptRange(encryptedFile, offset, length, buffer)) {
+        data.clear();
+        qWarning() << "Failed to decrypt range of:" << encryptedFilePath;
+        return false;
+    }
+    return true;
+}
+
+qint64 FileDecryptor::plaintextSize(const QString& encryptedFilePath)
+{
+    QFile encryptedFile(encryptedFilePath);
+    if (!encryptedFile.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    if (!EncryptedContainer::isContainer(encryptedFile)) {
+        return encryptedFile.size();
+    }
+    
+    EncryptedContainerHeader header;
+    if (!EncryptedContainerHeader::fromBytes(encryptedFile.read(EncryptedContainer::HeaderSize), header)) {
+        return -1;
+    }
+    return EncryptedContainer::plaintextSize(encryptedFile.size(), header.chunkSize);
+}
+
+bool FileDecryptor::openContainer(QIODevice& input, QByteArray& headerBytes,
+                                  EncryptedContainerHeader& header, AeadCipher& cipher)
+{
+    if (m_password.isEmpty()) {
+        qWarning() << "No password set for decryption";
+        return false;
+    }
+    
+    headerBytes = QByteArray(EncryptedContainer::HeaderSize, Qt::Uninitialized);
+    if (EncryptedContainer::readFully(input, headerBytes.data(), headerBytes.size()) != headerBytes.size()
+        || !EncryptedContainerHeader::fromBytes(headerBytes, header)) {
+        qWarning() << "Unsupported or corrupt encrypted file header";
+        return false;
+    }
+    addProcessedBytes(headerBytes.size());
+    
+    const QByteArray masterKey = masterKeyFor(header);
+    if (masterKey.size() != AeadCipher::KeySize) {
+        qWarning() << "Failed to derive the decryption key";
+        return false;
+    }
+    cipher.setKey(header.algorithm, EncryptedContainer::deriveFileKey(masterKey, header));
+    return true;
+}
+
+bool FileDecryptor::processContainer(QIODevice& input, QIODevice* output, qint64 offset, qint64 length)
+{
+    const qint64 containerStart = input.pos();
+    QByteArray headerBytes;
+    EncryptedContainerHeader header;
+    AeadCipher cipher;
+    if (!openContainer(input, headerBytes, header, cipher)) {
+        return false;
+    }
+    
+    // A range only touches the chunks covering it; the fixed chunk size
+    // gives their position directly
+    quint64 chunkIndex = 0;
+    quint64 lastChunkIndex = std::numeric_limits<quint64>::max();
+    qint64 skipBytes = 0;
+    qint64 remainingBytes = std::numeric_limits<qint64>::max();
+    if (length >= 0) {
+        const qint64 totalSize = EncryptedContainer::plaintextSize(input.size() - containerStart, header.chunkSize);
+        if (totalSize < 0) {
+            qWarning() << "Encrypted file is truncated";
+            return false;
+        }
+        offset = qMin(offset, totalSize);
+        remainingBytes = qMin(length, totalSize - offset);
+        if (remainingBytes == 0) {
+            return true;
+        }
+        
+        chunkIndex = offset / header.chunkSize;
+        lastChunkIndex = (offset + remainingBytes - 1) / header.chunkSize;
+        skipBytes = offset - qint64(chunkIndex) * header.chunkSize;
+        if (!input.seek(containerStart + EncryptedContainer::chunkOffset(chunkIndex, header.chunkSize))) {
+            qWarning() << "Seek error while decrypting:" << input.errorString();
+            return false;
+        }
+    }
+    
+    const qint64 slotSize = qint64(header.chunkSize) + AeadCipher::TagSize;
+    int batchChunks = qMax(1, EncryptedContainer::batchChunkCount(header.chunkSize) / qMax(1, m_activeFiles.load()));
+    if (!input.isSequential()) {
+        const qint64 remaining = input.size() - input.pos();
+        batchChunks = static_cast<int>(qBound<qint64>(1, (remaining + slotSize - 1) / slotSize, batchChunks));
+    }
+    if (length >= 0) {
+        batchChunks = static_cast<int>(qMin<quint64>(batchChunks, lastChunkIndex - chunkIndex + 1));
+    }
+    QByteArray buffer(static_cast<int>(slotSize * batchChunks), Qt::Uninitialized);
+    
+    const bool verifyOnly = (output == nullptr);
+    auto open = [&cipher, &headerBytes, verifyOnly](EncryptedChunk& chunk) {
+        unsigned char nonce[AeadCipher::NonceSize];
+        EncryptedContainer::chunkNonce(chunk.index, chunk.finalChunk, nonce);
+        unsigned char *data = reinterpret_cast<unsigned char*>(chunk.data);
+        chunk.authenticated = verifyOnly
+            ? cipher.verify(nonce, headerBytes, data, chunk.size, data + chunk.size)
+            : cipher.decrypt(nonce, headerBytes, data, chunk.size, data + chunk.size);
+    };
+    
+    QVector<EncryptedChunk> chunks;
+    bool finished = false;
+    while (!finished) {
+        if (m_cancelled) {
+            qWarning() << "Decryption cancelled";
+            return false;
+        }
+        chunks.clear();
+        
+        for (int slot = 0; slot < batchChunks && !finished; ++slot) {
+            EncryptedChunk chunk;
+            chunk.data = buffer.data() + slot * slotSize;
+            const qint64 bytesRead = EncryptedContainer::readFully(input, chunk.data, slotSize);
+            if (bytesRead < 0) {
+                qWarning() << "Read error while decrypting:" << input.errorString();
+                return false;
+            }
+            m_readLimiter.acquire(bytesRead);
+            if (bytesRead < AeadCipher::TagSize) {
+                // Every container ends with a tagged final chunk
+                qWarning() << "Encrypted file is truncated at chunk" << chunkIndex;
+                return false;
+            }
+            
+            // A wrong guess here can't be exploited: the flag is part of the
+            // nonce, so a chunk opened with the wrong flag fails its tag
+            chunk.size = bytesRead - AeadCipher::TagSize;
+            chunk.index = chunkIndex++;
+            chunk.finalChunk = bytesRead < slotSize || input.atEnd();
+            finished = chunk.finalChunk || chunk.index == lastChunkIndex;
+            chunks.append(chunk);
+        }
+        
+        if (chunks.size() == 1) {
+            open(chunks[0]);
+        } else {
+            QtConcurrent::blockingMap(chunks, open);
+        }
+        
+        // Nothing from a batch is written until all of it has authenticated
+        for (const EncryptedChunk& chunk : chunks) {
+            if (!chunk.authenticated) {
+                qWarning() << "Authentication failed at chunk" << chunk.index
+                           << "- wrong password or corrupted file";
+                return false;
+            }
+        }
+        
+        if (output) {
+            for (const EncryptedChunk& chunk : chunks) {
+                // Only the ends of a range cut into a chunk
+                const qint64 size = qMin(chunk.size - skipBytes, remainingBytes);
+                if (output->write(chunk.data + skipBytes, size) != size) {
+                    qWarning() << "Write error while decrypting:" << output->errorString();
+                    return false;
+                }
+                skipBytes = 0;
+                remainingBytes -= size;
+            }
+        }
+        for (const EncryptedChunk& chunk : chunks) {
+            addProcessedBytes(chunk.size + AeadCipher::TagSize);
+        }
+    }
+    
+    return true;
+}
+
+bool FileDecryptor::decryptLegacyStream(QIODevice& input, QIODevice& output, qint64 offset, qint64 length)
+{
+    if (!m_keystream.isValid()) {
+        m_keystream.setKey(generateKey());
+    }
+    
+    // The keystream is seekable, so a range starts reading at its offset
+    qint64 remainingBytes = std::numeric_limits<qint64>::max();
+    if (length >= 0) {
+        const qint64 start = input.pos();
+        offset = qMin(offset, input.size() - start);
+        remainingBytes = qMin(length, input.size() - start - offset);
+        if (!input.seek(start + offset)) {
+            qWarning() << "Seek error while decrypting:" << input.errorString();
+            return false;
+        }
+    } else {
+        offset = 0;
+    }
+    
+    // Small inputs get a buffer of their own size so they don't pay for a full chunk
+    qint64 bufferSize = StreamChunkSize;
+    if (!input.isSequential() && input.size() < bufferSize) {
+        bufferSize = qMax<qint64>(input.size(), 1);
+    }
+    QByteArray buffer(static_cast<int>(bufferSize), Qt::Uninitialized);
+    
+    while (remainingBytes > 0) {
+        if (m_cancelled) {
+            qWarning() << "Decryption cancelled";
+            return false;
+        }
+        qint64 bytesRead = input.read(buffer.data(), qMin(bufferSize, remainingBytes));
+        if (bytesRead < 0) {
+            qWarning() << "Read error while decrypting:" << input.errorString();
+            return false;
+        }
+        m_readLimiter.acquire(bytesRead);
+        if (bytesRead == 0) {
+            break;
+        }
+        
+        m_keystream.apply(buffer.data(), bytesRead, offset);
+        
+        if (output.write(buffer.constData(), bytesRead) != bytesRead) {
+            qWarning() << "Write error while decrypting:" << output.errorString();
+            return false;
+        }
+        offset += bytesRead;
+        remainingBytes -= bytesRead;
+        addProcessedBytes(bytesRead);
+    }
+    
+    return true;
+}
+
+bool FileDecryptor::useMemoryMapping(const QFile& input) const
+{
+    return m_memoryMapping
+        && input.size() >= FileMapping::MinimumFileSize
+        && FileMapping::isSupported(input.fileName());
+}
+
+MappedResult FileDecryptor::decryptMapped(QFile& input, QFile& output)
+{
+    // Legacy files have no chunks to spread over the cores
+    if (!EncryptedContainer::isContainer(input)) {
+        return MappedResult::Unavailable;
+    }
+    
+    QByteArray headerBytes;
+    EncryptedContainerHeader header;
+    AeadCipher cipher;
+    if (!openContainer(input, headerBytes, header, cipher)) {
+        return MappedResult::Failed;
+    }
+    
+    const qint64 plaintextSize = EncryptedContainer::plaintextSize(input.size(), header.chunkSize);
+    if (plaintextSize < 0) {
+        qWarning() << "Encrypted file is truncated";
+        return MappedResult::Failed;
+    }
+    
+    const qint64 chunkSize = header.chunkSize;
+    const qint64 slotSize = chunkSize + AeadCipher::TagSize;
+    // From the container rather than the plaintext size, which can't tell
+    // whether an empty final chunk follows the last full one
+    const quint64 totalChunks = EncryptedContainer::chunkCount(input.size(), header.chunkSize);
+    const quint64 windowChunks = qMax<quint64>(1, FileMapping::WindowSize / slotSize);
+    const int batchChunks = qMax(1, EncryptedContainer::batchChunkCount(header.chunkSize) / qMax(1, m_activeFiles.load()));
+    QByteArray buffer(static_cast<int>(chunkSize * batchChunks), Qt::Uninitialized);
+    
+    QVector<EncryptedChunk> chunks;
+    for (quint64 windowStart = 0; windowStart < totalChunks; windowStart += windowChunks) {
+        const quint64 windowEnd = qMin(windowStart + windowChunks, totalChunks);
+        const qint64 windowOffset = EncryptedContainer::chunkOffset(windowStart, header.chunkSize);
+        const qint64 windowLength = qMin(qint64(windowEnd - windowStart) * slotSize, input.size() - windowOffset);
+        
+        uchar *source = FileMapping::map(input, windowOffset, windowLength);
+        if (!source) {
+            return windowStart == 0 ? MappedResult::Unavailable : MappedResult::Failed;
+        }
+        
+        // Each chunk is copied out of the map by the thread that opens it, so
+        // the copy is spread over the cores instead of done by read(); the
+        // tag is checked where it lies
+        auto open = [&cipher, &headerBytes, source, windowStart, slotSize](EncryptedChunk& chunk) {
+            unsigned char nonce[AeadCipher::NonceSize];
+            EncryptedContainer::chunkNonce(chunk.index, chunk.finalChunk, nonce);
+            const unsigned char *sealed = source + (chunk.index - windowStart) * slotSize;
+            unsigned char *data = reinterpret_cast<unsigned char*>(chunk.data);
+            if (chunk.size > 0) {
+                memcpy(data, sealed, chunk.size);
+            }
+            chunk.authenticated = cipher.decrypt(nonce, headerBytes, data, chunk.size, sealed + chunk.size);
+        };
+        
+        for (quint64 batchStart = windowStart; batchStart < windowEnd; batchStart += batchChunks) {
+            if (m_cancelled) {
+                qWarning() << "Decryption cancelled";
+                FileMapping::unmap(input, source);
+                return MappedResult::Failed;
+            }
+            
+            chunks.clear();
+            qint64 batchBytes = 0;
+            const quint64 batchEnd = qMin<quint64>(batchStart + batchChunks, windowEnd);
+            for (quint64 index = batchStart; index < batchEnd; ++index) {
+                EncryptedChunk chunk;
+                chunk.data = buffer.data() + (index - batchStart) * chunkSize;
+                chunk.size = qMin(chunkSize, plaintextSize - qint64(index) * chunkSize);
+                chunk.index = index;
+                chunk.finalChunk = (index == totalChunks - 1);
+                chunks.append(chunk);
+                batchBytes += chunk.size + AeadCipher::TagSize;
+            }
+            
+            // Pages are read in as the chunks are copied out
+            m_readLimiter.acquire(batchBytes);
+            
+            if (chunks.size() == 1) {
+                open(chunks[0]);
+            } else {
+                QtConcurrent::blockingMap(chunks, open);
+            }
+            
+            for (const EncryptedChunk& chunk : chunks) {
+                if (!chunk.authenticated) {
+                    qWarning() << "Authentication failed at chunk" << chunk.index
+                               << "- wrong password or corrupted file";
+                    FileMapping::unmap(input, source);
+                    return MappedResult::Failed;
+                }
+            }
+            for (const EncryptedChunk& chunk : chunks) {
+                if (output.write(chunk.data, chunk.size) != chunk.size) {
+                    qWarning() << "Write error while decrypting:" << output.errorString();
+                    FileMapping::unmap(input, source);
+                    return MappedResult::Failed;
+                }
+                addProcessedBytes(chunk.size + AeadCipher::TagSize);
+            }
+        }
+        
+        FileMapping::unmap(input, source);
+    }
     
-    QByteArray decryptedData = decryptData(encryptedData);
+    return MappedResult::Completed;
+}
+
+bool FileDecryptor::decryptFile(const QString& encryptedFilePath, const QString& decryptedFilePath)
+{
+    QFile encryptedFile(encryptedFilePath);
+    if (!encryptedFile.open(QIODevice::ReadOnly)) {
+        qWarning() << "Failed to open encrypted file:" << encryptedFilePath;
+        return false;
+    }
     
     // Create destination directory if needed
     QFileInfo fileInfo(decryptedFilePath);
@@ -81,9 +571,27 @@ bool FileDecryptor::decryptFile(const QString& encryptedFilePath, const QString&
         return false;
     }
     
-    decryptedFile.write(decryptedData);
+    // Unavailable means nothing was written yet; streaming starts over from the top
+    bool success = false;
+    MappedResult result = MappedResult::Unavailable;
+    if (useMemoryMapping(encryptedFile)) {
+        result = decryptMapped(encryptedFile, decryptedFile);
+    }
+    if (result == MappedResult::Unavailable) {
+        encryptedFile.seek(0);
+        success = decryptStream(encryptedFile, decryptedFile);
+    } else {
+        success = (result == MappedResult::Completed);
+    }
+    encryptedFile.close();
     decryptedFile.close();
     
+    if (!success) {
+        QFile::remove(decryptedFilePath);
+        qWarning() << "Failed to decrypt:" << encryptedFilePath;
+        return false;
+    }
+    
     qDebug() << "Decrypted:" << encryptedFilePath << "->" << decryptedFilePath;
     return true;
 }
@@ -102,9 +610,22 @@ bool FileDecryptor::decryptDirectory(const QString& encryptedBackupDir)
     
     qDebug() << "Decrypting files to:" << decryptedDir;
     
-    QDirIterator it(encryptedBackupDir, QStringList() << "*.enc", QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    // The legacy key is set lazily; do it before the workers share it
+    if (!m_keystream.isValid()) {
+        m_keystream.setKey(generateKey());
+    }
+    m_cancelled = false;
     
-    bool allSuccess = true;
+    // A backup spread over several destinations lists the files of its
+    // other parts in its manifest; copies left here from before they
+    // moved are stale
+    BackupManifest manifest;
+    manifest.load(BackupManifest::filePathFor(encryptedBackupDir));
+    
+    // List everything first so progress can be reported against a total
+    QList<QPair<QString, QString>> files;
+    qint64 totalBytes = 0;
+    QDirIterator it(encryptedBackupDir, QStringList() << "*.enc", QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
     while (it.hasNext()) {
         QString encryptedFile = it.next();
         
@@ -119,17 +640,291 @@ bool FileDecryptor::decryptDirectory(const QString& encryptedBackupDir)
         if (relativePath.endsWith(".enc")) {
             relativePath.chop(4);
         }
+        if (!manifest.entry(relativePath).location.isEmpty()) {
+            continue;
+        }
         
-        QString decryptedFile = decryptedDir + "/" + relativePath;
-        
-        if (!decryptFile(encryptedFile, decryptedFile)) {
-            allSuccess = false;
+        files.append(qMakePair(encryptedFile, decryptedDir + "/" + relativePath));
+        totalBytes += it.fileInfo().size();
+    }
+    
+    bool pathsValid = true;
+    for (const QString& path : manifest.paths()) {
+        if (!manifest.entry(path).location.isEmpty()) {
+            const QString target = restoreTarget(decryptedDir, path);
+            if (target.isEmpty()) {
+                qWarning() << "Skipping a path outside the backup:" << path;
+                pathsValid = false;
+                continue;
+            }
+            const QString encryptedFile = manifest.encryptedFilePath(encryptedBackupDir, path);
+            files.append(qMakePair(encryptedFile, target));
+            totalBytes += QFileInfo(encryptedFile).size();
         }
     }
     
+    bool allSuccess = decryptFiles(files, totalBytes) && pathsValid;
+    
+    if (m_cancelled) {
+        qWarning() << "Directory decryption cancelled:" << encryptedBackupDir;
+        return false;
+    }
+    
     if (allSuccess) {
         qDebug() << "All files decrypted successfully to:" << decryptedDir;
     }
     
     return allSuccess;
 }
+
+bool FileDecryptor::restoreFiles(const QString& encryptedBackupDir, const QStringList& patterns, const QString& targetDir)
+{
+    if (!QDir(encryptedBackupDir).exists()) {
+        qWarning() << "Encrypted backup directory does not exist:" << encryptedBackupDir;
+        return false;
+    }
+    
+    BackupManifest manifest;
+    if (!manifest.load(BackupManifest::filePathFor(encryptedBackupDir))) {
+        qWarning() << "No manifest in" << encryptedBackupDir << "- scanning the backup instead";
+        manifest = BackupManifest::scan(encryptedBackupDir);
+    }
+    
+    const QStringList paths = manifest.resolve(patterns);
+    if (paths.isEmpty()) {
+        qWarning() << "Nothing in the backup matches" << patterns;
+        return false;
+    }
+    
+    if (!QDir().mkpath(targetDir)) {
+        qWarning() << "Failed to create restore directory:" << targetDir;
+        return false;
+    }
+    
+    qDebug() << "Restoring" << paths.size() << "files to:" << targetDir;
+    
+    if (!m_keystream.isValid()) {
+        m_keystream.setKey(generateKey());
+    }
+    m_cancelled = false;
+    
+    // Only the selected files are touched, so sizing them is cheap. Paths
+    // come from the backup, so none may write outside the target.
+    QList<QPair<QString, QString>> files;
+    qint64 totalBytes = 0;
+    bool pathsValid = true;
+    for (const QString &path : paths) {
+        const QString target = restoreTarget(targetDir, path);
+        if (target.isEmpty()) {
+            qWarning() << "Skipping a path outside the restore directory:" << path;
+            pathsValid = false;
+            continue;
+        }
+        const QString encryptedFile = manifest.encryptedFilePath(encryptedBackupDir, path);
+        files.append(qMakePair(encryptedFile, target));
+        totalBytes += QFileInfo(encryptedFile).size();
+    }
+    
+    bool allSuccess = decryptFiles(files, totalBytes) && pathsValid;
+    
+    if (m_cancelled) {
+        qWarning() << "Restore cancelled:" << encryptedBackupDir;
+        return false;
+    }
+    
+    return allSuccess;
+}
+
+QString FileDecryptor::verifyCheckpointPathFor(const QString& encryptedBackupDir)
+{
+    return encryptedBackupDir + "/verify-checkpoint.txt";
+}
+
+bool FileDecryptor::verifyBackup(const QString& encryptedBackupDir, BackupVerifyReport& report, qint64 timeLimitMsecs)
+{
+    report = BackupVerifyReport();
+    
+    if (!QDir(encryptedBackupDir).exists()) {
+        qWarning() << "Encrypted backup directory does not exist:" << encryptedBackupDir;
+        return false;
+    }
+    
+    BackupManifest manifest;
+    if (!manifest.load(BackupManifest::filePathFor(encryptedBackupDir))) {
+        qWarning() << "No manifest in" << encryptedBackupDir << "- scanning the backup instead";
+        manifest = BackupManifest::scan(encryptedBackupDir);
+    }
+    
+    // The checkpoint holds one "outcome<TAB>path" line per file already
+    // checked in this pass
+    const QString checkpointPath = verifyCheckpointPathFor(encryptedBackupDir);
+    QHash<QString, VerifyOutcome> checked;
+    QFile checkpoint(checkpointPath);
+    if (checkpoint.open(QIODevice::ReadOnly)) {
+        while (!checkpoint.atEnd()) {
+            QByteArray line = checkpoint.readLine();
+            if (line.endsWith('\n')) {
+                line.chop(1);
+            }
+            const int separator = line.indexOf('\t');
+            if (separator < 0) {
+                continue;
+            }
+            const QByteArray outcome = line.left(separator);
+            checked.insert(BackupManifest::decodePath(line.mid(separator + 1)),
+                           outcome == "ok" ? VerifyOutcome::Verified
+                           : outcome == "legacy" ? VerifyOutcome::Legacy : VerifyOutcome::Failed);
+        }
+        checkpoint.close();
+        qDebug() << "Resuming verification of" << encryptedBackupDir << "after" << checked.size() << "files";
+    }
+    
+    auto record = [&report](const QString& path, VerifyOutcome outcome) {
+        switch (outcome) {
+        case VerifyOutcome::Verified:
+            report.verifiedFiles++;
+            break;
+        case VerifyOutcome::Legacy:
+            report.legacyFiles++;
+            break;
+        case VerifyOutcome::Failed:
+            report.failedFiles.append(path);
+            break;
+        }
+    };
+    
+    QStringList pending;
+    qint64 totalBytes = 0;
+    // Files a spread backup keeps in its other parts are checked there
+    for (const QString& path : manifest.localPaths()) {
+        auto it = checked.constFind(path);
+        if (it != checked.constEnd()) {
+            record(path, it.value());
+            continue;
+        }
+        pending.append(path);
+        totalBytes += QFileInfo(encryptedBackupDir + "/" + path + ".enc").size();
+    }
+    
+    if (!checkpoint.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "Failed to write verification checkpoint:" << checkpointPath;
+        return false;
+    }
+    
+    m_cancelled = false;
+    beginProgress(totalBytes);
+    
+    QElapsedTimer clock;
+    clock.start();
+    QMutex reportMutex;
+    int finishedFiles = 0;
+    for (const QString& path : pending) {
+        m_threadPool.start([&, path]() {
+            if (m_cancelled || (timeLimitMsecs > 0 && clock.elapsed() >= timeLimitMsecs)) {
+                return;
+            }
+            
+            const QString encryptedFile = encryptedBackupDir + "/" + path + ".enc";
+            QString reason;
+            m_activeFiles++;
+            VerifyOutcome outcome = verifyBackupFile(encryptedFile, manifest.entry(path).size, reason);
+            m_activeFiles--;
+            if (m_cancelled) {
+                return;  // The file may have been cut short; check it again next time
+            }
+            
+            {
+                QMutexLocker locker(&reportMutex);
+                record(path, outcome);
+                finishedFiles++;
+                
+                // Flushed per file so an interrupted run loses no finished work
+                QByteArray line = outcome == VerifyOutcome::Verified ? "ok\t"
+                                : outcome == VerifyOutcome::Legacy ? "legacy\t" : "failed\t";
+                line.append(BackupManifest::encodePath(path));
+                line.append('\n');
+                checkpoint.write(line);
+                checkpoint.flush();
+            }
+            
+            if (outcome == VerifyOutcome::Failed) {
+                emit corruptedFileFound(encryptedFile, reason);
+            }
+            emit fileProcessed(encryptedFile);
+        });
+    }
+    m_threadPool.waitForDone();
+    checkpoint.close();
+    
+    report.remainingFiles = pending.size() - finishedFiles;
+    if (report.isComplete()) {
+        // The next run starts a new pass
+        QFile::remove(checkpointPath);
+    }
+    
+    if (m_cancelled) {
+        qWarning() << "Verification cancelled:" << encryptedBackupDir;
+        return false;
+    }
+    
+    qDebug() << "Verified" << report.verifiedFiles << "files in" << encryptedBackupDir << "-"
+             << report.failedFiles.size() << "failed," << report.legacyFiles << "legacy,"
+             << report.remainingFiles << "left for the next run";
+    return report.failedFiles.isEmpty();
+}
+
+FileDecryptor::VerifyOutcome FileDecryptor::verifyBackupFile(const QString& encryptedFilePath, qint64 expectedSize, QString& reason)
+{
+    const QFileInfo fileInfo(encryptedFilePath);
+    if (!fileInfo.exists()) {
+        reason = "File is missing";
+        return VerifyOutcome::Failed;
+    }
+    const qint64 fileSize = fileInfo.size();
+    
+    if (isLegacyFile(encryptedFilePath)) {
+        addProcessedBytes(fileSize);
+        return VerifyOutcome::Legacy;
+    }
+    
+    // The size check is free and catches truncation before any reading
+    if (expectedSize >= 0 && plaintextSize(encryptedFilePath) != expectedSize) {
+        addProcessedBytes(fileSize);
+        reason = "Size does not match the manifest";
+        return VerifyOutcome::Failed;
+    }
+    
+    if (!verifyFile(encryptedFilePath)) {
+        reason = "Authentication failed";
+        return VerifyOutcome::Failed;
+    }
+    return VerifyOutcome::Verified;
+}
+
+bool FileDecryptor::decryptFiles(const QList<QPair<QString, QString>>& files, qint64 totalBytes)
+{
+    beginProgress(totalBytes);
+    
+    // The pool runs tasks in the order they were started, so files come
+    // out roughly in list order
+    std::atomic<bool> allSuccess(true);
+    for (const auto& file : files) {
+        m_threadPool.start([this, file, &allSuccess]() {
+            if (m_cancelled) {
+                allSuccess = false;
+                return;
+            }
+            m_activeFiles++;
+            bool decrypted = decryptFile(file.first, file.second);
+            m_activeFiles--;
+            if (!decrypted) {
+                allSuccess = false;
+                return;
+            }
+            emit fileProcessed(file.second);
+        });
+    }
+    m_threadPool.waitForDone();
+    
+    return allSuccess;
+}
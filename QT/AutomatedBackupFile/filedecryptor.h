@@ -1,15 +1,46 @@
 #ifndef FILEDECRYPTOR_H
 #define FILEDECRYPTOR_H
 
+#include <QObject>
 #include <QString>
+#include <QStringList>
+#include <QList>
+#include <QPair>
 #include <QByteArray>
 #include <QFile>
+#include <QIODevice>
 #include <QCryptographicHash>
+#include <QHash>
+#include <QMutex>
+#include <QThreadPool>
+#include <atomic>
+#include "xorkeystream.h"
+#include "aeadcipher.h"
+#include "encryptedcontainer.h"
+#include "filemapping.h"
+#include "bandwidthlimiter.h"
 
-class FileDecryptor
+// Outcome of FileDecryptor::verifyBackup, covering every run of the pass
+struct BackupVerifyReport
 {
+    int verifiedFiles = 0;    // Every chunk authenticated
+    int legacyFiles = 0;      // Old XOR files; they carry no tags to check
+    QStringList failedFiles;  // Missing, wrong size, or failed authentication
+    int remainingFiles = 0;   // Left for the next run of an unfinished pass
+    
+    bool isComplete() const { return remainingFiles == 0; }
+};
+
+class FileDecryptor : public QObject
+{
+    Q_OBJECT
+
 public:
-    FileDecryptor();
+    explicit FileDecryptor(QObject *parent = nullptr);
+    
+    // Chunk size used when streaming legacy files back to plaintext;
+    // containers use the chunk size stored in their header
+    static const qint64 StreamChunkSize = 1024 * 1024;
     
     // Load password from key.txt file
     bool loadPasswordFromFile(const QString& keyFilePath);
@@ -20,18 +51,127 @@ public:
     // Decrypt a single file
     bool decryptFile(const QString& encryptedFilePath, const QString& decryptedFilePath);
     
+    // Decrypt everything readable from input into output, one chunk at a time.
+    // Accepts both the authenticated container and the legacy XOR format.
+    bool decryptStream(QIODevice& input, QIODevice& output);
+    
+    // Authenticate every chunk of a container without producing plaintext.
+    // Legacy files carry no tags and always fail verification.
+    bool verifyFile(const QString& encryptedFilePath);
+    bool verifyStream(QIODevice& input);
+    
+    // Decrypt only the plaintext bytes [offset, offset + length). Seeks
+    // straight to the chunks covering the range and authenticates just
+    // those, so the cost follows the range, not the file. A range past the
+    // end is clipped, like QIODevice::read.
+    bool decryptRange(QIODevice& input, qint64 offset, qint64 length, QIODevice& output);
+    bool decryptRange(const QString& encryptedFilePath, qint64 offset, qint64 length, QByteArray& data);
+    
+    // Size of the decrypted file, from the header and file size alone; -1 on error
+    static qint64 plaintextSize(const QString& encryptedFilePath);
+    
+    // True for files written before the authenticated container existed
+    static bool isLegacyFile(const QString& encryptedFilePath);
+    
     // Decrypt entire directory and save to "decrypted" subfolder
     // Creates: destinationBackupFolder/decrypted/...
+    // Files are decrypted in parallel on the decryptor's thread pool. Blocks
+    // until done, so call it from a worker thread and follow the signals.
     bool decryptDirectory(const QString& encryptedBackupDir);
     
+    // Restore only the files matching patterns (paths, directories or
+    // wildcards relative to the backup root, see BackupManifest::resolve)
+    // into targetDir, keeping their relative paths. The files are looked up
+    // in the backup's manifest rather than by walking it, and decrypted in
+    // parallel in the order asked for, so the first patterns arrive first.
+    bool restoreFiles(const QString& encryptedBackupDir, const QStringList& patterns, const QString& targetDir);
+    
+    // Prove a backup is restorable without writing any plaintext: every
+    // file in its manifest must exist, have the recorded size and pass
+    // authentication of every chunk. Files are checked in parallel. With a
+    // time limit (ms) the run stops starting new files once it is used up,
+    // and the next call picks the pass up where it stopped, so a large
+    // backup can be scrubbed over several nights. Returns false if a file
+    // failed or the run was cancelled.
+    bool verifyBackup(const QString& encryptedBackupDir, BackupVerifyReport& report, qint64 timeLimitMsecs = 0);
+    
+    // Where verifyBackup keeps track of an unfinished pass
+    static QString verifyCheckpointPathFor(const QString& encryptedBackupDir);
+    
+    // Cap on how fast encrypted files are read, shared by all threads, in
+    // bytes per second (default 0: unlimited). Keeps a scrub from starving
+    // everything else on the destination.
+    void setBandwidthLimit(qint64 bytesPerSecond) { m_readLimiter.setLimit(bytesPerSecond); }
+    qint64 getBandwidthLimit() const { return m_readLimiter.limit(); }
+    
+    // Read large containers on local disks through a memory map rather
+    // than read() (default: on). Falls back to streaming by itself.
+    void setMemoryMappingEnabled(bool enabled) { m_memoryMapping = enabled; }
+    bool isMemoryMappingEnabled() const { return m_memoryMapping; }
+    
+    // Files decrypted in parallel by decryptDirectory and restoreFiles (default: one per core)
+    void setThreadCount(int threadCount);
+    int getThreadCount() const;
+    
+    // Abort the running directory operation; safe to call from any thread.
+    // Files that were not finished are removed.
+    void cancel();
+    bool isCancelled() const { return m_cancelled; }
+    
+signals:
+    // Emitted from pool threads during decryptDirectory, restoreFiles and verifyBackup
+    void progressUpdated(int percentage);
+    void fileProcessed(const QString& filePath);
+    void corruptedFileFound(const QString& filePath, const QString& reason);
+    
 private:
     QString m_password;
+    XorKeystream m_keystream;  // Legacy format key, derived once when the password is set
+    
+    // Master keys by KDF salt and iteration count; every file of a backup
+    // run shares one, so the slow KDF runs once per run rather than per file
+    QHash<QByteArray, QByteArray> m_masterKeys;
+    QMutex m_masterKeyMutex;
+    
+    bool m_memoryMapping;
+    BandwidthLimiter m_readLimiter;
     
-    // XOR-based decryption with password (same as encryption)
-    QByteArray decryptData(const QByteArray& data);
+    QThreadPool m_threadPool;
+    std::atomic<bool> m_cancelled;
+    std::atomic<int> m_activeFiles;  // Files being decrypted right now
     
-    // Generate key from password
+    // Byte-based progress (encrypted bytes read) for the running directory operation
+    qint64 m_totalBytes;
+    std::atomic<qint64> m_processedBytes;
+    std::atomic<int> m_lastPercentage;
+    
+    // Generate the legacy key from password
     QByteArray generateKey();
+    
+    QByteArray masterKeyFor(const EncryptedContainerHeader& header);
+    
+    // Read the header and set up the file's cipher
+    bool openContainer(QIODevice& input, QByteArray& headerBytes,
+                       EncryptedContainerHeader& header, AeadCipher& cipher);
+    
+    // Without an output device the chunks are only authenticated. A
+    // non-negative length restricts the work to that plaintext range.
+    bool processContainer(QIODevice& input, QIODevice* output, qint64 offset = 0, qint64 length = -1);
+    bool decryptLegacyStream(QIODevice& input, QIODevice& output, qint64 offset = 0, qint64 length = -1);
+    bool useMemoryMapping(const QFile& input) const;
+    MappedResult decryptMapped(QFile& input, QFile& output);
+    enum class VerifyOutcome {
+        Verified,
+        Legacy,
+        Failed
+    };
+    
+    VerifyOutcome verifyBackupFile(const QString& encryptedFilePath, qint64 expectedSize, QString& reason);
+    
+    // Decrypt (encrypted, decrypted) path pairs on the thread pool
+    bool decryptFiles(const QList<QPair<QString, QString>>& files, qint64 totalBytes);
+    void beginProgress(qint64 totalBytes);
+    void addProcessedBytes(qint64 bytes);
 };
 
 #endif // FILEDECRYPTOR_H
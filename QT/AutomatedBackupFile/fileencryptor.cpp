@@ -1,11 +1,28 @@
 #include "fileencryptor.h"
+#include "backupmanifest.h"
 #include <QDebug>
 #include <QDir>
 #include <QFileInfo>
 #include <QDirIterator>
+#include <QPair>
+#include <QThread>
+#include <QVector>
+#include <QtConcurrent>
+#include <cstring>
 
-FileEncryptor::FileEncryptor()
+FileEncryptor::FileEncryptor(QObject *parent)
+    : QObject(parent)
+    , m_algorithm(AeadCipher::preferredAlgorithm())
+    , m_kdfIterations(EncryptedContainer::DefaultKdfIterations)
+    , m_chunkSize(EncryptedContainer::DefaultChunkSize)
+    , m_memoryMapping(true)
+    , m_cancelled(false)
+    , m_activeFiles(0)
+    , m_totalBytes(0)
+    , m_processedBytes(0)
+    , m_lastPercentage(0)
 {
+    m_threadPool.setMaxThreadCount(qMax(1, QThread::idealThreadCount()));
 }
 
 bool FileEncryptor::loadPasswordFromFile(const QString& keyFilePath)
@@ -18,6 +35,7 @@ bool FileEncryptor::loadPasswordFromFile(const QString& keyFilePath)
     
     m_password = keyFile.readAll().trimmed();
     keyFile.close();
+    resetMasterKey();
     
     if (m_password.isEmpty()) {
         qWarning() << "Password is empty in key file";
@@ -31,28 +49,267 @@ bool FileEncryptor::loadPasswordFromFile(const QString& keyFilePath)
 void FileEncryptor::setPassword(const QString& password)
 {
     m_password = password;
+    resetMasterKey();
 }
 
-QByteArray FileEncryptor::generateKey()
+void FileEncryptor::setAlgorithm(AeadCipher::Algorithm algorithm)
 {
-    // Generate a hash-based key from password
-    QByteArray passwordBytes = m_password.toUtf8();
-    QByteArray key = QCryptographicHash::hash(passwordBytes, QCryptographicHash::Sha256);
-    return key;
+    m_algorithm = algorithm;
 }
 
-QByteArray FileEncryptor::encryptData(const QByteArray& data)
+void FileEncryptor::setKdfIterations(quint32 iterations)
 {
-    QByteArray key = generateKey();
-    QByteArray encrypted;
-    encrypted.resize(data.size());
+    m_kdfIterations = qBound<quint32>(1, iterations, EncryptedContainer::MaxKdfIterations);
+    resetMasterKey();
+}
+
+void FileEncryptor::setChunkSize(quint32 chunkSize)
+{
+    m_chunkSize = qBound(EncryptedContainer::MinChunkSize, chunkSize, EncryptedContainer::MaxChunkSize);
+}
+
+void FileEncryptor::setThreadCount(int threadCount)
+{
+    m_threadPool.setMaxThreadCount(qMax(1, threadCount));
+}
+
+int FileEncryptor::getThreadCount() const
+{
+    return m_threadPool.maxThreadCount();
+}
+
+void FileEncryptor::cancel()
+{
+    m_cancelled = true;
+}
+
+void FileEncryptor::beginProgress(qint64 totalBytes)
+{
+    m_totalBytes = totalBytes;
+    m_processedBytes = 0;
+    m_lastPercentage = 0;
+}
+
+void FileEncryptor::addProcessedBytes(qint64 bytes)
+{
+    if (m_totalBytes <= 0 || bytes <= 0) {
+        return;
+    }
+    
+    // Emit each percentage once, whichever thread gets there first
+    const qint64 processed = m_processedBytes.fetch_add(bytes) + bytes;
+    const int percentage = static_cast<int>(qMin<qint64>(100, processed * 100 / m_totalBytes));
+    int last = m_lastPercentage.load();
+    while (percentage > last) {
+        if (m_lastPercentage.compare_exchange_weak(last, percentage)) {
+            emit progressUpdated(percentage);
+            break;
+        }
+    }
+}
+
+void FileEncryptor::resetMasterKey()
+{
+    m_kdfSalt.clear();
+    m_masterKey.clear();
+}
+
+bool FileEncryptor::ensureMasterKey()
+{
+    if (m_password.isEmpty()) {
+        qWarning() << "No password set for encryption";
+        return false;
+    }
     
-    // XOR encryption with repeating key
-    for (int i = 0; i < data.size(); ++i) {
-        encrypted[i] = data[i] ^ key[i % key.size()];
+    if (m_masterKey.isEmpty()) {
+        m_kdfSalt = EncryptedContainer::randomSalt();
+        m_masterKey = EncryptedContainer::deriveMasterKey(m_password, m_kdfSalt, m_kdfIterations);
     }
     
-    return encrypted;
+    return m_masterKey.size() == AeadCipher::KeySize;
+}
+
+EncryptedContainerHeader FileEncryptor::newHeader() const
+{
+    EncryptedContainerHeader header;
+    header.algorithm = m_algorithm;
+    header.kdfIterations = m_kdfIterations;
+    header.chunkSize = m_chunkSize;
+    header.kdfSalt = m_kdfSalt;
+    header.fileSalt = EncryptedContainer::randomSalt();
+    return header;
+}
+
+bool FileEncryptor::encryptStream(QIODevice& input, QIODevice& output)
+{
+    if (!ensureMasterKey()) {
+        return false;
+    }
+    
+    const EncryptedContainerHeader header = newHeader();
+    const QByteArray headerBytes = header.toBytes();
+    const AeadCipher cipher(m_algorithm, EncryptedContainer::deriveFileKey(m_masterKey, header));
+    
+    if (output.write(headerBytes) != headerBytes.size()) {
+        qWarning() << "Write error while encrypting:" << output.errorString();
+        return false;
+    }
+    
+    // Don't reserve a slot per core for a file that only fills one chunk, and
+    // share the cores with the other files of a directory operation
+    const qint64 slotSize = qint64(m_chunkSize) + AeadCipher::TagSize;
+    int batchChunks = qMax(1, EncryptedContainer::batchChunkCount(m_chunkSize) / qMax(1, m_activeFiles.load()));
+    if (!input.isSequential()) {
+        const qint64 remaining = input.size() - input.pos();
+        batchChunks = static_cast<int>(qBound<qint64>(1, (remaining + m_chunkSize - 1) / m_chunkSize, batchChunks));
+    }
+    QByteArray buffer(static_cast<int>(slotSize * batchChunks), Qt::Uninitialized);
+    
+    auto seal = [&cipher, &headerBytes](EncryptedChunk& chunk) {
+        unsigned char nonce[AeadCipher::NonceSize];
+        EncryptedContainer::chunkNonce(chunk.index, chunk.finalChunk, nonce);
+        unsigned char *data = reinterpret_cast<unsigned char*>(chunk.data);
+        cipher.encrypt(nonce, headerBytes, data, chunk.size, data + chunk.size);
+    };
+    
+    QVector<EncryptedChunk> chunks;
+    quint64 chunkIndex = 0;
+    bool finished = false;
+    while (!finished) {
+        if (m_cancelled) {
+            qWarning() << "Encryption cancelled";
+            return false;
+        }
+        chunks.clear();
+        
+        // The last chunk is the first short one, or a full one at end of input.
+        // An empty file is a single empty final chunk.
+        for (int slot = 0; slot < batchChunks && !finished; ++slot) {
+            EncryptedChunk chunk;
+            chunk.data = buffer.data() + slot * slotSize;
+            chunk.size = EncryptedContainer::readFully(input, chunk.data, m_chunkSize);
+            if (chunk.size < 0) {
+                qWarning() << "Read error while encrypting:" << input.errorString();
+                return false;
+            }
+            chunk.index = chunkIndex++;
+            chunk.finalChunk = chunk.size < m_chunkSize || input.atEnd();
+            finished = chunk.finalChunk;
+            chunks.append(chunk);
+        }
+        
+        if (chunks.size() == 1) {
+            seal(chunks[0]);
+        } else {
+            QtConcurrent::blockingMap(chunks, seal);
+        }
+        
+        for (const EncryptedChunk& chunk : chunks) {
+            const qint64 sealedSize = chunk.size + AeadCipher::TagSize;
+            if (output.write(chunk.data, sealedSize) != sealedSize) {
+                qWarning() << "Write error while encrypting:" << output.errorString();
+                return false;
+            }
+            addProcessedBytes(chunk.size);
+        }
+    }
+    
+    return true;
+}
+
+bool FileEncryptor::useMemoryMapping(const QFile& input) const
+{
+    return m_memoryMapping
+        && input.size() >= FileMapping::MinimumFileSize
+        && FileMapping::isSupported(input.fileName());
+}
+
+MappedResult FileEncryptor::encryptMapped(QFile& input, QFile& output)
+{
+    if (!ensureMasterKey()) {
+        return MappedResult::Failed;
+    }
+    
+    const EncryptedContainerHeader header = newHeader();
+    const QByteArray headerBytes = header.toBytes();
+    const AeadCipher cipher(m_algorithm, EncryptedContainer::deriveFileKey(m_masterKey, header));
+    
+    if (output.write(headerBytes) != headerBytes.size()) {
+        qWarning() << "Write error while encrypting:" << output.errorString();
+        return MappedResult::Failed;
+    }
+    
+    const qint64 plaintextSize = input.size();
+    const qint64 chunkSize = m_chunkSize;
+    const qint64 slotSize = chunkSize + AeadCipher::TagSize;
+    const quint64 totalChunks = qMax<quint64>(1, (plaintextSize + chunkSize - 1) / chunkSize);
+    const quint64 windowChunks = qMax<quint64>(1, FileMapping::WindowSize / chunkSize);
+    const int batchChunks = qMax(1, EncryptedContainer::batchChunkCount(m_chunkSize) / qMax(1, m_activeFiles.load()));
+    QByteArray buffer(static_cast<int>(slotSize * batchChunks), Qt::Uninitialized);
+    
+    QVector<EncryptedChunk> chunks;
+    for (quint64 windowStart = 0; windowStart < totalChunks; windowStart += windowChunks) {
+        const quint64 windowEnd = qMin(windowStart + windowChunks, totalChunks);
+        const qint64 windowOffset = qint64(windowStart) * chunkSize;
+        const qint64 windowLength = qMin(qint64(windowEnd - windowStart) * chunkSize, plaintextSize - windowOffset);
+        
+        // An empty file has nothing to map, but still gets its final chunk
+        uchar *source = FileMapping::map(input, windowOffset, windowLength);
+        if (!source && windowLength > 0) {
+            return windowStart == 0 ? MappedResult::Unavailable : MappedResult::Failed;
+        }
+        
+        // Each chunk is copied out of the map by the thread that seals it,
+        // so the copy is spread over the cores instead of done by read()
+        auto seal = [&cipher, &headerBytes, source, windowOffset, chunkSize](EncryptedChunk& chunk) {
+            unsigned char nonce[AeadCipher::NonceSize];
+            EncryptedContainer::chunkNonce(chunk.index, chunk.finalChunk, nonce);
+            unsigned char *data = reinterpret_cast<unsigned char*>(chunk.data);
+            if (chunk.size > 0) {
+                memcpy(data, source + (qint64(chunk.index) * chunkSize - windowOffset), chunk.size);
+            }
+            cipher.encrypt(nonce, headerBytes, data, chunk.size, data + chunk.size);
+        };
+        
+        for (quint64 batchStart = windowStart; batchStart < windowEnd; batchStart += batchChunks) {
+            if (m_cancelled) {
+                qWarning() << "Encryption cancelled";
+                FileMapping::unmap(input, source);
+                return MappedResult::Failed;
+            }
+            
+            chunks.clear();
+            const quint64 batchEnd = qMin<quint64>(batchStart + batchChunks, windowEnd);
+            for (quint64 index = batchStart; index < batchEnd; ++index) {
+                EncryptedChunk chunk;
+                chunk.data = buffer.data() + (index - batchStart) * slotSize;
+                chunk.size = qMin(chunkSize, plaintextSize - qint64(index) * chunkSize);
+                chunk.index = index;
+                chunk.finalChunk = (index == totalChunks - 1);
+                chunks.append(chunk);
+            }
+            
+            if (chunks.size() == 1) {
+                seal(chunks[0]);
+            } else {
+                QtConcurrent::blockingMap(chunks, seal);
+            }
+            
+            for (const EncryptedChunk& chunk : chunks) {
+                const qint64 sealedSize = chunk.size + AeadCipher::TagSize;
+                if (output.write(chunk.data, sealedSize) != sealedSize) {
+                    qWarning() << "Write error while encrypting:" << output.errorString();
+                    FileMapping::unmap(input, source);
+                    return MappedResult::Failed;
+                }
+                addProcessedBytes(chunk.size);
+            }
+        }
+        
+        FileMapping::unmap(input, source);
+    }
+    
+    return MappedResult::Completed;
 }
 
 bool FileEncryptor::encryptFile(const QString& sourceFilePath, const QString& encryptedFilePath)
@@ -63,11 +320,6 @@ bool FileEncryptor::encryptFile(const QString& sourceFilePath, const QString& en
         return false;
     }
     
-    QByteArray data = sourceFile.readAll();
-    sourceFile.close();
-    
-    QByteArray encryptedData = encryptData(data);
-    
     // Create destination directory if needed
     QFileInfo fileInfo(encryptedFilePath);
     QDir dir = fileInfo.dir();
@@ -81,9 +333,29 @@ bool FileEncryptor::encryptFile(const QString& sourceFilePath, const QString& en
         return false;
     }
     
-    encryptedFile.write(encryptedData);
+    // Unavailable means the input couldn't be mapped at all; only the
+    // header has been written, and streaming writes it again from the start
+    bool success = false;
+    MappedResult result = MappedResult::Unavailable;
+    if (useMemoryMapping(sourceFile)) {
+        result = encryptMapped(sourceFile, encryptedFile);
+    }
+    if (result == MappedResult::Unavailable) {
+        encryptedFile.seek(0);
+        success = encryptStream(sourceFile, encryptedFile);
+    } else {
+        success = (result == MappedResult::Completed);
+    }
+    sourceFile.close();
     encryptedFile.close();
     
+    if (!success) {
+        // Don't leave a truncated file behind that looks like a valid backup
+        QFile::remove(encryptedFilePath);
+        qWarning() << "Failed to encrypt:" << sourceFilePath;
+        return false;
+    }
+    
     qDebug() << "Encrypted:" << sourceFilePath << "->" << encryptedFilePath;
     return true;
 }
@@ -101,18 +373,77 @@ bool FileEncryptor::encryptDirectory(const QString& sourceDir, const QString& en
         encrypted.mkpath(".");
     }
     
-    QDirIterator it(sourceDir, QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+    // Derive the key before fanning out so the workers only read it
+    if (!ensureMasterKey()) {
+        return false;
+    }
+    m_cancelled = false;
     
-    bool allSuccess = true;
+    // List everything first so progress can be reported against a total
+    QList<QPair<QString, QString>> files;
+    QVector<BackupManifestEntry> entries;
+    qint64 totalBytes = 0;
+    QDirIterator it(sourceDir, QDir::Files | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
     while (it.hasNext()) {
         QString sourceFile = it.next();
         QString relativePath = source.relativeFilePath(sourceFile);
-        QString encryptedFile = encryptedDir + "/" + relativePath + ".enc";
+        files.append(qMakePair(sourceFile, encryptedDir + "/" + relativePath + ".enc"));
         
-        if (!encryptFile(sourceFile, encryptedFile)) {
-            allSuccess = false;
+        BackupManifestEntry entry;
+        entry.path = relativePath;
+        entry.size = it.fileInfo().size();
+        entry.lastModified = it.fileInfo().lastModified();
+        entries.append(entry);
+        totalBytes += entry.size;
+    }
+    beginProgress(totalBytes);
+    
+    // One flag per file, each written by a single task
+    QVector<char> completed(files.size(), 0);
+    char *completedFlags = completed.data();
+    std::atomic<bool> allSuccess(true);
+    for (int i = 0; i < files.size(); ++i) {
+        const QPair<QString, QString> file = files.at(i);
+        m_threadPool.start([this, file, completedFlags, &allSuccess, i]() {
+            if (m_cancelled) {
+                allSuccess = false;
+                return;
+            }
+            m_activeFiles++;
+            bool encrypted = encryptFile(file.first, file.second);
+            m_activeFiles--;
+            if (!encrypted) {
+                allSuccess = false;
+                return;
+            }
+            completedFlags[i] = 1;
+            emit fileProcessed(file.first);
+        });
+    }
+    m_threadPool.waitForDone();
+    
+    // Merge into the manifest of earlier runs so files already in the
+    // destination stay restorable; a destination written before manifests
+    // existed is indexed once here. Also done on cancel, since the files
+    // that finished are complete.
+    BackupManifest manifest;
+    const QString manifestPath = BackupManifest::filePathFor(encryptedDir);
+    if (!manifest.load(manifestPath)) {
+        manifest = BackupManifest::scan(encryptedDir);
+    }
+    for (int i = 0; i < entries.size(); ++i) {
+        if (completed[i]) {
+            manifest.insert(entries[i]);
         }
     }
+    if (!manifest.save(manifestPath)) {
+        allSuccess = false;
+    }
+    
+    if (m_cancelled) {
+        qWarning() << "Directory encryption cancelled:" << sourceDir;
+        return false;
+    }
     
     return allSuccess;
 }
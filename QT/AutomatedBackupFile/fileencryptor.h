@@ -1,15 +1,28 @@
 #ifndef FILEENCRYPTOR_H
 #define FILEENCRYPTOR_H
 
+#include <QObject>
 #include <QString>
 #include <QByteArray>
 #include <QFile>
+#include <QIODevice>
 #include <QCryptographicHash>
+#include <QThreadPool>
+#include <atomic>
+#include "aeadcipher.h"
+#include "encryptedcontainer.h"
+#include "filemapping.h"
 
-class FileEncryptor
+class FileEncryptor : public QObject
 {
+    Q_OBJECT
+
 public:
-    FileEncryptor();
+    explicit FileEncryptor(QObject *parent = nullptr);
+    
+    // Files are sealed in chunks of this size (see encryptedcontainer.h);
+    // a batch of chunks is encrypted in parallel, one per core
+    static const qint64 StreamChunkSize = EncryptedContainer::DefaultChunkSize;
     
     // Load password from key.txt file
     bool loadPasswordFromFile(const QString& keyFilePath);
@@ -20,17 +33,69 @@ public:
     // Encrypt a single file
     bool encryptFile(const QString& sourceFilePath, const QString& encryptedFilePath);
     
-    // Encrypt entire directory recursively
+    // Encrypt everything readable from input into output, one chunk at a time
+    bool encryptStream(QIODevice& input, QIODevice& output);
+    
+    // Encrypt entire directory recursively, several files at a time on the
+    // encryptor's thread pool. Blocks until done, so call it from a worker
+    // thread; progress arrives through the signals below. The files that
+    // made it are recorded in the backup's manifest (see BackupManifest).
     bool encryptDirectory(const QString& sourceDir, const QString& encryptedDir);
     
+    // Files encrypted in parallel by encryptDirectory (default: one per core)
+    void setThreadCount(int threadCount);
+    int getThreadCount() const;
+    
+    // Abort the running directory operation; safe to call from any thread.
+    // Files that were not finished are removed.
+    void cancel();
+    bool isCancelled() const { return m_cancelled; }
+    
+    // Read large files on local disks through a memory map rather than
+    // read() (default: on). Falls back to streaming by itself.
+    void setMemoryMappingEnabled(bool enabled) { m_memoryMapping = enabled; }
+    bool isMemoryMappingEnabled() const { return m_memoryMapping; }
+    
+    // Container parameters for files written from now on
+    void setAlgorithm(AeadCipher::Algorithm algorithm);
+    AeadCipher::Algorithm getAlgorithm() const { return m_algorithm; }
+    void setKdfIterations(quint32 iterations);
+    void setChunkSize(quint32 chunkSize);
+    
+signals:
+    // Emitted from pool threads during encryptDirectory
+    void progressUpdated(int percentage);
+    void fileProcessed(const QString& filePath);
+    
 private:
     QString m_password;
+    AeadCipher::Algorithm m_algorithm;
+    quint32 m_kdfIterations;
+    quint32 m_chunkSize;
+    
+    // The password KDF is slow on purpose, so it runs once per encryptor
+    // (one backup job) and every file shares its salt
+    QByteArray m_kdfSalt;
+    QByteArray m_masterKey;
+    
+    bool m_memoryMapping;
+    
+    QThreadPool m_threadPool;
+    std::atomic<bool> m_cancelled;
+    std::atomic<int> m_activeFiles;  // Files being encrypted right now
     
-    // XOR-based encryption with password
-    QByteArray encryptData(const QByteArray& data);
+    // Byte-based progress for the running directory operation
+    qint64 m_totalBytes;
+    std::atomic<qint64> m_processedBytes;
+    std::atomic<int> m_lastPercentage;
     
-    // Generate key from password
-    QByteArray generateKey();
+    bool ensureMasterKey();
+    void resetMasterKey();
+    EncryptedContainerHeader newHeader() const;
+    bool useMemoryMapping(const QFile& input) const;
+    MappedResult encryptMapped(QFile& input, QFile& output);
+    void beginProgress(qint64 totalBytes);
+    void addProcessedBytes(qint64 bytes);
 };
 
 #endif // FILEENCRYPTOR_H
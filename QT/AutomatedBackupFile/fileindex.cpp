@@ -0,0 +1,518 @@
+#include "fileindex.h"
+#include "backupfilemonitor.h"
+#include "contenthash.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace {
+
+const quint8 kUsed = 1;
+const quint8 kSeen = 2;
+
+// Device table index of files on devices past the 255th; read back as 0
+const quint8 kNoDevice = 255;
+
+// The name arena is rewritten once this much of it, and more than half, is dead
+const qint64 kMinNameGarbage = 1024 * 1024;
+
+// Rough heap cost of a QHash node with a QByteArray key and quint32 value
+const int kHashNodeSize = 32;
+
+int lastSlash(const char *path, int length)
+{
+    for (int i = length - 1; i >= 0; --i) {
+        if (path[i] == '/') {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Order of directory + name against another such pair, as if each were
+// one string; memcmp compares UTF-8 bytes, which gives code point order
+int comparePaths(const QByteArray &directoryA, const char *nameA, int lengthA,
+                 const QByteArray &directoryB, const char *nameB, int lengthB)
+{
+    const char *a[2] = {directoryA.constData(), nameA};
+    const int aSize[2] = {int(directoryA.size()), lengthA};
+    const char *b[2] = {directoryB.constData(), nameB};
+    const int bSize[2] = {int(directoryB.size()), lengthB};
+
+    int ai = 0, ao = 0, bi = 0, bo = 0;
+    for (;;) {
+        while (ai < 2 && ao == aSize[ai]) {
+            ++ai;
+            ao = 0;
+        }
+        while (bi < 2 && bo == bSize[bi]) {
+            ++bi;
+            bo = 0;
+        }
+        if (ai == 2 || bi == 2) {
+            return (ai == 2 ? 0 : 1) - (bi == 2 ? 0 : 1);
+        }
+
+        const int n = qMin(aSize[ai] - ao, bSize[bi] - bo);
+        const int order = memcmp(a[ai] + ao, b[bi] + bo, n);
+        if (order != 0) {
+            return order;
+        }
+        ao += n;
+        bo += n;
+    }
+}
+
+} // namespace
+
+void FileIndex::clear()
+{
+    *this = FileIndex();
+}
+
+void FileIndex::reserve(int count)
+{
+    int bucketCount = 16;
+    while (bucketCount < count) {
+        bucketCount *= 2;
+    }
+    if (bucketCount > m_buckets.size()) {
+        rehash(bucketCount);
+    }
+}
+
+void FileIndex::swap(FileIndex &other)
+{
+    std::swap(*this, other);
+}
+
+quint64 FileIndex::nameHash(quint32 directory, const char *name, int length)
+{
+    return ContentHash::hash(name, length) ^ (quint64(directory) * 0x9E3779B97F4A7C15ULL);
+}
+
+const FileIndexRecord &FileIndex::record(int handle) const
+{
+    return m_blocks.at(handle / BlockSize).at(handle % BlockSize);
+}
+
+FileIndexRecord &FileIndex::mutableRecord(int handle)
+{
+    return m_blocks[handle / BlockSize][handle % BlockSize];
+}
+
+bool FileIndex::isUsed(int handle) const
+{
+    return handle >= 0 && handle < m_handleLimit && (record(handle).flags & kUsed);
+}
+
+const char *FileIndex::nameData(const FileIndexRecord &record) const
+{
+    return m_nameChunks.at(record.name >> 16).constData() + (record.name & 0xffff);
+}
+
+quint32 FileIndex::storeName(const char *name, int length)
+{
+    if (m_nameChunks.isEmpty() || m_nameChunks.last().size() + length > NameChunkSize) {
+        QByteArray chunk;
+        chunk.reserve(NameChunkSize);
+        m_nameChunks.append(chunk);
+    }
+
+    QByteArray &chunk = m_nameChunks.last();
+    const quint32 reference = (quint32(m_nameChunks.size() - 1) << 16) | quint32(chunk.size());
+    chunk.append(name, length);
+    return reference;
+}
+
+void FileIndex::compactNames()
+{
+    QVector<QByteArray> oldChunks;
+    oldChunks.swap(m_nameChunks);
+
+    for (int handle = 0; handle < m_handleLimit; ++handle) {
+        if (!isUsed(handle)) {
+            continue;
+        }
+        FileIndexRecord &file = mutableRecord(handle);
+        const char *name = oldChunks.at(file.name >> 16).constData() + (file.name & 0xffff);
+        file.name = storeName(name, file.nameLength);
+    }
+    m_nameGarbage = 0;
+}
+
+quint32 FileIndex::internDirectory(const char *path, int length)
+{
+    if (m_lastDirectory >= 0) {
+        const QByteArray &last = m_directories.at(m_lastDirectory).path;
+        if (last.size() == length && memcmp(last.constData(), path, length) == 0) {
+            return quint32(m_lastDirectory);
+        }
+    }
+
+    auto it = m_directoryIds.constFind(QByteArray::fromRawData(path, length));
+    if (it != m_directoryIds.constEnd()) {
+        m_lastDirectory = int(it.value());
+        return it.value();
+    }
+
+    Directory directory;
+    directory.path = QByteArray(path, length);
+
+    quint32 id;
+    if (!m_freeDirectories.isEmpty()) {
+        id = m_freeDirectories.takeLast();
+        m_directories[id] = directory;
+    } else {
+        id = quint32(m_directories.size());
+        m_directories.append(directory);
+    }
+    m_directoryIds.insert(directory.path, id);
+    m_lastDirectory = int(id);
+    return id;
+}
+
+void FileIndex::releaseDirectory(quint32 directory)
+{
+    Directory &entry = m_directories[directory];
+    if (--entry.fileCount > 0) {
+        return;
+    }
+
+    m_directoryIds.remove(entry.path);
+    entry.path = QByteArray();
+    m_freeDirectories.append(directory);
+    if (m_lastDirectory == int(directory)) {
+        m_lastDirectory = -1;
+    }
+}
+
+quint8 FileIndex::deviceIndex(quint64 device)
+{
+    // A destination rarely spans more than a device or two
+    for (int i = 0; i < m_devices.size(); ++i) {
+        if (m_devices.at(i) == device) {
+            return quint8(i);
+        }
+    }
+    if (m_devices.size() == kNoDevice) {
+        return kNoDevice;
+    }
+    m_devices.append(device);
+    return quint8(m_devices.size() - 1);
+}
+
+quint64 FileIndex::device(int handle) const
+{
+    const quint8 index = record(handle).device;
+    return index == kNoDevice ? 0 : m_devices.at(index);
+}
+
+void FileIndex::rehash(int bucketCount)
+{
+    m_buckets = QVector<quint32>(bucketCount, 0);
+    const quint64 mask = quint64(bucketCount - 1);
+
+    for (int handle = 0; handle < m_handleLimit; ++handle) {
+        if (!isUsed(handle)) {
+            continue;
+        }
+        FileIndexRecord &file = mutableRecord(handle);
+        quint32 &bucket = m_buckets[int(nameHash(file.directory, nameData(file), file.nameLength) & mask)];
+        file.next = bucket;
+        bucket = quint32(handle) + 1;
+    }
+}
+
+int FileIndex::locate(quint32 directory, const char *name, int length, quint64 hash) const
+{
+    if (m_buckets.isEmpty()) {
+        return NoFile;
+    }
+
+    quint32 link = m_buckets.at(int(hash & quint64(m_buckets.size() - 1)));
+    while (link != 0) {
+        const int handle = int(link - 1);
+        const FileIndexRecord &file = record(handle);
+        if (file.directory == directory && file.nameLength == length &&
+            memcmp(nameData(file), name, length) == 0) {
+            return handle;
+        }
+        link = file.next;
+    }
+    return NoFile;
+}
+
+int FileIndex::find(const char *path, int length) const
+{
+    const int split = lastSlash(path, length) + 1;
+    auto it = m_directoryIds.constFind(QByteArray::fromRawData(path, split));
+    if (it == m_directoryIds.constEnd()) {
+        return NoFile;
+    }
+
+    const char *name = path + split;
+    const int nameLength = length - split;
+    return locate(it.value(), name, nameLength, nameHash(it.value(), name, nameLength));
+}
+
+int FileIndex::find(const QString &filePath) const
+{
+    const QByteArray encoded = filePath.toUtf8();
+    return find(encoded.constData(), encoded.size());
+}
+
+int FileIndex::insert(const BackupFileInfo &info)
+{
+    const QByteArray encoded = info.filePath.toUtf8();
+    const qint64 modifiedMs = info.lastModified.isValid() ? info.lastModified.toMSecsSinceEpoch() : 0;
+    return insert(encoded.constData(), encoded.size(), info.size, modifiedMs, info.device, info.inode);
+}
+
+int FileIndex::insert(const char *path, int length, qint64 size, qint64 modifiedMs, quint64 device, quint64 inode)
+{
+    const int split = lastSlash(path, length) + 1;
+    const char *name = path + split;
+    const int nameLength = length - split;
+    if (nameLength >= NameChunkSize) {
+        return NoFile;
+    }
+
+    const quint32 directory = internDirectory(path, split);
+    const quint64 hash = nameHash(directory, name, nameLength);
+    int handle = locate(directory, name, nameLength, hash);
+
+    if (handle == NoFile) {
+        if (!m_freeHandles.isEmpty()) {
+            handle = int(m_freeHandles.takeLast());
+        } else {
+            handle = m_handleLimit++;
+            if (handle % BlockSize == 0) {
+                m_blocks.append(QVector<FileIndexRecord>(BlockSize, FileIndexRecord()));
+            }
+        }
+
+        // Chains average one to two files
+        if (m_count >= 2 * m_buckets.size()) {
+            rehash(qMax(16, 2 * int(m_buckets.size())));
+        }
+        quint32 &bucket = m_buckets[int(hash & quint64(m_buckets.size() - 1))];
+
+        FileIndexRecord &file = mutableRecord(handle);
+        file.directory = directory;
+        file.name = storeName(name, nameLength);
+        file.nameLength = quint16(nameLength);
+        file.flags = kUsed;
+        file.next = bucket;
+        bucket = quint32(handle) + 1;
+
+        m_directories[directory].fileCount++;
+        m_nameBytes += nameLength;
+        m_count++;
+    }
+
+    setMetadata(handle, size, modifiedMs, device, inode);
+    return handle;
+}
+
+void FileIndex::setMetadata(int handle, qint64 size, qint64 modifiedMs, quint64 device, quint64 inode)
+{
+    const quint8 index = deviceIndex(device);
+    FileIndexRecord &file = mutableRecord(handle);
+    file.size = size;
+    file.modifiedMs = modifiedMs;
+    file.inode = inode;
+    file.device = index;
+}
+
+bool FileIndex::remove(const QString &filePath)
+{
+    const int handle = find(filePath);
+    if (handle == NoFile) {
+        return false;
+    }
+    removeAt(handle);
+    return true;
+}
+
+void FileIndex::removeAt(int handle)
+{
+    if (!isUsed(handle)) {
+        return;
+    }
+
+    if (m_count == 1) {
+        clear();
+        return;
+    }
+
+    const FileIndexRecord &file = record(handle);
+    const quint32 directory = file.directory;
+    const quint32 next = file.next;
+    const int nameLength = file.nameLength;
+    const quint64 hash = nameHash(directory, nameData(file), nameLength);
+
+    // Unlink from its bucket's chain
+    quint32 *link = &m_buckets[int(hash & quint64(m_buckets.size() - 1))];
+    while (*link != quint32(handle) + 1) {
+        link = &mutableRecord(int(*link - 1)).next;
+    }
+    *link = next;
+
+    mutableRecord(handle) = FileIndexRecord();
+    m_freeHandles.append(quint32(handle));
+    releaseDirectory(directory);
+    m_nameBytes -= nameLength;
+    m_nameGarbage += nameLength;
+    m_count--;
+
+    if (m_nameGarbage > kMinNameGarbage && m_nameGarbage > m_nameBytes) {
+        compactNames();
+    }
+}
+
+QByteArray FileIndex::encodedPath(int handle) const
+{
+    const FileIndexRecord &file = record(handle);
+    const QByteArray &directory = m_directories.at(file.directory).path;
+
+    QByteArray path;
+    path.reserve(directory.size() + file.nameLength);
+    path.append(directory);
+    path.append(nameData(file), file.nameLength);
+    return path;
+}
+
+QString FileIndex::filePath(int handle) const
+{
+    return QString::fromUtf8(encodedPath(handle));
+}
+
+BackupFileInfo FileIndex::fileInfo(int handle, const QDateTime &lastChecked) const
+{
+    const FileIndexRecord &file = record(handle);
+
+    BackupFileInfo info;
+    info.filePath = filePath(handle);
+    info.fileName = QString::fromUtf8(nameData(file), file.nameLength);
+    info.size = file.size;
+    if (file.modifiedMs != 0) {
+        info.lastModified = QDateTime::fromMSecsSinceEpoch(file.modifiedMs);
+    }
+    info.lastChecked = lastChecked;
+    info.device = device(handle);
+    info.inode = file.inode;
+    info.isValid = true;
+    return info;
+}
+
+BackupFileInfo FileIndex::value(const QString &filePath, const QDateTime &lastChecked) const
+{
+    const int handle = find(filePath);
+    return handle == NoFile ? BackupFileInfo() : fileInfo(handle, lastChecked);
+}
+
+QList<BackupFileInfo> FileIndex::values(const QDateTime &lastChecked) const
+{
+    QList<BackupFileInfo> files;
+    files.reserve(m_count);
+    for (int handle = 0; handle < m_handleLimit; ++handle) {
+        if (isUsed(handle)) {
+            files.append(fileInfo(handle, lastChecked));
+        }
+    }
+    return files;
+}
+
+QStringList FileIndex::filePaths() const
+{
+    QStringList paths;
+    paths.reserve(m_count);
+    for (int handle = 0; handle < m_handleLimit; ++handle) {
+        if (isUsed(handle)) {
+            paths.append(filePath(handle));
+        }
+    }
+    return paths;
+}
+
+QStringList FileIndex::filePathsBelow(const QString &dirPath) const
+{
+    // Directories are matched once; files only by their directory's id
+    const QByteArray prefix = (dirPath + "/").toUtf8();
+    QVector<bool> below(m_directories.size(), false);
+    bool any = false;
+    for (int i = 0; i < m_directories.size(); ++i) {
+        if (m_directories.at(i).fileCount > 0 && m_directories.at(i).path.startsWith(prefix)) {
+            below[i] = true;
+            any = true;
+        }
+    }
+
+    QStringList paths;
+    if (!any) {
+        return paths;
+    }
+    for (int handle = 0; handle < m_handleLimit; ++handle) {
+        if (isUsed(handle) && below[record(handle).directory]) {
+            paths.append(filePath(handle));
+        }
+    }
+    return paths;
+}
+
+QVector<int> FileIndex::sortedHandles() const
+{
+    QVector<int> handles;
+    handles.reserve(m_count);
+    for (int handle = 0; handle < m_handleLimit; ++handle) {
+        if (isUsed(handle)) {
+            handles.append(handle);
+        }
+    }
+
+    std::sort(handles.begin(), handles.end(), [this](int a, int b) {
+        const FileIndexRecord &fileA = record(a);
+        const FileIndexRecord &fileB = record(b);
+        const int common = qMin(fileA.nameLength, fileB.nameLength);
+        if (fileA.directory == fileB.directory) {
+            const int order = memcmp(nameData(fileA), nameData(fileB), common);
+            return order != 0 ? order < 0 : fileA.nameLength < fileB.nameLength;
+        }
+        return comparePaths(m_directories.at(fileA.directory).path, nameData(fileA), fileA.nameLength,
+                            m_directories.at(fileB.directory).path, nameData(fileB), fileB.nameLength) < 0;
+    });
+    return handles;
+}
+
+void FileIndex::clearSeen()
+{
+    for (int handle = 0; handle < m_handleLimit; ++handle) {
+        if (record(handle).flags & kSeen) {
+            mutableRecord(handle).flags &= ~kSeen;
+        }
+    }
+}
+
+void FileIndex::markSeen(int handle)
+{
+    mutableRecord(handle).flags |= kSeen;
+}
+
+bool FileIndex::isSeen(int handle) const
+{
+    return record(handle).flags & kSeen;
+}
+
+qint64 FileIndex::memoryUsage() const
+{
+    qint64 bytes = qint64(m_blocks.size()) * BlockSize * qint64(sizeof(FileIndexRecord))
+                 + qint64(m_nameChunks.size()) * NameChunkSize
+                 + qint64(m_buckets.capacity() + m_freeHandles.capacity() + m_freeDirectories.capacity()) * qint64(sizeof(quint32))
+                 + qint64(m_devices.capacity()) * qint64(sizeof(quint64));
+
+    for (const Directory &directory : m_directories) {
+        bytes += qint64(sizeof(Directory)) + directory.path.capacity() + kHashNodeSize;
+    }
+    return bytes;
+}
@@ -0,0 +1,124 @@
+#ifndef FILEINDEX_H
+#define FILEINDEX_H
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+struct BackupFileInfo;
+
+// Fixed-width part of one indexed file
+struct FileIndexRecord
+{
+    qint64 size;
+    qint64 modifiedMs;    // 0 if unknown
+    quint64 inode;
+    quint32 directory;    // Index into the directory table
+    quint32 name;         // Name arena chunk (high 16 bits) and offset in it
+    quint32 next;         // Handle + 1 of the next file in the same hash bucket, 0 at the end
+    quint16 nameLength;
+    quint8 device;        // Index into the device table
+    quint8 flags;
+};
+
+// Files of one monitored destination, laid out for millions of them. A
+// path is split into its parent directory, interned once in a table that
+// every file below it shares, and its name, kept as UTF-8 in arena chunks
+// of NameChunkSize bytes; the rest is a FileIndexRecord in blocks of
+// BlockSize. Lookup hashes (directory, name) into buckets chained through
+// the records, so with typical names a file costs about 60 bytes rather
+// than the several hundred of a QHash<QString, BackupFileInfo> entry.
+//
+// Files are addressed by handles, which stay valid until the file is
+// removed. The time a file was last checked isn't stored; callers pass it
+// in when asking for a BackupFileInfo. Copies share their storage until
+// one of them is modified.
+class FileIndex
+{
+public:
+    static const int NoFile = -1;
+    static const int BlockSize = 1024;       // Records per block
+    static const int NameChunkSize = 65536;  // Bytes per name chunk; names must be shorter
+
+    int size() const { return m_count; }
+    bool isEmpty() const { return m_count == 0; }
+    void clear();
+    void reserve(int count);
+    void swap(FileIndex &other);
+
+    // Handle of the file at filePath, or NoFile
+    int find(const QString &filePath) const;
+    bool contains(const QString &filePath) const { return find(filePath) != NoFile; }
+
+    // Add a file, or update the metadata of the one at its path. Returns
+    // its handle, or NoFile if the name is too long to store.
+    int insert(const BackupFileInfo &info);
+    int insert(const char *path, int length, qint64 size, qint64 modifiedMs, quint64 device, quint64 inode);
+    bool remove(const QString &filePath);
+    void removeAt(int handle);
+
+    // Handles are below handleLimit(); not all of those are in use
+    int handleLimit() const { return m_handleLimit; }
+    bool isUsed(int handle) const;
+    const FileIndexRecord &record(int handle) const;
+    quint64 device(int handle) const;
+    QString filePath(int handle) const;
+    QByteArray encodedPath(int handle) const;  // UTF-8
+    void setMetadata(int handle, qint64 size, qint64 modifiedMs, quint64 device, quint64 inode);
+
+    BackupFileInfo fileInfo(int handle, const QDateTime &lastChecked = QDateTime()) const;
+    BackupFileInfo value(const QString &filePath, const QDateTime &lastChecked = QDateTime()) const;  // Invalid if absent
+    QList<BackupFileInfo> values(const QDateTime &lastChecked = QDateTime()) const;
+    QStringList filePaths() const;
+    QStringList filePathsBelow(const QString &dirPath) const;
+
+    // Handles of all files by path, in code point order
+    QVector<int> sortedHandles() const;
+
+    // Lets a scan tell the files it saw from the ones it didn't
+    void clearSeen();
+    void markSeen(int handle);
+    bool isSeen(int handle) const;
+
+    // Heap bytes held, approximately; divided by size() it gives the cost
+    // of a file
+    qint64 memoryUsage() const;
+
+private:
+    struct Directory {
+        QByteArray path;  // UTF-8 with the trailing '/', shared with the m_directoryIds key
+        quint32 fileCount = 0;
+    };
+
+    QVector<QVector<FileIndexRecord>> m_blocks;
+    QVector<QByteArray> m_nameChunks;
+    QVector<quint32> m_buckets;  // Handle + 1 of the first file of each chain, 0 if none
+    QVector<Directory> m_directories;
+    QHash<QByteArray, quint32> m_directoryIds;
+    QVector<quint32> m_freeDirectories;
+    QVector<quint64> m_devices;
+    QVector<quint32> m_freeHandles;
+    int m_count = 0;
+    int m_handleLimit = 0;
+    qint64 m_nameBytes = 0;    // Of files in the index
+    qint64 m_nameGarbage = 0;  // Left behind in the arena by removed files
+    int m_lastDirectory = -1;  // Consecutive inserts are usually in the same directory
+
+    FileIndexRecord &mutableRecord(int handle);
+    const char *nameData(const FileIndexRecord &record) const;
+    quint32 storeName(const char *name, int length);
+    void compactNames();
+    int find(const char *path, int length) const;
+    int locate(quint32 directory, const char *name, int length, quint64 hash) const;
+    quint32 internDirectory(const char *path, int length);
+    void releaseDirectory(quint32 directory);
+    quint8 deviceIndex(quint64 device);
+    void rehash(int bucketCount);
+    static quint64 nameHash(quint32 directory, const char *name, int length);
+};
+
+#endif // FILEINDEX_H
@@ -0,0 +1,42 @@
+#include "filemapping.h"
+#include "storagedevice.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+bool FileMapping::isSupported(const QString &path)
+{
+    return StorageDeviceResolver::resolve(path).kind != StorageDeviceKind::Network;
+}
+
+uchar *FileMapping::map(QFile &file, qint64 offset, qint64 size)
+{
+    if (size <= 0) {
+        return nullptr;
+    }
+
+    uchar *data = file.map(offset, size);
+    if (!data) {
+        return nullptr;
+    }
+
+#ifdef Q_OS_UNIX
+    // madvise wants a page-aligned start; Qt hands back the exact offset
+    const quintptr pageSize = static_cast<quintptr>(sysconf(_SC_PAGESIZE));
+    const quintptr start = reinterpret_cast<quintptr>(data) & ~(pageSize - 1);
+    const size_t length = static_cast<size_t>(size) + (reinterpret_cast<quintptr>(data) - start);
+    madvise(reinterpret_cast<void*>(start), length, MADV_SEQUENTIAL);
+#endif
+    // No madvise on Windows; its page fault clustering already reads ahead
+
+    return data;
+}
+
+void FileMapping::unmap(QFile &file, uchar *data)
+{
+    if (data) {
+        file.unmap(data);
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef FILEMAPPING_H
+#define FILEMAPPING_H
+
+#include <QFile>
+#include <QString>
+
+// Outcome of a memory-mapped file operation. Unavailable means the input
+// couldn't be mapped and the caller should fall back to streaming.
+enum class MappedResult {
+    Completed,
+    Failed,
+    Unavailable
+};
+
+// Read-only windows of a file mapped into memory, for encrypting and
+// decrypting large files without read() copies. Files are processed one
+// window at a time so address space use stays bounded. Output is still
+// written with write(): filling a new file through a map costs a zeroed
+// page and a fault per 4 KiB, which measured slower than writing.
+class FileMapping
+{
+public:
+    // Smaller files go through the streaming path; setting up maps isn't worth it
+    static const qint64 MinimumFileSize = 16 * 1024 * 1024;
+
+    // Bytes of input mapped at a time
+    static const qint64 WindowSize = 256 * 1024 * 1024;
+
+    // Local disks only: network filesystems map poorly (or not at all), and
+    // a dropped connection, like a file shrinking while it is mapped, turns
+    // into a bus error instead of a read error
+    static bool isSupported(const QString &path);
+
+    // Map a window and tell the kernel it will be read front to back.
+    // Returns nullptr when the window can't be mapped.
+    static uchar *map(QFile &file, qint64 offset, qint64 size);
+    static void unmap(QFile &file, uchar *data);
+};
+
+#endif // FILEMAPPING_H
@@ -0,0 +1,173 @@
+#include "hashcache.h"
+#include <QDebug>
+#include <QFile>
+#include <QSaveFile>
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+
+const char kMagic[8] = {'A', 'B', 'F', 'M', 'H', 'A', 'S', 'H'};
+
+const quint32 FlagMismatch = 0x1;
+
+// Entries are written in batches of this many
+const int WriteBatch = 4096;
+
+} // namespace
+
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+size_t qHash(const HashCacheKey &key, size_t seed)
+#else
+uint qHash(const HashCacheKey &key, uint seed)
+#endif
+{
+    // Inodes are dense and usually unique on their own; the rest only
+    // matters for the rare key that differs from an old one in metadata
+    quint64 h = key.inode * 0x9E3779B97F4A7C15ULL;
+    h ^= key.device + 0x632BE59BD9B4E019ULL + (h << 6) + (h >> 2);
+    h ^= quint64(key.size) + (h << 6) + (h >> 2);
+    h ^= quint64(key.modifiedMs) + (h << 6) + (h >> 2);
+    return static_cast<decltype(seed)>(h ^ (h >> 32)) ^ seed;
+}
+
+bool HashCache::load(const QString &filePath)
+{
+    clear();
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;  // No cache yet
+    }
+    const QByteArray data = file.readAll();
+    file.close();
+
+    const uchar *p = reinterpret_cast<const uchar*>(data.constData());
+    if (data.size() < HeaderSize || memcmp(p, kMagic, sizeof(kMagic)) != 0 ||
+        qFromLittleEndian<quint32>(p + 8) != FormatVersion) {
+        qWarning() << "Not a hash cache, ignored:" << filePath;
+        return false;
+    }
+
+    const quint64 entryCount = qFromLittleEndian<quint64>(p + 16);
+    const quint32 destinationLength = qFromLittleEndian<quint32>(p + 32);
+    const quint32 pathLength = qFromLittleEndian<quint32>(p + 36);
+    if (entryCount > quint64(data.size()) / EntrySize ||
+        quint64(HeaderSize) + entryCount * EntrySize + destinationLength + pathLength != quint64(data.size())) {
+        qWarning() << "Hash cache is damaged, ignored:" << filePath;
+        return false;
+    }
+
+    m_passStartedMs = qFromLittleEndian<qint64>(p + 24);
+
+    m_entries.reserve(static_cast<int>(entryCount));
+    const uchar *entry = p + HeaderSize;
+    for (quint64 i = 0; i < entryCount; ++i, entry += EntrySize) {
+        HashCacheKey key;
+        key.device = qFromLittleEndian<quint64>(entry);
+        key.inode = qFromLittleEndian<quint64>(entry + 8);
+        key.size = qFromLittleEndian<qint64>(entry + 16);
+        key.modifiedMs = qFromLittleEndian<qint64>(entry + 24);
+
+        HashCacheEntry value;
+        value.hash = qFromLittleEndian<quint64>(entry + 32);
+        value.verifiedMs = qFromLittleEndian<qint64>(entry + 40);
+        value.mismatch = (qFromLittleEndian<quint32>(entry + 48) & FlagMismatch) != 0;
+        m_entries.insert(key, value);
+    }
+
+    const char *strings = reinterpret_cast<const char*>(entry);
+    m_cursorDestination = QString::fromUtf8(strings, static_cast<int>(destinationLength));
+    m_cursorPath = QString::fromUtf8(strings + destinationLength, static_cast<int>(pathLength));
+    return true;
+}
+
+bool HashCache::save(const QString &filePath) const
+{
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to write hash cache:" << filePath << file.errorString();
+        return false;
+    }
+
+    const QByteArray destination = m_cursorDestination.toUtf8();
+    const QByteArray path = m_cursorPath.toUtf8();
+
+    QByteArray header(HeaderSize, '\0');
+    uchar *h = reinterpret_cast<uchar*>(header.data());
+    memcpy(h, kMagic, sizeof(kMagic));
+    qToLittleEndian<quint32>(FormatVersion, h + 8);
+    qToLittleEndian<quint64>(static_cast<quint64>(m_entries.size()), h + 16);
+    qToLittleEndian<qint64>(m_passStartedMs, h + 24);
+    qToLittleEndian<quint32>(destination.size(), h + 32);
+    qToLittleEndian<quint32>(path.size(), h + 36);
+    file.write(header);
+
+    QByteArray batch;
+    batch.reserve(WriteBatch * EntrySize);
+    for (auto it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        const int offset = batch.size();
+        batch.resize(offset + EntrySize);
+        uchar *entry = reinterpret_cast<uchar*>(batch.data()) + offset;
+        qToLittleEndian<quint64>(it.key().device, entry);
+        qToLittleEndian<quint64>(it.key().inode, entry + 8);
+        qToLittleEndian<qint64>(it.key().size, entry + 16);
+        qToLittleEndian<qint64>(it.key().modifiedMs, entry + 24);
+        qToLittleEndian<quint64>(it->hash, entry + 32);
+        qToLittleEndian<qint64>(it->verifiedMs, entry + 40);
+        qToLittleEndian<quint32>(it->mismatch ? FlagMismatch : 0, entry + 48);
+        qToLittleEndian<quint32>(0, entry + 52);
+
+        if (batch.size() >= WriteBatch * EntrySize) {
+            file.write(batch);
+            batch.clear();
+        }
+    }
+    file.write(batch);
+    file.write(destination);
+    file.write(path);
+
+    if (!file.commit()) {
+        qWarning() << "Failed to write hash cache:" << filePath << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool HashCache::lookup(const HashCacheKey &key, HashCacheEntry &entry) const
+{
+    auto it = m_entries.constFind(key);
+    if (it == m_entries.constEnd()) {
+        return false;
+    }
+    entry = it.value();
+    return true;
+}
+
+void HashCache::clear()
+{
+    m_entries.clear();
+    m_cursorDestination.clear();
+    m_cursorPath.clear();
+    m_passStartedMs = 0;
+}
+
+int HashCache::removeVerifiedBefore(qint64 ms)
+{
+    int removed = 0;
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (it->verifiedMs < ms) {
+            it = m_entries.erase(it);
+            ++removed;
+        } else {
+            ++it;
+        }
+    }
+    return removed;
+}
+
+void HashCache::setCursor(const QString &destinationId, const QString &filePath)
+{
+    m_cursorDestination = destinationId;
+    m_cursorPath = filePath;
+}
@@ -0,0 +1,82 @@
+#ifndef HASHCACHE_H
+#define HASHCACHE_H
+
+#include <QHash>
+#include <QString>
+
+// File identity and metadata a cached hash was taken at. A file rewritten
+// in place gets a new size or modification time and so a new key; the old
+// hash is never compared against new contents.
+struct HashCacheKey
+{
+    quint64 device = 0;
+    quint64 inode = 0;
+    qint64 size = 0;
+    qint64 modifiedMs = 0;
+
+    bool operator==(const HashCacheKey &other) const {
+        return device == other.device && inode == other.inode &&
+               size == other.size && modifiedMs == other.modifiedMs;
+    }
+};
+
+// Qt 6 hashes to size_t, Qt 5 to uint
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+size_t qHash(const HashCacheKey &key, size_t seed = 0);
+#else
+uint qHash(const HashCacheKey &key, uint seed = 0);
+#endif
+
+struct HashCacheEntry
+{
+    quint64 hash = 0;        // ContentHash of the file when it was first hashed under this key
+    qint64 verifiedMs = 0;   // Last time the contents were read and compared
+    bool mismatch = false;   // Last read gave a different hash: the contents rotted
+};
+
+// Content hashes of backup files for BackupFileMonitor's scrub, kept in a
+// small binary file across restarts together with where the last scrub
+// stopped, so a time-limited scrub continues from there the next night.
+//
+//   header (HeaderSize bytes): magic, version, entry count, scrub position
+//   entries: EntrySize bytes each (key, hash, verification time, flags)
+//   scrub cursor: UTF-8 destination id and file path
+//
+// Numbers are little-endian.
+class HashCache
+{
+public:
+    static const int HeaderSize = 48;
+    static const int EntrySize = 56;
+    static const quint32 FormatVersion = 1;
+
+    // False, leaving the cache empty, if the file is missing or invalid
+    bool load(const QString &filePath);
+    bool save(const QString &filePath) const;
+
+    bool lookup(const HashCacheKey &key, HashCacheEntry &entry) const;
+    void insert(const HashCacheKey &key, const HashCacheEntry &entry) { m_entries.insert(key, entry); }
+    int size() const { return m_entries.size(); }
+    void clear();
+
+    // Drop entries not verified since ms, i.e. files gone or rewritten
+    // since the last complete pass. Returns how many were dropped.
+    int removeVerifiedBefore(qint64 ms);
+
+    // Last file a scrub finished; empty once a pass is complete
+    QString cursorDestination() const { return m_cursorDestination; }
+    QString cursorPath() const { return m_cursorPath; }
+    void setCursor(const QString &destinationId, const QString &filePath);
+
+    // When the pass the cursor belongs to began
+    qint64 passStartedMs() const { return m_passStartedMs; }
+    void setPassStartedMs(qint64 ms) { m_passStartedMs = ms; }
+
+private:
+    QHash<HashCacheKey, HashCacheEntry> m_entries;
+    QString m_cursorDestination;
+    QString m_cursorPath;
+    qint64 m_passStartedMs = 0;
+};
+
+#endif // HASHCACHE_H
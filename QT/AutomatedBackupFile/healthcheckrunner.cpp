@@ -0,0 +1,117 @@
+#include "healthcheckrunner.h"
+#include <QFutureWatcher>
+#include <QThreadPool>
+#include <QTimer>
+#include <QtConcurrent>
+
+HealthCheckRunner::HealthCheckRunner(QObject *parent)
+    : QObject(parent)
+    , m_pool(new QThreadPool())
+    , m_nextSerial(0)
+    , m_timeoutMsecs(DefaultTimeoutMsecs)
+    , m_maxConcurrent(DefaultMaxConcurrent)
+    , m_stalled(0)
+{
+    qRegisterMetaType<HealthCheckResult>("HealthCheckResult");
+    updatePoolSize();
+}
+
+HealthCheckRunner::~HealthCheckRunner()
+{
+    // Destroying the pool waits for its threads. Probes that answer are
+    // done soon; a stalled one may wait minutes more for the OS to give up,
+    // so with any of those the pool is left to the end of the process.
+    if (m_stalled == 0) {
+        delete m_pool;
+    }
+}
+
+void HealthCheckRunner::setMaxConcurrent(int count)
+{
+    m_maxConcurrent = qMax(1, count);
+    updatePoolSize();
+}
+
+bool HealthCheckRunner::start(const QString &id, const Probe &probe)
+{
+    if (m_checks.contains(id)) {
+        return false;
+    }
+
+    Check check;
+    check.serial = ++m_nextSerial;
+    check.deadline = new QTimer(this);
+    check.deadline->setSingleShot(true);
+    const quint64 serial = check.serial;
+    connect(check.deadline, &QTimer::timeout, this, [this, id, serial]() {
+        onDeadline(id, serial);
+    });
+    check.deadline->start(m_timeoutMsecs);
+    m_checks.insert(id, check);
+
+    auto *watcher = new QFutureWatcher<HealthCheckResult>(this);
+    connect(watcher, &QFutureWatcher<HealthCheckResult>::finished, this, [this, watcher, id, serial]() {
+        const HealthCheckResult result = watcher->result();
+        watcher->deleteLater();
+        onProbeFinished(id, serial, result);
+    });
+    watcher->setFuture(QtConcurrent::run(m_pool, probe));
+    return true;
+}
+
+void HealthCheckRunner::cancel(const QString &id)
+{
+    auto it = m_checks.find(id);
+    if (it != m_checks.end()) {
+        it->cancelled = true;
+    }
+}
+
+void HealthCheckRunner::onDeadline(const QString &id, quint64 serial)
+{
+    auto it = m_checks.find(id);
+    if (it == m_checks.end() || it->serial != serial) {
+        return;
+    }
+
+    // The thread is stuck until the OS gives up; let another take its place
+    it->timedOut = true;
+    ++m_stalled;
+    updatePoolSize();
+    if (it->cancelled) {
+        return;
+    }
+
+    HealthCheckResult result;
+    result.outcome = HealthCheckResult::Outcome::TimedOut;
+    result.error = QString("No response within %1 s").arg(m_timeoutMsecs / 1000.0);
+    emit finished(id, result);
+}
+
+void HealthCheckRunner::onProbeFinished(const QString &id, quint64 serial, const HealthCheckResult &result)
+{
+    auto it = m_checks.find(id);
+    if (it == m_checks.end() || it->serial != serial) {
+        return;
+    }
+
+    const Check check = it.value();
+    m_checks.erase(it);
+    check.deadline->deleteLater();
+
+    // A timed-out probe was already reported; its late answer is dropped
+    if (check.timedOut) {
+        --m_stalled;
+        updatePoolSize();
+        return;
+    }
+    check.deadline->stop();
+    if (!check.cancelled) {
+        emit finished(id, result);
+    }
+}
+
+void HealthCheckRunner::updatePoolSize()
+{
+    m_pool->setMaxThreadCount(m_maxConcurrent + m_stalled);
+}
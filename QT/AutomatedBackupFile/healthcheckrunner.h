@@ -0,0 +1,89 @@
+#ifndef HEALTHCHECKRUNNER_H
+#define HEALTHCHECKRUNNER_H
+
+#include <QHash>
+#include <QMetaType>
+#include <QObject>
+#include <QString>
+#include <functional>
+
+class QThreadPool;
+class QTimer;
+
+struct HealthCheckResult
+{
+    enum class Outcome { Available, Unavailable, Error, TimedOut };
+
+    Outcome outcome = Outcome::Error;
+    QString error;            // Why it isn't available
+    qint64 freeSpace = -1;    // Destinations; -1 if not known
+    qint64 totalSpace = -1;
+};
+
+Q_DECLARE_METATYPE(HealthCheckResult)
+
+// Runs the connectivity checks of sources and destinations, many at once,
+// on a pool of its own. A probe blocks on the file system or network with
+// whatever timeout the OS applies, which for a dead SMB share is minutes;
+// here each probe gets a deadline, and one that misses it is reported as
+// TimedOut while its thread stops counting against the pool. A sweep over
+// all entries so takes as long as its slowest check, capped by the
+// deadline, instead of the sum of them.
+//
+// Probes get copies of what they need and never touch the managers'
+// objects; results are delivered on the runner's thread. An entry has at
+// most one probe in flight: while a timed-out one is still blocked, new
+// checks of that entry are refused and its last status stands.
+class HealthCheckRunner : public QObject
+{
+    Q_OBJECT
+
+public:
+    typedef std::function<HealthCheckResult()> Probe;
+
+    static const int DefaultTimeoutMsecs = 15000;
+    static const int DefaultMaxConcurrent = 8;
+
+    explicit HealthCheckRunner(QObject *parent = nullptr);
+    ~HealthCheckRunner();
+
+    // Counted from when the check is started
+    void setTimeout(int msecs) { m_timeoutMsecs = msecs; }
+    int timeout() const { return m_timeoutMsecs; }
+    void setMaxConcurrent(int count);
+    int maxConcurrent() const { return m_maxConcurrent; }
+
+    // False, doing nothing, if a probe of id is still in flight
+    bool start(const QString &id, const Probe &probe);
+    bool isRunning(const QString &id) const { return m_checks.contains(id); }
+
+    // Drop the result of id's probe, e.g. when the entry was removed
+    void cancel(const QString &id);
+
+    // Probes past their deadline that haven't returned yet
+    int stalledCount() const { return m_stalled; }
+
+signals:
+    void finished(const QString &id, const HealthCheckResult &result);
+
+private:
+    struct Check {
+        quint64 serial = 0;
+        QTimer *deadline = nullptr;
+        bool timedOut = false;
+        bool cancelled = false;
+    };
+
+    QThreadPool *m_pool;  // Not a child: see the destructor
+    QHash<QString, Check> m_checks;  // In flight, by id
+    quint64 m_nextSerial;
+    int m_timeoutMsecs;
+    int m_maxConcurrent;
+    int m_stalled;
+
+    void onDeadline(const QString &id, quint64 serial);
+    void onProbeFinished(const QString &id, quint64 serial, const HealthCheckResult &result);
+    void updatePoolSize();
+};
+
+#endif // HEALTHCHECKRUNNER_H
@@ -0,0 +1,330 @@
+#include "inotifywatcher.h"
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QSocketNotifier>
+
+#ifdef Q_OS_LINUX
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+// Files are reported on close rather than on every write
+const quint32 kWatchMask = IN_CREATE | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE
+                         | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF
+                         | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+} // namespace
+#endif
+
+InotifyWatcher::InotifyWatcher(QObject *parent)
+    : QObject(parent)
+    , m_fd(-1)
+    , m_notifier(nullptr)
+{
+#ifdef Q_OS_LINUX
+    m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_fd < 0) {
+        qWarning() << "inotify unavailable:" << strerror(errno);
+        return;
+    }
+    m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &InotifyWatcher::readEvents);
+#endif
+}
+
+InotifyWatcher::~InotifyWatcher()
+{
+#ifdef Q_OS_LINUX
+    if (m_fd >= 0) {
+        // Closing the instance drops all of its watches
+        delete m_notifier;
+        close(m_fd);
+    }
+#endif
+}
+
+bool InotifyWatcher::addPath(const QString &root)
+{
+    if (!isSupported()) {
+        return false;
+    }
+
+    const QString cleanRoot = QDir::cleanPath(root);
+    if (m_roots.contains(cleanRoot)) {
+        return true;
+    }
+
+    m_roots.append(cleanRoot);
+    m_rootOwners.insert(cleanRoot, cleanRoot);
+    if (!addTree(cleanRoot)) {
+        removePath(cleanRoot);
+        return false;
+    }
+    return true;
+}
+
+void InotifyWatcher::removePath(const QString &root)
+{
+    const QString cleanRoot = QDir::cleanPath(root);
+    m_roots.removeAll(cleanRoot);
+    m_rootOwners.remove(cleanRoot);
+    m_incompleteRoots.remove(cleanRoot);
+
+    // A directory under nested roots has one watch for all of them, so only
+    // drop the ones no remaining root covers
+    for (const QString &path : treePaths(cleanRoot)) {
+        if (rootOf(path).isEmpty()) {
+            removeWatch(path, true);
+        }
+    }
+}
+
+bool InotifyWatcher::addWatch(const QString &dirPath)
+{
+#ifdef Q_OS_LINUX
+    const int watch = inotify_add_watch(m_fd, QFile::encodeName(dirPath).constData(), kWatchMask);
+    if (watch < 0) {
+        if (errno == ENOSPC) {
+            qWarning() << "inotify watch limit reached at" << dirPath
+                       << "- raise fs.inotify.max_user_watches";
+        } else if (errno != ENOENT && errno != ENOTDIR) {
+            qWarning() << "Failed to watch" << dirPath << ":" << strerror(errno);
+        }
+        // A directory that vanished before it could be watched is not a failure
+        return errno == ENOENT || errno == ENOTDIR;
+    }
+
+    // The kernel hands back the same descriptor for a directory that was
+    // moved, so drop the old name
+    const QString previous = m_pathsByWatch.value(watch);
+    if (!previous.isEmpty() && previous != dirPath) {
+        m_watchesByPath.remove(previous);
+    }
+    m_pathsByWatch.insert(watch, dirPath);
+    m_watchesByPath.insert(dirPath, watch);
+    return true;
+#else
+    Q_UNUSED(dirPath);
+    return false;
+#endif
+}
+
+bool InotifyWatcher::addTree(const QString &dirPath)
+{
+    if (!addWatch(dirPath)) {
+        return false;
+    }
+
+    // Directories are watched top-down, so one created while this runs is
+    // either found here or reported by its (already watched) parent
+    QDirIterator it(dirPath, QDir::Dirs | QDir::NoDotAndDotDot | QDir::Hidden | QDir::NoSymLinks,
+                    QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        if (!addWatch(it.next())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+QStringList InotifyWatcher::treePaths(const QString &dirPath) const
+{
+    QStringList paths;
+    if (m_watchesByPath.contains(dirPath)) {
+        paths.append(dirPath);
+    }
+
+    const QString prefix = dirPath + "/";
+    for (auto it = m_watchesByPath.lowerBound(prefix); it != m_watchesByPath.constEnd() && it.key().startsWith(prefix); ++it) {
+        paths.append(it.key());
+    }
+    return paths;
+}
+
+void InotifyWatcher::removeWatch(const QString &dirPath, bool removeFromKernel)
+{
+    const int watch = m_watchesByPath.value(dirPath);
+#ifdef Q_OS_LINUX
+    // Deleted directories lose their watches by themselves
+    if (removeFromKernel) {
+        inotify_rm_watch(m_fd, watch);
+    }
+#else
+    Q_UNUSED(removeFromKernel);
+#endif
+    m_watchesByPath.remove(dirPath);
+    m_pathsByWatch.remove(watch);
+}
+
+void InotifyWatcher::removeTree(const QString &dirPath, bool removeWatches)
+{
+    for (const QString &path : treePaths(dirPath)) {
+        removeWatch(path, removeWatches);
+    }
+}
+
+void InotifyWatcher::dropRoots(const QString &dirPath)
+{
+    // The directory is gone, and with it any root at or below it
+    const QString prefix = dirPath + "/";
+    for (const QString &root : QStringList(m_roots)) {
+        if (root == dirPath || root.startsWith(prefix)) {
+            m_roots.removeAll(root);
+            m_rootOwners.remove(root);
+            m_incompleteRoots.remove(root);
+        }
+    }
+}
+
+void InotifyWatcher::markIncomplete(const QString &path)
+{
+    // Every root covering path misses what is below it
+    for (const QString &root : m_rootOwners.findAll(path)) {
+        m_incompleteRoots.insert(root);
+    }
+}
+
+void InotifyWatcher::renameTree(const QString &oldPath, const QString &newPath)
+{
+    // Watches follow the directories, only their names change
+    for (const QString &path : treePaths(oldPath)) {
+        const int watch = m_watchesByPath.value(path);
+        const QString renamed = newPath + path.mid(oldPath.size());
+        m_watchesByPath.remove(path);
+        m_watchesByPath.insert(renamed, watch);
+        m_pathsByWatch.insert(watch, renamed);
+    }
+}
+
+QString InotifyWatcher::rootOf(const QString &path) const
+{
+    return m_rootOwners.value(path);
+}
+
+void InotifyWatcher::readEvents()
+{
+#ifdef Q_OS_LINUX
+    // A move is two events tied by a cookie; a half without its partner
+    // crossed the edge of the watched trees
+    QHash<quint32, PendingMove> pendingMoves;
+
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    for (;;) {
+        const ssize_t length = read(m_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;  // EAGAIN: the queue is drained
+        }
+
+        for (const char *p = buffer; p < buffer + length; ) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event*>(p);
+            const QString name = event->len > 0 ? QFile::decodeName(event->name) : QString();
+            handleEvent(event->wd, event->mask, event->cookie, name, pendingMoves);
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    for (const PendingMove &move : pendingMoves) {
+        if (move.isDirectory) {
+            removeTree(move.path, true);
+            emit directoryRemoved(move.path);
+        } else {
+            emit fileRemoved(move.path);
+        }
+    }
+#endif
+}
+
+void InotifyWatcher::handleEvent(int watch, quint32 mask, quint32 cookie, const QString &name,
+                                 QHash<quint32, PendingMove> &pendingMoves)
+{
+#ifdef Q_OS_LINUX
+    if (mask & IN_Q_OVERFLOW) {
+        for (const QString &root : m_roots) {
+            emit rescanRequired(root);
+        }
+        return;
+    }
+
+    const QString dirPath = m_pathsByWatch.value(watch);
+    if (dirPath.isEmpty()) {
+        return;  // Late event for a watch already dropped
+    }
+
+    if (mask & IN_IGNORED) {
+        if (m_watchesByPath.value(dirPath, -1) == watch) {
+            m_watchesByPath.remove(dirPath);
+        }
+        m_pathsByWatch.remove(watch);
+        if (m_roots.contains(dirPath)) {
+            dropRoots(dirPath);  // Deleted or unmounted; addPath() may watch it again
+        }
+        return;
+    }
+
+    if (name.isEmpty()) {
+        // Events on a watched directory itself; the parent reports them,
+        // except for a root whose parent isn't watched under another root
+        if ((mask & IN_DELETE_SELF) && m_roots.contains(dirPath)) {
+            dropRoots(dirPath);
+            if (rootOf(dirPath).isEmpty()) {
+                emit directoryRemoved(dirPath);
+            }
+        }
+        return;
+    }
+
+    const QString path = dirPath + "/" + name;
+    const bool isDirectory = mask & IN_ISDIR;
+
+    if (mask & IN_MOVED_FROM) {
+        pendingMoves.insert(cookie, PendingMove{path, isDirectory});
+    } else if (mask & IN_MOVED_TO) {
+        if (pendingMoves.contains(cookie)) {
+            const PendingMove move = pendingMoves.take(cookie);
+            if (isDirectory) {
+                renameTree(move.path, path);
+                emit directoryMoved(move.path, path);
+            } else {
+                emit fileMoved(move.path, path);
+            }
+        } else if (isDirectory) {
+            if (!addTree(path)) {
+                markIncomplete(path);
+            }
+            emit directoryAdded(path);
+        } else {
+            emit fileChanged(path);
+        }
+    } else if (mask & IN_CREATE) {
+        if (isDirectory) {
+            if (!addTree(path)) {
+                markIncomplete(path);
+            }
+            emit directoryAdded(path);
+        }
+    } else if (mask & IN_DELETE) {
+        if (isDirectory) {
+            dropRoots(path);
+            removeTree(path, false);
+            emit directoryRemoved(path);
+        } else {
+            emit fileRemoved(path);
+        }
+    } else if (mask & (IN_CLOSE_WRITE | IN_ATTRIB)) {
+        if (!isDirectory) {
+            emit fileChanged(path);
+        }
+    }
+#else
+    Q_UNUSED(watch);
+    Q_UNUSED(mask);
+    Q_UNUSED(cookie);
+    Q_UNUSED(name);
+    Q_UNUSED(pendingMoves);
+#endif
+}
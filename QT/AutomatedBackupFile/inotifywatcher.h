@@ -0,0 +1,87 @@
+#ifndef INOTIFYWATCHER_H
+#define INOTIFYWATCHER_H
+
+#include <QObject>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include "pathtrie.h"
+
+class QSocketNotifier;
+
+// Recursive change watcher for whole directory trees, built on Linux
+// inotify. QFileSystemWatcher only says that a directory it was given
+// changed; this watches every directory below the roots, adds watches as
+// directories appear and reports which file changed and how, so callers
+// can update their view of the tree without rescanning it.
+//
+// Files are reported once they have been written and closed, touched or
+// moved in, not when they are created empty. Elsewhere than on Linux
+// isSupported() is false and callers keep using QFileSystemWatcher.
+class InotifyWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit InotifyWatcher(QObject *parent = nullptr);
+    ~InotifyWatcher();
+
+    // False off Linux or when no inotify instance could be created
+    bool isSupported() const { return m_fd >= 0; }
+
+    // Watch root and every directory below it. Fails, leaving nothing
+    // watched, when the watch limit (fs.inotify.max_user_watches) is hit.
+    // Roots may be nested; removing one keeps the watches another still needs.
+    bool addPath(const QString &root);
+    void removePath(const QString &root);
+    QStringList roots() const { return m_roots; }
+    int watchCount() const { return m_pathsByWatch.size(); }
+
+    // False once a directory that appeared under root could not be watched;
+    // changes below it are then only seen by rescanning
+    bool isWatchingFully(const QString &root) const { return !m_incompleteRoots.contains(root); }
+
+signals:
+    void fileChanged(const QString &path);  // Written, touched or moved in
+    void fileRemoved(const QString &path);  // Deleted or moved out of the tree
+    void fileMoved(const QString &oldPath, const QString &newPath);
+    void directoryAdded(const QString &path);  // Created or moved in; watched, contents not reported
+    void directoryRemoved(const QString &path);
+    void directoryMoved(const QString &oldPath, const QString &newPath);
+
+    // The kernel dropped events; root has to be rescanned to catch up
+    void rescanRequired(const QString &root);
+
+private slots:
+    void readEvents();
+
+private:
+    struct PendingMove {
+        QString path;
+        bool isDirectory;
+    };
+
+    int m_fd;
+    QSocketNotifier *m_notifier;
+    QStringList m_roots;
+    PathTrie<QString> m_rootOwners;  // Path -> innermost root covering it
+    QSet<QString> m_incompleteRoots;
+    QHash<int, QString> m_pathsByWatch;  // Watch descriptor -> directory
+    QMap<QString, int> m_watchesByPath;  // Sorted, so a subtree is one range
+
+    bool addWatch(const QString &dirPath);
+    bool addTree(const QString &dirPath);
+    void removeWatch(const QString &dirPath, bool removeFromKernel);
+    void removeTree(const QString &dirPath, bool removeWatches);
+    void dropRoots(const QString &dirPath);
+    void markIncomplete(const QString &path);
+    void renameTree(const QString &oldPath, const QString &newPath);
+    QStringList treePaths(const QString &dirPath) const;
+    QString rootOf(const QString &path) const;
+    void handleEvent(int watch, quint32 mask, quint32 cookie, const QString &name,
+                     QHash<quint32, PendingMove> &pendingMoves);
+};
+
+#endif // INOTIFYWATCHER_H
@@ -6,6 +6,7 @@
 #include "destinationtab.h"
 #include "settingstab.h"
 #include "fileencryptor.h"
+#include "backupjobqueue.h"
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QInputDialog>
@@ -41,14 +42,15 @@ MainWindow::MainWindow(QWidget *parent)
         tasksTab->getStatusLabel()->setText("Status: Backup completed successfully!");
         tasksTab->getProgressBar()->setValue(100);
         QMessageBox::information(this, "Backup Complete", "Backup completed successfully!");
-        tasksTab->getBtnStartBackup()->setEnabled(true);
-        tasksTab->getBtnStopBackup()->setEnabled(false);
     });
     connect(m_backupEngine, &BackupEngine::backupFailed, this, [this](const QString& error) {
         statusBar()->showMessage("Backup failed: " + error);
         tasksTab->getStatusLabel()->setText("Status: Backup failed - " + error);
         QMessageBox::critical(this, "Backup Failed", error);
-        tasksTab->getBtnStartBackup()->setEnabled(true);
+    });
+    connect(m_backupEngine, &BackupEngine::throughputMeasured,
+            m_destinationManager, &DestinationManager::recordThroughput);
+    connect(m_backupEngine->getJobQueue(), &BackupJobQueue::queueIdle, this, [this]() {
         tasksTab->getBtnStopBackup()->setEnabled(false);
     });
     
@@ -197,10 +199,23 @@ void MainWindow::onStartBackup()
     
     // Build source-destination pairs
     std::vector<std::pair<QString, QString>> pairs;
+    QStringList destPaths;
+    QMap<QString, BackupFilter> filters;
+    qint64 totalBytes = 0;
+    qint64 totalFiles = 0;
     
     for (BackupSource* source : sources) {
         if (!source->isEnabled()) continue;
         
+        const SizeEstimate estimate = m_sourceManager->getSizeEstimate(source->getId());
+        totalBytes += estimate.isValid() ? estimate.totalSize : source->getTotalSize();
+        totalFiles += estimate.isValid() ? estimate.fileCount : source->getFileCount();
+        
+        BackupFilter filter = source->createFilter();
+        if (!filter.isEmpty()) {
+            filters.insert(source->getPath(), filter);
+        }
+        
         for (BackupDestination* dest : destinations) {
             if (dest->getStatus() != DestinationStatus::Available) continue;
             
@@ -208,6 +223,7 @@ void MainWindow::onStartBackup()
             QString destPath = dest->getPath() + "/" + source->getId();
             
             pairs.push_back({sourcePath, destPath});
+            destPaths.append(destPath);
         }
     }
     
@@ -216,22 +232,40 @@ void MainWindow::onStartBackup()
         return;
     }
     
-    // Update UI
-    tasksTab->getBtnStartBackup()->setEnabled(false);
+    // Update UI - further jobs may be queued while this one runs
     tasksTab->getBtnStopBackup()->setEnabled(true);
-    tasksTab->getProgressBar()->setValue(0);
-    tasksTab->getStatusLabel()->setText("Status: Starting backup...");
-    statusBar()->showMessage("Starting backup...");
+    tasksTab->getProgressBar()->setValue(m_backupEngine->getProgress());
+    
+    // Queue backup; it starts as soon as its source and destination devices are free
+    // With several destinations, the files may be spread over them by what
+    // is known of their speed and free space
+    QString jobId = m_backupEngine->startBackup(pairs, filters, m_destinationManager->createPlacement(destPaths));
     
-    // Start backup
-    m_backupEngine->startBackup(pairs);
+    // How long it should take by the destinations' benchmarks: the slowest
+    // taking everything, which bounds it when files are spread
+    double expectedSeconds = -1;
+    for (BackupDestination* dest : destinations) {
+        if (dest->getStatus() == DestinationStatus::Available) {
+            expectedSeconds = qMax(expectedSeconds,
+                                   m_destinationManager->estimateBackupSeconds(dest->getId(), totalBytes, totalFiles));
+        }
+    }
+    const QString expected = expectedSeconds < 0 ? QString()
+        : QString(" (about %1 min)").arg(qMax(1, qRound(expectedSeconds / 60)));
+    
+    if (m_backupEngine->getJobQueue()->getPendingJobIds().contains(jobId)) {
+        tasksTab->getStatusLabel()->setText("Status: Backup queued, waiting for busy devices...");
+        statusBar()->showMessage("Backup queued: " + jobId + expected);
+    } else {
+        tasksTab->getStatusLabel()->setText("Status: Starting backup" + expected + "...");
+        statusBar()->showMessage("Starting backup" + expected + "...");
+    }
 }
 
 void MainWindow::onStopBackup()
 {
     m_backupEngine->stopBackup();
     statusBar()->showMessage("Backup stopped by user");
-    tasksTab->getBtnStartBackup()->setEnabled(true);
     tasksTab->getBtnStopBackup()->setEnabled(false);
 }
 
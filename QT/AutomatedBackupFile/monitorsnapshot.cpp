@@ -0,0 +1,488 @@
+#include "monitorsnapshot.h"
+#include <QDebug>
+#include <QSaveFile>
+#include <QtEndian>
+#include <cstring>
+#include <initializer_list>
+
+namespace {
+
+const char kMagic[8] = {'A', 'B', 'F', 'M', 'S', 'N', 'A', 'P'};
+
+const quint32 kFlagMonitoringEnabled = 1;
+const quint32 kRecordAbsolutePath = 1;  // File outside its destination's directory
+
+// Records and strings are written in blocks of about this size
+const int kWriteBlockSize = 1024 * 1024;
+
+// Writes two sections of the file at once, each from its own cursor
+class SectionWriter
+{
+public:
+    SectionWriter(QSaveFile &file, qint64 offset) : m_file(file), m_offset(offset) {}
+
+    void append(const char *data, qint64 size)
+    {
+        m_buffer.append(data, static_cast<int>(size));
+        if (m_buffer.size() >= kWriteBlockSize) {
+            flush();
+        }
+    }
+
+    void append(const QByteArray &bytes) { append(bytes.constData(), bytes.size()); }
+
+    bool flush()
+    {
+        if (m_buffer.isEmpty()) {
+            return m_ok;
+        }
+        m_ok = m_ok && m_file.seek(m_offset) && m_file.write(m_buffer) == m_buffer.size();
+        m_offset += m_buffer.size();
+        m_buffer.clear();
+        return m_ok;
+    }
+
+    qint64 position() const { return m_offset + m_buffer.size(); }
+
+private:
+    QSaveFile &m_file;
+    qint64 m_offset;
+    QByteArray m_buffer;
+    bool m_ok = true;
+};
+
+void putRecord(uchar *p, quint64 pathOffset, quint32 pathLength, quint32 flags,
+               const FileIndexRecord &file, quint64 device)
+{
+    qToLittleEndian<quint64>(pathOffset, p);
+    qToLittleEndian<quint32>(pathLength, p + 8);
+    qToLittleEndian<quint32>(flags, p + 12);
+    qToLittleEndian<qint64>(file.size, p + 16);
+    qToLittleEndian<qint64>(file.modifiedMs, p + 24);
+    qToLittleEndian<quint64>(device, p + 32);
+    qToLittleEndian<quint64>(file.inode, p + 40);
+}
+
+// Order of the concatenated parts against path, by UTF-8 bytes
+int compareJoined(std::initializer_list<QByteArray> parts, const QByteArray &path)
+{
+    int offset = 0;
+    for (const QByteArray &part : parts) {
+        const int n = qMin(part.size(), path.size() - offset);
+        const int order = memcmp(part.constData(), path.constData() + offset, n);
+        if (order != 0) {
+            return order;
+        }
+        if (n < part.size()) {
+            return 1;  // path is a prefix of the parts
+        }
+        offset += n;
+    }
+    return offset < path.size() ? -1 : 0;
+}
+
+} // namespace
+
+MonitorSnapshot::MonitorSnapshot()
+    : m_data(nullptr)
+    , m_size(0)
+    , m_monitoringEnabled(false)
+    , m_scanIntervalMinutes(0)
+    , m_destinationCount(0)
+    , m_recordsOffset(0)
+    , m_stringsOffset(0)
+    , m_stringsSize(0)
+{
+}
+
+MonitorSnapshot::~MonitorSnapshot()
+{
+    close();
+}
+
+bool MonitorSnapshot::isSnapshotFile(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QByteArray magic = file.read(sizeof(kMagic));
+    return magic.size() == sizeof(kMagic) && memcmp(magic.constData(), kMagic, sizeof(kMagic)) == 0;
+}
+
+bool MonitorSnapshot::open(const QString &filePath)
+{
+    close();
+
+    m_file.setFileName(filePath);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    m_size = m_file.size();
+    if (m_size < HeaderSize) {
+        qWarning() << "Monitor snapshot is truncated:" << filePath;
+        close();
+        return false;
+    }
+
+#ifdef Q_OS_WIN
+    // A mapped file can't be replaced on Windows, and the next save replaces
+    // it while this snapshot is still read, so take a copy instead
+    m_buffer = m_file.readAll();
+    m_file.close();
+    m_data = m_buffer.size() == m_size ? reinterpret_cast<const uchar*>(m_buffer.constData()) : nullptr;
+#else
+    m_data = m_file.map(0, m_size);
+#endif
+    if (!m_data) {
+        qWarning() << "Failed to map monitor snapshot:" << filePath << m_file.errorString();
+        close();
+        return false;
+    }
+
+    const uchar *p = m_data;
+    const quint32 version = qFromLittleEndian<quint32>(p + 8);
+    if (memcmp(p, kMagic, sizeof(kMagic)) != 0 || version != FormatVersion) {
+        qWarning() << "Not a monitor snapshot, or a newer version:" << filePath;
+        close();
+        return false;
+    }
+
+    const quint32 flags = qFromLittleEndian<quint32>(p + 12);
+    m_monitoringEnabled = flags & kFlagMonitoringEnabled;
+    m_scanIntervalMinutes = qFromLittleEndian<qint32>(p + 16);
+    const quint32 destinationCount = qFromLittleEndian<quint32>(p + 20);
+    m_recordsOffset = qFromLittleEndian<quint64>(p + 24);
+    const quint64 recordCount = qFromLittleEndian<quint64>(p + 32);
+    m_stringsOffset = qFromLittleEndian<quint64>(p + 40);
+    m_stringsSize = qFromLittleEndian<quint64>(p + 48);
+
+    // Every table must lie inside the file; records are checked one by one
+    // as they are read
+    const quint64 size = static_cast<quint64>(m_size);
+    const bool tablesFit =
+        destinationCount <= (size - HeaderSize) / DestinationEntrySize &&
+        m_recordsOffset >= HeaderSize + quint64(destinationCount) * DestinationEntrySize &&
+        m_recordsOffset <= size &&
+        recordCount <= (size - m_recordsOffset) / FileRecordSize &&
+        m_stringsOffset >= m_recordsOffset + recordCount * FileRecordSize &&
+        m_stringsOffset <= size &&
+        m_stringsSize <= size - m_stringsOffset;
+
+    if (!tablesFit) {
+        qWarning() << "Monitor snapshot is damaged:" << filePath;
+        close();
+        return false;
+    }
+
+    for (quint32 i = 0; i < destinationCount; ++i) {
+        const uchar *entry = m_data + HeaderSize + quint64(i) * DestinationEntrySize;
+        const quint64 firstRecord = qFromLittleEndian<quint64>(entry);
+        const quint64 count = qFromLittleEndian<quint64>(entry + 8);
+        const quint64 stringsBegin = qFromLittleEndian<quint64>(entry + 16);
+        const quint64 stringsSize = qFromLittleEndian<quint64>(entry + 24);
+        const quint64 namesSize = quint64(qFromLittleEndian<quint32>(entry + 32)) + qFromLittleEndian<quint32>(entry + 36);
+
+        if (firstRecord > recordCount || count > recordCount - firstRecord ||
+            stringsBegin > m_stringsSize || stringsSize > m_stringsSize - stringsBegin ||
+            namesSize > stringsSize) {
+            qWarning() << "Monitor snapshot is damaged:" << filePath;
+            close();
+            return false;
+        }
+    }
+
+    m_destinationCount = static_cast<int>(destinationCount);
+    return true;
+}
+
+void MonitorSnapshot::close()
+{
+    if (m_data && m_buffer.isEmpty()) {
+        m_file.unmap(const_cast<uchar*>(m_data));
+    }
+    m_data = nullptr;
+    m_buffer.clear();
+    m_file.close();
+    m_size = 0;
+    m_destinationCount = 0;
+}
+
+const uchar *MonitorSnapshot::destinationEntry(int index) const
+{
+    return m_data + HeaderSize + qint64(index) * DestinationEntrySize;
+}
+
+QString MonitorSnapshot::string(quint64 offset, quint32 length) const
+{
+    return QString::fromUtf8(reinterpret_cast<const char*>(m_data + m_stringsOffset + offset), static_cast<int>(length));
+}
+
+QString MonitorSnapshot::destinationPath(const uchar *entry) const
+{
+    const quint64 stringsBegin = qFromLittleEndian<quint64>(entry + 16);
+    const quint32 idLength = qFromLittleEndian<quint32>(entry + 32);
+    return string(stringsBegin + idLength, qFromLittleEndian<quint32>(entry + 36));
+}
+
+MonitorSnapshotDestination MonitorSnapshot::destination(int index) const
+{
+    MonitorSnapshotDestination destination;
+    if (index < 0 || index >= m_destinationCount) {
+        return destination;
+    }
+
+    const uchar *entry = destinationEntry(index);
+    destination.id = string(qFromLittleEndian<quint64>(entry + 16), qFromLittleEndian<quint32>(entry + 32));
+    destination.path = destinationPath(entry);
+    destination.fileCount = static_cast<qint64>(qFromLittleEndian<quint64>(entry + 8));
+    destination.totalSize = qFromLittleEndian<qint64>(entry + 40);
+
+    const qint64 lastScan = qFromLittleEndian<qint64>(entry + 48);
+    if (lastScan != 0) {
+        destination.lastScan = QDateTime::fromMSecsSinceEpoch(lastScan);
+    }
+
+    destination.source = this;
+    destination.sourceIndex = index;
+    return destination;
+}
+
+bool MonitorSnapshot::recordInRange(const uchar *record) const
+{
+    const quint64 pathOffset = qFromLittleEndian<quint64>(record);
+    const quint32 pathLength = qFromLittleEndian<quint32>(record + 8);
+    return pathOffset <= m_stringsSize && pathLength <= m_stringsSize - pathOffset;
+}
+
+BackupFileInfo MonitorSnapshot::decodeRecord(const uchar *record, const QString &destinationPath,
+                                             const QDateTime &lastChecked) const
+{
+    const QString storedPath = string(qFromLittleEndian<quint64>(record), qFromLittleEndian<quint32>(record + 8));
+    const bool absolute = qFromLittleEndian<quint32>(record + 12) & kRecordAbsolutePath;
+
+    BackupFileInfo info;
+    info.filePath = absolute ? storedPath : destinationPath + "/" + storedPath;
+    info.fileName = info.filePath.mid(info.filePath.lastIndexOf('/') + 1);
+    info.size = qFromLittleEndian<qint64>(record + 16);
+
+    const qint64 modified = qFromLittleEndian<qint64>(record + 24);
+    if (modified != 0) {
+        info.lastModified = QDateTime::fromMSecsSinceEpoch(modified);
+    }
+
+    info.device = qFromLittleEndian<quint64>(record + 32);
+    info.inode = qFromLittleEndian<quint64>(record + 40);
+
+    // Trusted until the next scan says otherwise; checking every file here
+    // would touch the disk once per file at startup
+    info.lastChecked = lastChecked;
+    info.isValid = true;
+    return info;
+}
+
+bool MonitorSnapshot::readFiles(int index, FileIndex &files) const
+{
+    if (index < 0 || index >= m_destinationCount) {
+        return false;
+    }
+
+    const uchar *entry = destinationEntry(index);
+    const quint64 firstRecord = qFromLittleEndian<quint64>(entry);
+    const quint64 count = qFromLittleEndian<quint64>(entry + 8);
+
+    files.clear();
+    files.reserve(static_cast<int>(count));
+
+    // Paths go into the index as UTF-8, without a detour through QString
+    QByteArray path = destinationPath(entry).toUtf8() + '/';
+    const int prefixSize = path.size();
+
+    const uchar *record = m_data + m_recordsOffset + firstRecord * FileRecordSize;
+    for (quint64 i = 0; i < count; ++i, record += FileRecordSize) {
+        if (!recordInRange(record)) {
+            qWarning() << "Monitor snapshot is damaged:" << m_file.fileName();
+            files.clear();
+            return false;
+        }
+
+        const char *stored = reinterpret_cast<const char*>(m_data + m_stringsOffset + qFromLittleEndian<quint64>(record));
+        const int storedLength = static_cast<int>(qFromLittleEndian<quint32>(record + 8));
+        if (qFromLittleEndian<quint32>(record + 12) & kRecordAbsolutePath) {
+            path.truncate(0);
+        } else {
+            path.truncate(prefixSize);
+        }
+        path.append(stored, storedLength);
+
+        files.insert(path.constData(), path.size(),
+                     qFromLittleEndian<qint64>(record + 16), qFromLittleEndian<qint64>(record + 24),
+                     qFromLittleEndian<quint64>(record + 32), qFromLittleEndian<quint64>(record + 40));
+    }
+
+    return true;
+}
+
+bool MonitorSnapshot::findFile(int index, const QString &filePath, BackupFileInfo &info) const
+{
+    if (index < 0 || index >= m_destinationCount) {
+        return false;
+    }
+
+    const uchar *entry = destinationEntry(index);
+    const quint64 firstRecord = qFromLittleEndian<quint64>(entry);
+    const QString path = destinationPath(entry);
+    const uchar *records = m_data + m_recordsOffset + firstRecord * FileRecordSize;
+
+    // Records are sorted by absolute UTF-8 path; probes compare bytes
+    // without decoding
+    const QByteArray wanted = filePath.toUtf8();
+    const quint64 stringsBegin = qFromLittleEndian<quint64>(entry + 16);
+    const QByteArray prefix = QByteArray::fromRawData(
+        reinterpret_cast<const char*>(m_data + m_stringsOffset + stringsBegin + qFromLittleEndian<quint32>(entry + 32)),
+        static_cast<int>(qFromLittleEndian<quint32>(entry + 36)));
+    const QByteArray separator("/");
+
+    quint64 low = 0;
+    quint64 high = qFromLittleEndian<quint64>(entry + 8);
+    while (low < high) {
+        const quint64 middle = low + (high - low) / 2;
+        const uchar *record = records + middle * FileRecordSize;
+        if (!recordInRange(record)) {
+            return false;
+        }
+
+        const QByteArray stored = QByteArray::fromRawData(
+            reinterpret_cast<const char*>(m_data + m_stringsOffset + qFromLittleEndian<quint64>(record)),
+            static_cast<int>(qFromLittleEndian<quint32>(record + 8)));
+        const int order = (qFromLittleEndian<quint32>(record + 12) & kRecordAbsolutePath)
+                        ? compareJoined({stored}, wanted)
+                        : compareJoined({prefix, separator, stored}, wanted);
+        if (order == 0) {
+            const qint64 lastScan = qFromLittleEndian<qint64>(entry + 48);
+            info = decodeRecord(record, path, lastScan != 0 ? QDateTime::fromMSecsSinceEpoch(lastScan) : QDateTime());
+            return true;
+        }
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    return false;
+}
+
+bool MonitorSnapshot::save(const QString &filePath, bool monitoringEnabled, int scanIntervalMinutes,
+                           const QList<MonitorSnapshotDestination> &destinations)
+{
+    // Section sizes are known up front from the file counts, so records and
+    // strings can be streamed to their places in one pass
+    quint64 recordCount = 0;
+    for (const MonitorSnapshotDestination &destination : destinations) {
+        recordCount += destination.files ? destination.files->size()
+                                         : destination.source->destination(destination.sourceIndex).fileCount;
+    }
+
+    const quint64 recordsOffset = HeaderSize + quint64(destinations.size()) * DestinationEntrySize;
+    const quint64 stringsOffset = recordsOffset + recordCount * FileRecordSize;
+
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to write monitor snapshot:" << filePath << file.errorString();
+        return false;
+    }
+
+    SectionWriter records(file, static_cast<qint64>(recordsOffset));
+    SectionWriter strings(file, static_cast<qint64>(stringsOffset));
+    QByteArray table(destinations.size() * DestinationEntrySize, '\0');
+    quint64 nextRecord = 0;
+
+    for (int d = 0; d < destinations.size(); ++d) {
+        const MonitorSnapshotDestination &destination = destinations[d];
+        const quint64 stringsBegin = static_cast<quint64>(strings.position()) - stringsOffset;
+        const QByteArray id = destination.id.toUtf8();
+        const QByteArray path = destination.path.toUtf8();
+        quint64 count = 0;
+
+        strings.append(id);
+        strings.append(path);
+
+        if (destination.files) {
+            // Sorted so that single files can be found by binary search
+            const FileIndex &files = *destination.files;
+            const QByteArray prefix = path + '/';
+            uchar record[FileRecordSize];
+            for (int handle : files.sortedHandles()) {
+                const QByteArray filePath = files.encodedPath(handle);
+                const bool relative = filePath.startsWith(prefix);
+                const int skip = relative ? prefix.size() : 0;
+
+                putRecord(record, static_cast<quint64>(strings.position()) - stringsOffset, filePath.size() - skip,
+                          relative ? 0 : kRecordAbsolutePath, files.record(handle), files.device(handle));
+                records.append(reinterpret_cast<const char*>(record), FileRecordSize);
+                strings.append(filePath.constData() + skip, filePath.size() - skip);
+            }
+            count = files.size();
+        } else {
+            // Unchanged since the source snapshot was written: copy its
+            // strings as they are and move the records' string offsets
+            const MonitorSnapshot &source = *destination.source;
+            const uchar *entry = source.destinationEntry(destination.sourceIndex);
+            const quint64 sourceFirst = qFromLittleEndian<quint64>(entry);
+            const quint64 sourceStringsBegin = qFromLittleEndian<quint64>(entry + 16);
+            const quint64 sourceStringsSize = qFromLittleEndian<quint64>(entry + 24);
+            const quint64 sourceNamesSize = quint64(qFromLittleEndian<quint32>(entry + 32)) + qFromLittleEndian<quint32>(entry + 36);
+            count = qFromLittleEndian<quint64>(entry + 8);
+
+            const qint64 fileStrings = static_cast<qint64>(strings.position()) - static_cast<qint64>(stringsOffset);
+            const qint64 delta = fileStrings - static_cast<qint64>(sourceStringsBegin + sourceNamesSize);
+
+            const uchar *sourceRecord = source.m_data + source.m_recordsOffset + sourceFirst * FileRecordSize;
+            uchar record[FileRecordSize];
+            for (quint64 i = 0; i < count; ++i, sourceRecord += FileRecordSize) {
+                memcpy(record, sourceRecord, FileRecordSize);
+                qToLittleEndian<quint64>(qFromLittleEndian<quint64>(sourceRecord) + delta, record);
+                records.append(reinterpret_cast<const char*>(record), FileRecordSize);
+            }
+
+            const uchar *sourceStrings = source.m_data + source.m_stringsOffset + sourceStringsBegin + sourceNamesSize;
+            strings.append(reinterpret_cast<const char*>(sourceStrings), static_cast<qint64>(sourceStringsSize - sourceNamesSize));
+        }
+
+        uchar *entry = reinterpret_cast<uchar*>(table.data()) + d * DestinationEntrySize;
+        qToLittleEndian<quint64>(nextRecord, entry);
+        qToLittleEndian<quint64>(count, entry + 8);
+        qToLittleEndian<quint64>(stringsBegin, entry + 16);
+        qToLittleEndian<quint64>(static_cast<quint64>(strings.position()) - stringsOffset - stringsBegin, entry + 24);
+        qToLittleEndian<quint32>(id.size(), entry + 32);
+        qToLittleEndian<quint32>(path.size(), entry + 36);
+        qToLittleEndian<qint64>(destination.totalSize, entry + 40);
+        qToLittleEndian<qint64>(destination.lastScan.isValid() ? destination.lastScan.toMSecsSinceEpoch() : 0, entry + 48);
+        nextRecord += count;
+    }
+
+    const quint64 stringsSize = static_cast<quint64>(strings.position()) - stringsOffset;
+
+    QByteArray header(HeaderSize, '\0');
+    uchar *p = reinterpret_cast<uchar*>(header.data());
+    memcpy(p, kMagic, sizeof(kMagic));
+    qToLittleEndian<quint32>(FormatVersion, p + 8);
+    qToLittleEndian<quint32>(monitoringEnabled ? kFlagMonitoringEnabled : 0, p + 12);
+    qToLittleEndian<qint32>(scanIntervalMinutes, p + 16);
+    qToLittleEndian<quint32>(destinations.size(), p + 20);
+    qToLittleEndian<quint64>(recordsOffset, p + 24);
+    qToLittleEndian<quint64>(nextRecord, p + 32);
+    qToLittleEndian<quint64>(stringsOffset, p + 40);
+    qToLittleEndian<quint64>(stringsSize, p + 48);
+
+    const bool written = records.flush() && strings.flush() &&
+                         file.seek(0) && file.write(header) == header.size() && file.write(table) == table.size();
+
+    if (!written || nextRecord != recordCount || !file.commit()) {
+        qWarning() << "Failed to write monitor snapshot:" << filePath << file.errorString();
+        return false;
+    }
+    return true;
+}
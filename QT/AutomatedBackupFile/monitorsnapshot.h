@@ -0,0 +1,99 @@
+#ifndef MONITORSNAPSHOT_H
+#define MONITORSNAPSHOT_H
+
+#include <QDateTime>
+#include <QFile>
+#include <QList>
+#include <QString>
+#include "backupfilemonitor.h"
+
+class MonitorSnapshot;
+
+// One destination as stored in a snapshot. Its files come either from an
+// in-memory index or, when they haven't changed since, straight from the
+// snapshot being replaced.
+struct MonitorSnapshotDestination
+{
+    QString id;
+    QString path;
+    qint64 fileCount = 0;
+    qint64 totalSize = 0;
+    QDateTime lastScan;
+
+    const FileIndex *files = nullptr;
+    const MonitorSnapshot *source = nullptr;
+    int sourceIndex = -1;
+};
+
+// Binary state file of BackupFileMonitor:
+//
+//   header (HeaderSize bytes): magic, version, settings, section offsets
+//   destination table: DestinationEntrySize bytes per destination
+//   file records: FileRecordSize bytes per file, each destination's files
+//                 contiguous and sorted by UTF-8 path (code point order)
+//   string table: UTF-8 destination ids, paths and file paths
+//
+// Numbers are little-endian. Opening a snapshot maps it and checks the
+// tables; file records are only decoded when a destination's index is
+// needed, and single files can be looked up by binary search without
+// decoding anything. File paths are stored relative to their destination.
+//
+// Saving rewrites the file, but destinations whose files are unchanged
+// since the snapshot was opened are copied across as raw blocks instead of
+// being encoded again.
+class MonitorSnapshot
+{
+public:
+    static const int HeaderSize = 64;
+    static const int DestinationEntrySize = 64;
+    static const int FileRecordSize = 48;
+    static const quint32 FormatVersion = 1;
+
+    MonitorSnapshot();
+    ~MonitorSnapshot();
+
+    // Cheap check of the magic, to tell snapshots from older JSON state
+    static bool isSnapshotFile(const QString &filePath);
+
+    bool open(const QString &filePath);
+    void close();
+    bool isOpen() const { return m_data != nullptr; }
+
+    bool monitoringEnabled() const { return m_monitoringEnabled; }
+    int scanIntervalMinutes() const { return m_scanIntervalMinutes; }
+
+    int destinationCount() const { return m_destinationCount; }
+
+    // Header of a destination; its files stay in the snapshot
+    MonitorSnapshotDestination destination(int index) const;
+
+    // Decode all files of a destination into an index of absolute paths.
+    // Safe to call from several threads at once.
+    bool readFiles(int index, FileIndex &files) const;
+
+    // Look up one file without decoding the others
+    bool findFile(int index, const QString &filePath, BackupFileInfo &info) const;
+
+    static bool save(const QString &filePath, bool monitoringEnabled, int scanIntervalMinutes,
+                     const QList<MonitorSnapshotDestination> &destinations);
+
+private:
+    QFile m_file;
+    QByteArray m_buffer;  // File contents where it can't be mapped
+    const uchar *m_data;
+    qint64 m_size;
+    bool m_monitoringEnabled;
+    int m_scanIntervalMinutes;
+    int m_destinationCount;
+    quint64 m_recordsOffset;
+    quint64 m_stringsOffset;
+    quint64 m_stringsSize;
+
+    const uchar *destinationEntry(int index) const;
+    QString string(quint64 offset, quint32 length) const;
+    QString destinationPath(const uchar *entry) const;
+    BackupFileInfo decodeRecord(const uchar *record, const QString &destinationPath, const QDateTime &lastChecked) const;
+    bool recordInRange(const uchar *record) const;
+};
+
+#endif // MONITORSNAPSHOT_H
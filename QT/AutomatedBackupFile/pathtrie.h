@@ -0,0 +1,189 @@
+#ifndef PATHTRIE_H
+#define PATHTRIE_H
+
+#include <QDir>
+#include <QHash>
+#include <QPair>
+#include <QString>
+#include <QVector>
+#include <QtAlgorithms>
+
+// Registered directories (sources, destinations) keyed by path component,
+// so any path below them resolves to its owner in one step per component
+// however many are registered. Matching is by whole components: "/a/b" owns
+// "/a/b/c" but not "/a/bc". With nested registrations the deepest one wins.
+// Native separators are accepted; on Windows components compare without case.
+template <typename T>
+class PathTrie
+{
+public:
+    PathTrie() : m_root(new Node()), m_size(0) {}
+    ~PathTrie() { delete m_root; }
+
+    PathTrie(const PathTrie &) = delete;
+    PathTrie &operator=(const PathTrie &) = delete;
+
+    void insert(const QString &path, const T &value)
+    {
+        Node *node = m_root;
+        forEachComponent(path, [&node](const QString &component) {
+            Node *&child = node->children[component];
+            if (!child) {
+                child = new Node();
+            }
+            node = child;
+            return true;
+        });
+        if (!node->hasValue) {
+            ++m_size;
+        }
+        node->value = value;
+        node->hasValue = true;
+    }
+
+    // Only path itself is unregistered; paths nested in it stay
+    bool remove(const QString &path)
+    {
+        QVector<QPair<Node*, QString>> trail;  // Parent and the component leading out of it
+        Node *node = m_root;
+        const bool found = forEachComponent(path, [&node, &trail](const QString &component) {
+            Node *child = node->children.value(component);
+            if (!child) {
+                return false;
+            }
+            trail.append(qMakePair(node, component));
+            node = child;
+            return true;
+        });
+        if (!found || !node->hasValue) {
+            return false;
+        }
+
+        node->value = T();
+        node->hasValue = false;
+        --m_size;
+
+        // Prune branches that no longer lead anywhere
+        while (!trail.isEmpty() && !node->hasValue && node->children.isEmpty()) {
+            const QPair<Node*, QString> step = trail.takeLast();
+            step.first->children.remove(step.second);
+            delete node;
+            node = step.first;
+        }
+        return true;
+    }
+
+    void clear()
+    {
+        delete m_root;
+        m_root = new Node();
+        m_size = 0;
+    }
+
+    // Value of the deepest registered path that is path or one of its
+    // ancestors; false if there is none
+    bool find(const QString &path, T &value) const
+    {
+        const Node *node = m_root;
+        const Node *owner = m_root->hasValue ? m_root : nullptr;
+        forEachComponent(path, [&node, &owner](const QString &component) {
+            node = node->children.value(component);
+            if (!node) {
+                return false;
+            }
+            if (node->hasValue) {
+                owner = node;
+            }
+            return true;
+        });
+        if (!owner) {
+            return false;
+        }
+        value = owner->value;
+        return true;
+    }
+
+    // Values of every registered path that is path or one of its
+    // ancestors, outermost first
+    QVector<T> findAll(const QString &path) const
+    {
+        QVector<T> values;
+        if (m_root->hasValue) {
+            values.append(m_root->value);
+        }
+        const Node *node = m_root;
+        forEachComponent(path, [&node, &values](const QString &component) {
+            node = node->children.value(component);
+            if (!node) {
+                return false;
+            }
+            if (node->hasValue) {
+                values.append(node->value);
+            }
+            return true;
+        });
+        return values;
+    }
+
+    T value(const QString &path, const T &defaultValue = T()) const
+    {
+        T result;
+        return find(path, result) ? result : defaultValue;
+    }
+
+    int size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+
+private:
+    struct Node {
+        QHash<QString, Node*> children;
+        T value = T();
+        bool hasValue = false;
+
+        ~Node() { qDeleteAll(children); }
+    };
+
+    Node *m_root;
+    int m_size;
+
+    // Calls visit with each component of path until it returns false;
+    // returns whether every component was visited. A UNC path's leading
+    // "//" is a component of its own so it can't match a local path.
+    template <typename Visit>
+    static bool forEachComponent(const QString &path, Visit visit)
+    {
+        const QString normalized = QDir::fromNativeSeparators(path);
+        const int length = normalized.size();
+        int start = 0;
+
+        if (normalized.startsWith("//")) {
+            if (!visit(QStringLiteral("//"))) {
+                return false;
+            }
+            start = 2;
+        }
+
+        while (start < length) {
+            int end = normalized.indexOf('/', start);
+            if (end < 0) {
+                end = length;
+            }
+            const int componentLength = end - start;
+            if (componentLength > 0 &&
+                !(componentLength == 1 && normalized.at(start) == '.')) {
+#ifdef Q_OS_WIN
+                const QString component = normalized.mid(start, componentLength).toCaseFolded();
+#else
+                const QString component = normalized.mid(start, componentLength);
+#endif
+                if (!visit(component)) {
+                    return false;
+                }
+            }
+            start = end + 1;
+        }
+        return true;
+    }
+};
+
+#endif // PATHTRIE_H
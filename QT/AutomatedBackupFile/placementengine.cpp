@@ -0,0 +1,131 @@
+#include "placementengine.h"
+#include <algorithm>
+
+double PlacementTarget::effectiveThroughput() const
+{
+    const double rate = throughput > 0 ? throughput : PlacementEngine::DefaultThroughput;
+    return rate / (1 + qMax(0, activeStreams));
+}
+
+Placement PlacementEngine::place(const QVector<PlacementTarget> &targets, const QVector<PlacementFile> &files,
+                                 Mode mode)
+{
+    Placement placement;
+    placement.files.resize(targets.size());
+    placement.bytes.fill(0, targets.size());
+    if (targets.isEmpty()) {
+        for (const PlacementFile &file : files) {
+            placement.unplaced.append(file.path);
+        }
+        return placement;
+    }
+
+    qint64 total = 0;
+    QStringList paths;
+    paths.reserve(files.size());
+    for (const PlacementFile &file : files) {
+        total += file.size;
+        paths.append(file.path);
+    }
+
+    switch (mode) {
+        case Mode::Mirror:
+            for (int i = 0; i < targets.size(); ++i) {
+                placement.files[i] = paths;
+                placement.bytes[i] = total;
+                placement.finishSeconds = qMax(placement.finishSeconds, total / targets[i].effectiveThroughput());
+            }
+            return placement;
+
+        case Mode::Fastest: {
+            int best = -1;
+            double bestSeconds = 0;
+            for (int i = 0; i < targets.size(); ++i) {
+                if (targets[i].freeSpace >= 0 && total > targets[i].freeSpace) {
+                    continue;
+                }
+                const double seconds = total / targets[i].effectiveThroughput();
+                if (best < 0 || seconds < bestSeconds) {
+                    best = i;
+                    bestSeconds = seconds;
+                }
+            }
+            if (best >= 0) {
+                placement.files[best] = paths;
+                placement.bytes[best] = total;
+                placement.finishSeconds = bestSeconds;
+                return placement;
+            }
+            return stripe(targets, files);
+        }
+
+        case Mode::Stripe:
+            return stripe(targets, files);
+    }
+    return placement;
+}
+
+Placement PlacementEngine::stripe(const QVector<PlacementTarget> &targets, QVector<PlacementFile> files)
+{
+    Placement placement;
+    placement.files.resize(targets.size());
+    placement.bytes.fill(0, targets.size());
+
+    // Largest first: the small files that come last even out what is left
+    std::stable_sort(files.begin(), files.end(), [](const PlacementFile &a, const PlacementFile &b) {
+        return a.size > b.size;
+    });
+
+    QVector<double> rates(targets.size());
+    for (int i = 0; i < targets.size(); ++i) {
+        rates[i] = targets[i].effectiveThroughput();
+    }
+
+    for (const PlacementFile &file : files) {
+        int best = -1;
+        double bestSeconds = 0;
+        for (int i = 0; i < targets.size(); ++i) {
+            const qint64 bytes = placement.bytes[i] + file.size;
+            if (targets[i].freeSpace >= 0 && bytes > targets[i].freeSpace) {
+                continue;
+            }
+            const double seconds = bytes / rates[i];
+            if (best < 0 || seconds < bestSeconds) {
+                best = i;
+                bestSeconds = seconds;
+            }
+        }
+        if (best < 0) {
+            placement.unplaced.append(file.path);
+            continue;
+        }
+        placement.files[best].append(file.path);
+        placement.bytes[best] += file.size;
+        placement.finishSeconds = qMax(placement.finishSeconds, bestSeconds);
+    }
+    return placement;
+}
+
+QString PlacementEngine::modeToString(Mode mode)
+{
+    switch (mode) {
+        case Mode::Mirror:
+            return "mirror";
+        case Mode::Fastest:
+            return "fastest";
+        case Mode::Stripe:
+            return "stripe";
+    }
+    return "mirror";
+}
+
+PlacementEngine::Mode PlacementEngine::modeFromString(const QString &name)
+{
+    if (name == "fastest") {
+        return Mode::Fastest;
+    }
+    if (name == "stripe") {
+        return Mode::Stripe;
+    }
+    return Mode::Mirror;
+}
@@ -0,0 +1,73 @@
+#ifndef PLACEMENTENGINE_H
+#define PLACEMENTENGINE_H
+
+#include <QMap>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// A destination directory a job may write a source's files to, with what is
+// known of how fast it takes them
+struct PlacementTarget
+{
+    qint64 freeSpace = -1;    // Bytes; negative if unknown
+    double throughput = 0;    // Measured write rate in bytes per second; 0 if never measured
+    int activeStreams = 0;    // Other jobs writing to the same device when the job starts
+
+    // What this job can expect: the measured rate, or a default until there
+    // is one, shared with the other streams on the device
+    double effectiveThroughput() const;
+};
+
+struct PlacementFile
+{
+    QString path;    // Relative to the source
+    qint64 size = 0;
+};
+
+// Which files go to which target
+struct Placement
+{
+    QVector<QStringList> files;     // Per target, in the order the targets were given
+    QVector<qint64> bytes;          // Per target
+    QStringList unplaced;           // Fit on no target
+    double finishSeconds = 0;       // Expected time until the slowest target is done
+
+    bool isComplete() const { return unplaced.isEmpty(); }
+};
+
+// Spreads a job's files over the destinations of a source. The expected
+// time a target needs is the bytes given to it over its effective
+// throughput, and a target never gets more than its free space.
+//
+// - Mirror: every target gets every file (copies on each destination)
+// - Fastest: the one target that is done soonest with all of them; if no
+//   target has room for the whole job, the files are striped instead
+// - Stripe: each file goes to one target, largest files first, each to
+//   the target that would then be done soonest, so all finish at about
+//   the same time
+class PlacementEngine
+{
+public:
+    enum class Mode { Mirror, Fastest, Stripe };
+
+    static constexpr double DefaultThroughput = 20.0 * 1024 * 1024;  // Bytes per second
+
+    static Placement place(const QVector<PlacementTarget> &targets, const QVector<PlacementFile> &files, Mode mode);
+
+    static QString modeToString(Mode mode);
+    static Mode modeFromString(const QString &name);  // Mirror for anything unknown
+
+private:
+    static Placement stripe(const QVector<PlacementTarget> &targets, QVector<PlacementFile> files);
+};
+
+// Placement for one job: the mode and, by destination path of a pair, the
+// target figures of the destination behind it
+struct BackupPlacement
+{
+    PlacementEngine::Mode mode = PlacementEngine::Mode::Mirror;
+    QMap<QString, PlacementTarget> targets;
+};
+
+#endif // PLACEMENTENGINE_H
@@ -1,4 +1,7 @@
 #include "retentionpolicy.h"
+#include <QLocale>
+#include <QStringList>
+#include <algorithm>
 
 RetentionPolicy::RetentionPolicy()
     : m_retentionDays(30)
@@ -60,3 +63,177 @@ QString RetentionPolicy::getPolicyDescription() const
     
     return parts.join(", ");
 }
+
+RetentionPlan RetentionPolicy::plan(const QList<BackupGeneration> &generations, const QDateTime &now) const
+{
+    RetentionPlan plan;
+    
+    // One pass from the newest: a generation opens a bucket when its day,
+    // week or month differs from the last one that did
+    qint64 lastDay = -1;
+    int lastWeek = -1;
+    int lastMonth = -1;
+    int days = 0;
+    int weeks = 0;
+    int months = 0;
+    for (int i = 0; i < generations.size(); ++i) {
+        RetentionDecision decision;
+        decision.generation = generations.at(i);
+        const QDate date = decision.generation.timestamp.date();
+        
+        int weekYear = 0;
+        const int weekNumber = date.weekNumber(&weekYear);
+        const int week = weekYear * 100 + weekNumber;
+        const int month = date.year() * 12 + date.month();
+        
+        const bool daily = date.toJulianDay() != lastDay && days < DailyGenerations;
+        const bool weekly = week != lastWeek && weeks < WeeklyGenerations;
+        const bool monthly = month != lastMonth && months < MonthlyGenerations;
+        if (date.toJulianDay() != lastDay) {
+            lastDay = date.toJulianDay();
+            ++days;
+        }
+        if (week != lastWeek) {
+            lastWeek = week;
+            ++weeks;
+        }
+        if (month != lastMonth) {
+            lastMonth = month;
+            ++months;
+        }
+        
+        if (i == 0) {
+            decision.reason = RetentionDecision::Reason::Newest;
+        } else if (m_keepMonthlyBackups && monthly) {
+            decision.reason = RetentionDecision::Reason::Monthly;
+        } else if (m_keepWeeklyBackups && weekly) {
+            decision.reason = RetentionDecision::Reason::Weekly;
+        } else if (m_keepDailyBackups && daily) {
+            decision.reason = RetentionDecision::Reason::Daily;
+        } else if (m_retentionDays > 0 && decision.generation.timestamp.daysTo(now) > m_retentionDays) {
+            decision.reason = RetentionDecision::Reason::Expired;
+        } else {
+            decision.reason = RetentionDecision::Reason::WithinRetention;
+        }
+        plan.decisions.append(decision);
+    }
+    
+    // Count and size limits take the oldest kept generations, those only
+    // young enough first and the bucket ones after them
+    QList<int> candidates;
+    int keptCount = 0;
+    qint64 keptSize = 0;
+    for (int i = plan.decisions.size() - 1; i >= 0; --i) {
+        const RetentionDecision &decision = plan.decisions.at(i);
+        if (!decision.keep()) {
+            continue;
+        }
+        ++keptCount;
+        keptSize += decision.generation.size;
+        if (decision.reason == RetentionDecision::Reason::WithinRetention) {
+            candidates.append(i);
+        }
+    }
+    for (int i = plan.decisions.size() - 1; i > 0; --i) {
+        const RetentionDecision::Reason reason = plan.decisions.at(i).reason;
+        if (reason == RetentionDecision::Reason::Monthly || reason == RetentionDecision::Reason::Weekly ||
+            reason == RetentionDecision::Reason::Daily) {
+            candidates.append(i);
+        }
+    }
+    
+    for (int i : candidates) {
+        const bool overCount = m_maxBackupCount > 0 && keptCount > m_maxBackupCount;
+        const bool overSize = m_maxStorageSize > 0 && keptSize > m_maxStorageSize;
+        if (!overCount && !overSize) {
+            break;
+        }
+        RetentionDecision &decision = plan.decisions[i];
+        decision.reason = overCount ? RetentionDecision::Reason::OverCount : RetentionDecision::Reason::OverSize;
+        --keptCount;
+        keptSize -= decision.generation.size;
+    }
+    
+    return plan;
+}
+
+QString RetentionDecision::reasonText() const
+{
+    switch (reason) {
+        case Reason::Newest:
+            return "newest backup";
+        case Reason::Monthly:
+            return "newest of its month";
+        case Reason::Weekly:
+            return "newest of its week";
+        case Reason::Daily:
+            return "newest of its day";
+        case Reason::WithinRetention:
+            return "within retention period";
+        case Reason::Expired:
+            return "older than retention period";
+        case Reason::OverCount:
+            return "over maximum backup count";
+        case Reason::OverSize:
+            return "over maximum storage size";
+    }
+    return QString();
+}
+
+QList<BackupGeneration> RetentionPlan::toDelete() const
+{
+    QList<BackupGeneration> generations;
+    for (int i = decisions.size() - 1; i >= 0; --i) {
+        if (!decisions.at(i).keep()) {
+            generations.append(decisions.at(i).generation);
+        }
+    }
+    return generations;
+}
+
+int RetentionPlan::deleteCount() const
+{
+    return static_cast<int>(std::count_if(decisions.begin(), decisions.end(),
+                                          [](const RetentionDecision &decision) { return !decision.keep(); }));
+}
+
+qint64 RetentionPlan::reclaimedSize() const
+{
+    qint64 size = 0;
+    for (const RetentionDecision &decision : decisions) {
+        if (!decision.keep()) {
+            size += decision.generation.size;
+        }
+    }
+    return size;
+}
+
+qint64 RetentionPlan::keptSize() const
+{
+    qint64 size = 0;
+    for (const RetentionDecision &decision : decisions) {
+        if (decision.keep()) {
+            size += decision.generation.size;
+        }
+    }
+    return size;
+}
+
+QString RetentionPlan::report() const
+{
+    const QLocale locale;
+    QStringList lines;
+    for (const RetentionDecision &decision : decisions) {
+        lines << QString("%1 %2 (%3): %4")
+                     .arg(decision.keep() ? "Keep  " : "Delete")
+                     .arg(decision.generation.name)
+                     .arg(locale.formattedDataSize(decision.generation.size))
+                     .arg(decision.reasonText());
+    }
+    lines << QString("%1 of %2 backups to delete, %3 reclaimed, %4 kept")
+                 .arg(deleteCount())
+                 .arg(decisions.size())
+                 .arg(locale.formattedDataSize(reclaimedSize()))
+                 .arg(locale.formattedDataSize(keptSize()));
+    return lines.join('\n');
+}
@@ -1,7 +1,46 @@
 #ifndef RETENTIONPOLICY_H
 #define RETENTIONPOLICY_H
 
+#include "backupcatalog.h"
 #include <QDateTime>
+#include <QList>
+#include <QMetaType>
+
+// What retention does with one generation, and why
+struct RetentionDecision
+{
+    enum class Reason {
+        Newest,           // Kept: the latest backup is never deleted
+        Monthly,          // Kept: newest of its month
+        Weekly,           // Kept: newest of its week
+        Daily,            // Kept: newest of its day
+        WithinRetention,  // Kept: not older than the retention days
+        Expired,          // Deleted: older than the retention days
+        OverCount,        // Deleted: more generations than the maximum
+        OverSize          // Deleted: the generations take more than the maximum size
+    };
+
+    BackupGeneration generation;
+    Reason reason = Reason::WithinRetention;
+
+    bool keep() const { return reason < Reason::Expired; }
+    QString reasonText() const;
+};
+
+// Outcome of a policy over the generations of a destination, computed
+// before anything is deleted; also the dry-run report
+struct RetentionPlan
+{
+    QList<RetentionDecision> decisions;  // Newest first
+
+    QList<BackupGeneration> toDelete() const;  // Oldest first
+    int deleteCount() const;
+    qint64 reclaimedSize() const;
+    qint64 keptSize() const;
+    QString report() const;
+};
+
+Q_DECLARE_METATYPE(RetentionPlan)
 
 class RetentionPolicy
 {
@@ -26,8 +65,22 @@ public:
     void setKeepWeeklyBackups(bool keep) { m_keepWeeklyBackups = keep; }
     void setKeepMonthlyBackups(bool keep) { m_keepMonthlyBackups = keep; }
     
+    // Grandfather-father-son buckets: the newest generation of each of the
+    // last so many days, ISO weeks and months that have one
+    static const int DailyGenerations = 7;
+    static const int WeeklyGenerations = 4;
+    static const int MonthlyGenerations = 12;
+    
     // Utility methods
     bool shouldDeleteBackup(const QDateTime &backupDate) const;
+    
+    // Decide over all generations of a destination at once, newest first as
+    // BackupCatalog lists them. The buckets are filled in one pass from the
+    // newest; generations older than the retention days are deleted unless
+    // a bucket keeps them. The count and size limits then delete the oldest
+    // of what is left, unprotected generations before bucket ones, never
+    // the newest. Auto-cleanup is the caller's concern.
+    RetentionPlan plan(const QList<BackupGeneration> &generations, const QDateTime &now) const;
     QString getPolicyDescription() const;
     
 private:
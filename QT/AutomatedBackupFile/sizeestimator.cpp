@@ -0,0 +1,166 @@
+#include "sizeestimator.h"
+#include "sourcestatistics.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QStorageInfo>
+#include <QStringList>
+#include <QVector>
+#include <cmath>
+
+#ifdef Q_OS_UNIX
+#include <sys/statvfs.h>
+#endif
+
+namespace {
+
+// Two-sided 95% interval of a normal distribution
+const double Z95 = 1.96;
+
+// Extrapolate per-probe subtree figures to count unread directories:
+// the mean, plus or minus the 95% margin of the mean
+void extrapolate(const QVector<double> &values, int count, qint64 known,
+                 qint64 &estimate, qint64 &low, qint64 &high)
+{
+    const int n = values.size();
+    double sum = 0;
+    for (double value : values) {
+        sum += value;
+    }
+    const double mean = sum / n;
+
+    double squares = 0;
+    for (double value : values) {
+        squares += (value - mean) * (value - mean);
+    }
+    const double variance = n > 1 ? squares / (n - 1) : mean * mean;
+
+    const double total = count * mean;
+    const double margin = Z95 * count * std::sqrt(variance / n);
+    estimate = known + qint64(std::llround(total));
+    low = known + qint64(std::llround(qMax(0.0, total - margin)));
+    high = known + qint64(std::llround(total + margin));
+}
+
+} // namespace
+
+SizeEstimate SizeEstimate::exact(qint64 fileCount, qint64 totalSize)
+{
+    SizeEstimate estimate;
+    estimate.method = Method::Exact;
+    estimate.fileCount = fileCount;
+    estimate.fileCountLow = fileCount;
+    estimate.fileCountHigh = fileCount;
+    estimate.totalSize = totalSize;
+    estimate.totalSizeLow = totalSize;
+    estimate.totalSizeHigh = totalSize;
+    return estimate;
+}
+
+SizeEstimate SizeEstimator::estimate(const QString &root, int budgetMsecs, const std::atomic<bool> *stop)
+{
+    const QString cleanRoot = QDir::cleanPath(root);
+    if (!QFileInfo(cleanRoot).isDir()) {
+        return SizeEstimate();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    // Breadth-first for half the budget: the top of the tree is what the
+    // probes would otherwise read over and over
+    qint64 files = 0;
+    qint64 bytes = 0;
+    int directoriesRead = 0;
+    QStringList pending(cleanRoot);
+    int next = 0;
+    while (next < pending.size() && (next == 0 || timer.elapsed() < budgetMsecs / 2)) {
+        if (stop && stop->load()) {
+            return SizeEstimate();
+        }
+        const QString path = pending.at(next++);
+        const SourceStatistics::Directory directory = SourceStatistics::readDirectory(path);
+        files += directory.files;
+        bytes += directory.bytes;
+        ++directoriesRead;
+        for (const QString &name : directory.subdirectories) {
+            pending.append(SourceStatistics::childPath(path, name));
+        }
+    }
+
+    if (next == pending.size()) {
+        SizeEstimate estimate = SizeEstimate::exact(files, bytes);
+        estimate.directoriesRead = directoriesRead;
+        return estimate;
+    }
+    const QStringList unread = pending.mid(next);
+
+    SizeEstimate estimate;
+#ifdef Q_OS_UNIX
+    // The filesystem's usage covers the rest: bytes allocated, which is
+    // about what files hold, and inodes, which count directories too and
+    // are split between them as in the part read. Filesystems without
+    // inode counts (f_files 0) are sampled instead.
+    struct statvfs fs;
+    if (isFilesystemRoot(cleanRoot) &&
+        statvfs(QFile::encodeName(cleanRoot).constData(), &fs) == 0 && fs.f_files > 0) {
+        const qint64 usedBytes = qint64(fs.f_blocks - fs.f_bfree) * qint64(fs.f_frsize);
+        const qint64 usedInodes = qint64(fs.f_files - fs.f_ffree);
+        const double fileShare = double(files) / qMax<qint64>(1, files + pending.size());
+
+        estimate.method = SizeEstimate::Method::Filesystem;
+        estimate.fileCountLow = files;
+        estimate.fileCountHigh = qMax(files, usedInodes);
+        estimate.fileCount = qBound(files, qint64(usedInodes * fileShare), estimate.fileCountHigh);
+        estimate.totalSizeLow = bytes;
+        estimate.totalSizeHigh = qMax(bytes, usedBytes);
+        estimate.totalSize = estimate.totalSizeHigh;
+        estimate.directoriesRead = directoriesRead;
+        return estimate;
+    }
+#endif
+
+    // Each probe follows one random path down from a random unread
+    // directory; what it finds at a level counts once for every directory
+    // the branching above implies there is at that level
+    QVector<double> probeFiles;
+    QVector<double> probeBytes;
+    while (probeFiles.size() < MinimumProbes || timer.elapsed() < budgetMsecs) {
+        QString path = unread.at(m_random.bounded(unread.size()));
+        double weight = 1;
+        double subtreeFiles = 0;
+        double subtreeBytes = 0;
+        for (;;) {
+            if (stop && stop->load()) {
+                return SizeEstimate();
+            }
+            const SourceStatistics::Directory directory = SourceStatistics::readDirectory(path);
+            ++directoriesRead;
+            subtreeFiles += weight * directory.files;
+            subtreeBytes += weight * directory.bytes;
+            if (directory.subdirectories.isEmpty()) {
+                break;
+            }
+            weight *= directory.subdirectories.size();
+            path = SourceStatistics::childPath(path, directory.subdirectories.at(
+                m_random.bounded(directory.subdirectories.size())));
+        }
+        probeFiles.append(subtreeFiles);
+        probeBytes.append(subtreeBytes);
+    }
+
+    estimate.method = SizeEstimate::Method::Sampled;
+    extrapolate(probeFiles, unread.size(), files,
+                estimate.fileCount, estimate.fileCountLow, estimate.fileCountHigh);
+    extrapolate(probeBytes, unread.size(), bytes,
+                estimate.totalSize, estimate.totalSizeLow, estimate.totalSizeHigh);
+    estimate.directoriesRead = directoriesRead;
+    return estimate;
+}
+
+bool SizeEstimator::isFilesystemRoot(const QString &root)
+{
+    const QStorageInfo storage(root);
+    return storage.isValid() && QDir::cleanPath(storage.rootPath()) == QDir::cleanPath(root);
+}
@@ -0,0 +1,61 @@
+#ifndef SIZEESTIMATOR_H
+#define SIZEESTIMATOR_H
+
+#include <QRandomGenerator>
+#include <QString>
+#include <atomic>
+
+// File count and total size of a source, exact or estimated, with bounds
+// the true figures lie within: for a sample, about 95% of the time
+struct SizeEstimate
+{
+    enum class Method {
+        None,        // Nothing known
+        Exact,       // Every directory was read
+        Filesystem,  // The source is a whole filesystem; from its usage
+        Sampled      // Extrapolated from random paths into the unread part
+    };
+
+    Method method = Method::None;
+    qint64 fileCount = 0;
+    qint64 totalSize = 0;
+    qint64 fileCountLow = 0;
+    qint64 fileCountHigh = 0;
+    qint64 totalSizeLow = 0;
+    qint64 totalSizeHigh = 0;
+    int directoriesRead = 0;
+
+    bool isValid() const { return method != Method::None; }
+    bool isExact() const { return method == Method::Exact; }
+    static SizeEstimate exact(qint64 fileCount, qint64 totalSize);
+};
+
+// Quick size estimate of a source tree within a time budget, for planning
+// before the exact walk is done; files are counted as SourceStatistics
+// counts them. The first half of the budget reads the tree breadth-first,
+// which for small trees is the exact answer. What is still unread then is
+// estimated from the usage of the filesystem when the source is one
+// (statvfs on Unix), and otherwise by random root-to-leaf probes from the
+// unread directories (Knuth's tree size estimator), each extrapolating the
+// subtree from the branching it met. The spread of the probes gives the
+// bounds.
+class SizeEstimator
+{
+public:
+    static const int DefaultBudgetMsecs = 500;
+    static const int MinimumProbes = 8;  // Even past the budget
+
+    explicit SizeEstimator(quint32 seed = 1) : m_random(seed) {}
+
+    // Invalid if root isn't a directory or stop was set
+    SizeEstimate estimate(const QString &root, int budgetMsecs = DefaultBudgetMsecs,
+                          const std::atomic<bool> *stop = nullptr);
+
+    // root is the mount point of its filesystem
+    static bool isFilesystemRoot(const QString &root);
+
+private:
+    QRandomGenerator m_random;
+};
+
+#endif // SIZEESTIMATOR_H
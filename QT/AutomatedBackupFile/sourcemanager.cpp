@@ -1,13 +1,16 @@
 #include "sourcemanager.h"
+#include "inotifywatcher.h"
+#include <QDebug>
 #include <QFile>
 #include <QJsonDocument>
 #include <QJsonArray>
 #include <QJsonObject>
 #include <QDir>
 #include <QFileInfo>
-#include <QDirIterator>
 #include <QTimer>
+#include <QFutureWatcher>
 #include <QtConcurrent>
+#include <limits>
 
 #ifdef Q_OS_WIN
 #include <windows.h>
@@ -16,22 +19,90 @@
 #pragma comment(lib, "mpr.lib")
 #endif
 
+namespace {
+
+// Also runs on health check threads
+bool networkPathAccessible(const QString &path, const QString &username = QString(),
+                           const QString &password = QString(), const QString &domain = QString())
+{
+#ifdef Q_OS_WIN
+    // For Windows, try to access network path
+    if (!username.isEmpty() && !password.isEmpty()) {
+        // Try to connect with credentials
+        NETRESOURCEW netResource;
+        memset(&netResource, 0, sizeof(netResource));
+        netResource.dwType = RESOURCETYPE_DISK;
+        netResource.lpRemoteName = (LPWSTR)path.toStdWString().c_str();
+
+        QString userWithDomain = domain.isEmpty() ? username : domain + "\\" + username;
+        
+        DWORD result = WNetAddConnection2W(&netResource, 
+                                           (LPCWSTR)password.toStdWString().c_str(),
+                                           (LPCWSTR)userWithDomain.toStdWString().c_str(),
+                                           CONNECT_TEMPORARY);
+        
+        if (result == NO_ERROR || result == ERROR_SESSION_CREDENTIAL_CONFLICT) {
+            // Connection successful or already connected
+            QFileInfo info(path);
+            return info.exists() && info.isDir();
+        }
+        return false;
+    }
+#endif
+
+    // Try without credentials
+    QFileInfo info(path);
+    return info.exists() && info.isDir() && info.isReadable();
+}
+
+} // namespace
+
 SourceManager::SourceManager(QObject *parent)
     : QObject(parent)
     , m_fileWatcher(new QFileSystemWatcher(this))
+    , m_treeWatcher(new InotifyWatcher(this))
     , m_changeMonitoringEnabled(false)
     , m_checkIntervalMinutes(60)
     , m_checkTimer(new QTimer(this))
+    , m_healthChecks(new HealthCheckRunner(this))
+    , m_statsTimer(new QTimer(this))
 {
     connect(m_fileWatcher, &QFileSystemWatcher::directoryChanged,
             this, &SourceManager::onFileSystemChanged);
+
+    connect(m_treeWatcher, &InotifyWatcher::fileChanged, this, &SourceManager::onWatchedEntryChanged);
+    connect(m_treeWatcher, &InotifyWatcher::fileRemoved, this, &SourceManager::onWatchedEntryChanged);
+    connect(m_treeWatcher, &InotifyWatcher::directoryAdded, this, &SourceManager::onWatchedEntryChanged);
+    connect(m_treeWatcher, &InotifyWatcher::directoryRemoved, this, &SourceManager::onWatchedEntryChanged);
+    connect(m_treeWatcher, &InotifyWatcher::fileMoved, this, &SourceManager::onWatchedEntryMoved);
+    connect(m_treeWatcher, &InotifyWatcher::directoryMoved, this, &SourceManager::onWatchedEntryMoved);
+    connect(m_treeWatcher, &InotifyWatcher::rescanRequired, this, &SourceManager::onRescanRequired);
+
+    connect(m_healthChecks, &HealthCheckRunner::finished,
+            this, &SourceManager::onHealthCheckFinished);
     
     connect(m_checkTimer, &QTimer::timeout,
             this, &SourceManager::onCheckTimerTimeout);
+
+    // Changes are applied to the statistics in batches
+    m_statsTimer->setSingleShot(true);
+    m_statsTimer->setInterval(StatisticsDebounceMsecs);
+    connect(m_statsTimer, &QTimer::timeout,
+            this, &SourceManager::onStatisticsTimerTimeout);
+
+    m_statsPool.setMaxThreadCount(1);
 }
 
 SourceManager::~SourceManager()
 {
+    // Stop walks in progress and drop jobs not started yet
+    for (const auto &state : m_stats) {
+        state->cancelled = true;
+    }
+    m_statsPool.clear();
+    m_statsPool.waitForDone();
+
+    m_pathIndex.clear();
     qDeleteAll(m_sources);
     m_sources.clear();
 }
@@ -52,10 +123,11 @@ bool SourceManager::addSource(BackupSource *source)
     }
 
     m_sources.append(source);
+    m_pathIndex.insert(source->getPath(), source);
     
     // Add to file watcher if monitoring is enabled
     if (m_changeMonitoringEnabled && source->getType() == SourceType::Local) {
-        m_fileWatcher->addPath(source->getPath());
+        startWatching(source);
     }
 
     emit sourceAdded(source->getId());
@@ -74,10 +146,25 @@ bool SourceManager::removeSource(const QString &sourceId)
             
             // Remove from file watcher
             if (m_changeMonitoringEnabled) {
-                m_fileWatcher->removePath(source->getPath());
+                stopWatching(source);
+            }
+
+            m_healthChecks->cancel(sourceId);
+
+            // Its statistics jobs stop at the next check
+            const QSharedPointer<StatisticsState> state = m_stats.take(sourceId);
+            if (state) {
+                state->cancelled = true;
+            }
+            m_dirtyDirectories.remove(sourceId);
+            m_estimates.remove(sourceId);
+            const QString cachePath = statisticsCachePath(sourceId);
+            if (!cachePath.isEmpty()) {
+                QFile::remove(cachePath);
             }
             
             m_sources.removeAt(i);
+            m_pathIndex.remove(source->getPath());
             emit sourceRemoved(sourceId);
             delete source;
             return true;
@@ -111,45 +198,18 @@ QList<BackupSource*> SourceManager::getEnabledSources() const
 
 void SourceManager::checkSource(BackupSource *source)
 {
-    if (!source) {
-        return;
+    if (source) {
+        startCheck(source, true);
     }
-
-    QString sourceId = source->getId();
-    source->setStatus(SourceStatus::Checking);
-    emit sourceStatusChanged(sourceId, SourceStatus::Checking);
-
-    // Run check asynchronously (ignore return value as we don't need the QFuture)
-    (void)QtConcurrent::run([this, source, sourceId]() {
-        bool success = false;
-
-        switch (source->getType()) {
-            case SourceType::Local:
-                checkLocalSource(source);
-                success = source->getStatus() == SourceStatus::Available;
-                break;
-            case SourceType::Network:
-                checkNetworkSource(source);
-                success = source->getStatus() == SourceStatus::Available;
-                break;
-            case SourceType::Cloud:
-                checkCloudSource(source);
-                success = source->getStatus() == SourceStatus::Available;
-                break;
-        }
-
-        source->setLastChecked(QDateTime::currentDateTime());
-        emit sourceStatusChanged(sourceId, source->getStatus());
-        emit sourceUpdated(sourceId);
-        emit sourceCheckCompleted(sourceId, success);
-    });
 }
 
 void SourceManager::checkAllSources()
 {
+    // All at once; sources already checked keep their last status until
+    // their result is in
     for (auto *source : m_sources) {
         if (source->isEnabled()) {
-            checkSource(source);
+            startCheck(source, !source->getLastChecked().isValid());
         }
     }
 }
@@ -163,34 +223,7 @@ bool SourceManager::testLocalPath(const QString &path)
 bool SourceManager::testNetworkPath(const QString &path, const QString &username, 
                                    const QString &password, const QString &domain)
 {
-#ifdef Q_OS_WIN
-    // For Windows, try to access network path
-    if (!username.isEmpty() && !password.isEmpty()) {
-        // Try to connect with credentials
-        NETRESOURCEW netResource;
-        memset(&netResource, 0, sizeof(netResource));
-        netResource.dwType = RESOURCETYPE_DISK;
-        netResource.lpRemoteName = (LPWSTR)path.toStdWString().c_str();
-
-        QString userWithDomain = domain.isEmpty() ? username : domain + "\\" + username;
-        
-        DWORD result = WNetAddConnection2W(&netResource, 
-                                           (LPCWSTR)password.toStdWString().c_str(),
-                                           (LPCWSTR)userWithDomain.toStdWString().c_str(),
-                                           CONNECT_TEMPORARY);
-        
-        if (result == NO_ERROR || result == ERROR_SESSION_CREDENTIAL_CONFLICT) {
-            // Connection successful or already connected
-            QFileInfo info(path);
-            return info.exists() && info.isDir();
-        }
-        return false;
-    }
-#endif
-
-    // Try without credentials
-    QFileInfo info(path);
-    return info.exists() && info.isDir() && info.isReadable();
+    return networkPathAccessible(path, username, password, domain);
 }
 
 bool SourceManager::testCloudPath(const QString &path)
@@ -209,7 +242,7 @@ void SourceManager::enableChangeMonitoring(bool enable)
         // Add all local sources to watcher
         for (auto *source : m_sources) {
             if (source->getType() == SourceType::Local && source->isEnabled()) {
-                m_fileWatcher->addPath(source->getPath());
+                startWatching(source);
             }
         }
         
@@ -220,6 +253,9 @@ void SourceManager::enableChangeMonitoring(bool enable)
         if (!m_fileWatcher->directories().isEmpty()) {
             m_fileWatcher->removePaths(m_fileWatcher->directories());
         }
+        for (const QString &root : m_treeWatcher->roots()) {
+            m_treeWatcher->removePath(root);
+        }
         
         // Stop timer
         m_checkTimer->stop();
@@ -248,6 +284,14 @@ int SourceManager::getTotalFileCount() const
     return total;
 }
 
+void SourceManager::setStatisticsCacheDirectory(const QString &directory)
+{
+    m_statsCacheDirectory = directory;
+    if (!directory.isEmpty() && !QDir().mkpath(directory)) {
+        qWarning() << "Failed to create source statistics directory:" << directory;
+    }
+}
+
 bool SourceManager::saveToFile(const QString &filePath)
 {
     QJsonObject root;
@@ -300,6 +344,7 @@ bool SourceManager::loadFromFile(const QString &filePath)
         BackupSource *source = BackupSource::fromJson(value.toObject());
         if (source) {
             m_sources.append(source);
+            m_pathIndex.insert(source->getPath(), source);
             emit sourceAdded(source->getId());
         }
     }
@@ -314,15 +359,59 @@ bool SourceManager::loadFromFile(const QString &filePath)
 
 void SourceManager::onFileSystemChanged(const QString &path)
 {
-    // Find source with this path
-    for (auto *source : m_sources) {
-        if (source->getPath() == path) {
-            emit sourceChanged(source->getId(), path);
-            // Recalculate statistics
-            calculateSourceStats(source);
-            emit sourceUpdated(source->getId());
+    // Only the source root itself is watched this way
+    markDirectoryChanged(path, path);
+}
+
+void SourceManager::onWatchedEntryChanged(const QString &path)
+{
+    markDirectoryChanged(QFileInfo(path).path(), path);
+}
+
+void SourceManager::onWatchedEntryMoved(const QString &oldPath, const QString &newPath)
+{
+    markDirectoryChanged(QFileInfo(oldPath).path(), oldPath);
+    markDirectoryChanged(QFileInfo(newPath).path(), newPath);
+}
+
+void SourceManager::onRescanRequired(const QString &root)
+{
+    // Events were lost; only a walk brings the figures back in line
+    BackupSource *source = m_pathIndex.value(root, nullptr);
+    if (source) {
+        refreshSourceStats(source, true);
+    }
+}
+
+void SourceManager::onHealthCheckFinished(const QString &sourceId, const HealthCheckResult &result)
+{
+    BackupSource *source = getSource(sourceId);
+    if (!source) {
+        return;
+    }
+
+    switch (result.outcome) {
+        case HealthCheckResult::Outcome::Available:
+            source->setStatus(SourceStatus::Available);
             break;
-        }
+        case HealthCheckResult::Outcome::Unavailable:
+        case HealthCheckResult::Outcome::TimedOut:
+            source->setStatus(SourceStatus::Unavailable);
+            break;
+        case HealthCheckResult::Outcome::Error:
+            source->setStatus(SourceStatus::Error);
+            break;
+    }
+    source->setLastError(result.error);
+    source->setLastChecked(QDateTime::currentDateTime());
+
+    const bool success = result.outcome == HealthCheckResult::Outcome::Available;
+    emit sourceStatusChanged(sourceId, source->getStatus());
+    emit sourceUpdated(sourceId);
+    emit sourceCheckCompleted(sourceId, success);
+
+    if (success) {
+        refreshSourceStats(source, false);
     }
 }
 
@@ -332,96 +421,259 @@ void SourceManager::onCheckTimerTimeout()
     checkAllSources();
 }
 
-void SourceManager::checkLocalSource(BackupSource *source)
+void SourceManager::onStatisticsTimerTimeout()
+{
+    for (auto it = m_dirtyDirectories.constBegin(); it != m_dirtyDirectories.constEnd(); ++it) {
+        const QStringList directories = it.value().values();
+        const QString cachePath = statisticsCachePath(it.key());
+        runStatisticsJob(it.key(), [directories, cachePath](StatisticsState &state) {
+            if (state.statistics.isEmpty()) {
+                return false;  // Not walked yet; the walk sees these changes
+            }
+            for (const QString &directory : directories) {
+                state.statistics.updateDirectory(directory);
+            }
+
+            const qint64 now = QDateTime::currentMSecsSinceEpoch();
+            if (!cachePath.isEmpty() && now - state.savedMs >= StatisticsSaveIntervalMsecs) {
+                state.statistics.save(cachePath);
+                state.savedMs = now;
+            }
+            return true;
+        });
+    }
+    m_dirtyDirectories.clear();
+}
+
+void SourceManager::startCheck(BackupSource *source, bool showChecking)
+{
+    const QString sourceId = source->getId();
+    if (m_healthChecks->isRunning(sourceId)) {
+        return;  // Its result is still to come
+    }
+
+    // Probes run on the health check pool: they get copies, not the source
+    const QString path = source->getPath();
+    HealthCheckRunner::Probe probe;
+    switch (source->getType()) {
+        case SourceType::Local:
+            probe = [path]() {
+                HealthCheckResult result;
+                const QFileInfo info(path);
+                if (info.exists() && info.isDir() && info.isReadable()) {
+                    result.outcome = HealthCheckResult::Outcome::Available;
+                } else {
+                    result.outcome = HealthCheckResult::Outcome::Unavailable;
+                    result.error = "Directory not accessible";
+                }
+                return result;
+            };
+            break;
+        case SourceType::Network: {
+            if (source->requiresAuthentication() && source->getUsername().isEmpty()) {
+                source->setStatus(SourceStatus::CredentialsRequired);
+                source->setLastError("Credentials required");
+                source->setLastChecked(QDateTime::currentDateTime());
+                emit sourceStatusChanged(sourceId, SourceStatus::CredentialsRequired);
+                emit sourceUpdated(sourceId);
+                emit sourceCheckCompleted(sourceId, false);
+                return;
+            }
+            const bool authenticate = source->requiresAuthentication();
+            const QString username = source->getUsername();
+            const QString password = source->getPassword();
+            const QString domain = source->getDomain();
+            probe = [path, authenticate, username, password, domain]() {
+                HealthCheckResult result;
+                const bool accessible = authenticate ? networkPathAccessible(path, username, password, domain)
+                                                     : networkPathAccessible(path);
+                if (accessible) {
+                    result.outcome = HealthCheckResult::Outcome::Available;
+                } else {
+                    result.outcome = HealthCheckResult::Outcome::Unavailable;
+                    result.error = "Network path not accessible";
+                }
+                return result;
+            };
+            break;
+        }
+        case SourceType::Cloud:
+            // Cloud checking would require cloud provider integration
+            // For now, just mark as available
+            probe = []() {
+                HealthCheckResult result;
+                result.outcome = HealthCheckResult::Outcome::Available;
+                return result;
+            };
+            break;
+    }
+
+    m_healthChecks->start(sourceId, probe);
+    if (showChecking) {
+        source->setStatus(SourceStatus::Checking);
+        emit sourceStatusChanged(sourceId, SourceStatus::Checking);
+    }
+}
+
+bool SourceManager::validateSource(BackupSource *source) const
 {
     if (!source) {
-        return;
+        return false;
     }
     
-    QFileInfo info(source->getPath());
-    if (info.exists() && info.isDir() && info.isReadable()) {
-        source->setStatus(SourceStatus::Available);
-        source->setLastError("");
-        calculateSourceStats(source);
-    } else {
-        source->setStatus(SourceStatus::Unavailable);
-        source->setLastError("Directory not accessible");
+    return source->isValid();
+}
+
+void SourceManager::startWatching(BackupSource *source)
+{
+    // Inotify follows the whole tree; QFileSystemWatcher only the root
+    if (m_treeWatcher->isSupported() && m_treeWatcher->addPath(source->getPath())) {
+        return;
     }
+    m_fileWatcher->addPath(source->getPath());
 }
 
-void SourceManager::checkNetworkSource(BackupSource *source)
+void SourceManager::stopWatching(BackupSource *source)
 {
+    m_treeWatcher->removePath(source->getPath());
+    m_fileWatcher->removePath(source->getPath());
+}
+
+void SourceManager::markDirectoryChanged(const QString &dirPath, const QString &changedPath)
+{
+    // Find the innermost source containing this path
+    BackupSource *source = m_pathIndex.value(changedPath, nullptr);
     if (!source) {
         return;
     }
-    
-    bool success = false;
-    
-    if (source->requiresAuthentication()) {
-        if (source->getUsername().isEmpty()) {
-            source->setStatus(SourceStatus::CredentialsRequired);
-            source->setLastError("Credentials required");
-            return;
+    emit sourceChanged(source->getId(), changedPath);
+
+    // Sources containing it count it too
+    for (const BackupSource *owner : m_pathIndex.findAll(dirPath)) {
+        if (m_stats.contains(owner->getId())) {
+            m_dirtyDirectories[owner->getId()].insert(dirPath);
         }
-        
-        success = testNetworkPath(source->getPath(), 
-                                  source->getUsername(),
-                                  source->getPassword(),
-                                  source->getDomain());
-    } else {
-        success = testNetworkPath(source->getPath());
     }
-    
-    if (success) {
-        source->setStatus(SourceStatus::Available);
-        source->setLastError("");
-        calculateSourceStats(source);
-    } else {
-        source->setStatus(SourceStatus::Unavailable);
-        source->setLastError("Network path not accessible");
+    if (!m_statsTimer->isActive()) {
+        m_statsTimer->start();
     }
 }
 
-void SourceManager::checkCloudSource(BackupSource *source)
+void SourceManager::refreshSourceStats(BackupSource *source, bool fullWalk)
 {
-    if (!source) {
+    if (source->getType() == SourceType::Cloud) {
         return;
     }
-    
-    // Cloud checking would require cloud provider integration
-    // For now, just mark as available
-    source->setStatus(SourceStatus::Available);
-    source->setLastError("");
+
+    const QString sourceId = source->getId();
+    const QString root = QDir::cleanPath(source->getPath());
+    const QString cachePath = statisticsCachePath(sourceId);
+
+    QSharedPointer<StatisticsState> state = m_stats.value(sourceId);
+    if (!state) {
+        state.reset(new StatisticsState);
+        m_stats.insert(sourceId, state);
+        fullWalk = true;
+
+        // Last run's figures until the walk is done, or else an estimate
+        if (!cachePath.isEmpty()) {
+            runStatisticsJob(sourceId, [root, cachePath](StatisticsState &current) {
+                return current.statistics.load(cachePath, root);
+            });
+        }
+        runEstimateJob(sourceId, root);
+    } else if (!fullWalk) {
+        // A tree watched throughout is kept current by its events; with
+        // only the root watched, changes below it need the walk
+        fullWalk = !m_treeWatcher->roots().contains(root) || !m_treeWatcher->isWatchingFully(root);
+    }
+
+    if (!fullWalk || state->walking) {
+        return;
+    }
+    state->walking = true;
+    runStatisticsJob(sourceId, [root, cachePath](StatisticsState &current) {
+        if (!current.statistics.rebuild(root, &current.cancelled)) {
+            return false;
+        }
+        if (!cachePath.isEmpty()) {
+            current.statistics.save(cachePath);
+            current.savedMs = QDateTime::currentMSecsSinceEpoch();
+        }
+        return true;
+    }, true);
 }
 
-bool SourceManager::validateSource(BackupSource *source) const
+void SourceManager::runStatisticsJob(const QString &sourceId, const StatisticsJob &job, bool fullWalk)
 {
-    if (!source) {
-        return false;
+    const QSharedPointer<StatisticsState> state = m_stats.value(sourceId);
+    if (!state) {
+        return;
     }
-    
-    return source->isValid();
+
+    // Figures are published on this thread once the job is done
+    auto *watcher = new QFutureWatcher<SizeEstimate>(this);
+    connect(watcher, &QFutureWatcher<SizeEstimate>::finished, this, [this, watcher, sourceId, state, fullWalk]() {
+        const SizeEstimate result = watcher->result();
+        watcher->deleteLater();
+        if (fullWalk) {
+            state->walking = false;
+        }
+        if (result.isValid() && !state->cancelled) {
+            publishSizeEstimate(sourceId, result);
+        }
+    });
+
+    watcher->setFuture(QtConcurrent::run(&m_statsPool, [state, job]() {
+        if (state->cancelled || !job(*state)) {
+            return SizeEstimate();
+        }
+        return SizeEstimate::exact(state->statistics.fileCount(), state->statistics.totalSize());
+    }));
 }
 
-void SourceManager::calculateSourceStats(BackupSource *source)
+void SourceManager::runEstimateJob(const QString &sourceId, const QString &root)
 {
-    if (!source || source->getType() != SourceType::Local) {
+    const QSharedPointer<StatisticsState> state = m_stats.value(sourceId);
+    if (!state) {
         return;
     }
-    
-    qint64 totalSize = 0;
-    int fileCount = 0;
-    
-    QDirIterator it(source->getPath(), QDir::Files | QDir::NoDotAndDotDot, 
-                   QDirIterator::Subdirectories);
-    
-    while (it.hasNext()) {
-        it.next();
-        QFileInfo fileInfo = it.fileInfo();
-        totalSize += fileInfo.size();
-        fileCount++;
+
+    // Not on m_statsPool, where it would wait for other sources' walks
+    auto *watcher = new QFutureWatcher<SizeEstimate>(this);
+    connect(watcher, &QFutureWatcher<SizeEstimate>::finished, this, [this, watcher, sourceId, state]() {
+        const SizeEstimate estimate = watcher->result();
+        watcher->deleteLater();
+
+        // Cached or walked figures that came first are better
+        if (estimate.isValid() && !state->cancelled && !m_estimates.value(sourceId).isExact()) {
+            publishSizeEstimate(sourceId, estimate);
+        }
+    });
+
+    const quint32 seed = QRandomGenerator::global()->generate();
+    watcher->setFuture(QtConcurrent::run([state, root, seed]() {
+        SizeEstimator estimator(seed);
+        return estimator.estimate(root, SizeEstimator::DefaultBudgetMsecs, &state->cancelled);
+    }));
+}
+
+void SourceManager::publishSizeEstimate(const QString &sourceId, const SizeEstimate &estimate)
+{
+    BackupSource *source = getSource(sourceId);
+    if (!source) {
+        return;
     }
-    
-    source->setTotalSize(totalSize);
-    source->setFileCount(fileCount);
+    m_estimates.insert(sourceId, estimate);
+    source->setTotalSize(estimate.totalSize);
+    source->setFileCount(static_cast<int>(qMin<qint64>(estimate.fileCount, std::numeric_limits<int>::max())));
+    emit sourceUpdated(sourceId);
+}
+
+QString SourceManager::statisticsCachePath(const QString &sourceId) const
+{
+    if (m_statsCacheDirectory.isEmpty()) {
+        return QString();
+    }
+    return QDir(m_statsCacheDirectory).filePath(sourceId + ".stats");
 }
@@ -5,8 +5,20 @@
 #include <QList>
 #include <QString>
 #include <QFileSystemWatcher>
+#include <QMap>
+#include <QSet>
+#include <QSharedPointer>
+#include <QThreadPool>
 #include <QTimer>
+#include <atomic>
+#include <functional>
 #include "backupsource.h"
+#include "healthcheckrunner.h"
+#include "pathtrie.h"
+#include "sizeestimator.h"
+#include "sourcestatistics.h"
+
+class InotifyWatcher;
 
 class SourceManager : public QObject
 {
@@ -24,9 +36,12 @@ public:
     QList<BackupSource*> getEnabledSources() const;
     int getSourceCount() const { return m_sources.count(); }
 
-    // Connectivity testing
+    // Connectivity testing. Checks run concurrently and report through
+    // sourceCheckCompleted(); a source still being checked, e.g. a dead
+    // share past its deadline, isn't checked again until that one returns.
     void checkSource(BackupSource *source);
     void checkAllSources();
+    void setCheckTimeout(int msecs) { m_healthChecks->setTimeout(msecs); }
     bool testLocalPath(const QString &path);
     bool testNetworkPath(const QString &path, const QString &username = QString(), 
                         const QString &password = QString(), const QString &domain = QString());
@@ -42,6 +57,16 @@ public:
     qint64 getTotalSourceSize() const;
     int getTotalFileCount() const;
 
+    // Keep each source's per-directory statistics in this directory, so
+    // its size and file count are current at startup without a walk
+    void setStatisticsCacheDirectory(const QString &directory);
+
+    // What is known of a source's size, for planning before a job. Without
+    // cached statistics, a source gets an estimate (with bounds) within
+    // about a second of its first check; it is exact once the walk is done.
+    // Invalid before either.
+    SizeEstimate getSizeEstimate(const QString &sourceId) const { return m_estimates.value(sourceId); }
+
     // Persistence
     bool saveToFile(const QString &filePath);
     bool loadFromFile(const QString &filePath);
@@ -57,20 +82,53 @@ signals:
 
 private slots:
     void onFileSystemChanged(const QString &path);
+    void onWatchedEntryChanged(const QString &path);
+    void onWatchedEntryMoved(const QString &oldPath, const QString &newPath);
+    void onRescanRequired(const QString &root);
+    void onHealthCheckFinished(const QString &sourceId, const HealthCheckResult &result);
     void onCheckTimerTimeout();
+    void onStatisticsTimerTimeout();
 
 private:
+    // Statistics of one source. Only jobs on m_statsPool touch them, one at
+    // a time; a removed source's jobs see cancelled and stop.
+    struct StatisticsState {
+        SourceStatistics statistics;
+        std::atomic<bool> cancelled{false};
+        qint64 savedMs = 0;      // Last time the cache file was written
+        bool walking = false;    // A full walk is queued; GUI thread only
+    };
+    typedef std::function<bool(StatisticsState &)> StatisticsJob;
+
+    static const int StatisticsDebounceMsecs = 1000;
+    static const int StatisticsSaveIntervalMsecs = 60 * 1000;  // At most this often after changes
+
     QList<BackupSource*> m_sources;
+    PathTrie<BackupSource*> m_pathIndex;  // Source path -> source, for change events
     QFileSystemWatcher *m_fileWatcher;
+    InotifyWatcher *m_treeWatcher;  // Whole source trees where supported
     bool m_changeMonitoringEnabled;
     int m_checkIntervalMinutes;
     QTimer *m_checkTimer;
+    HealthCheckRunner *m_healthChecks;
+
+    QHash<QString, QSharedPointer<StatisticsState>> m_stats;  // Source id -> statistics
+    QHash<QString, SizeEstimate> m_estimates;  // Source id -> last figures published
+    QMap<QString, QSet<QString>> m_dirtyDirectories;  // Source id -> directories changed since the last update
+    QTimer *m_statsTimer;
+    QThreadPool m_statsPool;  // One thread, so jobs run in the order queued
+    QString m_statsCacheDirectory;
 
-    void checkLocalSource(BackupSource *source);
-    void checkNetworkSource(BackupSource *source);
-    void checkCloudSource(BackupSource *source);
+    void startCheck(BackupSource *source, bool showChecking);
     bool validateSource(BackupSource *source) const;
-    void calculateSourceStats(BackupSource *source);
+    void startWatching(BackupSource *source);
+    void stopWatching(BackupSource *source);
+    void markDirectoryChanged(const QString &dirPath, const QString &changedPath);
+    void refreshSourceStats(BackupSource *source, bool fullWalk);
+    void runStatisticsJob(const QString &sourceId, const StatisticsJob &job, bool fullWalk = false);
+    void runEstimateJob(const QString &sourceId, const QString &root);
+    void publishSizeEstimate(const QString &sourceId, const SizeEstimate &estimate);
+    QString statisticsCachePath(const QString &sourceId) const;
 };
 
 #endif // SOURCEMANAGER_H
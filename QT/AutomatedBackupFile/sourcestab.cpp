@@ -27,8 +27,12 @@ SourcesTab::SourcesTab(QWidget *parent)
     setupSourceFileMonitorConnections();
     
     // Load saved sources and monitor state
+    m_sourceManager->setStatisticsCacheDirectory("source_stats");
     m_sourceManager->loadFromFile("sources.json");
-    m_sourceFileMonitor->loadState("source_file_monitor.json");
+    m_sourceFileMonitor->openChangeJournal("source_file_monitor_journal");
+    if (!m_sourceFileMonitor->loadState("source_file_monitor.state")) {
+        m_sourceFileMonitor->loadState("source_file_monitor.json");  // Saved by older versions
+    }
     
     // Add existing sources to file monitor
     QList<BackupSource*> sources = m_sourceManager->getAllSources();
@@ -47,7 +51,7 @@ SourcesTab::~SourcesTab()
 {
     // Save sources and file monitor state before destruction
     m_sourceManager->saveToFile("sources.json");
-    m_sourceFileMonitor->saveState("source_file_monitor.json");
+    m_sourceFileMonitor->saveState("source_file_monitor.state");
     delete ui;
 }
 
@@ -377,15 +381,31 @@ void SourcesTab::refreshSourceTable()
         }
         ui->tableSourceList->setItem(row, 3, statusItem);
         
+        // Estimates, shown until the walk is done, are marked with "~"
+        // and give their bounds in the tooltip
+        const SizeEstimate estimate = m_sourceManager->getSizeEstimate(source->getId());
+        const bool estimated = estimate.isValid() && !estimate.isExact();
+        const QString prefix = estimated ? "~" : "";
+
         // Files count
         QString fileCount = source->getFileCount() > 0 ? 
-            QString::number(source->getFileCount()) : "-";
-        ui->tableSourceList->setItem(row, 4, new QTableWidgetItem(fileCount));
+            prefix + QString::number(source->getFileCount()) : "-";
+        QTableWidgetItem *fileCountItem = new QTableWidgetItem(fileCount);
+        if (estimated) {
+            fileCountItem->setToolTip(tr("Estimated: %1 to %2 files")
+                .arg(estimate.fileCountLow).arg(estimate.fileCountHigh));
+        }
+        ui->tableSourceList->setItem(row, 4, fileCountItem);
         
         // Size
         QString sizeStr = source->getTotalSize() > 0 ?
-            formatBytes(source->getTotalSize()) : "-";
-        ui->tableSourceList->setItem(row, 5, new QTableWidgetItem(sizeStr));
+            prefix + formatBytes(source->getTotalSize()) : "-";
+        QTableWidgetItem *sizeItem = new QTableWidgetItem(sizeStr);
+        if (estimated) {
+            sizeItem->setToolTip(tr("Estimated: %1 to %2")
+                .arg(formatBytes(estimate.totalSizeLow)).arg(formatBytes(estimate.totalSizeHigh)));
+        }
+        ui->tableSourceList->setItem(row, 5, sizeItem);
         
         // Last Checked
         QString lastChecked = source->getLastChecked().isValid() ?
@@ -0,0 +1,264 @@
+#include "sourcestatistics.h"
+#include <QDebug>
+#include <QDir>
+#include <QDirIterator>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QtEndian>
+#include <cstring>
+
+namespace {
+
+const char kMagic[8] = {'A', 'B', 'F', 'M', 'S', 'T', 'A', 'T'};
+
+// Directory record after its path: file count and bytes
+const int RecordSize = 16;
+
+} // namespace
+
+void SourceStatistics::clear()
+{
+    m_root.clear();
+    m_directories.clear();
+    m_files = 0;
+    m_bytes = 0;
+}
+
+bool SourceStatistics::rebuild(const QString &root, const std::atomic<bool> *stop)
+{
+    const QString cleanRoot = QDir::cleanPath(root);
+    if (!QFileInfo(cleanRoot).isDir()) {
+        return false;
+    }
+
+    SourceStatistics fresh;
+    fresh.m_root = cleanRoot;
+    if (!fresh.addTree(cleanRoot, stop)) {
+        return false;
+    }
+    *this = std::move(fresh);
+    return true;
+}
+
+void SourceStatistics::updateDirectory(const QString &dirPath)
+{
+    QString path = QDir::cleanPath(dirPath);
+    if (m_directories.isEmpty() || !isInside(path)) {
+        return;
+    }
+
+    // A directory that is new to the table, or gone from disk, is a change
+    // in the subdirectories of its parent
+    while (path != m_root && (!m_directories.contains(path) || !QFileInfo(path).isDir())) {
+        path = QFileInfo(path).path();
+    }
+
+    const Directory current = readDirectory(path);
+    Directory &known = m_directories[path];
+    m_files += current.files - known.files;
+    m_bytes += current.bytes - known.bytes;
+    const QStringList before = known.subdirectories;
+    known = current;
+
+    // Both lists are sorted
+    const QStringList &after = current.subdirectories;
+    int i = 0;
+    int j = 0;
+    while (i < before.size() || j < after.size()) {
+        if (j == after.size() || (i < before.size() && before[i] < after[j])) {
+            removeTree(childPath(path, before[i++]));
+        } else if (i == before.size() || after[j] < before[i]) {
+            addTree(childPath(path, after[j++]), nullptr);
+        } else {
+            ++i;
+            ++j;
+        }
+    }
+}
+
+bool SourceStatistics::load(const QString &filePath, const QString &root)
+{
+    clear();
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;  // No cache yet
+    }
+    const QByteArray data = file.readAll();
+    file.close();
+
+    const uchar *p = reinterpret_cast<const uchar*>(data.constData());
+    if (data.size() < HeaderSize || memcmp(p, kMagic, sizeof(kMagic)) != 0 ||
+        qFromLittleEndian<quint32>(p + 8) != FormatVersion) {
+        qWarning() << "Not a source statistics cache, ignored:" << filePath;
+        return false;
+    }
+
+    const quint32 directoryCount = qFromLittleEndian<quint32>(p + 12);
+    const quint32 rootLength = qFromLittleEndian<quint32>(p + 16);
+    const QString cleanRoot = QDir::cleanPath(root);
+    if (quint64(HeaderSize) + rootLength > quint64(data.size()) ||
+        QString::fromUtf8(data.constData() + HeaderSize, static_cast<int>(rootLength)) != cleanRoot) {
+        return false;  // Saved for a source at another path
+    }
+
+    QHash<QString, Directory> directories;
+    directories.reserve(static_cast<int>(qMin<quint32>(directoryCount, data.size() / (4 + RecordSize))));
+    qint64 files = 0;
+    qint64 bytes = 0;
+    qint64 offset = HeaderSize + rootLength;
+    for (quint32 i = 0; i < directoryCount; ++i) {
+        if (offset + 4 > data.size()) {
+            break;
+        }
+        const quint32 pathLength = qFromLittleEndian<quint32>(p + offset);
+        if (offset + 4 + pathLength + RecordSize > quint64(data.size())) {
+            break;
+        }
+        const QString relativePath = QString::fromUtf8(data.constData() + offset + 4, static_cast<int>(pathLength));
+        offset += 4 + pathLength;
+
+        Directory directory;
+        directory.files = qFromLittleEndian<qint64>(p + offset);
+        directory.bytes = qFromLittleEndian<qint64>(p + offset + 8);
+        offset += RecordSize;
+
+        files += directory.files;
+        bytes += directory.bytes;
+        directories.insert(relativePath.isEmpty() ? cleanRoot : childPath(cleanRoot, relativePath), directory);
+    }
+
+    if (offset != data.size() || directories.size() != int(directoryCount) || !directories.contains(cleanRoot)) {
+        qWarning() << "Source statistics cache is damaged, ignored:" << filePath;
+        return false;
+    }
+
+    // Subdirectory lists follow from the paths
+    for (auto it = directories.constBegin(); it != directories.constEnd(); ++it) {
+        if (it.key() == cleanRoot) {
+            continue;
+        }
+        const QFileInfo info(it.key());
+        auto parent = directories.find(info.path());
+        if (parent == directories.end()) {
+            qWarning() << "Source statistics cache is damaged, ignored:" << filePath;
+            return false;
+        }
+        parent->subdirectories.append(info.fileName());
+    }
+    for (auto it = directories.begin(); it != directories.end(); ++it) {
+        it->subdirectories.sort();
+    }
+
+    m_root = cleanRoot;
+    m_directories.swap(directories);
+    m_files = files;
+    m_bytes = bytes;
+    return true;
+}
+
+bool SourceStatistics::save(const QString &filePath) const
+{
+    QSaveFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to write source statistics cache:" << filePath << file.errorString();
+        return false;
+    }
+
+    const QByteArray root = m_root.toUtf8();
+    QByteArray data(HeaderSize, '\0');
+    uchar *h = reinterpret_cast<uchar*>(data.data());
+    memcpy(h, kMagic, sizeof(kMagic));
+    qToLittleEndian<quint32>(FormatVersion, h + 8);
+    qToLittleEndian<quint32>(static_cast<quint32>(m_directories.size()), h + 12);
+    qToLittleEndian<quint32>(static_cast<quint32>(root.size()), h + 16);
+    data.append(root);
+
+    const int prefixLength = m_root.endsWith('/') ? m_root.size() : m_root.size() + 1;
+    for (auto it = m_directories.constBegin(); it != m_directories.constEnd(); ++it) {
+        const QByteArray relativePath = it.key() == m_root ? QByteArray() : it.key().mid(prefixLength).toUtf8();
+        uchar record[4 + RecordSize];
+        qToLittleEndian<quint32>(static_cast<quint32>(relativePath.size()), record);
+        data.append(reinterpret_cast<const char*>(record), 4);
+        data.append(relativePath);
+        qToLittleEndian<qint64>(it->files, record + 4);
+        qToLittleEndian<qint64>(it->bytes, record + 12);
+        data.append(reinterpret_cast<const char*>(record + 4), RecordSize);
+    }
+    file.write(data);
+
+    if (!file.commit()) {
+        qWarning() << "Failed to write source statistics cache:" << filePath << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+bool SourceStatistics::addTree(const QString &dirPath, const std::atomic<bool> *stop)
+{
+    QStringList pending(dirPath);
+    while (!pending.isEmpty()) {
+        if (stop && stop->load()) {
+            return false;
+        }
+        const QString path = pending.takeLast();
+        const Directory directory = readDirectory(path);
+        for (const QString &name : directory.subdirectories) {
+            pending.append(childPath(path, name));
+        }
+        m_files += directory.files;
+        m_bytes += directory.bytes;
+        m_directories.insert(path, directory);
+    }
+    return true;
+}
+
+void SourceStatistics::removeTree(const QString &dirPath)
+{
+    QStringList pending(dirPath);
+    while (!pending.isEmpty()) {
+        const QString path = pending.takeLast();
+        auto it = m_directories.find(path);
+        if (it == m_directories.end()) {
+            continue;
+        }
+        for (const QString &name : it->subdirectories) {
+            pending.append(childPath(path, name));
+        }
+        m_files -= it->files;
+        m_bytes -= it->bytes;
+        m_directories.erase(it);
+    }
+}
+
+bool SourceStatistics::isInside(const QString &path) const
+{
+    if (path == m_root) {
+        return true;
+    }
+    return path.startsWith(m_root) && (m_root.endsWith('/') || path.at(m_root.size()) == '/');
+}
+
+SourceStatistics::Directory SourceStatistics::readDirectory(const QString &dirPath)
+{
+    Directory directory;
+    QDirIterator it(dirPath, QDir::Files | QDir::Dirs | QDir::NoDotAndDotDot);
+    while (it.hasNext()) {
+        it.next();
+        const QFileInfo info = it.fileInfo();
+        if (!info.isDir()) {
+            directory.files++;
+            directory.bytes += info.size();
+        } else if (!info.isSymLink()) {
+            directory.subdirectories.append(info.fileName());
+        }
+    }
+    directory.subdirectories.sort();
+    return directory;
+}
+
+QString SourceStatistics::childPath(const QString &dirPath, const QString &name)
+{
+    return dirPath.endsWith('/') ? dirPath + name : dirPath + '/' + name;
+}
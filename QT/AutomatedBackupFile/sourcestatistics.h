@@ -0,0 +1,72 @@
+#ifndef SOURCESTATISTICS_H
+#define SOURCESTATISTICS_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <atomic>
+
+// File count and total size of a source tree, kept per directory so that a
+// change costs re-reading the one directory it happened in rather than
+// walking the whole tree again. Hidden files are left out and symlinked
+// directories aren't followed, as with a plain QDirIterator walk.
+//
+// The table can be kept in a small binary file between runs, so figures
+// are there at startup before the tree has been walked again.
+//
+//   header (HeaderSize bytes): magic, version, directory count, root length
+//   root: UTF-8
+//   directories: path length, UTF-8 path relative to the root, file count, bytes
+//
+// Numbers are little-endian. Not thread-safe; callers serialize access.
+class SourceStatistics
+{
+public:
+    static const int HeaderSize = 24;
+    static const quint32 FormatVersion = 1;
+
+    QString root() const { return m_root; }
+    bool isEmpty() const { return m_directories.isEmpty(); }
+    int directoryCount() const { return m_directories.size(); }
+    qint64 fileCount() const { return m_files; }
+    qint64 totalSize() const { return m_bytes; }
+    void clear();
+
+    // Walk root from scratch. False, keeping the previous figures, if root
+    // isn't a directory or stop was set meanwhile.
+    bool rebuild(const QString &root, const std::atomic<bool> *stop = nullptr);
+
+    // Re-read dirPath after something in it changed: its own files are
+    // counted again, subdirectories that appeared are walked and those that
+    // vanished are dropped with everything below them. A directory not in
+    // the table updates its nearest ancestor that is; paths outside the
+    // root are ignored.
+    void updateDirectory(const QString &dirPath);
+
+    // False, leaving the table empty, if the file is missing, invalid or
+    // was saved for another root
+    bool load(const QString &filePath, const QString &root);
+    bool save(const QString &filePath) const;
+
+    struct Directory {
+        qint64 files = 0;            // Directly in it
+        qint64 bytes = 0;
+        QStringList subdirectories;  // Names, sorted
+    };
+
+    // One directory's own figures, counted the way the whole table is
+    static Directory readDirectory(const QString &dirPath);
+    static QString childPath(const QString &dirPath, const QString &name);
+
+private:
+    QString m_root;
+    QHash<QString, Directory> m_directories;  // Clean absolute path -> own figures
+    qint64 m_files = 0;
+    qint64 m_bytes = 0;
+
+    bool addTree(const QString &dirPath, const std::atomic<bool> *stop);
+    void removeTree(const QString &dirPath);
+    bool isInside(const QString &path) const;
+};
+
+#endif // SOURCESTATISTICS_H
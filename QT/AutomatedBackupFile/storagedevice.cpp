@@ -0,0 +1,203 @@
+#include "storagedevice.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QStorageInfo>
+#include <QMutexLocker>
+
+#ifdef Q_OS_LINUX
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#endif
+
+QMap<quint64, StorageDeviceInfo> StorageDeviceResolver::s_cache;
+QMutex StorageDeviceResolver::s_cacheMutex;
+
+StorageDeviceInfo StorageDeviceResolver::resolve(const QString &path)
+{
+    QString existing = nearestExistingPath(path);
+    if (existing.isEmpty()) {
+        StorageDeviceInfo info;
+        info.deviceId = "unknown";
+        info.maxConcurrentStreams = defaultStreamLimit(info.kind);
+        return info;
+    }
+
+#ifdef Q_OS_LINUX
+    struct stat st;
+    if (::stat(QFile::encodeName(existing).constData(), &st) == 0) {
+        quint64 dev = static_cast<quint64>(st.st_dev);
+        {
+            QMutexLocker locker(&s_cacheMutex);
+            auto it = s_cache.constFind(dev);
+            if (it != s_cache.constEnd()) {
+                return it.value();
+            }
+        }
+
+        StorageDeviceInfo info;
+        if (!resolveFromSysfs(major(st.st_dev), minor(st.st_dev), info)) {
+            // Anonymous devices (NFS, tmpfs, btrfs subvolumes, overlays)
+            info = resolveFromStorageInfo(existing);
+        }
+
+        QMutexLocker locker(&s_cacheMutex);
+        s_cache.insert(dev, info);
+        return info;
+    }
+#endif
+
+    return resolveFromStorageInfo(existing);
+}
+
+int StorageDeviceResolver::defaultStreamLimit(StorageDeviceKind kind)
+{
+    switch (kind) {
+        case StorageDeviceKind::Rotational: return 1;
+        case StorageDeviceKind::SolidState: return 2;
+        case StorageDeviceKind::NVMe:       return 4;
+        case StorageDeviceKind::Network:    return 2;
+        case StorageDeviceKind::Memory:     return 4;
+        case StorageDeviceKind::Unknown:    return 2;
+    }
+    return 1;
+}
+
+QString StorageDeviceResolver::kindToString(StorageDeviceKind kind)
+{
+    switch (kind) {
+        case StorageDeviceKind::Rotational: return "HDD";
+        case StorageDeviceKind::SolidState: return "SSD";
+        case StorageDeviceKind::NVMe:       return "NVMe";
+        case StorageDeviceKind::Network:    return "Network";
+        case StorageDeviceKind::Memory:     return "Memory";
+        case StorageDeviceKind::Unknown:    return "Unknown";
+    }
+    return "Unknown";
+}
+
+QString StorageDeviceResolver::nearestExistingPath(const QString &path)
+{
+    if (path.isEmpty()) {
+        return QString();
+    }
+
+    QString current = QFileInfo(path).absoluteFilePath();
+    while (!QFileInfo::exists(current)) {
+        QString parent = QFileInfo(current).absolutePath();
+        if (parent == current) {
+            return QString();
+        }
+        current = parent;
+    }
+    return current;
+}
+
+StorageDeviceInfo StorageDeviceResolver::resolveFromStorageInfo(const QString &path)
+{
+    StorageDeviceInfo info;
+    QStorageInfo storage(path);
+
+    QString device = QString::fromLocal8Bit(storage.device());
+    QString fsType = QString::fromLatin1(storage.fileSystemType()).toLower();
+
+    static const QStringList networkFileSystems = {
+        "nfs", "nfs4", "cifs", "smb", "smb2", "smb3", "smbfs",
+        "fuse.sshfs", "9p", "afs", "ceph", "glusterfs", "davfs"
+    };
+
+    if (path.startsWith("\\\\") || path.startsWith("//") || networkFileSystems.contains(fsType)) {
+        info.kind = StorageDeviceKind::Network;
+        info.deviceId = "net:" + (device.isEmpty() ? storage.rootPath() : device);
+        info.deviceName = device;
+    } else if (fsType == "tmpfs" || fsType == "ramfs") {
+        info.kind = StorageDeviceKind::Memory;
+        info.deviceId = "mem:" + storage.rootPath();
+        info.deviceName = fsType;
+    } else {
+#ifdef Q_OS_LINUX
+        // Filesystems with anonymous st_dev (btrfs) still report their block device
+        struct stat st;
+        if (device.startsWith("/dev/") &&
+            ::stat(QFile::encodeName(device).constData(), &st) == 0 && S_ISBLK(st.st_mode) &&
+            resolveFromSysfs(major(st.st_rdev), minor(st.st_rdev), info)) {
+            return info;
+        }
+#endif
+        info.kind = StorageDeviceKind::Unknown;
+        info.deviceId = "volume:" + (device.isEmpty() ? storage.rootPath() : device);
+        info.deviceName = device;
+    }
+
+    info.maxConcurrentStreams = defaultStreamLimit(info.kind);
+    return info;
+}
+
+#ifdef Q_OS_LINUX
+bool StorageDeviceResolver::resolveFromSysfs(quint32 majorNumber, quint32 minorNumber, StorageDeviceInfo &info)
+{
+    if (majorNumber == 0) {
+        return false;
+    }
+
+    QFileInfo linkInfo(QString("/sys/dev/block/%1:%2").arg(majorNumber).arg(minorNumber));
+    if (!linkInfo.exists()) {
+        return false;
+    }
+
+    QString diskDir = physicalDiskDir(linkInfo.canonicalFilePath());
+    QString name = QFileInfo(diskDir).fileName();
+
+    QString devNumber;
+    QFile devFile(diskDir + "/dev");
+    if (devFile.open(QIODevice::ReadOnly)) {
+        devNumber = QString::fromLatin1(devFile.readAll()).trimmed();
+    }
+
+    info.deviceName = name;
+    info.deviceId = "block:" + (devNumber.isEmpty() ? name : devNumber);
+
+    if (name.startsWith("nvme")) {
+        info.kind = StorageDeviceKind::NVMe;
+    } else {
+        QFile rotational(diskDir + "/queue/rotational");
+        if (rotational.open(QIODevice::ReadOnly)) {
+            info.kind = rotational.readAll().trimmed() == "1"
+                ? StorageDeviceKind::Rotational
+                : StorageDeviceKind::SolidState;
+        } else {
+            info.kind = StorageDeviceKind::Unknown;
+        }
+    }
+
+    info.maxConcurrentStreams = defaultStreamLimit(info.kind);
+    return true;
+}
+
+QString StorageDeviceResolver::physicalDiskDir(const QString &sysfsDir)
+{
+    QString dir = sysfsDir;
+
+    // Walk partitions up to their disk and follow single-member device-mapper
+    // stacks (LVM, dm-crypt) down to the disk they sit on
+    for (int depth = 0; depth < 8; ++depth) {
+        if (QFile::exists(dir + "/partition")) {
+            dir = QFileInfo(dir).absolutePath();
+            continue;
+        }
+
+        QDir slaves(dir + "/slaves");
+        QStringList members = slaves.entryList(QDir::AllEntries | QDir::NoDotAndDotDot);
+        if (members.size() == 1) {
+            QString member = QFileInfo(slaves.filePath(members.first())).canonicalFilePath();
+            if (!member.isEmpty()) {
+                dir = member;
+                continue;
+            }
+        }
+        break;
+    }
+
+    return dir;
+}
+#endif
@@ -0,0 +1,53 @@
+#ifndef STORAGEDEVICE_H
+#define STORAGEDEVICE_H
+
+#include <QString>
+#include <QMap>
+#include <QMutex>
+
+// Kind of physical device behind a path, used to decide how many
+// concurrent backup streams the device can take without thrashing
+enum class StorageDeviceKind {
+    Unknown,
+    Rotational,   // Spinning disk: one stream at a time
+    SolidState,   // SATA/SAS SSD
+    NVMe,
+    Network,      // NFS, SMB and other remote filesystems
+    Memory        // tmpfs/ramfs
+};
+
+struct StorageDeviceInfo {
+    QString deviceId;          // Stable id of the physical device, e.g. "block:8:0"
+    QString deviceName;        // Kernel/volume name, e.g. "sda" or "nvme0n1"
+    StorageDeviceKind kind;
+    int maxConcurrentStreams;  // Default admission limit for this device
+
+    StorageDeviceInfo()
+        : kind(StorageDeviceKind::Unknown), maxConcurrentStreams(1) {}
+};
+
+class StorageDeviceResolver
+{
+public:
+    // Resolve the physical device behind a path. The path does not need to
+    // exist yet; the nearest existing ancestor is used instead.
+    static StorageDeviceInfo resolve(const QString &path);
+
+    // Default number of concurrent streams for a kind of device
+    static int defaultStreamLimit(StorageDeviceKind kind);
+    static QString kindToString(StorageDeviceKind kind);
+
+private:
+    static QString nearestExistingPath(const QString &path);
+    static StorageDeviceInfo resolveFromStorageInfo(const QString &path);
+#ifdef Q_OS_LINUX
+    static bool resolveFromSysfs(quint32 majorNumber, quint32 minorNumber, StorageDeviceInfo &info);
+    static QString physicalDiskDir(const QString &sysfsDir);
+#endif
+
+    // st_dev -> resolved device, sysfs lookups are cached per filesystem
+    static QMap<quint64, StorageDeviceInfo> s_cache;
+    static QMutex s_cacheMutex;
+};
+
+#endif // STORAGEDEVICE_H
@@ -0,0 +1,274 @@
+#include "xorkeystream.h"
+#include <atomic>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define XORKEYSTREAM_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// GCC/Clang need per-function ISA targets so the rest of the binary stays
+// baseline; MSVC exposes every intrinsic unconditionally
+#if defined(__GNUC__) || defined(__clang__)
+#define XORKEYSTREAM_TARGET(isa) __attribute__((target(isa)))
+#else
+#define XORKEYSTREAM_TARGET(isa)
+#endif
+
+namespace {
+
+typedef void (*XorBlocksFunction)(unsigned char *data, size_t blocks, const unsigned char *pattern);
+
+std::atomic<int> s_activeImplementation(-1);
+
+// Portable fallback: eight 64-bit words per 64-byte block
+void xorBlocksScalar(unsigned char *data, size_t blocks, const unsigned char *pattern)
+{
+    quint64 words[8];
+    memcpy(words, pattern, sizeof(words));
+
+    for (size_t block = 0; block < blocks; ++block, data += 64) {
+        for (int i = 0; i < 8; ++i) {
+            quint64 value;
+            memcpy(&value, data + i * 8, sizeof(value));
+            value ^= words[i];
+            memcpy(data + i * 8, &value, sizeof(value));
+        }
+    }
+}
+
+#ifdef XORKEYSTREAM_X86
+XORKEYSTREAM_TARGET("sse2")
+void xorBlocksSse2(unsigned char *data, size_t blocks, const unsigned char *pattern)
+{
+    const __m128i k0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern));
+    const __m128i k1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern + 16));
+    const __m128i k2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern + 32));
+    const __m128i k3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pattern + 48));
+
+    for (size_t block = 0; block < blocks; ++block, data += 64) {
+        __m128i *p = reinterpret_cast<__m128i*>(data);
+        _mm_storeu_si128(p + 0, _mm_xor_si128(_mm_loadu_si128(p + 0), k0));
+        _mm_storeu_si128(p + 1, _mm_xor_si128(_mm_loadu_si128(p + 1), k1));
+        _mm_storeu_si128(p + 2, _mm_xor_si128(_mm_loadu_si128(p + 2), k2));
+        _mm_storeu_si128(p + 3, _mm_xor_si128(_mm_loadu_si128(p + 3), k3));
+    }
+}
+
+XORKEYSTREAM_TARGET("avx2")
+void xorBlocksAvx2(unsigned char *data, size_t blocks, const unsigned char *pattern)
+{
+    const __m256i k0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pattern));
+    const __m256i k1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pattern + 32));
+
+    size_t block = 0;
+    // Two blocks per iteration keeps four loads in flight
+    for (; block + 2 <= blocks; block += 2, data += 128) {
+        __m256i *p = reinterpret_cast<__m256i*>(data);
+        __m256i v0 = _mm256_loadu_si256(p + 0);
+        __m256i v1 = _mm256_loadu_si256(p + 1);
+        __m256i v2 = _mm256_loadu_si256(p + 2);
+        __m256i v3 = _mm256_loadu_si256(p + 3);
+        _mm256_storeu_si256(p + 0, _mm256_xor_si256(v0, k0));
+        _mm256_storeu_si256(p + 1, _mm256_xor_si256(v1, k1));
+        _mm256_storeu_si256(p + 2, _mm256_xor_si256(v2, k0));
+        _mm256_storeu_si256(p + 3, _mm256_xor_si256(v3, k1));
+    }
+    if (block < blocks) {
+        __m256i *p = reinterpret_cast<__m256i*>(data);
+        _mm256_storeu_si256(p + 0, _mm256_xor_si256(_mm256_loadu_si256(p + 0), k0));
+        _mm256_storeu_si256(p + 1, _mm256_xor_si256(_mm256_loadu_si256(p + 1), k1));
+    }
+}
+
+XORKEYSTREAM_TARGET("avx512f")
+void xorBlocksAvx512(unsigned char *data, size_t blocks, const unsigned char *pattern)
+{
+    const __m512i k = _mm512_loadu_si512(pattern);
+
+    size_t block = 0;
+    for (; block + 4 <= blocks; block += 4, data += 256) {
+        __m512i v0 = _mm512_loadu_si512(data);
+        __m512i v1 = _mm512_loadu_si512(data + 64);
+        __m512i v2 = _mm512_loadu_si512(data + 128);
+        __m512i v3 = _mm512_loadu_si512(data + 192);
+        _mm512_storeu_si512(data, _mm512_xor_si512(v0, k));
+        _mm512_storeu_si512(data + 64, _mm512_xor_si512(v1, k));
+        _mm512_storeu_si512(data + 128, _mm512_xor_si512(v2, k));
+        _mm512_storeu_si512(data + 192, _mm512_xor_si512(v3, k));
+    }
+    for (; block < blocks; ++block, data += 64) {
+        _mm512_storeu_si512(data, _mm512_xor_si512(_mm512_loadu_si512(data), k));
+    }
+}
+
+// Bit 0: SSE2, bit 1: AVX2, bit 2: AVX-512F. Includes the OS check that the
+// wider register state is actually saved across context switches.
+int detectCpuFeatures()
+{
+    int features = 0;
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    const int maxLeaf = info[0];
+
+    __cpuid(info, 1);
+    const bool sse2 = (info[3] & (1 << 26)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    const bool ymmState = (xcr0 & 0x6) == 0x6;
+    const bool zmmState = (xcr0 & 0xe6) == 0xe6;
+
+    bool avx2 = false;
+    bool avx512f = false;
+    if (maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+        avx512f = (info[1] & (1 << 16)) != 0;
+    }
+
+    if (sse2) features |= 1;
+    if (avx2 && ymmState) features |= 2;
+    if (avx512f && zmmState) features |= 4;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2")) features |= 1;
+    if (__builtin_cpu_supports("avx2")) features |= 2;
+    if (__builtin_cpu_supports("avx512f")) features |= 4;
+#endif
+    return features;
+}
+#else
+int detectCpuFeatures()
+{
+    return 0;
+}
+#endif
+
+int cpuFeatures()
+{
+    static const int features = detectCpuFeatures();
+    return features;
+}
+
+XorBlocksFunction kernelFor(XorKeystream::Implementation implementation)
+{
+    switch (implementation) {
+#ifdef XORKEYSTREAM_X86
+        case XorKeystream::Implementation::SSE2:   return xorBlocksSse2;
+        case XorKeystream::Implementation::AVX2:   return xorBlocksAvx2;
+        case XorKeystream::Implementation::AVX512: return xorBlocksAvx512;
+#endif
+        default: return xorBlocksScalar;
+    }
+}
+
+} // namespace
+
+XorKeystream::XorKeystream()
+    : m_vectorizable(false)
+{
+    memset(m_pattern, 0, sizeof(m_pattern));
+}
+
+XorKeystream::XorKeystream(const QByteArray &key)
+    : XorKeystream()
+{
+    setKey(key);
+}
+
+void XorKeystream::setKey(const QByteArray &key)
+{
+    m_key = key;
+    m_vectorizable = !key.isEmpty() && key.size() <= BlockSize && BlockSize % key.size() == 0;
+
+    if (m_vectorizable) {
+        for (int i = 0; i < BlockSize * 2; ++i) {
+            m_pattern[i] = static_cast<unsigned char>(key[i % key.size()]);
+        }
+    }
+}
+
+void XorKeystream::apply(QByteArray &data, qint64 streamOffset) const
+{
+    apply(data.data(), data.size(), streamOffset);
+}
+
+void XorKeystream::apply(char *data, qint64 size, qint64 streamOffset) const
+{
+    if (size <= 0 || m_key.isEmpty()) {
+        return;
+    }
+
+    unsigned char *bytes = reinterpret_cast<unsigned char*>(data);
+    const unsigned char *key = reinterpret_cast<const unsigned char*>(m_key.constData());
+    const qint64 keySize = m_key.size();
+    qint64 phase = streamOffset % keySize;
+    qint64 done = 0;
+
+    if (m_vectorizable && size >= BlockSize) {
+        // The key period divides 64, so every block sees the same window
+        // and the phase is unchanged after the vector part
+        const size_t blocks = static_cast<size_t>(size / BlockSize);
+        kernelFor(activeImplementation())(bytes, blocks, m_pattern + phase);
+        done = static_cast<qint64>(blocks) * BlockSize;
+    }
+
+    for (qint64 i = done; i < size; ++i) {
+        bytes[i] ^= key[phase];
+        if (++phase == keySize) {
+            phase = 0;
+        }
+    }
+}
+
+XorKeystream::Implementation XorKeystream::bestSupportedImplementation()
+{
+    if (isSupported(Implementation::AVX512)) return Implementation::AVX512;
+    if (isSupported(Implementation::AVX2)) return Implementation::AVX2;
+    if (isSupported(Implementation::SSE2)) return Implementation::SSE2;
+    return Implementation::Scalar;
+}
+
+bool XorKeystream::isSupported(Implementation implementation)
+{
+    switch (implementation) {
+        case Implementation::Scalar: return true;
+        case Implementation::SSE2:   return (cpuFeatures() & 1) != 0;
+        case Implementation::AVX2:   return (cpuFeatures() & 2) != 0;
+        case Implementation::AVX512: return (cpuFeatures() & 4) != 0;
+    }
+    return false;
+}
+
+XorKeystream::Implementation XorKeystream::activeImplementation()
+{
+    int active = s_activeImplementation.load(std::memory_order_relaxed);
+    if (active < 0) {
+        active = static_cast<int>(bestSupportedImplementation());
+        s_activeImplementation.store(active, std::memory_order_relaxed);
+    }
+    return static_cast<Implementation>(active);
+}
+
+void XorKeystream::setActiveImplementation(Implementation implementation)
+{
+    if (!isSupported(implementation)) {
+        implementation = bestSupportedImplementation();
+    }
+    s_activeImplementation.store(static_cast<int>(implementation), std::memory_order_relaxed);
+}
+
+QString XorKeystream::implementationName(Implementation implementation)
+{
+    switch (implementation) {
+        case Implementation::Scalar: return "Scalar";
+        case Implementation::SSE2:   return "SSE2";
+        case Implementation::AVX2:   return "AVX2";
+        case Implementation::AVX512: return "AVX-512";
+    }
+    return "Unknown";
+}
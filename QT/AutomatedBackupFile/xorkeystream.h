@@ -0,0 +1,50 @@
+#ifndef XORKEYSTREAM_H
+#define XORKEYSTREAM_H
+
+#include <QByteArray>
+#include <QString>
+
+// Repeating-key XOR used by the legacy .enc format, with SSE2/AVX2/AVX-512
+// kernels picked at runtime from cpuid and a portable scalar fallback.
+// The key is expanded once; apply() is const and safe to call from many
+// threads on the same instance.
+class XorKeystream
+{
+public:
+    enum class Implementation {
+        Scalar,
+        SSE2,
+        AVX2,
+        AVX512
+    };
+
+    XorKeystream();
+    explicit XorKeystream(const QByteArray &key);
+
+    void setKey(const QByteArray &key);
+    QByteArray getKey() const { return m_key; }
+    bool isValid() const { return !m_key.isEmpty(); }
+
+    // XOR size bytes in place, starting at position streamOffset of the keystream
+    void apply(char *data, qint64 size, qint64 streamOffset) const;
+    void apply(QByteArray &data, qint64 streamOffset = 0) const;
+
+    // Runtime dispatch
+    static Implementation bestSupportedImplementation();
+    static bool isSupported(Implementation implementation);
+    static Implementation activeImplementation();
+    static void setActiveImplementation(Implementation implementation);  // For tests and benchmarks
+    static QString implementationName(Implementation implementation);
+
+private:
+    // Vector kernels work on 64-byte blocks, so the key is stored repeated
+    // out to 128 bytes; the 64-byte window starting at any phase is then a
+    // contiguous load
+    static const int BlockSize = 64;
+
+    QByteArray m_key;
+    unsigned char m_pattern[BlockSize * 2];
+    bool m_vectorizable;  // Key length divides the block size
+};
+
+#endif // XORKEYSTREAM_H
@@ -23,6 +23,25 @@ int main(int argc, char *argv[])
     qInfo() << "- FileEncryptor (test_fileencryptor.cpp)";
     qInfo() << "- FileDecryptor (test_filedecryptor.cpp)";
     qInfo() << "- BackupEngine (test_backupengine.cpp)";
+    qInfo() << "- BackupJobQueue (test_backupjobqueue.cpp)";
+    qInfo() << "- XorKeystream (test_xorkeystream.cpp)";
+    qInfo() << "- AeadCipher (test_aeadcipher.cpp)";
+    qInfo() << "- BackupManifest (test_backupmanifest.cpp)";
+    qInfo() << "- InotifyWatcher (test_inotifywatcher.cpp)";
+    qInfo() << "- MonitorSnapshot (test_monitorsnapshot.cpp)";
+    qInfo() << "- ChangeJournal (test_changejournal.cpp)";
+    qInfo() << "- ContentHash (test_contenthash.cpp)";
+    qInfo() << "- HashCache (test_hashcache.cpp)";
+    qInfo() << "- PathTrie (test_pathtrie.cpp)";
+    qInfo() << "- BackupFilter (test_backupfilter.cpp)";
+    qInfo() << "- FileIndex (test_fileindex.cpp)";
+    qInfo() << "- SourceStatistics (test_sourcestatistics.cpp)";
+    qInfo() << "- HealthCheckRunner (test_healthcheckrunner.cpp)";
+    qInfo() << "- SizeEstimator (test_sizeestimator.cpp)";
+    qInfo() << "- BackupCatalog (test_backupcatalog.cpp)";
+    qInfo() << "- PlacementEngine (test_placementengine.cpp)";
+    qInfo() << "- DestinationProbe (test_destinationprobe.cpp)";
+    qInfo() << "- BackupFileMonitor (test_backupfilemonitor.cpp)";
     qInfo() << "";
     qInfo() << "Each test file contains its own QTEST_MAIN macro.";
     qInfo() << "Build and run the test executable to execute all tests.";
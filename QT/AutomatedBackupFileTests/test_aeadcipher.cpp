@@ -0,0 +1,173 @@
+#include <QtTest/QtTest>
+#include "aeadcipher.h"
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+
+class TestAeadCipher : public QObject
+{
+    Q_OBJECT
+
+private:
+    QByteArray key;
+    QByteArray nonce;
+    QByteArray aad;
+    QByteArray plaintext;
+
+    QByteArray randomData(int size)
+    {
+        QByteArray data(size, Qt::Uninitialized);
+        for (int i = 0; i < size; ++i) {
+            data[i] = static_cast<char>(QRandomGenerator::global()->bounded(256));
+        }
+        return data;
+    }
+
+    const unsigned char *bytes(const QByteArray &data)
+    {
+        return reinterpret_cast<const unsigned char*>(data.constData());
+    }
+
+    unsigned char *bytes(QByteArray &data)
+    {
+        return reinterpret_cast<unsigned char*>(data.data());
+    }
+
+    void checkKnownAnswer(AeadCipher::Algorithm algorithm, const QByteArray &expectedTag,
+                          const QByteArray &expectedPrefix)
+    {
+        AeadCipher cipher(algorithm, key);
+        QVERIFY(cipher.isValid());
+
+        QByteArray data = plaintext;
+        QByteArray tag(AeadCipher::TagSize, '\0');
+        cipher.encrypt(bytes(nonce), aad, bytes(data), data.size(), bytes(tag));
+
+        QCOMPARE(tag.toHex(), expectedTag);
+        QCOMPARE(data.left(expectedPrefix.size() / 2).toHex(), expectedPrefix);
+
+        QVERIFY(cipher.decrypt(bytes(nonce), aad, bytes(data), data.size(), bytes(tag)));
+        QCOMPARE(data, plaintext);
+    }
+
+private slots:
+    void initTestCase()
+    {
+        // RFC 8439 section 2.8.2 inputs
+        key = QByteArray::fromHex("808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f");
+        nonce = QByteArray::fromHex("070000004041424344454647");
+        aad = QByteArray::fromHex("50515253c0c1c2c3c4c5c6c7");
+        plaintext = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip "
+                    "for the future, sunscreen would be it.";
+        qInfo() << "Hardware AES:" << AeadCipher::hasHardwareAes()
+                << "preferred:" << AeadCipher::algorithmName(AeadCipher::preferredAlgorithm());
+    }
+
+    void cleanupTestCase()
+    {
+        AeadCipher::setHardwareAesEnabled(true);
+    }
+
+    void testInvalidKeySize()
+    {
+        AeadCipher cipher(AeadCipher::Algorithm::Aes256Gcm, QByteArray(16, 'k'));
+        QVERIFY(!cipher.isValid());
+    }
+
+    void testChaCha20Poly1305KnownAnswer()
+    {
+        checkKnownAnswer(AeadCipher::Algorithm::ChaCha20Poly1305,
+                         "1ae10b594f09e26a7e902ecbd0600691",
+                         "d31a8d34648e60db7b86afbc53ef7ec2a4aded51296e08fea9e2b5a736ee62d6");
+    }
+
+    void testAes256GcmKnownAnswer()
+    {
+        checkKnownAnswer(AeadCipher::Algorithm::Aes256Gcm,
+                         "029f36e34e07302fbf985597bca58e5f",
+                         "7c0df61c33f0c998dbe516797c7908dcdfd52f1f10ec0b5ae2e4de9942ced85e");
+    }
+
+    void testAes256GcmSoftwareFallback()
+    {
+        // Files sealed on AES-NI machines must open on machines without it
+        AeadCipher::setHardwareAesEnabled(false);
+        QVERIFY(!AeadCipher::hasHardwareAes());
+        checkKnownAnswer(AeadCipher::Algorithm::Aes256Gcm,
+                         "029f36e34e07302fbf985597bca58e5f",
+                         "7c0df61c33f0c998dbe516797c7908dcdfd52f1f10ec0b5ae2e4de9942ced85e");
+        AeadCipher::setHardwareAesEnabled(true);
+    }
+
+    void testHardwareAndSoftwareAgree()
+    {
+        AeadCipher cipher(AeadCipher::Algorithm::Aes256Gcm, key);
+        const QList<int> sizes = {0, 1, 15, 16, 17, 127, 128, 129, 1000, 4099};
+
+        for (int size : sizes) {
+            QByteArray data = randomData(size);
+            QByteArray hardware = data;
+            QByteArray software = data;
+            QByteArray hardwareTag(AeadCipher::TagSize, '\0');
+            QByteArray softwareTag(AeadCipher::TagSize, '\0');
+
+            cipher.encrypt(bytes(nonce), aad, bytes(hardware), size, bytes(hardwareTag));
+            AeadCipher::setHardwareAesEnabled(false);
+            cipher.encrypt(bytes(nonce), aad, bytes(software), size, bytes(softwareTag));
+            AeadCipher::setHardwareAesEnabled(true);
+
+            QCOMPARE(hardware, software);
+            QCOMPARE(hardwareTag, softwareTag);
+        }
+    }
+
+    void testTamperingDetected()
+    {
+        for (AeadCipher::Algorithm algorithm : {AeadCipher::Algorithm::Aes256Gcm,
+                                                AeadCipher::Algorithm::ChaCha20Poly1305}) {
+            AeadCipher cipher(algorithm, key);
+            QByteArray data = randomData(300);
+            QByteArray tag(AeadCipher::TagSize, '\0');
+            cipher.encrypt(bytes(nonce), aad, bytes(data), data.size(), bytes(tag));
+            QVERIFY(cipher.verify(bytes(nonce), aad, bytes(data), data.size(), bytes(tag)));
+
+            // Flipped ciphertext bit: rejected and left untouched
+            QByteArray corrupted = data;
+            corrupted[150] = static_cast<char>(corrupted[150] ^ 0x01);
+            QByteArray before = corrupted;
+            QVERIFY(!cipher.decrypt(bytes(nonce), aad, bytes(corrupted), corrupted.size(), bytes(tag)));
+            QCOMPARE(corrupted, before);
+
+            // Different associated data
+            QVERIFY(!cipher.verify(bytes(nonce), QByteArray("other"), bytes(data), data.size(), bytes(tag)));
+
+            // Different nonce
+            QByteArray otherNonce = nonce;
+            otherNonce[11] = static_cast<char>(otherNonce[11] ^ 0x01);
+            QVERIFY(!cipher.verify(bytes(otherNonce), aad, bytes(data), data.size(), bytes(tag)));
+        }
+    }
+
+    void benchmarkThroughput()
+    {
+        // Reports single-core GB/s; the container runs one chunk per core
+        QByteArray buffer(16 * 1024 * 1024, 'A');
+        QByteArray tag(AeadCipher::TagSize, '\0');
+
+        for (AeadCipher::Algorithm algorithm : {AeadCipher::Algorithm::Aes256Gcm,
+                                                AeadCipher::Algorithm::ChaCha20Poly1305}) {
+            AeadCipher cipher(algorithm, key);
+            QElapsedTimer timer;
+            timer.start();
+            for (int i = 0; i < 4; ++i) {
+                cipher.encrypt(bytes(nonce), aad, bytes(buffer), buffer.size(), bytes(tag));
+            }
+            double gigabytesPerSecond = double(buffer.size()) * 4 / double(qMax<qint64>(timer.nsecsElapsed(), 1));
+            qInfo().noquote() << QString("%1: %2 GB/s")
+                                 .arg(AeadCipher::algorithmName(algorithm), -18)
+                                 .arg(gigabytesPerSecond, 0, 'f', 2);
+        }
+    }
+};
+
+QTEST_MAIN(TestAeadCipher)
+#include "test_aeadcipher.moc"
@@ -0,0 +1,140 @@
+#include <QtTest/QtTest>
+#include "backupcatalog.h"
+#include <QTemporaryDir>
+#include <QtEndian>
+
+class TestBackupCatalog : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir* tempDir;
+
+    void writeFile(const QString& relativePath, int size = 100)
+    {
+        const QString path = tempDir->filePath(relativePath);
+        QDir().mkpath(QFileInfo(path).absolutePath());
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(QByteArray(size, 'x'));
+    }
+
+    void markGenerations(const QStringList& names)
+    {
+        for (const QString& name : names) {
+            QVERIFY(BackupCatalog::markGeneration(tempDir->filePath(name)));
+        }
+    }
+
+    static QStringList namesOf(const BackupCatalog& catalog)
+    {
+        QStringList names;
+        for (const BackupGeneration& generation : catalog.generations()) {
+            names.append(generation.name);
+        }
+        return names;
+    }
+
+private slots:
+    void init()
+    {
+        tempDir = new QTemporaryDir();
+        QVERIFY(tempDir->isValid());
+    }
+
+    void cleanup()
+    {
+        delete tempDir;
+    }
+
+    void testGenerationNames()
+    {
+        const QDateTime timestamp(QDate(2024, 1, 31), QTime(22, 5, 9));
+        QCOMPARE(BackupCatalog::generationName(timestamp), QString("20240131-220509"));
+        QCOMPARE(BackupCatalog::timestampOf("20240131-220509"), timestamp);
+
+        QVERIFY(!BackupCatalog::timestampOf("encrypted").isValid());
+        QVERIFY(!BackupCatalog::timestampOf("20241331-220509").isValid());
+        QVERIFY(!BackupCatalog::timestampOf("20240131-220509-copy").isValid());
+    }
+
+    void testRefresh()
+    {
+        writeFile("20240101-220000/a.bin", 10);
+        writeFile("20240103-220000/a.bin", 10);
+        writeFile("20240103-220000/docs/b.bin", 20);
+        writeFile("20240103-220000/.hidden", 5);
+        writeFile("20240102-220000/a.bin", 30);
+        writeFile("encrypted/a.bin.enc", 1000);
+        writeFile("temp_unencrypted/a.bin", 1000);
+        writeFile(".deleting-20231231-220000/a.bin", 1000);
+        writeFile("20240104-220000", 1000);  // A file, not a generation
+        writeFile("20240105-220000/photo.jpg", 1000);  // Not written by a backup: no marker
+        markGenerations({"20240101-220000", "20240102-220000", "20240103-220000"});
+
+        BackupCatalog catalog;
+        QVERIFY(catalog.refresh(tempDir->path()));
+        QCOMPARE(namesOf(catalog), QStringList({"20240103-220000", "20240102-220000", "20240101-220000"}));
+        QCOMPARE(catalog.leftovers(), QStringList({".deleting-20231231-220000"}));
+        QCOMPARE(catalog.generations().first().size, qint64(35));
+        QCOMPARE(catalog.generations().first().fileCount, qint64(3));
+        QCOMPARE(catalog.totalSize(), qint64(75));
+        QCOMPARE(BackupCatalog::latestGeneration(tempDir->path()), QString("20240103-220000"));
+
+        QVERIFY(QDir(tempDir->filePath("20240102-220000")).removeRecursively());
+        QVERIFY(catalog.refresh(tempDir->path()));
+        QCOMPARE(namesOf(catalog), QStringList({"20240103-220000", "20240101-220000"}));
+
+        QVERIFY(!catalog.refresh(tempDir->filePath("missing")));
+        QCOMPARE(catalog.count(), 2);
+        QCOMPARE(BackupCatalog::latestGeneration(tempDir->filePath("missing")), QString());
+
+        std::atomic<bool> stop(true);
+        BackupCatalog stopped;
+        QVERIFY(!stopped.refresh(tempDir->path(), &stop));
+    }
+
+    void testSaveLoad()
+    {
+        writeFile("20240101-220000/a.bin", 10);
+        writeFile("20240102-220000/a.bin", 20);
+        markGenerations({"20240101-220000", "20240102-220000"});
+
+        BackupCatalog catalog;
+        QVERIFY(catalog.refresh(tempDir->path()));
+        const QString catalogPath = tempDir->filePath("catalog.bin");
+        QVERIFY(catalog.save(catalogPath));
+
+        BackupCatalog loaded;
+        QVERIFY(loaded.load(catalogPath, tempDir->path()));
+        QCOMPARE(namesOf(loaded), namesOf(catalog));
+        QCOMPARE(loaded.totalSize(), qint64(30));
+        QCOMPARE(loaded.generations().first().timestamp, QDateTime(QDate(2024, 1, 2), QTime(22, 0)));
+
+        // Sizes of unchanged generations are taken from the catalog, not
+        // counted again
+        BackupGeneration cached = loaded.generations().first();
+        QFile file(catalogPath);
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QByteArray data = file.readAll();
+        const int offset = data.indexOf(cached.name.toUtf8()) + cached.name.size();
+        qToLittleEndian<qint64>(12345, reinterpret_cast<uchar*>(data.data()) + offset);
+        file.seek(0);
+        file.write(data);
+        file.close();
+        QVERIFY(loaded.load(catalogPath, tempDir->path()));
+        QVERIFY(loaded.refresh(tempDir->path()));
+        QCOMPARE(loaded.generations().first().size, qint64(12345));
+
+        QVERIFY(!loaded.load(catalogPath, tempDir->filePath("elsewhere")));
+        QCOMPARE(loaded.count(), 0);
+
+        QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+        file.write("not a catalog");
+        file.close();
+        QVERIFY(!loaded.load(catalogPath, tempDir->path()));
+    }
+};
+
+QTEST_MAIN(TestBackupCatalog)
+#include "test_backupcatalog.moc"
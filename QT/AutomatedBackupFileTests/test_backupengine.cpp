@@ -201,6 +201,75 @@ private slots:
         QVERIFY(true);
     }
 
+    void testStartBackupWhileRunningQueuesJob()
+    {
+        QString sourceDir = tempDir->filePath("queued_source");
+        QDir().mkpath(sourceDir);
+        QFile file(sourceDir + "/queued.txt");
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write("Queued content");
+        file.close();
+        
+        BackupEngine engine;
+        std::vector<std::pair<QString, QString>> pairs1;
+        pairs1.push_back(std::make_pair(sourceDir, tempDir->filePath("queued_dest1")));
+        std::vector<std::pair<QString, QString>> pairs2;
+        pairs2.push_back(std::make_pair(sourceDir, tempDir->filePath("queued_dest2")));
+        
+        // A second run is accepted instead of being refused while the first is active
+        QString firstJob = engine.startBackup(pairs1);
+        QString secondJob = engine.startBackup(pairs2);
+        
+        QVERIFY(!firstJob.isEmpty());
+        QVERIFY(!secondJob.isEmpty());
+        QVERIFY(firstJob != secondJob);
+        QCOMPARE(engine.getRunningJobCount() + engine.getPendingJobCount(), 2);
+        
+        QSignalSpy finishedSpy(&engine, &BackupEngine::jobFinished);
+        for (int i = 0; i < 50 && finishedSpy.count() < 2; ++i) {
+            finishedSpy.wait(200);
+        }
+        QCOMPARE(finishedSpy.count(), 2);
+    }
+
+    void testStagingDirectoryIsCleared()
+    {
+        QString sourceDir = tempDir->filePath("staging_source");
+        QDir().mkpath(sourceDir);
+        QFile file(sourceDir + "/current.txt");
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write("Current content");
+        file.close();
+
+        // Plaintext an interrupted run left behind must not reach the next
+        // generation, nor stay in the destination
+        QString destDir = tempDir->filePath("staging_dest");
+        QString staging = destDir + "/temp_unencrypted";
+        QDir().mkpath(staging);
+        QFile stale(staging + "/stale.txt");
+        QVERIFY(stale.open(QIODevice::WriteOnly));
+        stale.write("Left over");
+        stale.close();
+
+        BackupEngine engine;
+        std::vector<std::pair<QString, QString>> pairs;
+        pairs.push_back(std::make_pair(sourceDir, destDir));
+
+        QSignalSpy finishedSpy(&engine, &BackupEngine::jobFinished);
+        engine.startBackup(pairs);
+        for (int i = 0; i < 50 && finishedSpy.count() < 1; ++i) {
+            finishedSpy.wait(200);
+        }
+        QCOMPARE(finishedSpy.count(), 1);
+
+        // Succeeded or not (the key file may be missing), nothing is left
+        QVERIFY(!QFileInfo::exists(staging));
+        QDirIterator it(destDir, QDir::Files | QDir::Hidden, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            QVERIFY(!it.next().contains("stale.txt"));
+        }
+    }
+
     void testBackupWithSubdirectories()
     {
         // Create source with subdirectories
@@ -0,0 +1,470 @@
+#include <QtTest/QtTest>
+#include "backupfilemonitor.h"
+#include "inotifywatcher.h"
+#include <QTemporaryDir>
+#include <QSignalSpy>
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+class TestBackupFileMonitor : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir* tempDir;
+    BackupFileMonitor* monitor;
+    QString root;
+    QStringList events;
+
+    void writeFile(const QString& path, const QByteArray& data)
+    {
+        QDir().mkpath(QFileInfo(path).path());
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(data);
+    }
+
+    // Every change the monitor reports from now on, as "kind path"
+    void recordEvents()
+    {
+        connect(monitor, &BackupFileMonitor::fileAdded, this,
+                [this](const QString&, const QString& path, const BackupFileInfo&) {
+            events.append("added " + path);
+        });
+        connect(monitor, &BackupFileMonitor::fileModified, this,
+                [this](const QString&, const QString& path, const BackupFileInfo&, const BackupFileInfo&) {
+            events.append("modified " + path);
+        });
+        connect(monitor, &BackupFileMonitor::fileDeleted, this,
+                [this](const QString&, const QString& path, const BackupFileInfo&) {
+            events.append("deleted " + path);
+        });
+        connect(monitor, &BackupFileMonitor::fileRenamed, this,
+                [this](const QString&, const QString& oldPath, const QString& newPath) {
+            events.append("renamed " + oldPath + " " + newPath);
+        });
+    }
+
+    // Adds root as destination "dest" and waits for its first scan
+    bool addDestination()
+    {
+        QSignalSpy completed(monitor, &BackupFileMonitor::scanCompleted);
+        monitor->addDestinationPath("dest", root);
+        return completed.wait(20000);
+    }
+
+    bool enableMonitoring()
+    {
+        QSignalSpy completed(monitor, &BackupFileMonitor::scanCompleted);
+        monitor->setMonitoringEnabled(true);
+        return completed.wait(20000);
+    }
+
+private slots:
+    void init()
+    {
+        tempDir = new QTemporaryDir();
+        QVERIFY(tempDir->isValid());
+        root = QDir::cleanPath(tempDir->path());
+        monitor = new BackupFileMonitor();
+        events.clear();
+    }
+
+    void cleanup()
+    {
+        delete monitor;
+        delete tempDir;
+    }
+
+    void testScansAreSingleFlight()
+    {
+        writeFile(root + "/a.bak", "data");
+        QVERIFY(addDestination());
+
+        QSignalSpy started(monitor, &BackupFileMonitor::scanStarted);
+        QSignalSpy completed(monitor, &BackupFileMonitor::scanCompleted);
+        monitor->scanDestination("dest");
+        monitor->scanDestination("dest");
+        monitor->scanAllDestinations();
+
+        // One walk at a time; the requests made during it share one more,
+        // whose listing is the one applied
+        QCOMPARE(started.count(), 1);
+        QVERIFY(completed.wait(10000));
+        QCOMPARE(started.count(), 2);
+        QTest::qWait(200);
+        QCOMPARE(completed.count(), 1);
+        QCOMPARE(started.count(), 2);
+        QCOMPARE(monitor->getFileCountInDestination("dest"), 1);
+    }
+
+    void testScanDiff()
+    {
+        writeFile(root + "/kept.bak", QByteArray(30, 'k'));
+        writeFile(root + "/changed.bak", QByteArray(10, 'c'));
+        writeFile(root + "/removed.bak", QByteArray(20, 'r'));
+        writeFile(root + "/notes.txt", "not a backup");
+        QVERIFY(addDestination());
+        QCOMPARE(monitor->getFileCountInDestination("dest"), 3);
+        QCOMPARE(monitor->getSizeInDestination("dest"), qint64(60));
+        recordEvents();
+
+        // Sizes differ, so the new file cannot pass for the removed one
+        writeFile(root + "/sub/added.bak", QByteArray(5, 'a'));
+        QVERIFY(QFile::remove(root + "/removed.bak"));
+        writeFile(root + "/changed.bak", QByteArray(100, 'c'));
+        {
+            QFile file(root + "/changed.bak");
+            QVERIFY(file.open(QIODevice::ReadWrite));
+            QVERIFY(file.setFileTime(QDateTime::currentDateTime().addDays(-1), QFileDevice::FileModificationTime));
+        }
+
+        QSignalSpy completed(monitor, &BackupFileMonitor::scanCompleted);
+        monitor->scanDestination("dest");
+        QVERIFY(completed.wait(10000));
+        QCOMPARE(completed.first().at(1).toInt(), 3);
+        QCOMPARE(completed.first().at(2).toInt(), 3);
+
+        events.sort();
+        QCOMPARE(events, QStringList({"added " + root + "/sub/added.bak",
+                                      "deleted " + root + "/removed.bak",
+                                      "modified " + root + "/changed.bak"}));
+        QCOMPARE(monitor->getFileCountInDestination("dest"), 3);
+        QCOMPARE(monitor->getSizeInDestination("dest"), qint64(135));
+
+        // Nothing changed since, so nothing is reported
+        events.clear();
+        monitor->scanDestination("dest");
+        QVERIFY(completed.wait(10000));
+        QCOMPARE(completed.last().at(2).toInt(), 0);
+        QVERIFY(events.isEmpty());
+        QCOMPARE(monitor->getFileCountInDestination("dest"), 3);
+    }
+
+    void testScanDetectsRenames()
+    {
+        writeFile(root + "/a.bak", "archive a");
+        writeFile(root + "/b.bak", "archive b");
+        QVERIFY(addDestination());
+        recordEvents();
+
+        QVERIFY(QFile::rename(root + "/a.bak", root + "/a2.bak"));
+        QVERIFY(QDir().mkpath(root + "/moved"));
+        QVERIFY(QFile::rename(root + "/b.bak", root + "/moved/b.bak"));
+
+        QSignalSpy completed(monitor, &BackupFileMonitor::scanCompleted);
+        monitor->scanDestination("dest");
+        QVERIFY(completed.wait(10000));
+        events.sort();
+        QCOMPARE(events, QStringList({"renamed " + root + "/a.bak " + root + "/a2.bak",
+                                      "renamed " + root + "/b.bak " + root + "/moved/b.bak"}));
+        QCOMPARE(completed.first().at(2).toInt(), 2);
+        QCOMPARE(monitor->getFileCountInDestination("dest"), 2);
+    }
+
+    void testScanInodeReuseIsNotRename()
+    {
+        writeFile(root + "/old.bak", "old contents");
+        QVERIFY(addDestination());
+        recordEvents();
+
+        // The new file may well get the freed inode; its size tells it apart
+        QVERIFY(QFile::remove(root + "/old.bak"));
+        writeFile(root + "/new.bak", "new and longer contents");
+
+        QSignalSpy completed(monitor, &BackupFileMonitor::scanCompleted);
+        monitor->scanDestination("dest");
+        QVERIFY(completed.wait(10000));
+        events.sort();
+        QCOMPARE(events, QStringList({"added " + root + "/new.bak", "deleted " + root + "/old.bak"}));
+    }
+
+    void testScanHardLinks()
+    {
+#ifdef Q_OS_UNIX
+        writeFile(root + "/original.bak", "linked");
+        QVERIFY(addDestination());
+        recordEvents();
+
+        // A second name for a file that keeps its first is a new file
+        QCOMPARE(::link(QFile::encodeName(root + "/original.bak").constData(),
+                        QFile::encodeName(root + "/first.bak").constData()), 0);
+        QSignalSpy completed(monitor, &BackupFileMonitor::scanCompleted);
+        monitor->scanDestination("dest");
+        QVERIFY(completed.wait(10000));
+        QCOMPARE(events, QStringList({"added " + root + "/first.bak"}));
+
+        // Once the first name goes, one of two new names is its rename
+        events.clear();
+        QCOMPARE(::link(QFile::encodeName(root + "/original.bak").constData(),
+                        QFile::encodeName(root + "/second.bak").constData()), 0);
+        QCOMPARE(::link(QFile::encodeName(root + "/original.bak").constData(),
+                        QFile::encodeName(root + "/third.bak").constData()), 0);
+        QVERIFY(QFile::remove(root + "/original.bak"));
+        monitor->scanDestination("dest");
+        QVERIFY(completed.wait(10000));
+        QCOMPARE(events.size(), 2);
+        QCOMPARE(events.filter("renamed " + root + "/original.bak ").size(), 1);
+        QCOMPARE(events.filter("added ").size(), 1);
+        QCOMPARE(monitor->getFileCountInDestination("dest"), 3);
+#else
+        QSKIP("Hard links are not tested on this platform");
+#endif
+    }
+
+    void testWatcherReportsRename()
+    {
+        if (!InotifyWatcher().isSupported()) {
+            QSKIP("inotify is not available on this platform");
+        }
+
+        writeFile(root + "/a.bak", "archive");
+        QVERIFY(QDir().mkpath(root + "/other"));
+        QVERIFY(addDestination());
+        QVERIFY(enableMonitoring());
+        recordEvents();
+
+        QVERIFY(QFile::rename(root + "/a.bak", root + "/other/a.bak"));
+        QTRY_COMPARE(events, QStringList({"renamed " + root + "/a.bak " + root + "/other/a.bak"}));
+        QTest::qWait(200);
+        QCOMPARE(events.size(), 1);
+    }
+
+    void testMovedInTreeIsListedOnThePool()
+    {
+        if (!InotifyWatcher().isSupported()) {
+            QSKIP("inotify is not available on this platform");
+        }
+
+        QTemporaryDir outside;
+        QVERIFY(outside.isValid());
+        for (int i = 0; i < 2000; ++i) {
+            writeFile(outside.filePath(QString("tree/%1/%2.bak").arg(i % 20).arg(i)), "x");
+        }
+        QVERIFY(addDestination());
+        QVERIFY(enableMonitoring());
+        recordEvents();
+
+        // Only the new tree is listed, without a scan of the destination
+        // and without blocking the event loop while it is walked
+        QSignalSpy started(monitor, &BackupFileMonitor::scanStarted);
+        QVERIFY(QDir().rename(outside.filePath("tree"), root + "/tree"));
+        QTRY_COMPARE(monitor->getFileCountInDestination("dest"), 2000);
+        QCOMPARE(events.filter("added " + root + "/tree/").size(), 2000);
+        QCOMPARE(started.count(), 0);
+    }
+
+    void testTreeMovedWhileListedEndsUpWhereItWent()
+    {
+        if (!InotifyWatcher().isSupported()) {
+            QSKIP("inotify is not available on this platform");
+        }
+
+        QTemporaryDir outside;
+        QVERIFY(outside.isValid());
+        for (int i = 0; i < 10000; ++i) {
+            writeFile(outside.filePath(QString("tree/%1/%2.bak").arg(i % 20).arg(i)), "x");
+        }
+        QVERIFY(addDestination());
+        QVERIFY(enableMonitoring());
+
+        // Moved on again before or after its listing is applied, the index
+        // ends up with the files at their final place either way
+        QVERIFY(QDir().rename(outside.filePath("tree"), root + "/tree"));
+        QTest::qWait(1);
+        QVERIFY(QDir().rename(root + "/tree", root + "/moved"));
+        QTRY_COMPARE(monitor->getFileCountInDestination("dest"), 10000);
+        QTest::qWait(500);
+        QCOMPARE(monitor->getFileCountInDestination("dest"), 10000);
+        for (const BackupFileInfo& info : monitor->getFilesInDestination("dest")) {
+            QVERIFY(info.filePath.startsWith(root + "/moved/"));
+        }
+    }
+
+    void testScrubFindsSilentCorruption()
+    {
+        writeFile(root + "/good.bak", "unchanged contents");
+        writeFile(root + "/rotten.bak", "original contents");
+        QVERIFY(addDestination());
+        QVERIFY(monitor->openHashCache(root + "/hashes.cache"));
+
+        QSignalSpy finished(monitor, &BackupFileMonitor::scrubFinished);
+        QSignalSpy corrupted(monitor, &BackupFileMonitor::corruptedFileFound);
+        monitor->startScrub();
+        QVERIFY(finished.wait(10000));
+        QCOMPARE(finished.last().at(0).toInt(), 2);
+        QCOMPARE(finished.last().at(1).toInt(), 0);
+        QVERIFY(finished.last().at(2).toBool());
+
+        // Same size, and the modification time put back: only the contents tell
+        const QDateTime modified = QFileInfo(root + "/rotten.bak").lastModified();
+        writeFile(root + "/rotten.bak", "flipped contents!");
+        {
+            QFile file(root + "/rotten.bak");
+            QVERIFY(file.open(QIODevice::ReadWrite));
+            QVERIFY(file.setFileTime(modified, QFileDevice::FileModificationTime));
+        }
+        QCOMPARE(QFileInfo(root + "/rotten.bak").size(), qint64(17));
+
+        monitor->startScrub();
+        QVERIFY(finished.wait(10000));
+        QCOMPARE(finished.last().at(0).toInt(), 2);
+        QCOMPARE(finished.last().at(1).toInt(), 1);
+        QCOMPARE(corrupted.count(), 1);
+        QCOMPARE(corrupted.first().at(0).toString(), root + "/rotten.bak");
+        QCOMPARE(corrupted.first().at(1).toString(), QString("Contents changed but size and modification time did not"));
+    }
+
+    void testScrubResumesWhereItStopped()
+    {
+        QTemporaryDir cacheDir;
+        QVERIFY(cacheDir.isValid());
+        const QString cachePath = cacheDir.filePath("hashes.cache");
+        const int total = 20;
+        for (int i = 0; i < total; ++i) {
+            writeFile(root + QString("/%1.bak").arg(i, 2, 10, QChar('0')), QByteArray(1024, char('a' + i)));
+        }
+        QVERIFY(addDestination());
+        QVERIFY(monitor->openHashCache(cachePath));
+
+        // About a tenth of a second per file, so the budget runs out early
+        monitor->setScrubThreadCount(1);
+        monitor->setScrubRateLimit(20 * 1024 * 1024);
+        QSignalSpy finished(monitor, &BackupFileMonitor::scrubFinished);
+        monitor->startScrub(300);
+        QVERIFY(finished.wait(10000));
+        const int firstChecked = finished.last().at(0).toInt();
+        QVERIFY(firstChecked > 0);
+        QVERIFY(firstChecked < total);
+        QVERIFY(!finished.last().at(2).toBool());
+
+        // A restarted monitor picks up after the last file checked
+        delete monitor;
+        monitor = new BackupFileMonitor();
+        QVERIFY(addDestination());
+        QVERIFY(monitor->openHashCache(cachePath));
+        QSignalSpy resumed(monitor, &BackupFileMonitor::scrubFinished);
+        monitor->startScrub();
+        QVERIFY(resumed.wait(10000));
+        QCOMPARE(resumed.last().at(0).toInt(), total - firstChecked);
+        QCOMPARE(resumed.last().at(1).toInt(), 0);
+        QVERIFY(resumed.last().at(2).toBool());
+
+        // The next pass starts from the beginning again
+        monitor->startScrub();
+        QVERIFY(resumed.wait(10000));
+        QCOMPARE(resumed.last().at(0).toInt(), total);
+    }
+
+    void testScrubWindow()
+    {
+        writeFile(root + "/a.bak", "data");
+        QVERIFY(addDestination());
+
+        QSignalSpy started(monitor, &BackupFileMonitor::scrubStarted);
+        QSignalSpy finished(monitor, &BackupFileMonitor::scrubFinished);
+        monitor->setScrubWindow(QTime::currentTime().addMSecs(500), 1);
+        QCOMPARE(started.count(), 0);
+        QVERIFY(started.wait(5000));
+        QVERIFY(finished.wait(5000));
+        QCOMPARE(finished.last().at(0).toInt(), 1);
+
+        // An invalid start turns the daily scrub off
+        monitor->setScrubWindow(QTime::currentTime().addMSecs(300), 1);
+        monitor->setScrubWindow(QTime(), 1);
+        QTest::qWait(1000);
+        QCOMPARE(started.count(), 1);
+    }
+
+    void testRescanBenchmark()
+    {
+        for (int i = 0; i < 20000; ++i) {
+            writeFile(root + QString("/%1/%2.bak").arg(i / 1000).arg(i), "x");
+        }
+        QVERIFY(addDestination());
+
+        QSignalSpy completed(monitor, &BackupFileMonitor::scanCompleted);
+        QBENCHMARK {
+            monitor->scanDestination("dest");
+            QVERIFY(completed.wait(20000));
+        }
+        QCOMPARE(completed.last().at(2).toInt(), 0);
+        QCOMPARE(monitor->getFileCountInDestination("dest"), 20000);
+    }
+
+    void testStaleListingIsDropped()
+    {
+        if (!InotifyWatcher().isSupported()) {
+            QSKIP("inotify is not available on this platform");
+        }
+
+        // Enough files that the walk is still running when the events come
+        for (int i = 0; i < 10000; ++i) {
+            writeFile(root + QString("/big/%1.bak").arg(i), "x");
+        }
+        writeFile(root + "/old.bak", "data");
+        QVERIFY(addDestination());
+        QVERIFY(enableMonitoring());
+        recordEvents();
+
+        QSignalSpy completed(monitor, &BackupFileMonitor::scanCompleted);
+        monitor->scanDestination("dest");
+        // After the top level was listed, so missing from the walk's listing
+        writeFile(root + "/late/new.bak", "data");
+        QVERIFY(QFile::remove(root + "/old.bak"));
+
+        // Each change is reported once, and not undone by the older listing
+        QVERIFY(completed.wait(20000));
+        QTest::qWait(200);
+        events.sort();
+        QCOMPARE(events, QStringList({"added " + root + "/late/new.bak", "deleted " + root + "/old.bak"}));
+        QCOMPARE(completed.count(), 1);
+        QCOMPARE(monitor->getFileCountInDestination("dest"), 10001);
+    }
+
+    void testEventBurstsAreDebounced()
+    {
+        if (!InotifyWatcher().isSupported()) {
+            QSKIP("inotify is not available on this platform");
+        }
+        QFile limitFile("/proc/sys/fs/inotify/max_queued_events");
+        const int limit = limitFile.open(QIODevice::ReadOnly) ? limitFile.readAll().trimmed().toInt() : 0;
+        if (limit <= 0 || limit > 100000) {
+            QSKIP("Cannot overflow the inotify queue in reasonable time");
+        }
+
+        QVERIFY(QDir().mkpath(root + "/first"));
+        QVERIFY(QDir().mkpath(root + "/second"));
+        QVERIFY(addDestination());
+        QVERIFY(enableMonitoring());
+
+        // More events than the kernel queues, so the watcher asks for a
+        // rescan; a second burst within the quiet period starts it over
+        QSignalSpy started(monitor, &BackupFileMonitor::scanStarted);
+        QSignalSpy completed(monitor, &BackupFileMonitor::scanCompleted);
+        for (int i = 0; i <= limit; ++i) {
+            writeFile(root + QString("/first/%1.bak").arg(i), "x");
+        }
+        QTest::qWait(300);
+        QCOMPARE(started.count(), 0);
+
+        for (int i = 0; i <= limit; ++i) {
+            writeFile(root + QString("/second/%1.bak").arg(i), "x");
+        }
+        QElapsedTimer sinceBurst;
+        sinceBurst.start();
+        QVERIFY(started.wait(10000));
+        QVERIFY(sinceBurst.elapsed() >= 900);
+
+        // Both bursts cost one scan, which finds everything
+        QVERIFY(completed.wait(20000));
+        QTest::qWait(200);
+        QCOMPARE(started.count(), 1);
+        QCOMPARE(monitor->getFileCountInDestination("dest"), 2 * (limit + 1));
+    }
+};
+
+QTEST_MAIN(TestBackupFileMonitor)
+#include "test_backupfilemonitor.moc"
@@ -0,0 +1,166 @@
+#include <QtTest/QtTest>
+#include "backupfilter.h"
+#include <QTemporaryDir>
+
+class TestBackupFilter : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir* tempDir;
+
+    void writeFile(const QString& relativePath, const QByteArray& data = "x")
+    {
+        const QString path = tempDir->filePath(relativePath);
+        QDir().mkpath(QFileInfo(path).absolutePath());
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(data);
+    }
+
+    QStringList select(BackupFilter& filter)
+    {
+        QStringList files = filter.selectFiles(tempDir->path());
+        files.sort();
+        return files;
+    }
+
+    FilterRuleStats statsFor(const BackupFilter& filter, const QString& rule)
+    {
+        for (const FilterRuleStats& stats : filter.statistics()) {
+            if (stats.rule == rule) {
+                return stats;
+            }
+        }
+        return FilterRuleStats();
+    }
+
+private slots:
+    void init()
+    {
+        tempDir = new QTemporaryDir();
+        QVERIFY(tempDir->isValid());
+
+        writeFile("src/main.cpp");
+        writeFile("src/main.o");
+        writeFile("src/util/helper.cpp");
+        writeFile("src/util/helper.o");
+        writeFile("node_modules/left-pad/index.js");
+        writeFile("node_modules/left-pad/package.json");
+        writeFile("web/node_modules/react/index.js");
+        writeFile("build/app.bin", QByteArray(1000, 'b'));
+        writeFile("docs/build/readme.txt");
+        writeFile("notes.txt");
+    }
+
+    void cleanup()
+    {
+        delete tempDir;
+    }
+
+    void testNoRules()
+    {
+        BackupFilter filter;
+        QVERIFY(filter.isEmpty());
+        QCOMPARE(select(filter).size(), 10);
+        QVERIFY(filter.statistics().isEmpty());
+    }
+
+    void testPrunesExcludedDirectories()
+    {
+        BackupFilter filter({FilterRule::glob("node_modules/"),
+                             FilterRule::glob("*.o"),
+                             FilterRule::glob("/build")});
+
+        QCOMPARE(select(filter), QStringList() << "docs/build/readme.txt" << "notes.txt"
+                                               << "src/main.cpp" << "src/util/helper.cpp");
+
+        // Directories are counted once and their contents never listed
+        FilterRuleStats nodeModules = statsFor(filter, "node_modules/");
+        QCOMPARE(nodeModules.directories, qint64(2));
+        QCOMPARE(nodeModules.files, qint64(0));
+
+        FilterRuleStats objects = statsFor(filter, "*.o");
+        QCOMPARE(objects.files, qint64(2));
+        QCOMPARE(objects.bytes, qint64(2));
+
+        // Anchored: only the top-level build directory
+        QCOMPARE(statsFor(filter, "/build").directories, qint64(1));
+
+        // Counters start over with each walk
+        select(filter);
+        QCOMPARE(statsFor(filter, "*.o").files, qint64(2));
+    }
+
+    void testLastMatchWins()
+    {
+        BackupFilter filter({FilterRule::glob("*.cpp"),
+                             FilterRule::glob("main.cpp", true),
+                             FilterRule::glob("src/util/**")});
+
+        QStringList files = select(filter);
+        QVERIFY(files.contains("src/main.cpp"));
+        QVERIFY(!files.contains("src/util/helper.cpp"));
+        QVERIFY(!files.contains("src/util/helper.o"));
+        QCOMPARE(statsFor(filter, "!main.cpp").files, qint64(1));
+
+        // Only some files: exclude everything, then bring back directories and the wanted names
+        BackupFilter only({FilterRule::glob("*"),
+                           FilterRule::glob("*/", true),
+                           FilterRule::glob("*.txt", true)});
+        QCOMPARE(select(only), QStringList() << "docs/build/readme.txt" << "notes.txt");
+    }
+
+    void testRegexAndLimits()
+    {
+        writeFile("old.txt");
+        const QString oldFile = tempDir->filePath("old.txt");
+        QFile file(oldFile);
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QVERIFY(file.setFileTime(QDateTime::currentDateTime().addDays(-40), QFileDevice::FileModificationTime));
+        file.close();
+
+        BackupFilter filter({FilterRule::regex("^src/.*\\.o$"),
+                             FilterRule::regex("^(web/)?node_modules$"),
+                             FilterRule::largerThan(500),
+                             FilterRule::olderThan(30)});
+
+        QCOMPARE(select(filter), QStringList() << "docs/build/readme.txt" << "notes.txt"
+                                               << "src/main.cpp" << "src/util/helper.cpp");
+        QCOMPARE(statsFor(filter, "regex:^src/.*\\.o$").files, qint64(2));
+        QCOMPARE(statsFor(filter, "regex:^(web/)?node_modules$").directories, qint64(2));
+        QCOMPARE(statsFor(filter, "larger than 500 bytes").bytes, qint64(1000));
+        QCOMPARE(statsFor(filter, "older than 30 days").files, qint64(1));
+
+        // An invalid expression is dropped, not applied
+        BackupFilter invalid({FilterRule::regex("([")});
+        QCOMPARE(select(invalid).size(), 11);
+    }
+
+    void testIgnoreFiles()
+    {
+        writeFile("src/.backupignore", "# Objects are rebuilt\n*.o\n!helper.o\n/util/\n");
+        writeFile("docs/.backupignore", "build/\n");
+
+        BackupFilter filter({FilterRule::glob("node_modules/")}, ".backupignore");
+        QCOMPARE(select(filter), QStringList() << "build/app.bin" << "notes.txt" << "src/main.cpp");
+
+        QCOMPARE(statsFor(filter, "src/.backupignore: *.o").files, qint64(1));
+        QCOMPARE(statsFor(filter, "src/.backupignore: /util/").directories, qint64(1));
+        QCOMPARE(statsFor(filter, "docs/.backupignore: build/").directories, qint64(1));
+
+        // A later walk sees edits to the ignore files
+        writeFile("docs/.backupignore", "# nothing\n");
+        QVERIFY(select(filter).contains("docs/build/readme.txt"));
+    }
+
+    void testStop()
+    {
+        std::atomic<bool> stop(true);
+        BackupFilter filter;
+        QVERIFY(filter.selectFiles(tempDir->path(), &stop).isEmpty());
+    }
+};
+
+QTEST_MAIN(TestBackupFilter)
+#include "test_backupfilter.moc"
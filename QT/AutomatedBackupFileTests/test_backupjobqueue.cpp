@@ -0,0 +1,178 @@
+#include <QtTest/QtTest>
+#include "backupjobqueue.h"
+#include "storagedevice.h"
+#include <QTemporaryDir>
+#include <QSignalSpy>
+
+class TestBackupJobQueue : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir* tempDir;
+    QString deviceId;
+
+    QString createSource(const QString &name)
+    {
+        QString sourceDir = tempDir->filePath(name);
+        QDir().mkpath(sourceDir);
+
+        QFile file(sourceDir + "/data.txt");
+        if (file.open(QIODevice::WriteOnly)) {
+            file.write("Job queue test content");
+            file.close();
+        }
+        return sourceDir;
+    }
+
+    std::vector<std::pair<QString, QString>> makePairs(const QString &source, const QString &dest)
+    {
+        std::vector<std::pair<QString, QString>> pairs;
+        pairs.push_back(std::make_pair(source, tempDir->filePath(dest)));
+        return pairs;
+    }
+
+private slots:
+    void initTestCase()
+    {
+        tempDir = new QTemporaryDir();
+        QVERIFY(tempDir->isValid());
+        deviceId = StorageDeviceResolver::resolve(tempDir->path()).deviceId;
+    }
+
+    void cleanupTestCase()
+    {
+        delete tempDir;
+    }
+
+    void testResolveExistingPath()
+    {
+        StorageDeviceInfo info = StorageDeviceResolver::resolve(tempDir->path());
+        QVERIFY(!info.deviceId.isEmpty());
+        QVERIFY(info.maxConcurrentStreams >= 1);
+    }
+
+    void testResolveMissingPathUsesAncestor()
+    {
+        StorageDeviceInfo info = StorageDeviceResolver::resolve(tempDir->filePath("not/created/yet"));
+        QCOMPARE(info.deviceId, deviceId);
+    }
+
+    void testDefaultStreamLimits()
+    {
+        QCOMPARE(StorageDeviceResolver::defaultStreamLimit(StorageDeviceKind::Rotational), 1);
+        QVERIFY(StorageDeviceResolver::defaultStreamLimit(StorageDeviceKind::NVMe) >
+                StorageDeviceResolver::defaultStreamLimit(StorageDeviceKind::Rotational));
+    }
+
+    void testSameDeviceJobsSerialize()
+    {
+        BackupJobQueue queue;
+        queue.setDeviceStreamLimit(deviceId, 1);
+
+        QString source = createSource("serial_source");
+        queue.enqueue(makePairs(source, "serial_dest1"));
+        queue.enqueue(makePairs(source, "serial_dest2"));
+
+        // Both jobs touch the same device, so only one may stream at a time
+        QCOMPARE(queue.getRunningJobCount(), 1);
+        QCOMPARE(queue.getPendingJobCount(), 1);
+        QCOMPARE(queue.getActiveStreams(deviceId), 1);
+
+        QSignalSpy idleSpy(&queue, &BackupJobQueue::queueIdle);
+        QVERIFY(idleSpy.wait(10000));
+        QVERIFY(queue.isIdle());
+        QCOMPARE(queue.getActiveStreams(deviceId), 0);
+    }
+
+    void testDeviceLimitAllowsOverlap()
+    {
+        BackupJobQueue queue;
+        queue.setDeviceStreamLimit(deviceId, 2);
+
+        QString source = createSource("overlap_source");
+        queue.enqueue(makePairs(source, "overlap_dest1"));
+        queue.enqueue(makePairs(source, "overlap_dest2"));
+
+        QCOMPARE(queue.getRunningJobCount(), 2);
+        QCOMPARE(queue.getPendingJobCount(), 0);
+
+        QSignalSpy idleSpy(&queue, &BackupJobQueue::queueIdle);
+        QVERIFY(idleSpy.wait(10000));
+    }
+
+    void testSameDestinationNeverConcurrent()
+    {
+        BackupJobQueue queue;
+        queue.setDeviceStreamLimit(deviceId, 4);
+
+        QString source = createSource("samedest_source");
+        queue.enqueue(makePairs(source, "samedest_dest"));
+        queue.enqueue(makePairs(source, "samedest_dest"));
+
+        QCOMPARE(queue.getRunningJobCount(), 1);
+        QCOMPARE(queue.getPendingJobCount(), 1);
+
+        QSignalSpy idleSpy(&queue, &BackupJobQueue::queueIdle);
+        QVERIFY(idleSpy.wait(10000));
+    }
+
+    void testNestedDestinationNeverConcurrent()
+    {
+        BackupJobQueue queue;
+        queue.setDeviceStreamLimit(deviceId, 4);
+
+        QString source = createSource("nested_source");
+        queue.enqueue(makePairs(source, "nested_dest"));
+        queue.enqueue(makePairs(source, "nested_dest/sub"));
+        // A sibling sharing only a name prefix may run alongside
+        queue.enqueue(makePairs(source, "nested_dest2"));
+
+        QCOMPARE(queue.getRunningJobCount(), 2);
+        QCOMPARE(queue.getPendingJobCount(), 1);
+
+        QSignalSpy idleSpy(&queue, &BackupJobQueue::queueIdle);
+        QVERIFY(idleSpy.wait(10000));
+    }
+
+    void testMaxConcurrentJobs()
+    {
+        BackupJobQueue queue;
+        queue.setDeviceStreamLimit(deviceId, 4);
+        queue.setMaxConcurrentJobs(1);
+
+        QString source = createSource("maxjobs_source");
+        queue.enqueue(makePairs(source, "maxjobs_dest1"));
+        queue.enqueue(makePairs(source, "maxjobs_dest2"));
+
+        QCOMPARE(queue.getRunningJobCount(), 1);
+        QCOMPARE(queue.getPendingJobCount(), 1);
+
+        QSignalSpy idleSpy(&queue, &BackupJobQueue::queueIdle);
+        QVERIFY(idleSpy.wait(10000));
+    }
+
+    void testCancelPendingJob()
+    {
+        BackupJobQueue queue;
+        queue.setDeviceStreamLimit(deviceId, 1);
+
+        QString source = createSource("cancel_source");
+        queue.enqueue(makePairs(source, "cancel_dest1"));
+        QString pendingId = queue.enqueue(makePairs(source, "cancel_dest2"));
+        QVERIFY(queue.getPendingJobIds().contains(pendingId));
+
+        QSignalSpy failedSpy(&queue, &BackupJobQueue::jobFailed);
+        queue.cancelJob(pendingId);
+
+        QCOMPARE(queue.getPendingJobCount(), 0);
+        QCOMPARE(failedSpy.count(), 1);
+        QCOMPARE(failedSpy.first().at(0).toString(), pendingId);
+
+        queue.cancelAll();
+        QVERIFY(queue.isIdle());
+    }
+};
+
+QTEST_MAIN(TestBackupJobQueue)
+#include "test_backupjobqueue.moc"
@@ -0,0 +1,183 @@
+#include <QtTest/QtTest>
+#include "backupmanifest.h"
+#include <QTemporaryDir>
+
+class TestBackupManifest : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir* tempDir;
+
+    BackupManifest sampleManifest()
+    {
+        BackupManifest manifest;
+        const QStringList paths = {"docs/a.txt", "docs/b.txt", "docs/old/c.txt", "docsx/d.txt",
+                                   "photos/1.jpg", "photos/2.png", "readme.md"};
+        for (const QString &path : paths) {
+            BackupManifestEntry entry;
+            entry.path = path;
+            entry.size = path.size();
+            manifest.insert(entry);
+        }
+        return manifest;
+    }
+
+private slots:
+    void initTestCase()
+    {
+        tempDir = new QTemporaryDir();
+        QVERIFY(tempDir->isValid());
+    }
+
+    void cleanupTestCase()
+    {
+        delete tempDir;
+    }
+
+    void testSaveAndLoad()
+    {
+        BackupManifest manifest = sampleManifest();
+
+        // Separators in names must survive the line format
+        BackupManifestEntry odd;
+        odd.path = "odd/tab\tname\\with\nbreak.txt";
+        odd.size = 12345678901LL;
+        odd.lastModified = QDateTime::fromMSecsSinceEpoch(1700000000123LL);
+        manifest.insert(odd);
+
+        QString filePath = tempDir->filePath("manifest_roundtrip.txt");
+        QVERIFY(manifest.save(filePath));
+
+        BackupManifest loaded;
+        QVERIFY(loaded.load(filePath));
+        QCOMPARE(loaded.count(), manifest.count());
+        QCOMPARE(loaded.paths(), manifest.paths());
+
+        BackupManifestEntry entry = loaded.entry(odd.path);
+        QCOMPARE(entry.path, odd.path);
+        QCOMPARE(entry.size, odd.size);
+        QCOMPARE(entry.lastModified.toMSecsSinceEpoch(), odd.lastModified.toMSecsSinceEpoch());
+        QVERIFY(!loaded.entry("readme.md").lastModified.isValid());
+    }
+
+    void testLocations()
+    {
+        BackupManifest manifest = sampleManifest();
+        QString filePath = tempDir->filePath("manifest_local.txt");
+        QVERIFY(manifest.save(filePath));
+        QFile file(filePath);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        QCOMPARE(file.readLine().trimmed(), QByteArray("AutomatedBackupFile manifest 1"));
+        file.close();
+
+        // Files of other parts of a spread backup
+        BackupManifestEntry remote;
+        remote.path = "photos/2.png";
+        remote.size = 42;
+        remote.location = "../../../other\tdest/encrypted";
+        manifest.insert(remote);
+
+        filePath = tempDir->filePath("manifest_locations.txt");
+        QVERIFY(manifest.save(filePath));
+        BackupManifest loaded;
+        QVERIFY(loaded.load(filePath));
+        QCOMPARE(loaded.paths(), manifest.paths());
+        QCOMPARE(loaded.entry("photos/2.png").location, remote.location);
+        QCOMPARE(loaded.entry("photos/2.png").size, qint64(42));
+        QVERIFY(loaded.entry("photos/1.jpg").location.isEmpty());
+        QVERIFY(!loaded.localPaths().contains("photos/2.png"));
+        QCOMPARE(loaded.localPaths().size(), loaded.count() - 1);
+
+        QCOMPARE(loaded.encryptedFilePath("/backups/a/src/encrypted", "photos/1.jpg"),
+                 QString("/backups/a/src/encrypted/photos/1.jpg.enc"));
+        QCOMPARE(loaded.encryptedFilePath("/backups/a/src/encrypted", "photos/2.png"),
+                 QString("/backups/other\tdest/encrypted/photos/2.png.enc"));
+    }
+
+    void testLoadRejectsOtherFiles()
+    {
+        BackupManifest manifest;
+        QVERIFY(!manifest.load(tempDir->filePath("missing_manifest.txt")));
+
+        QString filePath = tempDir->filePath("not_a_manifest.txt");
+        QFile file(filePath);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write("something else\n1\t2\tpath\n");
+        file.close();
+        QVERIFY(!manifest.load(filePath));
+        QVERIFY(manifest.isEmpty());
+    }
+
+    void testResolve_data()
+    {
+        QTest::addColumn<QStringList>("patterns");
+        QTest::addColumn<QStringList>("expected");
+
+        QTest::newRow("file") << QStringList{"docs/b.txt"} << QStringList{"docs/b.txt"};
+        QTest::newRow("directory") << QStringList{"docs"}
+                                   << QStringList{"docs/a.txt", "docs/b.txt", "docs/old/c.txt"};
+        QTest::newRow("trailing slash") << QStringList{"/docs/old/"} << QStringList{"docs/old/c.txt"};
+        QTest::newRow("wildcard stays in directory") << QStringList{"docs/*.txt"}
+                                                     << QStringList{"docs/a.txt", "docs/b.txt"};
+        QTest::newRow("wildcard directory") << QStringList{"*/a.txt"} << QStringList{"docs/a.txt"};
+        QTest::newRow("question mark") << QStringList{"photos/?.*"}
+                                       << QStringList{"photos/1.jpg", "photos/2.png"};
+        QTest::newRow("request order") << QStringList{"readme.md", "photos/2.png", "docs/a.txt"}
+                                       << QStringList{"readme.md", "photos/2.png", "docs/a.txt"};
+        QTest::newRow("no duplicates") << QStringList{"docs/b.txt", "docs", "docs/*.txt"}
+                                       << QStringList{"docs/b.txt", "docs/a.txt", "docs/old/c.txt"};
+        QTest::newRow("everything") << QStringList{"."}
+                                    << QStringList{"docs/a.txt", "docs/b.txt", "docs/old/c.txt", "docsx/d.txt",
+                                                   "photos/1.jpg", "photos/2.png", "readme.md"};
+        QTest::newRow("no match") << QStringList{"doc", "photos/*.gif"} << QStringList();
+    }
+
+    void testResolve()
+    {
+        QFETCH(QStringList, patterns);
+        QFETCH(QStringList, expected);
+
+        QCOMPARE(sampleManifest().resolve(patterns), expected);
+    }
+
+    void testScanIndexesExistingBackup()
+    {
+        QString backupDir = tempDir->filePath("scan_backup");
+        QDir().mkpath(backupDir + "/sub");
+        QDir().mkpath(backupDir + "/decrypted");
+        for (const QString &name : {QString("top.bin.enc"), QString("sub/inner.txt.enc"),
+                                    QString("decrypted/top.bin.enc"), QString("notes.txt")}) {
+            QFile file(backupDir + "/" + name);
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            file.write("x");
+        }
+
+        BackupManifest manifest = BackupManifest::scan(backupDir);
+        QCOMPARE(manifest.paths(), QStringList({"sub/inner.txt", "top.bin"}));
+        QCOMPARE(manifest.entry("top.bin").size, qint64(-1));
+    }
+
+    void benchmarkResolveLargeIndex()
+    {
+        // A file and a small directory out of a million entries
+        BackupManifest manifest;
+        for (int i = 0; i < 1000000; ++i) {
+            BackupManifestEntry entry;
+            entry.path = QString("dir%1/file%2.dat").arg(i / 1000).arg(i % 1000);
+            manifest.insert(entry);
+        }
+
+        QStringList result;
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < 100; ++i) {
+            result = manifest.resolve({"dir500/file7.dat", "dir999/file99*.dat"});
+        }
+        qInfo() << "100 resolves over" << manifest.count() << "entries:" << timer.elapsed() << "ms";
+        QCOMPARE(result.size(), 12);
+    }
+};
+
+QTEST_MAIN(TestBackupManifest)
+#include "test_backupmanifest.moc"
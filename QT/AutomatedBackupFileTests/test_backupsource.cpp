@@ -137,6 +137,33 @@ private slots:
         delete deserializedSource;
     }
 
+    void testFilterRulesSerialization()
+    {
+        BackupSource originalSource("C:/projects", SourceType::Local);
+        originalSource.setFilterRules({FilterRule::glob("node_modules/"),
+                                       FilterRule::glob("important.log", true),
+                                       FilterRule::regex("\\.tmp$"),
+                                       FilterRule::largerThan(4LL * 1024 * 1024 * 1024),
+                                       FilterRule::olderThan(365)});
+        originalSource.setIgnoreFileName(".backupignore");
+
+        BackupSource* deserializedSource = BackupSource::fromJson(originalSource.toJson());
+        QVERIFY(deserializedSource != nullptr);
+        QCOMPARE(deserializedSource->getIgnoreFileName(), QString(".backupignore"));
+
+        const QList<FilterRule> rules = deserializedSource->getFilterRules();
+        QCOMPARE(rules.size(), 5);
+        QCOMPARE(rules[0].toString(), QString("node_modules/"));
+        QCOMPARE(rules[1].toString(), QString("!important.log"));
+        QCOMPARE(rules[2].toString(), QString("regex:\\.tmp$"));
+        QVERIFY(rules[3].type == FilterRule::Type::LargerThan);
+        QCOMPARE(rules[3].limit, 4LL * 1024 * 1024 * 1024);
+        QVERIFY(rules[4].type == FilterRule::Type::OlderThan);
+        QCOMPARE(rules[4].limit, qint64(365));
+
+        delete deserializedSource;
+    }
+
     void testIsValid()
     {
         BackupSource validSource("C:/valid/path", SourceType::Local);
@@ -0,0 +1,152 @@
+#include <QtTest/QtTest>
+#include "changejournal.h"
+#include <QTemporaryDir>
+
+class TestChangeJournal : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir* tempDir;
+    QString journalDir;
+    const qint64 baseTime = 1760000000000;
+
+    FileChangeRecord makeChange(int i, FileChangeRecord::ChangeType type = FileChangeRecord::Added)
+    {
+        FileChangeRecord change;
+        change.filePath = QString("/backups/backup_%1.zip").arg(i);
+        change.changeType = type;
+        change.changeTime = QDateTime::fromMSecsSinceEpoch(baseTime + i * 1000);
+        change.newInfo.filePath = change.filePath;
+        change.newInfo.size = i;
+        change.newInfo.inode = 100 + i;
+        change.description = QString("Change %1").arg(i);
+        return change;
+    }
+
+    QDateTime at(int i) const
+    {
+        return QDateTime::fromMSecsSinceEpoch(baseTime + i * 1000);
+    }
+
+    // Every third change is for "a", the others for "b"
+    void fill(ChangeJournal& journal, int count)
+    {
+        for (int i = 0; i < count; ++i) {
+            QVERIFY(journal.append(i % 3 == 0 ? "a" : "b", makeChange(i)));
+        }
+    }
+
+private slots:
+    void init()
+    {
+        tempDir = new QTemporaryDir();
+        QVERIFY(tempDir->isValid());
+        journalDir = tempDir->filePath("journal");
+    }
+
+    void cleanup()
+    {
+        delete tempDir;
+    }
+
+    void testHistoryPerDestination()
+    {
+        ChangeJournal journal;
+        QVERIFY(journal.open(journalDir));
+        journal.setSegmentSize(4096);
+        fill(journal, 600);
+
+        QCOMPARE(journal.recordCount(), qint64(600));
+        QVERIFY(journal.segmentCount() > 1);
+
+        QList<FileChangeRecord> history = journal.history("a", 3);
+        QCOMPARE(history.size(), 3);
+        QCOMPARE(history.at(0).filePath, QString("/backups/backup_597.zip"));
+        QCOMPARE(history.at(1).filePath, QString("/backups/backup_594.zip"));
+
+        const FileChangeRecord change = history.at(0);
+        QCOMPARE(change.changeType, FileChangeRecord::Added);
+        QCOMPARE(change.changeTime, at(597));
+        QCOMPARE(change.description, QString("Change 597"));
+        QCOMPARE(change.newInfo.size, qint64(597));
+        QCOMPARE(change.newInfo.inode, quint64(697));
+        QCOMPARE(change.newInfo.fileName, QString("backup_597.zip"));
+
+        QCOMPARE(journal.history("a", 0).size(), 200);
+        QCOMPARE(journal.history("b", 0).size(), 400);
+        QVERIFY(journal.history("missing", 10).isEmpty());
+    }
+
+    void testTimeRanges()
+    {
+        ChangeJournal journal;
+        QVERIFY(journal.open(journalDir));
+        journal.setSegmentSize(4096);
+        fill(journal, 600);
+
+        QList<FileChangeRecord> changes = journal.changesBetween(at(100), at(199));
+        QCOMPARE(changes.size(), 100);
+        QCOMPARE(changes.first().filePath, QString("/backups/backup_199.zip"));
+        QCOMPARE(changes.last().filePath, QString("/backups/backup_100.zip"));
+
+        changes = journal.changesBetween("a", at(100), at(199));
+        QCOMPARE(changes.size(), 33);
+        QCOMPARE(changes.first().filePath, QString("/backups/backup_198.zip"));
+        QCOMPARE(changes.last().filePath, QString("/backups/backup_102.zip"));
+
+        QVERIFY(journal.changesBetween(at(-100), at(-1)).isEmpty());
+        QCOMPARE(journal.changesBetween(at(0), at(10000)).size(), 600);
+    }
+
+    void testReopen()
+    {
+        {
+            ChangeJournal journal;
+            QVERIFY(journal.open(journalDir));
+            fill(journal, 10);
+        }
+
+        // A record cut short at the end is dropped
+        const QStringList segments = QDir(journalDir).entryList(QStringList() << "changes-*.log", QDir::Files);
+        QCOMPARE(segments.size(), 1);
+        QFile file(QDir(journalDir).filePath(segments.first()));
+        QVERIFY(file.open(QIODevice::Append));
+        file.write(QByteArray("\x60\x00\x00\x00partial", 11));
+        file.close();
+
+        ChangeJournal journal;
+        QVERIFY(journal.open(journalDir));
+        QCOMPARE(journal.recordCount(), qint64(10));
+
+        QVERIFY(journal.append("a", makeChange(10)));
+        QList<FileChangeRecord> history = journal.history("a", 2);
+        QCOMPARE(history.size(), 2);
+        QCOMPARE(history.at(0).filePath, QString("/backups/backup_10.zip"));
+        QCOMPARE(history.at(1).filePath, QString("/backups/backup_9.zip"));
+    }
+
+    void testRetention()
+    {
+        ChangeJournal journal;
+        QVERIFY(journal.open(journalDir));
+        journal.setSegmentSize(4096);
+        journal.setMaxRecords(0);
+        fill(journal, 1000);
+        QCOMPARE(journal.recordCount(), qint64(1000));
+
+        // Whole segments go, oldest first, keeping at least the limit
+        journal.setMaxRecords(100);
+        QVERIFY(journal.recordCount() >= 100);
+        QVERIFY(journal.recordCount() < 200);
+        QCOMPARE(journal.history("a", 1).first().filePath, QString("/backups/backup_999.zip"));
+
+        // Records from 2025 are older than a day
+        journal.setMaxRecords(0);
+        journal.setMaxAgeDays(1);
+        QCOMPARE(journal.segmentCount(), 1);
+    }
+};
+
+QTEST_MAIN(TestChangeJournal)
+#include "test_changejournal.moc"
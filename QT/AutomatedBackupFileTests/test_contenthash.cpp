@@ -0,0 +1,125 @@
+#include <QtTest/QtTest>
+#include "contenthash.h"
+#include <QElapsedTimer>
+
+class TestContentHash : public QObject
+{
+    Q_OBJECT
+
+private:
+    QList<ContentHash::Implementation> implementations;
+
+    // Deterministic input; reference values below are XXH3_64bits() of its prefixes
+    QByteArray patternData(int size)
+    {
+        QByteArray data(size, Qt::Uninitialized);
+        for (int i = 0; i < size; ++i) {
+            data[i] = static_cast<char>((i * 7 + 3) & 0xff);
+        }
+        return data;
+    }
+
+    QList<QPair<int, quint64>> referenceValues()
+    {
+        return {
+            {0, 0x2d06800538d394c2ULL},
+            {1, 0x13e608bc156defedULL},
+            {3, 0xa9088dda485b481cULL},
+            {4, 0x6d9253b16c8b1ed3ULL},
+            {8, 0x60539db630471163ULL},
+            {9, 0xfeff668361d723a8ULL},
+            {16, 0xb8c859b0f030b585ULL},
+            {17, 0x714a04408e79b80fULL},
+            {128, 0x67425a03650261bfULL},
+            {129, 0xc664bf3311c6abc4ULL},
+            {240, 0x64556dc6b462a6cfULL},
+            {241, 0x8beadd3a8874fe17ULL},
+            {1024, 0x9b81661c641c72b1ULL},
+            {1025, 0x806c2072ed713576ULL},
+            {100000, 0x0c056f6fcc340974ULL}
+        };
+    }
+
+private slots:
+    void initTestCase()
+    {
+        implementations << ContentHash::Implementation::Scalar
+                        << ContentHash::Implementation::SSE2
+                        << ContentHash::Implementation::AVX2;
+        qInfo() << "Best implementation:"
+                << ContentHash::implementationName(ContentHash::bestSupportedImplementation());
+    }
+
+    void cleanupTestCase()
+    {
+        ContentHash::setActiveImplementation(ContentHash::bestSupportedImplementation());
+    }
+
+    void testReferenceValues()
+    {
+        const QByteArray data = patternData(100000);
+
+        for (ContentHash::Implementation implementation : implementations) {
+            if (!ContentHash::isSupported(implementation)) {
+                continue;
+            }
+            ContentHash::setActiveImplementation(implementation);
+
+            for (const auto &reference : referenceValues()) {
+                QCOMPARE(ContentHash::hash(data.constData(), reference.first), reference.second);
+            }
+        }
+
+        QCOMPARE(ContentHash::toHex(ContentHash::hash(QByteArray("abc"))), QString("78af5f94892f3950"));
+    }
+
+    void testIncrementalMatchesOneShot()
+    {
+        const QByteArray data = patternData(100000);
+        const QList<int> steps = {1, 7, 63, 64, 65, 255, 256, 257, 1000, 4096};
+
+        for (const auto &reference : referenceValues()) {
+            for (int step : steps) {
+                ContentHash hash;
+                for (int offset = 0; offset < reference.first; offset += step) {
+                    hash.addData(data.constData() + offset, qMin(step, reference.first - offset));
+                }
+                QCOMPARE(hash.result(), reference.second);
+            }
+        }
+
+        // result() doesn't end the input
+        ContentHash hash;
+        hash.addData(data.left(500));
+        QCOMPARE(hash.result(), ContentHash::hash(data.left(500)));
+        hash.addData(data.mid(500, 1500));
+        QCOMPARE(hash.result(), ContentHash::hash(data.left(2000)));
+
+        hash.reset();
+        QCOMPARE(hash.result(), ContentHash::hash(QByteArray()));
+    }
+
+    void testThroughput()
+    {
+        const QByteArray data(64 * 1024 * 1024, 'x');
+
+        for (ContentHash::Implementation implementation : implementations) {
+            if (!ContentHash::isSupported(implementation)) {
+                continue;
+            }
+            ContentHash::setActiveImplementation(implementation);
+
+            QElapsedTimer timer;
+            timer.start();
+            const quint64 hash = ContentHash::hash(data);
+            const qint64 elapsedMs = qMax<qint64>(1, timer.elapsed());
+
+            qDebug() << ContentHash::implementationName(implementation) << ":"
+                     << (data.size() / 1024.0 / 1024.0) / (elapsedMs / 1000.0) << "MB/s"
+                     << ContentHash::toHex(hash);
+        }
+    }
+};
+
+QTEST_MAIN(TestContentHash)
+#include "test_contenthash.moc"
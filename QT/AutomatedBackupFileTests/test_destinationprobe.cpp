@@ -0,0 +1,123 @@
+#include <QtTest/QtTest>
+#include <QDir>
+#include <QTemporaryDir>
+#include "destinationprobe.h"
+#include "cloudprovider.h"
+
+class TestDestinationProbe : public QObject
+{
+    Q_OBJECT
+
+private:
+    static ProbeBudget smallBudget()
+    {
+        ProbeBudget budget;
+        budget.sequentialBytes = 2 * 1024 * 1024;
+        budget.smallFiles = 20;
+        budget.fsyncSamples = 3;
+        budget.uploadBytes = 64 * 1024;
+        budget.roundTripSamples = 2;
+        budget.timeLimitMsecs = 5000;
+        return budget;
+    }
+
+private slots:
+    void testProbeDirectory()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+
+        const ProbeResult result = DestinationProbe::probeDirectory(dir.path(), smallBudget());
+        QVERIFY2(result.isValid(), qPrintable(result.error));
+        QVERIFY(result.writeBytesPerSecond > 0);
+        QVERIFY(result.readBytesPerSecond > 0);
+        QVERIFY(result.createsPerSecond > 0);
+        QVERIFY(result.fsyncMsecs >= 0);
+        QCOMPARE(result.roundTripMsecs, -1.0);
+        QCOMPARE(result.uploadBytesPerSecond, 0.0);
+
+        // Nothing left behind in the destination
+        QVERIFY(QDir(dir.path()).entryList(QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot).isEmpty());
+    }
+
+    void testProbeMissingDirectory()
+    {
+        QTemporaryDir dir;
+        const ProbeResult result = DestinationProbe::probeDirectory(dir.filePath("missing"), smallBudget());
+        QVERIFY(!result.isValid());
+        QVERIFY(!result.error.isEmpty());
+        QVERIFY(result.summary().startsWith("Failed: "));
+    }
+
+    void testProbeCancelled()
+    {
+        QTemporaryDir dir;
+        std::atomic<bool> stop(true);
+        const ProbeResult result = DestinationProbe::probeDirectory(dir.path(), smallBudget(), &stop);
+        QCOMPARE(result.error, QString("Cancelled"));
+        QVERIFY(QDir(dir.path()).entryList(QDir::AllEntries | QDir::Hidden | QDir::NoDotAndDotDot).isEmpty());
+    }
+
+    void testProbeCloud()
+    {
+        MockCloudProvider provider;
+        const ProbeResult result = DestinationProbe::probeCloud(&provider, smallBudget());
+        QVERIFY2(result.isValid(), qPrintable(result.error));
+        QVERIFY(result.roundTripMsecs >= 400);  // The mock waits 500 ms
+        QVERIFY(result.uploadBytesPerSecond > 0);
+        QCOMPARE(result.writeBytesPerSecond, 0.0);
+
+        // The upload was deleted again
+        QStringList files;
+        QVERIFY(provider.listFiles("/", files));
+        QVERIFY(files.isEmpty());
+
+        QVERIFY(!DestinationProbe::probeCloud(nullptr, smallBudget()).isValid());
+    }
+
+    void testProbeCloudWithProviderOfItsOwn()
+    {
+        // What a probe on a pool thread signs in with instead of the
+        // configured provider
+        MockCloudProvider configured;
+        QMap<QString, QString> credentials;
+        credentials.insert("access_token", "token");
+        QVERIFY(configured.authenticate(credentials));
+
+        QString error;
+        CloudProvider *provider = CloudProviderFactory::createAuthenticated(
+            configured.getProviderType(), configured.getCredentials(), &error);
+        QVERIFY2(provider, qPrintable(error));
+        QCOMPARE(provider->getCredentials(), credentials);
+        QVERIFY(DestinationProbe::probeCloud(provider, smallBudget()).isValid());
+        delete provider;
+
+        QVERIFY(!CloudProviderFactory::createAuthenticated(CloudProvider::Dropbox, QMap<QString, QString>(), &error));
+        QVERIFY(!error.isEmpty());
+    }
+
+    void testEstimateSeconds()
+    {
+        ProbeResult result;
+        QCOMPARE(result.estimateSeconds(100, 10), -1.0);
+        QCOMPARE(result.summary(), QString("Not measured"));
+
+        result.timestamp = QDateTime::currentDateTime();
+        result.writeBytesPerSecond = 100;
+        result.createsPerSecond = 10;
+        QCOMPARE(result.estimateSeconds(1000, 20), 12.0);
+
+        // Cloud: the upload rate, and a round trip per file
+        ProbeResult cloud;
+        cloud.timestamp = QDateTime::currentDateTime();
+        cloud.uploadBytesPerSecond = 50;
+        cloud.roundTripMsecs = 250;
+        QCOMPARE(cloud.estimateSeconds(1000, 4), 21.0);
+
+        cloud.error = "Timed out";
+        QCOMPARE(cloud.estimateSeconds(1000, 4), -1.0);
+    }
+};
+
+QTEST_MAIN(TestDestinationProbe)
+#include "test_destinationprobe.moc"
@@ -1,8 +1,41 @@
 #include <QtTest/QtTest>
 #include "filedecryptor.h"
 #include "fileencryptor.h"
+#include "backupmanifest.h"
 #include <QTemporaryDir>
 #include <QTextStream>
+#include <QRandomGenerator>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <atomic>
+
+// Reads like a pipe: the end only shows once a read comes back empty
+class PipeDevice : public QIODevice
+{
+public:
+    explicit PipeDevice(const QByteArray &data) : m_data(data) { open(QIODevice::ReadOnly | QIODevice::Unbuffered); }
+    bool isSequential() const override { return true; }
+    bool atEnd() const override { return m_drained; }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override
+    {
+        const qint64 size = qMin(maxSize, qint64(m_data.size()) - m_position);
+        if (size <= 0) {
+            m_drained = true;
+            return 0;
+        }
+        memcpy(data, m_data.constData() + m_position, size);
+        m_position += size;
+        return size;
+    }
+    qint64 writeData(const char *, qint64) override { return -1; }
+
+private:
+    QByteArray m_data;
+    qint64 m_position = 0;
+    bool m_drained = false;
+};
 
 class TestFileDecryptor : public QObject
 {
@@ -11,6 +44,43 @@ class TestFileDecryptor : public QObject
 private:
     QTemporaryDir* tempDir;
     QString testPassword;
+    
+    QString writeFile(const QString &name, const QByteArray &data)
+    {
+        QString path = tempDir->filePath(name);
+        QFile file(path);
+        if (file.open(QIODevice::WriteOnly)) {
+            file.write(data);
+            file.close();
+        }
+        return path;
+    }
+    
+    QByteArray readFile(const QString &path)
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return QByteArray();
+        }
+        return file.readAll();
+    }
+    
+    QByteArray randomData(int size)
+    {
+        QByteArray data(size, Qt::Uninitialized);
+        for (int i = 0; i < size; ++i) {
+            data[i] = static_cast<char>(QRandomGenerator::global()->bounded(256));
+        }
+        return data;
+    }
+    
+    // Small chunks and a cheap KDF so multi-chunk files stay fast to test
+    void configureForTests(FileEncryptor &encryptor)
+    {
+        encryptor.setPassword(testPassword);
+        encryptor.setKdfIterations(1000);
+        encryptor.setChunkSize(4096);
+    }
 
 private slots:
     void initTestCase()
@@ -123,9 +193,9 @@ private slots:
         decryptor.setPassword("WrongPassword");
         bool decrypted = decryptor.decryptFile(encryptedFile, decryptedFile);
         
-        // Decryption may succeed but content will be garbage
-        // The implementation determines exact behavior
-        Q_UNUSED(decrypted);
+        // The first chunk fails authentication and nothing is left behind
+        QVERIFY(!decrypted);
+        QVERIFY(!QFile::exists(decryptedFile));
     }
 
     void testDecryptDirectory()
@@ -212,6 +282,620 @@ private slots:
         
         QCOMPARE(finalContent, originalContent);
     }
+
+    void testLargeFileRoundTripAcrossChunks()
+    {
+        QByteArray data(static_cast<int>(FileDecryptor::StreamChunkSize * 3 + 777), Qt::Uninitialized);
+        for (int i = 0; i < data.size(); ++i) {
+            data[i] = static_cast<char>(QRandomGenerator::global()->bounded(256));
+        }
+        
+        QString originalFile = tempDir->filePath("chunked_original.bin");
+        QFile file(originalFile);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(data);
+        file.close();
+        
+        FileEncryptor encryptor;
+        encryptor.setPassword(testPassword);
+        QString encryptedFile = tempDir->filePath("chunked_encrypted.bin");
+        QVERIFY(encryptor.encryptFile(originalFile, encryptedFile));
+        
+        FileDecryptor decryptor;
+        decryptor.setPassword(testPassword);
+        QString decryptedFile = tempDir->filePath("chunked_decrypted.bin");
+        QVERIFY(decryptor.decryptFile(encryptedFile, decryptedFile));
+        
+        QFile decryptedF(decryptedFile);
+        QVERIFY(decryptedF.open(QIODevice::ReadOnly));
+        QCOMPARE(decryptedF.readAll(), data);
+        decryptedF.close();
+    }
+    
+    void testDecryptKnownContainer_data()
+    {
+        QTest::addColumn<QByteArray>("container");
+        
+        // Produced independently (Python cryptography) with password
+        // "TestPassword123", 1000 KDF iterations and 4096-byte chunks
+        QTest::newRow("AES-256-GCM") << QByteArray::fromHex(
+            "414246435259505401010100000003e800001000000102030405060708090a0b0c0d0e0f"
+            "101112131415161718191a1b1c1d1e1fd04a369c04316fb49f30e9219bec9a176219e98a"
+            "1bc8e7a34c8422cd34d765e75ae442f3");
+        QTest::newRow("ChaCha20-Poly1305") << QByteArray::fromHex(
+            "414246435259505401020100000003e800001000000102030405060708090a0b0c0d0e0f"
+            "101112131415161718191a1b1c1d1e1f61e0146b269cbfc3b8db5926aec5b4d3696d1ec6"
+            "f6f1768074b2ca3ed5d15ddcabe1df60");
+    }
+    
+    void testDecryptKnownContainer()
+    {
+        QFETCH(QByteArray, container);
+        QString encryptedFile = writeFile("known_container.bin", container);
+        
+        FileDecryptor decryptor;
+        decryptor.setPassword(testPassword);
+        QVERIFY(decryptor.verifyFile(encryptedFile));
+        
+        QString decryptedFile = tempDir->filePath("known_container.txt");
+        QVERIFY(decryptor.decryptFile(encryptedFile, decryptedFile));
+        QCOMPARE(readFile(decryptedFile), QByteArray("Known answer payload"));
+    }
+    
+    void testReadsLegacyFormat()
+    {
+        // Files written before the container: SHA-256 of the password as a repeating XOR key
+        QByteArray data = randomData(static_cast<int>(FileDecryptor::StreamChunkSize + 999));
+        QByteArray legacy = data;
+        XorKeystream(QCryptographicHash::hash(testPassword.toUtf8(), QCryptographicHash::Sha256)).apply(legacy);
+        QString encryptedFile = writeFile("legacy.txt.enc", legacy);
+        
+        QVERIFY(FileDecryptor::isLegacyFile(encryptedFile));
+        
+        FileDecryptor decryptor;
+        decryptor.setPassword(testPassword);
+        QString decryptedFile = tempDir->filePath("legacy_decrypted.txt");
+        QVERIFY(decryptor.decryptFile(encryptedFile, decryptedFile));
+        QCOMPARE(readFile(decryptedFile), data);
+        
+        // Nothing to authenticate in the old format
+        QVERIFY(!decryptor.verifyFile(encryptedFile));
+    }
+    
+    void testChunkedRoundTrip_data()
+    {
+        QTest::addColumn<int>("algorithm");
+        QTest::addColumn<int>("size");
+        
+        for (AeadCipher::Algorithm algorithm : {AeadCipher::Algorithm::Aes256Gcm,
+                                                AeadCipher::Algorithm::ChaCha20Poly1305}) {
+            QString name = AeadCipher::algorithmName(algorithm);
+            for (int size : {0, 1, 4096, 4097, 3 * 4096, 100000}) {
+                QTest::newRow(qPrintable(QString("%1 %2").arg(name).arg(size)))
+                    << static_cast<int>(algorithm) << size;
+            }
+        }
+    }
+    
+    void testChunkedRoundTrip()
+    {
+        QFETCH(int, algorithm);
+        QFETCH(int, size);
+        
+        QByteArray data = randomData(size);
+        QString originalFile = writeFile("roundtrip_original.bin", data);
+        
+        FileEncryptor encryptor;
+        configureForTests(encryptor);
+        encryptor.setAlgorithm(static_cast<AeadCipher::Algorithm>(algorithm));
+        QString encryptedFile = tempDir->filePath("roundtrip_encrypted.bin");
+        QVERIFY(encryptor.encryptFile(originalFile, encryptedFile));
+        QCOMPARE(QFileInfo(encryptedFile).size(), EncryptedContainer::encryptedSize(size, 4096));
+        
+        FileDecryptor decryptor;
+        decryptor.setPassword(testPassword);
+        QVERIFY(decryptor.verifyFile(encryptedFile));
+        QString decryptedFile = tempDir->filePath("roundtrip_decrypted.bin");
+        QVERIFY(decryptor.decryptFile(encryptedFile, decryptedFile));
+        QCOMPARE(readFile(decryptedFile), data);
+    }
+    
+    void testCorruptedChunkRejected()
+    {
+        QString originalFile = writeFile("corrupt_original.bin", randomData(10 * 4096));
+        FileEncryptor encryptor;
+        configureForTests(encryptor);
+        QString encryptedFile = tempDir->filePath("corrupt_encrypted.bin");
+        QVERIFY(encryptor.encryptFile(originalFile, encryptedFile));
+        
+        // Flip one bit in the sixth chunk
+        QByteArray container = readFile(encryptedFile);
+        int offset = EncryptedContainer::HeaderSize + 5 * (4096 + AeadCipher::TagSize) + 100;
+        container[offset] = static_cast<char>(container[offset] ^ 0x04);
+        writeFile("corrupt_encrypted.bin", container);
+        
+        FileDecryptor decryptor;
+        decryptor.setPassword(testPassword);
+        QVERIFY(!decryptor.verifyFile(encryptedFile));
+        
+        QString decryptedFile = tempDir->filePath("corrupt_decrypted.bin");
+        QVERIFY(!decryptor.decryptFile(encryptedFile, decryptedFile));
+        QVERIFY(!QFile::exists(decryptedFile));
+    }
+    
+    void testTruncationAndReorderingRejected()
+    {
+        QString originalFile = writeFile("truncate_original.bin", randomData(4 * 4096));
+        FileEncryptor encryptor;
+        configureForTests(encryptor);
+        QString encryptedFile = tempDir->filePath("truncate_encrypted.bin");
+        QVERIFY(encryptor.encryptFile(originalFile, encryptedFile));
+        
+        QByteArray container = readFile(encryptedFile);
+        const int slot = 4096 + AeadCipher::TagSize;
+        FileDecryptor decryptor;
+        decryptor.setPassword(testPassword);
+        
+        // Dropping the final chunk leaves a non-final chunk at the end
+        QString truncatedFile = writeFile("truncated.bin", container.left(container.size() - slot));
+        QVERIFY(!decryptor.verifyFile(truncatedFile));
+        
+        // Swapping two chunks breaks their index binding
+        QByteArray swapped = container;
+        const int first = EncryptedContainer::HeaderSize;
+        swapped.replace(first, slot, container.mid(first + slot, slot));
+        swapped.replace(first + slot, slot, container.mid(first, slot));
+        QString swappedFile = writeFile("swapped.bin", swapped);
+        QVERIFY(!decryptor.verifyFile(swappedFile));
+        
+        // Header edits are covered by every tag
+        QByteArray editedHeader = container;
+        editedHeader[EncryptedContainer::HeaderSize - 1] = static_cast<char>(editedHeader[EncryptedContainer::HeaderSize - 1] ^ 0x01);
+        QString editedFile = writeFile("edited_header.bin", editedHeader);
+        QVERIFY(!decryptor.verifyFile(editedFile));
+    }
+    
+    void testDecryptRange_data()
+    {
+        QTest::addColumn<qint64>("offset");
+        QTest::addColumn<qint64>("length");
+        
+        // The test file is 10 chunks of 4096 bytes plus 7
+        QTest::newRow("start") << qint64(0) << qint64(100);
+        QTest::newRow("inside one chunk") << qint64(5000) << qint64(1000);
+        QTest::newRow("exact chunk") << qint64(4096) << qint64(4096);
+        QTest::newRow("across chunks") << qint64(4000) << qint64(9000);
+        QTest::newRow("final chunk") << qint64(10 * 4096) << qint64(7);
+        QTest::newRow("clipped at end") << qint64(10 * 4096 - 3) << qint64(1000);
+        QTest::newRow("past end") << qint64(20 * 4096) << qint64(10);
+        QTest::newRow("empty") << qint64(123) << qint64(0);
+    }
+    
+    void testDecryptRange()
+    {
+        QFETCH(qint64, offset);
+        QFETCH(qint64, length);
+        
+        QByteArray data = randomData(10 * 4096 + 7);
+        QString originalFile = writeFile("range_original.bin", data);
+        FileEncryptor encryptor;
+        configureForTests(encryptor);
+        QString encryptedFile = tempDir->filePath("range_encrypted.bin");
+        QVERIFY(encryptor.encryptFile(originalFile, encryptedFile));
+        QCOMPARE(FileDecryptor::plaintextSize(encryptedFile), qint64(data.size()));
+        
+        FileDecryptor decryptor;
+        decryptor.setPassword(testPassword);
+        QByteArray range;
+        QVERIFY(decryptor.decryptRange(encryptedFile, offset, length, range));
+        QCOMPARE(range, data.mid(static_cast<int>(qMin<qint64>(offset, data.size())), static_cast<int>(length)));
+    }
+    
+    void testDecryptRangeReadsOnlyCoveredChunks()
+    {
+        QByteArray data = randomData(8 * 4096);
+        QString originalFile = writeFile("range_partial_original.bin", data);
+        FileEncryptor encryptor;
+        configureForTests(encryptor);
+        QString encryptedFile = tempDir->filePath("range_partial_encrypted.bin");
+        QVERIFY(encryptor.encryptFile(originalFile, encryptedFile));
+        
+        // Damage chunk 5: ranges that don't touch it still authenticate
+        QByteArray container = readFile(encryptedFile);
+        const int slot = 4096 + AeadCipher::TagSize;
+        const int damaged = EncryptedContainer::HeaderSize + 5 * slot + 10;
+        container[damaged] = static_cast<char>(container[damaged] ^ 0x01);
+        QString corruptedFile = writeFile("range_partial_corrupted.bin", container);
+        
+        FileDecryptor decryptor;
+        decryptor.setPassword(testPassword);
+        QByteArray range;
+        QVERIFY(decryptor.decryptRange(corruptedFile, 0, 5 * 4096, range));
+        QCOMPARE(range, data.left(5 * 4096));
+        QVERIFY(!decryptor.decryptRange(corruptedFile, 5 * 4096 + 100, 10, range));
+        QVERIFY(range.isEmpty());
+        
+        // A range reaching a truncated end fails on the missing final chunk
+        QString truncatedFile = writeFile("range_partial_truncated.bin", readFile(encryptedFile).left(container.size() - slot));
+        QVERIFY(decryptor.decryptRange(truncatedFile, 0, 100, range));
+        QVERIFY(!decryptor.decryptRange(truncatedFile, 6 * 4096, 100, range));
+    }
+    
+    void testDecryptRangeLegacyFormat()
+    {
+        QByteArray data = randomData(3 * 4096);
+        QByteArray legacy = data;
+        XorKeystream(QCryptographicHash::hash(testPassword.toUtf8(), QCryptographicHash::Sha256)).apply(legacy);
+        QString encryptedFile = writeFile("range_legacy.txt.enc", legacy);
+        QCOMPARE(FileDecryptor::plaintextSize(encryptedFile), qint64(data.size()));
+        
+        FileDecryptor decryptor;
+        decryptor.setPassword(testPassword);
+        QByteArray range;
+        QVERIFY(decryptor.decryptRange(encryptedFile, 4097, 5000, range));
+        QCOMPARE(range, data.mid(4097, 5000));
+    }
+    
+    void testMemoryMappedMatchesStreaming()
+    {
+        // Just over the threshold, with a short final chunk
+        QByteArray data = randomData(static_cast<int>(FileMapping::MinimumFileSize + 12345));
+        QString originalFile = writeFile("mapped_original.bin", data);
+        
+        FileEncryptor mappedEncryptor;
+        configureForTests(mappedEncryptor);
+        mappedEncryptor.setChunkSize(EncryptedContainer::DefaultChunkSize);
+        QVERIFY(mappedEncryptor.isMemoryMappingEnabled());
+        QString mappedFile = tempDir->filePath("mapped_encrypted.bin");
+        QVERIFY(mappedEncryptor.encryptFile(originalFile, mappedFile));
+        QCOMPARE(QFileInfo(mappedFile).size(), EncryptedContainer::encryptedSize(data.size(), EncryptedContainer::DefaultChunkSize));
+        
+        // Each path reads what the other wrote
+        FileDecryptor streamingDecryptor;
+        streamingDecryptor.setPassword(testPassword);
+        streamingDecryptor.setMemoryMappingEnabled(false);
+        QString streamedOutput = tempDir->filePath("mapped_streamed.bin");
+        QVERIFY(streamingDecryptor.decryptFile(mappedFile, streamedOutput));
+        QCOMPARE(readFile(streamedOutput), data);
+        
+        FileEncryptor streamingEncryptor;
+        configureForTests(streamingEncryptor);
+        streamingEncryptor.setMemoryMappingEnabled(false);
+        QString streamedFile = tempDir->filePath("streamed_encrypted.bin");
+        QVERIFY(streamingEncryptor.encryptFile(originalFile, streamedFile));
+        
+        FileDecryptor mappedDecryptor;
+        mappedDecryptor.setPassword(testPassword);
+        QString mappedOutput = tempDir->filePath("streamed_mapped.bin");
+        QVERIFY(mappedDecryptor.decryptFile(streamedFile, mappedOutput));
+        QCOMPARE(readFile(mappedOutput), data);
+        
+        // Tampering is caught on the mapped path too
+        QByteArray container = readFile(streamedFile);
+        container[container.size() / 2] = static_cast<char>(container[container.size() / 2] ^ 0x01);
+        QString corruptedFile = writeFile("mapped_corrupted.bin", container);
+        QString corruptedOutput = tempDir->filePath("mapped_corrupted_out.bin");
+        QVERIFY(!mappedDecryptor.decryptFile(corruptedFile, corruptedOutput));
+        QVERIFY(!QFile::exists(corruptedOutput));
+    }
+    
+    void testChunkBoundaryOnBothPaths()
+    {
+        // Whole chunks only, and large enough to be mapped
+        QByteArray data = randomData(static_cast<int>(FileMapping::MinimumFileSize));
+        QString originalFile = writeFile("boundary_original.bin", data);
+        
+        FileEncryptor encryptor;
+        configureForTests(encryptor);
+        QString fileContainer = tempDir->filePath("boundary_file.bin");
+        QVERIFY(encryptor.encryptFile(originalFile, fileContainer));
+        
+        // From a pipe the end of input is only seen after the last full
+        // chunk, which then gets an empty final chunk of its own
+        QString pipeContainer = tempDir->filePath("boundary_pipe.bin");
+        {
+            PipeDevice pipe(data);
+            QFile output(pipeContainer);
+            QVERIFY(output.open(QIODevice::WriteOnly));
+            QVERIFY(encryptor.encryptStream(pipe, output));
+        }
+        QCOMPARE(QFileInfo(pipeContainer).size(),
+                 EncryptedContainer::encryptedSize(data.size(), 4096) + AeadCipher::TagSize);
+        QCOMPARE(EncryptedContainer::chunkCount(QFileInfo(pipeContainer).size(), 4096),
+                 EncryptedContainer::chunkCount(QFileInfo(fileContainer).size(), 4096) + 1);
+        
+        for (const QString &container : {fileContainer, pipeContainer}) {
+            for (bool mapped : {true, false}) {
+                FileDecryptor decryptor;
+                decryptor.setPassword(testPassword);
+                decryptor.setMemoryMappingEnabled(mapped);
+                QString output = tempDir->filePath(QString("boundary_out_%1.bin").arg(mapped));
+                QVERIFY2(decryptor.decryptFile(container, output), qPrintable(container));
+                QCOMPARE(readFile(output), data);
+            }
+        }
+    }
+    
+    void testParallelDecryptDirectory()
+    {
+        QString sourceDir = tempDir->filePath("parallel_plain");
+        QDir().mkpath(sourceDir + "/nested");
+        const int fileCount = 12;
+        QList<QByteArray> contents;
+        for (int i = 0; i < fileCount; ++i) {
+            contents.append(randomData(i * 3001));
+            writeFile(QString("parallel_plain") + (i % 2 ? "/nested" : "") + QString("/file%1.bin").arg(i), contents.last());
+        }
+        
+        FileEncryptor encryptor;
+        configureForTests(encryptor);
+        QString encryptedDir = tempDir->filePath("parallel_backup");
+        QVERIFY(encryptor.encryptDirectory(sourceDir, encryptedDir));
+        
+        FileDecryptor decryptor;
+        decryptor.setPassword(testPassword);
+        decryptor.setThreadCount(4);
+        
+        // Signals arrive on pool threads, so count them directly
+        std::atomic<int> lastPercentage(0);
+        std::atomic<int> filesProcessed(0);
+        connect(&decryptor, &FileDecryptor::progressUpdated, [&lastPercentage](int percentage) {
+            lastPercentage = percentage;
+        });
+        connect(&decryptor, &FileDecryptor::fileProcessed, [&filesProcessed](const QString&) {
+            filesProcessed++;
+        });
+        
+        QVERIFY(decryptor.decryptDirectory(encryptedDir));
+        QCOMPARE(lastPercentage.load(), 100);
+        QCOMPARE(filesProcessed.load(), fileCount);
+        
+        for (int i = 0; i < fileCount; ++i) {
+            QString decryptedFile = encryptedDir + "/decrypted" + (i % 2 ? "/nested" : "") + QString("/file%1.bin").arg(i);
+            QCOMPARE(readFile(decryptedFile), contents.at(i));
+        }
+    }
+    
+    void testCancelDecryptDirectory()
+    {
+        QString sourceDir = tempDir->filePath("cancel_plain");
+        QDir().mkpath(sourceDir);
+        for (int i = 0; i < 6; ++i) {
+            writeFile(QString("cancel_plain/file%1.bin").arg(i), randomData(10000));
+        }
+        
+        FileEncryptor encryptor;
+        configureForTests(encryptor);
+        QString encryptedDir = tempDir->filePath("cancel_backup");
+        QVERIFY(encryptor.encryptDirectory(sourceDir, encryptedDir));
+        
+        FileDecryptor decryptor;
+        decryptor.setPassword(testPassword);
+        decryptor.setThreadCount(1);
+        connect(&decryptor, &FileDecryptor::fileProcessed, [&decryptor](const QString&) {
+            decryptor.cancel();
+        });
+        
+        QVERIFY(!decryptor.decryptDirectory(encryptedDir));
+        QVERIFY(decryptor.isCancelled());
+        QCOMPARE(QDir(encryptedDir + "/decrypted").entryList(QDir::Files).size(), 1);
+    }
+    
+    void testRestoreSelectedFiles()
+    {
+        QString sourceDir = tempDir->filePath("restore_plain");
+        QDir().mkpath(sourceDir + "/docs/old");
+        QDir().mkpath(sourceDir + "/photos");
+        const QStringList names = {"docs/a.txt", "docs/b.txt", "docs/old/c.txt", "photos/1.jpg", "photos/2.jpg", "readme.md"};
+        QHash<QString, QByteArray> contents;
+        for (const QString &name : names) {
+            contents.insert(name, randomData(5000 + name.size() * 100));
+            writeFile("restore_plain/" + name, contents.value(name));
+        }
+        
+        FileEncryptor encryptor;
+        configureForTests(encryptor);
+        QString encryptedDir = tempDir->filePath("restore_backup");
+        QVERIFY(encryptor.encryptDirectory(sourceDir, encryptedDir));
+        QVERIFY(QFile::exists(encryptedDir + "/" + BackupManifest::FileName));
+        
+        FileDecryptor decryptor;
+        decryptor.setPassword(testPassword);
+        decryptor.setThreadCount(1);
+        
+        QStringList restoredOrder;
+        connect(&decryptor, &FileDecryptor::fileProcessed, [&restoredOrder](const QString &filePath) {
+            restoredOrder.append(filePath);
+        });
+        
+        QString targetDir = tempDir->filePath("restore_target");
+        QVERIFY(decryptor.restoreFiles(encryptedDir, {"photos/2.jpg", "docs", "photos/*.jpg"}, targetDir));
+        
+        // Files arrive in the order they were asked for
+        const QStringList expected = {"photos/2.jpg", "docs/a.txt", "docs/b.txt", "docs/old/c.txt", "photos/1.jpg"};
+        QCOMPARE(restoredOrder.size(), expected.size());
+        for (int i = 0; i < expected.size(); ++i) {
+            QCOMPARE(restoredOrder.at(i), targetDir + "/" + expected.at(i));
+            QCOMPARE(readFile(restoredOrder.at(i)), contents.value(expected.at(i)));
+        }
+        QVERIFY(!QFile::exists(targetDir + "/readme.md"));
+        QVERIFY(!QDir(encryptedDir + "/decrypted").exists());
+        
+        QVERIFY(!decryptor.restoreFiles(encryptedDir, {"missing/*"}, tempDir->filePath("restore_none")));
+    }
+    
+    void testRestoreRejectsPathsOutsideTarget()
+    {
+        QString sourceDir = tempDir->filePath("hostile_plain");
+        QDir().mkpath(sourceDir);
+        QByteArray data = randomData(3000);
+        writeFile("hostile_plain/good.txt", data);
+        
+        FileEncryptor encryptor;
+        configureForTests(encryptor);
+        QString encryptedDir = tempDir->filePath("hostile_backup");
+        QVERIFY(encryptor.encryptDirectory(sourceDir, encryptedDir));
+        
+        // A tampered manifest with paths that climb out of the restore
+        // directory, each with a valid container where it is read from
+        BackupManifest manifest;
+        QVERIFY(manifest.load(BackupManifest::filePathFor(encryptedDir)));
+        const QString absolutePath = tempDir->filePath("hostile_absolute.txt");
+        for (const QString &path : {QString("../hostile_escape.txt"), absolutePath}) {
+            BackupManifestEntry entry;
+            entry.path = path;
+            manifest.insert(entry);
+        }
+        BackupManifestEntry remote;
+        remote.path = "../hostile_remote.txt";
+        remote.location = ".";
+        manifest.insert(remote);
+        QVERIFY(manifest.save(BackupManifest::filePathFor(encryptedDir)));
+        QVERIFY(QFile::copy(encryptedDir + "/good.txt.enc", tempDir->filePath("hostile_escape.txt.enc")));
+        QVERIFY(QFile::copy(encryptedDir + "/good.txt.enc", tempDir->filePath("hostile_remote.txt.enc")));
+        
+        FileDecryptor decryptor;
+        decryptor.setPassword(testPassword);
+        QString targetDir = tempDir->filePath("hostile_target");
+        QVERIFY(!decryptor.restoreFiles(encryptedDir, {""}, targetDir));
+        QCOMPARE(readFile(targetDir + "/good.txt"), data);
+        QVERIFY(!QFile::exists(tempDir->filePath("hostile_escape.txt")));
+        QVERIFY(!QFile::exists(tempDir->filePath("hostile_remote.txt")));
+        QVERIFY(!QFile::exists(absolutePath));
+        
+        // Files of other parts are checked when the whole backup is decrypted
+        QVERIFY(!decryptor.decryptDirectory(encryptedDir));
+        QCOMPARE(readFile(encryptedDir + "/decrypted/good.txt"), data);
+        QVERIFY(!QFile::exists(encryptedDir + "/hostile_remote.txt"));
+    }
+    
+    void testRestoreWithoutManifest()
+    {
+        QString sourceDir = tempDir->filePath("restore_legacy_plain");
+        QDir().mkpath(sourceDir + "/sub");
+        QByteArray content = randomData(9000);
+        writeFile("restore_legacy_plain/sub/file.bin", content);
+        writeFile("restore_legacy_plain/other.bin", randomData(100));
+        
+        FileEncryptor encryptor;
+        configureForTests(encryptor);
+        QString encryptedDir = tempDir->filePath("restore_legacy_backup");
+        QVERIFY(encryptor.encryptDirectory(sourceDir, encryptedDir));
+        QVERIFY(QFile::remove(encryptedDir + "/" + BackupManifest::FileName));
+        
+        // Backups from before manifests are scanned instead
+        FileDecryptor decryptor;
+        decryptor.setPassword(testPassword);
+        QString targetDir = tempDir->filePath("restore_legacy_target");
+        QVERIFY(decryptor.restoreFiles(encryptedDir, {"sub/*.bin"}, targetDir));
+        QCOMPARE(readFile(targetDir + "/sub/file.bin"), content);
+        QVERIFY(!QFile::exists(targetDir + "/other.bin"));
+    }
+    
+    void testVerifyBackup()
+    {
+        QString sourceDir = tempDir->filePath("verify_plain");
+        QDir().mkpath(sourceDir + "/sub");
+        for (int i = 0; i < 5; ++i) {
+            writeFile(QString("verify_plain") + (i % 2 ? "/sub" : "") + QString("/file%1.bin").arg(i), randomData(20000 + i));
+        }
+        
+        FileEncryptor encryptor;
+        configureForTests(encryptor);
+        QString encryptedDir = tempDir->filePath("verify_backup");
+        QVERIFY(encryptor.encryptDirectory(sourceDir, encryptedDir));
+        
+        FileDecryptor decryptor;
+        decryptor.setPassword(testPassword);
+        BackupVerifyReport report;
+        QVERIFY(decryptor.verifyBackup(encryptedDir, report));
+        QCOMPARE(report.verifiedFiles, 5);
+        QVERIFY(report.failedFiles.isEmpty());
+        QVERIFY(report.isComplete());
+        QVERIFY(!QFile::exists(FileDecryptor::verifyCheckpointPathFor(encryptedDir)));
+        
+        // Flip one ciphertext bit, drop one file and truncate another
+        QByteArray container = readFile(encryptedDir + "/file0.bin.enc");
+        container[container.size() / 2] = static_cast<char>(container[container.size() / 2] ^ 0x01);
+        QFile corrupted(encryptedDir + "/file0.bin.enc");
+        QVERIFY(corrupted.open(QIODevice::WriteOnly));
+        corrupted.write(container);
+        corrupted.close();
+        QVERIFY(QFile::remove(encryptedDir + "/sub/file1.bin.enc"));
+        QFile truncated(encryptedDir + "/file2.bin.enc");
+        QVERIFY(truncated.open(QIODevice::ReadWrite));
+        QVERIFY(truncated.resize(truncated.size() - 4096 - 16));
+        truncated.close();
+        
+        QStringList reported;
+        connect(&decryptor, &FileDecryptor::corruptedFileFound, [&reported](const QString &filePath, const QString&) {
+            reported.append(filePath);
+        });
+        QVERIFY(!decryptor.verifyBackup(encryptedDir, report));
+        QCOMPARE(report.verifiedFiles, 2);
+        QCOMPARE(report.failedFiles.size(), 3);
+        QVERIFY(report.failedFiles.contains("file0.bin"));
+        QVERIFY(report.failedFiles.contains("sub/file1.bin"));
+        QVERIFY(report.failedFiles.contains("file2.bin"));
+        QCOMPARE(reported.size(), 3);
+        
+        // Nothing was decrypted to disk
+        QVERIFY(!QDir(encryptedDir + "/decrypted").exists());
+    }
+    
+    void testVerifyBackupResumesWithinBandwidth()
+    {
+        QString sourceDir = tempDir->filePath("scrub_plain");
+        QDir().mkpath(sourceDir);
+        const int fileCount = 6;
+        const int fileSize = 64 * 1024;
+        for (int i = 0; i < fileCount; ++i) {
+            writeFile(QString("scrub_plain/file%1.bin").arg(i), randomData(fileSize));
+        }
+        
+        FileEncryptor encryptor;
+        configureForTests(encryptor);
+        QString encryptedDir = tempDir->filePath("scrub_backup");
+        QVERIFY(encryptor.encryptDirectory(sourceDir, encryptedDir));
+        
+        FileDecryptor decryptor;
+        decryptor.setPassword(testPassword);
+        decryptor.setThreadCount(2);
+        const qint64 bytesPerSecond = 512 * 1024;
+        decryptor.setBandwidthLimit(bytesPerSecond);
+        QCOMPARE(decryptor.getBandwidthLimit(), bytesPerSecond);
+        
+        std::atomic<int> filesChecked(0);
+        connect(&decryptor, &FileDecryptor::fileProcessed, [&filesChecked](const QString&) {
+            filesChecked++;
+        });
+        
+        // The first night runs out of time part way through
+        BackupVerifyReport report;
+        QElapsedTimer timer;
+        timer.start();
+        QVERIFY(decryptor.verifyBackup(encryptedDir, report, 200));
+        QVERIFY(!report.isComplete());
+        QVERIFY(report.verifiedFiles > 0);
+        QCOMPARE(report.verifiedFiles + report.remainingFiles, fileCount);
+        QCOMPARE(filesChecked.load(), report.verifiedFiles);
+        QVERIFY(QFile::exists(FileDecryptor::verifyCheckpointPathFor(encryptedDir)));
+        
+        // The next one only reads what is left, at no more than the limit
+        const int remaining = report.remainingFiles;
+        filesChecked = 0;
+        timer.restart();
+        QVERIFY(decryptor.verifyBackup(encryptedDir, report));
+        const qint64 elapsed = timer.elapsed();
+        QVERIFY(report.isComplete());
+        QCOMPARE(report.verifiedFiles, fileCount);
+        QCOMPARE(filesChecked.load(), remaining);
+        QVERIFY(!QFile::exists(FileDecryptor::verifyCheckpointPathFor(encryptedDir)));
+        
+        // One chunk may go ahead of the schedule
+        const qint64 minimumMsecs = (qint64(remaining) * fileSize - 4096) * 1000 / bytesPerSecond;
+        QVERIFY2(elapsed >= minimumMsecs * 9 / 10, qPrintable(QString("%1 ms").arg(elapsed)));
+    }
 };
 
 QTEST_MAIN(TestFileDecryptor)
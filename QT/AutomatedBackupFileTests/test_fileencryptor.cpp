@@ -2,6 +2,9 @@
 #include "fileencryptor.h"
 #include <QTemporaryDir>
 #include <QTextStream>
+#include <QBuffer>
+#include <QRandomGenerator>
+#include <atomic>
 
 class TestFileEncryptor : public QObject
 {
@@ -178,6 +181,145 @@ private slots:
         QVERIFY(encrypted);
         QVERIFY(QFile::exists(encryptedFile));
     }
+
+    void testEncryptStreamMatchesEncryptFile()
+    {
+        // Data spanning several chunks, with an odd tail
+        QByteArray data(static_cast<int>(FileEncryptor::StreamChunkSize * 2 + 12345), Qt::Uninitialized);
+        for (int i = 0; i < data.size(); ++i) {
+            data[i] = static_cast<char>(QRandomGenerator::global()->bounded(256));
+        }
+        
+        QString sourceFile = tempDir->filePath("stream_source.bin");
+        QFile file(sourceFile);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(data);
+        file.close();
+        
+        FileEncryptor encryptor;
+        encryptor.setPassword(testPassword);
+        
+        QString encryptedFile = tempDir->filePath("stream_encrypted.bin");
+        QVERIFY(encryptor.encryptFile(sourceFile, encryptedFile));
+        
+        QBuffer input(&data);
+        QByteArray streamed;
+        QBuffer output(&streamed);
+        QVERIFY(input.open(QIODevice::ReadOnly));
+        QVERIFY(output.open(QIODevice::WriteOnly));
+        QVERIFY(encryptor.encryptStream(input, output));
+        
+        QFile encryptedF(encryptedFile);
+        QVERIFY(encryptedF.open(QIODevice::ReadOnly));
+        QByteArray fromFile = encryptedF.readAll();
+        encryptedF.close();
+        
+        // Same container layout, but every file gets its own salt and key
+        qint64 expectedSize = EncryptedContainer::encryptedSize(data.size(), EncryptedContainer::DefaultChunkSize);
+        QCOMPARE(qint64(fromFile.size()), expectedSize);
+        QCOMPARE(streamed.size(), fromFile.size());
+        QVERIFY(EncryptedContainer::hasMagic(fromFile));
+        QVERIFY(EncryptedContainer::hasMagic(streamed));
+        QVERIFY(streamed.mid(EncryptedContainer::HeaderSize) != fromFile.mid(EncryptedContainer::HeaderSize));
+    }
+    
+    void testEmptyFileHasFinalChunk()
+    {
+        QString emptyFile = tempDir->filePath("empty_container.txt");
+        QFile file(emptyFile);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.close();
+        
+        FileEncryptor encryptor;
+        encryptor.setPassword(testPassword);
+        QString encryptedFile = tempDir->filePath("empty_container.bin");
+        QVERIFY(encryptor.encryptFile(emptyFile, encryptedFile));
+        QCOMPARE(QFileInfo(encryptedFile).size(), qint64(EncryptedContainer::HeaderSize + AeadCipher::TagSize));
+    }
+    
+    void testEncryptWithoutPasswordFails()
+    {
+        QString sourceFile = tempDir->filePath("no_password.txt");
+        QFile file(sourceFile);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write("content");
+        file.close();
+        
+        FileEncryptor encryptor;
+        QString encryptedFile = tempDir->filePath("no_password.bin");
+        QVERIFY(!encryptor.encryptFile(sourceFile, encryptedFile));
+        QVERIFY(!QFile::exists(encryptedFile));
+    }
+    
+    void testEncryptDirectoryInParallelReportsProgress()
+    {
+        QString sourceDir = tempDir->filePath("parallel_source");
+        QDir().mkpath(sourceDir + "/nested");
+        const int fileCount = 16;
+        for (int i = 0; i < fileCount; ++i) {
+            QFile file(sourceDir + (i % 2 ? "/nested" : "") + QString("/file%1.bin").arg(i));
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            file.write(QByteArray(i * 5000 + 1, static_cast<char>('a' + i)));
+            file.close();
+        }
+        
+        FileEncryptor encryptor;
+        encryptor.setPassword(testPassword);
+        encryptor.setKdfIterations(1000);
+        encryptor.setChunkSize(4096);
+        encryptor.setThreadCount(4);
+        QCOMPARE(encryptor.getThreadCount(), 4);
+        
+        // Signals arrive on pool threads, so count them directly
+        std::atomic<int> lastPercentage(0);
+        std::atomic<int> filesProcessed(0);
+        connect(&encryptor, &FileEncryptor::progressUpdated, [&lastPercentage](int percentage) {
+            lastPercentage = percentage;
+        });
+        connect(&encryptor, &FileEncryptor::fileProcessed, [&filesProcessed](const QString&) {
+            filesProcessed++;
+        });
+        
+        QString encryptedDir = tempDir->filePath("parallel_encrypted");
+        QVERIFY(encryptor.encryptDirectory(sourceDir, encryptedDir));
+        QCOMPARE(lastPercentage.load(), 100);
+        QCOMPARE(filesProcessed.load(), fileCount);
+        
+        for (int i = 0; i < fileCount; ++i) {
+            QString encryptedFile = encryptedDir + (i % 2 ? "/nested" : "") + QString("/file%1.bin.enc").arg(i);
+            QCOMPARE(QFileInfo(encryptedFile).size(), EncryptedContainer::encryptedSize(i * 5000 + 1, 4096));
+        }
+    }
+    
+    void testCancelEncryptDirectory()
+    {
+        QString sourceDir = tempDir->filePath("cancel_source");
+        QDir().mkpath(sourceDir);
+        const int fileCount = 8;
+        for (int i = 0; i < fileCount; ++i) {
+            QFile file(sourceDir + QString("/file%1.bin").arg(i));
+            QVERIFY(file.open(QIODevice::WriteOnly));
+            file.write(QByteArray(20000, 'c'));
+            file.close();
+        }
+        
+        FileEncryptor encryptor;
+        encryptor.setPassword(testPassword);
+        encryptor.setKdfIterations(1000);
+        encryptor.setThreadCount(1);
+        
+        // Cancel as soon as the first file is done; the rest never start
+        connect(&encryptor, &FileEncryptor::fileProcessed, [&encryptor](const QString&) {
+            encryptor.cancel();
+        });
+        
+        QString encryptedDir = tempDir->filePath("cancel_encrypted");
+        QVERIFY(!encryptor.encryptDirectory(sourceDir, encryptedDir));
+        QVERIFY(encryptor.isCancelled());
+        
+        QDir encrypted(encryptedDir);
+        QCOMPARE(encrypted.entryList(QDir::Files).size(), 1);
+    }
 };
 
 QTEST_MAIN(TestFileEncryptor)
@@ -0,0 +1,192 @@
+#include <QtTest/QtTest>
+#include "backupfilemonitor.h"
+#include "fileindex.h"
+#include <QElapsedTimer>
+
+class TestFileIndex : public QObject
+{
+    Q_OBJECT
+
+private:
+    BackupFileInfo makeFile(const QString& path, qint64 size, qint64 modified, quint64 inode, quint64 device = 42)
+    {
+        BackupFileInfo info;
+        info.filePath = path;
+        info.fileName = path.mid(path.lastIndexOf('/') + 1);
+        info.size = size;
+        info.lastModified = QDateTime::fromMSecsSinceEpoch(modified);
+        info.device = device;
+        info.inode = inode;
+        info.isValid = true;
+        return info;
+    }
+
+private slots:
+    void testInsertAndFind()
+    {
+        FileIndex index;
+        QVERIFY(index.isEmpty());
+        QCOMPARE(index.find("/backups/a.zip"), int(FileIndex::NoFile));
+
+        index.insert(makeFile("/backups/a.zip", 100, 1750000000123, 1));
+        index.insert(makeFile("/backups/sub/b.bak", 200, 1750000001000, 2, 7));
+        index.insert(makeFile(QString::fromUtf8("/backups/sub/résumé.tar"), 5, 1750000002000, 3));
+        QCOMPARE(index.size(), 3);
+
+        QVERIFY(index.contains("/backups/a.zip"));
+        QVERIFY(!index.contains("/backups/sub/a.zip"));
+        QVERIFY(!index.contains("/backups/a.zi"));
+        QVERIFY(!index.contains("/backups"));
+
+        const QDateTime checked = QDateTime::fromMSecsSinceEpoch(1760000000000);
+        const BackupFileInfo info = index.value("/backups/sub/b.bak", checked);
+        QVERIFY(info.isValid);
+        QCOMPARE(info.filePath, QString("/backups/sub/b.bak"));
+        QCOMPARE(info.fileName, QString("b.bak"));
+        QCOMPARE(info.size, qint64(200));
+        QCOMPARE(info.lastModified, QDateTime::fromMSecsSinceEpoch(1750000001000));
+        QCOMPARE(info.lastChecked, checked);
+        QCOMPARE(info.device, quint64(7));
+        QCOMPARE(info.inode, quint64(2));
+
+        QCOMPARE(index.value(QString::fromUtf8("/backups/sub/résumé.tar")).fileName, QString::fromUtf8("résumé.tar"));
+        QVERIFY(!index.value("/backups/missing.zip").isValid);
+
+        // Inserting a path again updates it in place
+        const int handle = index.find("/backups/a.zip");
+        index.insert(makeFile("/backups/a.zip", 150, 1750000009000, 9));
+        QCOMPARE(index.size(), 3);
+        QCOMPARE(index.find("/backups/a.zip"), handle);
+        QCOMPARE(index.record(handle).size, qint64(150));
+        QCOMPARE(index.record(handle).modifiedMs, qint64(1750000009000));
+    }
+
+    void testRemoveAndReuse()
+    {
+        FileIndex index;
+        for (int i = 0; i < 100; ++i) {
+            index.insert(makeFile(QString("/backups/set%1/file%2.zip").arg(i % 3).arg(i), i, 1750000000000, i + 1));
+        }
+
+        QVERIFY(index.remove("/backups/set1/file1.zip"));
+        QVERIFY(!index.remove("/backups/set1/file1.zip"));
+        QCOMPARE(index.size(), 99);
+        QVERIFY(!index.contains("/backups/set1/file1.zip"));
+
+        // The freed handle is used again; the other files keep theirs
+        const int kept = index.find("/backups/set2/file2.zip");
+        const int reused = index.insert(makeFile("/backups/new/file.zip", 1, 1750000000000, 1000));
+        QVERIFY(reused < 100);
+        QCOMPARE(index.find("/backups/set2/file2.zip"), kept);
+        QCOMPARE(index.filePath(reused), QString("/backups/new/file.zip"));
+
+        for (int i = 0; i < 100; ++i) {
+            index.remove(QString("/backups/set%1/file%2.zip").arg(i % 3).arg(i));
+        }
+        QCOMPARE(index.size(), 1);
+        QCOMPARE(index.filePaths(), QStringList() << "/backups/new/file.zip");
+    }
+
+    void testDirectories()
+    {
+        FileIndex index;
+        index.insert(makeFile("/backups/a/1.zip", 1, 1750000000000, 1));
+        index.insert(makeFile("/backups/a/b/2.zip", 1, 1750000000000, 2));
+        index.insert(makeFile("/backups/ab/3.zip", 1, 1750000000000, 3));
+        index.insert(makeFile("/backups/4.zip", 1, 1750000000000, 4));
+
+        QStringList below = index.filePathsBelow("/backups/a");
+        below.sort();
+        QCOMPARE(below, QStringList() << "/backups/a/1.zip" << "/backups/a/b/2.zip");
+        QCOMPARE(index.filePathsBelow("/backups").size(), 4);
+        QVERIFY(index.filePathsBelow("/backups/c").isEmpty());
+
+        // A directory emptied and filled again
+        QVERIFY(index.remove("/backups/ab/3.zip"));
+        QVERIFY(index.filePathsBelow("/backups/ab").isEmpty());
+        index.insert(makeFile("/backups/ab/5.zip", 1, 1750000000000, 5));
+        QCOMPARE(index.filePathsBelow("/backups/ab"), QStringList() << "/backups/ab/5.zip");
+    }
+
+    void testSortedHandles()
+    {
+        FileIndex index;
+        const QStringList paths = QStringList() << "/b/x" << "/a/c" << "/a/b/x" << "/a/b.zip" << "/a/b/a"
+                                                << QString::fromUtf8("/a/é") << "/a/z";
+        for (int i = 0; i < paths.size(); ++i) {
+            index.insert(makeFile(paths[i], 1, 1750000000000, i + 1));
+        }
+
+        // Full paths in code point order, not grouped by directory
+        QStringList sorted;
+        for (int handle : index.sortedHandles()) {
+            sorted.append(index.filePath(handle));
+        }
+        QCOMPARE(sorted, QStringList() << "/a/b.zip" << "/a/b/a" << "/a/b/x" << "/a/c" << "/a/z"
+                                       << QString::fromUtf8("/a/é") << "/b/x");
+    }
+
+    void testSeenAndCopies()
+    {
+        FileIndex index;
+        const int a = index.insert(makeFile("/backups/a.zip", 1, 1750000000000, 1));
+        const int b = index.insert(makeFile("/backups/b.zip", 2, 1750000000000, 2));
+
+        index.markSeen(a);
+        QVERIFY(index.isSeen(a));
+        QVERIFY(!index.isSeen(b));
+        index.clearSeen();
+        QVERIFY(!index.isSeen(a));
+
+        // Copies are independent once either side changes
+        FileIndex copy = index;
+        copy.remove("/backups/a.zip");
+        copy.insert(makeFile("/backups/c.zip", 3, 1750000000000, 3));
+        QCOMPARE(index.size(), 2);
+        QVERIFY(index.contains("/backups/a.zip"));
+        QVERIFY(!index.contains("/backups/c.zip"));
+        QCOMPARE(copy.size(), 2);
+        QVERIFY(copy.contains("/backups/c.zip"));
+
+        index.clear();
+        QVERIFY(index.isEmpty());
+        QVERIFY(!index.contains("/backups/b.zip"));
+        QVERIFY(copy.contains("/backups/b.zip"));
+    }
+
+    void testMillionFiles()
+    {
+        // A million files, a thousand per directory
+        const int fileCount = 1000000;
+        FileIndex index;
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < fileCount; ++i) {
+            const QByteArray path = QString("/srv/backups/host%1/2026/file-%2.bak")
+                                        .arg(i / 1000, 3, 10, QChar('0'))
+                                        .arg(i, 7, 10, QChar('0')).toUtf8();
+            index.insert(path.constData(), path.size(), i, 1750000000000 + i, 2049, quint64(i) + 1);
+        }
+        const qint64 insertMs = timer.elapsed();
+        QCOMPARE(index.size(), fileCount);
+
+        timer.restart();
+        for (int i = 0; i < fileCount; i += 97) {
+            const QString path = QString("/srv/backups/host%1/2026/file-%2.bak")
+                                     .arg(i / 1000, 3, 10, QChar('0'))
+                                     .arg(i, 7, 10, QChar('0'));
+            const int handle = index.find(path);
+            QVERIFY(handle != FileIndex::NoFile);
+            QCOMPARE(index.record(handle).inode, quint64(i) + 1);
+        }
+        const qint64 findMs = timer.elapsed();
+
+        const double bytesPerFile = double(index.memoryUsage()) / index.size();
+        qDebug() << "Indexed" << fileCount << "files in" << insertMs << "ms, looked up"
+                 << fileCount / 97 + 1 << "in" << findMs << "ms;" << bytesPerFile << "bytes per file";
+        QVERIFY(bytesPerFile < 64);
+    }
+};
+
+QTEST_MAIN(TestFileIndex)
+#include "test_fileindex.moc"
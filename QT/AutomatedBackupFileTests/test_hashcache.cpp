@@ -0,0 +1,133 @@
+#include <QtTest/QtTest>
+#include "hashcache.h"
+#include <QTemporaryDir>
+
+class TestHashCache : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir* tempDir;
+
+    HashCacheKey makeKey(quint64 inode, qint64 size = 100)
+    {
+        HashCacheKey key;
+        key.device = 42;
+        key.inode = inode;
+        key.size = size;
+        key.modifiedMs = 1760000000000 + qint64(inode);
+        return key;
+    }
+
+    HashCacheEntry makeEntry(quint64 hash, qint64 verifiedMs, bool mismatch = false)
+    {
+        HashCacheEntry entry;
+        entry.hash = hash;
+        entry.verifiedMs = verifiedMs;
+        entry.mismatch = mismatch;
+        return entry;
+    }
+
+    void writeAll(const QString& path, const QByteArray& data)
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(data);
+    }
+
+private slots:
+    void init()
+    {
+        tempDir = new QTemporaryDir();
+        QVERIFY(tempDir->isValid());
+    }
+
+    void cleanup()
+    {
+        delete tempDir;
+    }
+
+    void testRoundTrip()
+    {
+        HashCache cache;
+        for (int i = 1; i <= 10000; ++i) {
+            cache.insert(makeKey(i), makeEntry(quint64(i) * 0x9E3779B97F4A7C15ULL, 1000 + i, i % 100 == 0));
+        }
+        cache.setCursor("local", QString::fromUtf8("/backups/local/résumé.zip"));
+        cache.setPassStartedMs(123456789);
+
+        const QString path = tempDir->filePath("hashes.cache");
+        QVERIFY(cache.save(path));
+
+        HashCache loaded;
+        QVERIFY(loaded.load(path));
+        QCOMPARE(loaded.size(), 10000);
+        QCOMPARE(loaded.cursorDestination(), QString("local"));
+        QCOMPARE(loaded.cursorPath(), QString::fromUtf8("/backups/local/résumé.zip"));
+        QCOMPARE(loaded.passStartedMs(), qint64(123456789));
+
+        HashCacheEntry entry;
+        QVERIFY(loaded.lookup(makeKey(500), entry));
+        QCOMPARE(entry.hash, quint64(500) * 0x9E3779B97F4A7C15ULL);
+        QCOMPARE(entry.verifiedMs, qint64(1500));
+        QVERIFY(entry.mismatch);
+        QVERIFY(loaded.lookup(makeKey(501), entry));
+        QVERIFY(!entry.mismatch);
+
+        // Same file at another size is another key
+        QVERIFY(!loaded.lookup(makeKey(500, 101), entry));
+    }
+
+    void testRejectsOtherFiles()
+    {
+        HashCache cache;
+        QVERIFY(!cache.load(tempDir->filePath("missing.cache")));
+
+        const QString foreign = tempDir->filePath("foreign.cache");
+        writeAll(foreign, "{\"version\": \"1.0\"}");
+        QVERIFY(!cache.load(foreign));
+
+        cache.insert(makeKey(1), makeEntry(1, 1));
+        cache.insert(makeKey(2), makeEntry(2, 2));
+        const QString path = tempDir->filePath("hashes.cache");
+        QVERIFY(cache.save(path));
+
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::ReadOnly));
+        const QByteArray good = file.readAll();
+        file.close();
+
+        // Truncated inside the entries
+        const QString damaged = tempDir->filePath("damaged.cache");
+        writeAll(damaged, good.left(HashCache::HeaderSize + HashCache::EntrySize + 10));
+        HashCache loaded;
+        QVERIFY(!loaded.load(damaged));
+        QCOMPARE(loaded.size(), 0);
+
+        // Unknown version
+        QByteArray other = good;
+        other[8] = char(HashCache::FormatVersion + 1);
+        writeAll(damaged, other);
+        QVERIFY(!loaded.load(damaged));
+        QCOMPARE(loaded.size(), 0);
+    }
+
+    void testRemoveVerifiedBefore()
+    {
+        HashCache cache;
+        for (int i = 0; i < 100; ++i) {
+            cache.insert(makeKey(i), makeEntry(i, i < 30 ? 500 : 2000));
+        }
+
+        QCOMPARE(cache.removeVerifiedBefore(1000), 30);
+        QCOMPARE(cache.size(), 70);
+
+        HashCacheEntry entry;
+        QVERIFY(!cache.lookup(makeKey(10), entry));
+        QVERIFY(cache.lookup(makeKey(50), entry));
+        QCOMPARE(cache.removeVerifiedBefore(1000), 0);
+    }
+};
+
+QTEST_MAIN(TestHashCache)
+#include "test_hashcache.moc"
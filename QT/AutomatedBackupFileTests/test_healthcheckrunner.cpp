@@ -0,0 +1,118 @@
+#include <QtTest/QtTest>
+#include "healthcheckrunner.h"
+#include <QElapsedTimer>
+#include <QSignalSpy>
+#include <QThread>
+#include <atomic>
+
+class TestHealthCheckRunner : public QObject
+{
+    Q_OBJECT
+
+private:
+    static HealthCheckRunner::Probe sleepingProbe(int msecs,
+                                                  HealthCheckResult::Outcome outcome = HealthCheckResult::Outcome::Available)
+    {
+        return [msecs, outcome]() {
+            QThread::msleep(msecs);
+            HealthCheckResult result;
+            result.outcome = outcome;
+            return result;
+        };
+    }
+
+    static HealthCheckResult resultOf(const QList<QVariant>& arguments)
+    {
+        return arguments.at(1).value<HealthCheckResult>();
+    }
+
+private slots:
+    void testConcurrentChecks()
+    {
+        HealthCheckRunner runner;
+        runner.setMaxConcurrent(4);
+        QSignalSpy spy(&runner, &HealthCheckRunner::finished);
+
+        // Four half-second checks take about half a second, not two
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < 4; ++i) {
+            QVERIFY(runner.start(QString("source%1").arg(i), sleepingProbe(500)));
+        }
+        QTRY_COMPARE_WITH_TIMEOUT(spy.count(), 4, 5000);
+        QVERIFY(timer.elapsed() < 1500);
+        for (const QList<QVariant>& arguments : spy) {
+            QVERIFY(resultOf(arguments).outcome == HealthCheckResult::Outcome::Available);
+        }
+    }
+
+    void testOneProbePerEntry()
+    {
+        HealthCheckRunner runner;
+        QSignalSpy spy(&runner, &HealthCheckRunner::finished);
+
+        QVERIFY(runner.start("source", sleepingProbe(200, HealthCheckResult::Outcome::Unavailable)));
+        QVERIFY(runner.isRunning("source"));
+        QVERIFY(!runner.start("source", sleepingProbe(0)));
+
+        QTRY_COMPARE(spy.count(), 1);
+        QCOMPARE(spy.at(0).at(0).toString(), QString("source"));
+        QVERIFY(resultOf(spy.at(0)).outcome == HealthCheckResult::Outcome::Unavailable);
+        QVERIFY(!runner.isRunning("source"));
+
+        QVERIFY(runner.start("source", sleepingProbe(0)));
+        QTRY_COMPARE(spy.count(), 2);
+    }
+
+    void testDeadline()
+    {
+        HealthCheckRunner runner;
+        runner.setTimeout(200);
+        runner.setMaxConcurrent(1);
+        QSignalSpy spy(&runner, &HealthCheckRunner::finished);
+
+        // A dead share: reported at the deadline, long before the probe returns
+        std::atomic<bool> release(false);
+        QVERIFY(runner.start("dead", [&release]() {
+            while (!release) {
+                QThread::msleep(10);
+            }
+            return HealthCheckResult();
+        }));
+        QTRY_COMPARE_WITH_TIMEOUT(spy.count(), 1, 2000);
+        QCOMPARE(spy.at(0).at(0).toString(), QString("dead"));
+        QVERIFY(resultOf(spy.at(0)).outcome == HealthCheckResult::Outcome::TimedOut);
+        QVERIFY(!resultOf(spy.at(0)).error.isEmpty());
+        QCOMPARE(runner.stalledCount(), 1);
+
+        // Not probed again meanwhile, and not in the way of others even
+        // with a single slot
+        QVERIFY(!runner.start("dead", sleepingProbe(0)));
+        QVERIFY(runner.start("alive", sleepingProbe(0)));
+        QTRY_COMPARE(spy.count(), 2);
+        QCOMPARE(spy.at(1).at(0).toString(), QString("alive"));
+        QVERIFY(resultOf(spy.at(1)).outcome == HealthCheckResult::Outcome::Available);
+
+        // Its late answer is dropped
+        release = true;
+        QTRY_VERIFY(!runner.isRunning("dead"));
+        QCOMPARE(runner.stalledCount(), 0);
+        QTest::qWait(50);
+        QCOMPARE(spy.count(), 2);
+    }
+
+    void testCancel()
+    {
+        HealthCheckRunner runner;
+        QSignalSpy spy(&runner, &HealthCheckRunner::finished);
+
+        QVERIFY(runner.start("removed", sleepingProbe(100)));
+        runner.cancel("removed");
+        QTRY_VERIFY(!runner.isRunning("removed"));
+        QTest::qWait(50);
+        QCOMPARE(spy.count(), 0);
+    }
+};
+
+QTEST_MAIN(TestHealthCheckRunner)
+#include "test_healthcheckrunner.moc"
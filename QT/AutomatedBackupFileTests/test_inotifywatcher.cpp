@@ -0,0 +1,183 @@
+#include <QtTest/QtTest>
+#include "inotifywatcher.h"
+#include <QTemporaryDir>
+#include <QSignalSpy>
+
+class TestInotifyWatcher : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir* tempDir;
+    InotifyWatcher* watcher;
+    QString root;
+
+    void writeFile(const QString& path, const QByteArray& data)
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(data);
+    }
+
+private slots:
+    void init()
+    {
+        tempDir = new QTemporaryDir();
+        QVERIFY(tempDir->isValid());
+        root = QDir::cleanPath(tempDir->path());
+        QDir().mkpath(root + "/existing/deep");
+
+        watcher = new InotifyWatcher();
+        if (!watcher->isSupported()) {
+            QSKIP("inotify is not available on this platform");
+        }
+        QVERIFY(watcher->addPath(root));
+    }
+
+    void cleanup()
+    {
+        delete watcher;
+        delete tempDir;
+    }
+
+    void testWatchesExistingTree()
+    {
+        QCOMPARE(watcher->roots(), QStringList{root});
+        QCOMPARE(watcher->watchCount(), 3);
+        QVERIFY(watcher->isWatchingFully(root));
+
+        QSignalSpy changed(watcher, &InotifyWatcher::fileChanged);
+        writeFile(root + "/existing/deep/a.bak", "data");
+        QTRY_COMPARE(changed.count(), 1);
+        QCOMPARE(changed.at(0).at(0).toString(), root + "/existing/deep/a.bak");
+    }
+
+    void testNewDirectoriesAreWatched()
+    {
+        QSignalSpy added(watcher, &InotifyWatcher::directoryAdded);
+        QSignalSpy changed(watcher, &InotifyWatcher::fileChanged);
+
+        QVERIFY(QDir().mkpath(root + "/fresh"));
+        QTRY_COMPARE(added.count(), 1);
+        QCOMPARE(watcher->watchCount(), 4);
+
+        writeFile(root + "/fresh/b.bak", "data");
+        QTRY_COMPARE(changed.count(), 1);
+        QCOMPARE(changed.at(0).at(0).toString(), root + "/fresh/b.bak");
+    }
+
+    void testRemovals()
+    {
+        writeFile(root + "/existing/c.bak", "data");
+
+        QSignalSpy fileRemoved(watcher, &InotifyWatcher::fileRemoved);
+        QSignalSpy dirRemoved(watcher, &InotifyWatcher::directoryRemoved);
+
+        QVERIFY(QFile::remove(root + "/existing/c.bak"));
+        QTRY_COMPARE(fileRemoved.count(), 1);
+        QCOMPARE(fileRemoved.at(0).at(0).toString(), root + "/existing/c.bak");
+
+        QVERIFY(QDir(root + "/existing").removeRecursively());
+        QTRY_COMPARE(dirRemoved.count(), 2);
+        QTRY_COMPARE(watcher->watchCount(), 1);
+    }
+
+    void testMovesArePaired()
+    {
+        writeFile(root + "/existing/d.bak", "data");
+
+        QSignalSpy fileMoved(watcher, &InotifyWatcher::fileMoved);
+        QSignalSpy dirMoved(watcher, &InotifyWatcher::directoryMoved);
+        QSignalSpy changed(watcher, &InotifyWatcher::fileChanged);
+
+        QVERIFY(QFile::rename(root + "/existing/d.bak", root + "/d.bak"));
+        QTRY_COMPARE(fileMoved.count(), 1);
+        QCOMPARE(fileMoved.at(0).at(0).toString(), root + "/existing/d.bak");
+        QCOMPARE(fileMoved.at(0).at(1).toString(), root + "/d.bak");
+
+        // Watches below a moved directory follow it
+        QVERIFY(QDir().rename(root + "/existing", root + "/renamed"));
+        QTRY_COMPARE(dirMoved.count(), 1);
+        QCOMPARE(dirMoved.at(0).at(1).toString(), root + "/renamed");
+
+        changed.clear();
+        writeFile(root + "/renamed/deep/e.bak", "data");
+        QTRY_COMPARE(changed.count(), 1);
+        QCOMPARE(changed.at(0).at(0).toString(), root + "/renamed/deep/e.bak");
+    }
+
+    void testMovesAcrossTheEdge()
+    {
+        QTemporaryDir outside;
+        QVERIFY(outside.isValid());
+        writeFile(outside.filePath("in.bak"), "data");
+        writeFile(root + "/out.bak", "data");
+        QTest::qWait(200);  // Let the write of out.bak be reported first
+
+        QSignalSpy changed(watcher, &InotifyWatcher::fileChanged);
+        QSignalSpy removed(watcher, &InotifyWatcher::fileRemoved);
+
+        QVERIFY(QFile::rename(outside.filePath("in.bak"), root + "/in.bak"));
+        QTRY_COMPARE(changed.count(), 1);
+        QCOMPARE(changed.at(0).at(0).toString(), root + "/in.bak");
+
+        QVERIFY(QFile::rename(root + "/out.bak", outside.filePath("out.bak")));
+        QTRY_COMPARE(removed.count(), 1);
+        QCOMPARE(removed.at(0).at(0).toString(), root + "/out.bak");
+    }
+
+    void testRemovePath()
+    {
+        watcher->removePath(root);
+        QVERIFY(watcher->roots().isEmpty());
+        QCOMPARE(watcher->watchCount(), 0);
+    }
+
+    void testRemovingNestedRootKeepsOuterWatches()
+    {
+        const QString inner = root + "/existing";
+        QVERIFY(watcher->addPath(inner));
+        QCOMPARE(watcher->watchCount(), 3);
+
+        watcher->removePath(inner);
+        QCOMPARE(watcher->roots(), QStringList{root});
+        QCOMPARE(watcher->watchCount(), 3);
+
+        QSignalSpy changed(watcher, &InotifyWatcher::fileChanged);
+        writeFile(inner + "/deep/f.bak", "data");
+        QTRY_COMPARE(changed.count(), 1);
+        QCOMPARE(changed.at(0).at(0).toString(), inner + "/deep/f.bak");
+    }
+
+    void testRemovingOuterRootKeepsNestedWatches()
+    {
+        const QString inner = root + "/existing";
+        QVERIFY(watcher->addPath(inner));
+
+        watcher->removePath(root);
+        QCOMPARE(watcher->roots(), QStringList{inner});
+        QCOMPARE(watcher->watchCount(), 2);
+
+        QSignalSpy changed(watcher, &InotifyWatcher::fileChanged);
+        writeFile(root + "/g.bak", "data");
+        writeFile(inner + "/deep/g.bak", "data");
+        QTRY_COMPARE(changed.count(), 1);
+        QCOMPARE(changed.at(0).at(0).toString(), inner + "/deep/g.bak");
+    }
+
+    void testDeletedRootCanBeAddedAgain()
+    {
+        const QString inner = root + "/existing";
+        QVERIFY(watcher->addPath(inner));
+
+        QVERIFY(QDir(inner).removeRecursively());
+        QTRY_COMPARE(watcher->roots(), QStringList{root});
+
+        QVERIFY(QDir().mkpath(inner));
+        QVERIFY(watcher->addPath(inner));
+        QCOMPARE(watcher->roots(), (QStringList{root, inner}));
+    }
+};
+
+QTEST_MAIN(TestInotifyWatcher)
+#include "test_inotifywatcher.moc"
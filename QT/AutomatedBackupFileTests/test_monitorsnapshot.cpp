@@ -0,0 +1,255 @@
+#include <QtTest/QtTest>
+#include "monitorsnapshot.h"
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+
+class TestMonitorSnapshot : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir* tempDir;
+
+    BackupFileInfo makeFile(const QString& path, qint64 size, qint64 modified, quint64 inode)
+    {
+        BackupFileInfo info;
+        info.filePath = path;
+        info.fileName = path.mid(path.lastIndexOf('/') + 1);
+        info.size = size;
+        info.lastModified = QDateTime::fromMSecsSinceEpoch(modified);
+        info.device = 42;
+        info.inode = inode;
+        info.isValid = true;
+        return info;
+    }
+
+    void addFile(FileIndex& files, const BackupFileInfo& info)
+    {
+        files.insert(info);
+    }
+
+    MonitorSnapshotDestination destinationOf(const QString& id, const QString& path,
+                                             const FileIndex& files)
+    {
+        MonitorSnapshotDestination destination;
+        destination.id = id;
+        destination.path = path;
+        destination.fileCount = files.size();
+        for (const BackupFileInfo& info : files.values()) {
+            destination.totalSize += info.size;
+        }
+        destination.lastScan = QDateTime::fromMSecsSinceEpoch(1760000000000);
+        destination.files = &files;
+        return destination;
+    }
+
+    QByteArray readAll(const QString& path)
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly)) {
+            return QByteArray();
+        }
+        return file.readAll();
+    }
+
+    void writeAll(const QString& path, const QByteArray& data)
+    {
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(data);
+    }
+
+private slots:
+    void init()
+    {
+        tempDir = new QTemporaryDir();
+        QVERIFY(tempDir->isValid());
+    }
+
+    void cleanup()
+    {
+        delete tempDir;
+    }
+
+    void testRoundTrip()
+    {
+        FileIndex local;
+        addFile(local, makeFile("/backups/local/a.zip", 100, 1750000000123, 1));
+        addFile(local, makeFile("/backups/local/sub/b.bak", 200, 1750000001000, 2));
+        addFile(local, makeFile("/elsewhere/c.7z", 300, 1750000002000, 3));  // Outside the destination
+
+        FileIndex archive;
+        addFile(archive, makeFile(QString::fromUtf8("/backups/archive/résumé.tar"), 5, 1750000003000, 4));
+
+        const QString path = tempDir->filePath("monitor.state");
+        QVERIFY(MonitorSnapshot::save(path, true, 15,
+                                      {destinationOf("local", "/backups/local", local),
+                                       destinationOf("archive", "/backups/archive", archive)}));
+        QVERIFY(MonitorSnapshot::isSnapshotFile(path));
+
+        MonitorSnapshot snapshot;
+        QVERIFY(snapshot.open(path));
+        QVERIFY(snapshot.monitoringEnabled());
+        QCOMPARE(snapshot.scanIntervalMinutes(), 15);
+        QCOMPARE(snapshot.destinationCount(), 2);
+
+        const MonitorSnapshotDestination first = snapshot.destination(0);
+        QCOMPARE(first.id, QString("local"));
+        QCOMPARE(first.path, QString("/backups/local"));
+        QCOMPARE(first.fileCount, qint64(3));
+        QCOMPARE(first.totalSize, qint64(600));
+        QCOMPARE(first.lastScan, QDateTime::fromMSecsSinceEpoch(1760000000000));
+
+        FileIndex files;
+        QVERIFY(snapshot.readFiles(0, files));
+        QCOMPARE(files.size(), 3);
+        for (const BackupFileInfo& expected : local.values()) {
+            QVERIFY(files.contains(expected.filePath));
+            const BackupFileInfo loaded = files.value(expected.filePath);
+            QCOMPARE(loaded.fileName, expected.fileName);
+            QCOMPARE(loaded.size, expected.size);
+            QCOMPARE(loaded.lastModified, expected.lastModified);
+            QCOMPARE(loaded.device, expected.device);
+            QCOMPARE(loaded.inode, expected.inode);
+        }
+
+        QVERIFY(snapshot.readFiles(1, files));
+        QCOMPARE(files.size(), 1);
+        QVERIFY(files.contains(QString::fromUtf8("/backups/archive/résumé.tar")));
+    }
+
+    void testFindFile()
+    {
+        FileIndex files;
+        for (int i = 0; i < 1000; ++i) {
+            addFile(files, makeFile(QString("/backups/set%1/backup_%2.zip").arg(i % 7).arg(i), i, 1750000000000 + i, i + 1));
+        }
+
+        const QString path = tempDir->filePath("monitor.state");
+        QVERIFY(MonitorSnapshot::save(path, false, 30, {destinationOf("d", "/backups", files)}));
+
+        MonitorSnapshot snapshot;
+        QVERIFY(snapshot.open(path));
+
+        for (int i = 0; i < 1000; i += 37) {
+            BackupFileInfo info;
+            QVERIFY(snapshot.findFile(0, QString("/backups/set%1/backup_%2.zip").arg(i % 7).arg(i), info));
+            QCOMPARE(info.size, qint64(i));
+            QCOMPARE(info.inode, quint64(i + 1));
+        }
+
+        BackupFileInfo missing;
+        QVERIFY(!snapshot.findFile(0, "/backups/set0/backup_1.zip", missing));
+        QVERIFY(!snapshot.findFile(0, "/backups/zzz.zip", missing));
+        QVERIFY(!snapshot.findFile(1, "/backups/set0/backup_0.zip", missing));
+    }
+
+    void testUnchangedDestinationsAreCopied()
+    {
+        FileIndex files;
+        addFile(files, makeFile("/backups/one/a.zip", 1, 1750000000000, 1));
+        addFile(files, makeFile("/backups/one/b.zip", 2, 1750000000000, 2));
+
+        FileIndex other;
+        addFile(other, makeFile("/backups/two/c.zip", 3, 1750000000000, 3));
+
+        const QString first = tempDir->filePath("first.state");
+        QVERIFY(MonitorSnapshot::save(first, true, 30, {destinationOf("one", "/backups/one", files)}));
+
+        MonitorSnapshot source;
+        QVERIFY(source.open(first));
+
+        // Copied from the source, behind a destination that moves its strings
+        MonitorSnapshotDestination copied = source.destination(0);
+        copied.totalSize = 99;
+
+        const QString second = tempDir->filePath("second.state");
+        QVERIFY(MonitorSnapshot::save(second, true, 30, {destinationOf("two", "/backups/two", other), copied}));
+
+        MonitorSnapshot snapshot;
+        QVERIFY(snapshot.open(second));
+        QCOMPARE(snapshot.destinationCount(), 2);
+        QCOMPARE(snapshot.destination(1).id, QString("one"));
+        QCOMPARE(snapshot.destination(1).totalSize, qint64(99));
+
+        FileIndex loaded;
+        QVERIFY(snapshot.readFiles(1, loaded));
+        QCOMPARE(loaded.size(), 2);
+        QCOMPARE(loaded.value("/backups/one/b.zip").size, qint64(2));
+
+        BackupFileInfo info;
+        QVERIFY(snapshot.findFile(1, "/backups/one/a.zip", info));
+        QVERIFY(snapshot.findFile(0, "/backups/two/c.zip", info));
+    }
+
+    void testRejectsOtherFiles()
+    {
+        const QString json = tempDir->filePath("monitor.json");
+        writeAll(json, "{\"version\": \"1.0\", \"destinations\": []}");
+        QVERIFY(!MonitorSnapshot::isSnapshotFile(json));
+
+        MonitorSnapshot snapshot;
+        QVERIFY(!snapshot.open(json));
+        QVERIFY(!snapshot.open(tempDir->filePath("missing.state")));
+        QVERIFY(!snapshot.isOpen());
+
+        FileIndex files;
+        addFile(files, makeFile("/backups/a.zip", 1, 1750000000000, 1));
+        const QString path = tempDir->filePath("monitor.state");
+        QVERIFY(MonitorSnapshot::save(path, true, 30, {destinationOf("d", "/backups", files)}));
+        const QByteArray good = readAll(path);
+
+        // Section offsets pointing past the end
+        QByteArray damaged = good;
+        damaged[31] = char(0x7f);
+        const QString damagedPath = tempDir->filePath("damaged.state");
+        writeAll(damagedPath, damaged);
+        QVERIFY(!snapshot.open(damagedPath));
+
+        // Truncated
+        writeAll(damagedPath, good.left(good.size() - 4));
+        QVERIFY(!snapshot.open(damagedPath));
+
+        // Unknown version
+        damaged = good;
+        damaged[8] = char(MonitorSnapshot::FormatVersion + 1);
+        writeAll(damagedPath, damaged);
+        QVERIFY(!snapshot.open(damagedPath));
+    }
+
+    void testLargeIndex()
+    {
+        const int fileCount = 200000;
+        FileIndex files;
+        files.reserve(fileCount);
+        for (int i = 0; i < fileCount; ++i) {
+            addFile(files, makeFile(QString("/backups/host%1/2026/backup_%2.zip").arg(i % 50).arg(i), i, 1750000000000 + i, i + 1));
+        }
+
+        const QString path = tempDir->filePath("monitor.state");
+        QElapsedTimer timer;
+        timer.start();
+        QVERIFY(MonitorSnapshot::save(path, true, 30, {destinationOf("d", "/backups", files)}));
+        const qint64 saveMs = timer.elapsed();
+
+        MonitorSnapshot snapshot;
+        timer.restart();
+        QVERIFY(snapshot.open(path));
+        const qint64 openMs = timer.elapsed();
+
+        FileIndex loaded;
+        timer.restart();
+        QVERIFY(snapshot.readFiles(0, loaded));
+        const qint64 readMs = timer.elapsed();
+        QCOMPARE(loaded.size(), fileCount);
+
+        qDebug() << "Saved" << fileCount << "files in" << saveMs << "ms," << QFileInfo(path).size() << "bytes;"
+                 << "opened in" << openMs << "ms, decoded in" << readMs << "ms";
+
+        // Opening only maps the file and checks its tables
+        QVERIFY(openMs < 100);
+    }
+};
+
+QTEST_MAIN(TestMonitorSnapshot)
+#include "test_monitorsnapshot.moc"
@@ -0,0 +1,121 @@
+#include <QtTest/QtTest>
+#include "pathtrie.h"
+#include <QElapsedTimer>
+
+class TestPathTrie : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testWholeComponents()
+    {
+        PathTrie<QString> trie;
+        trie.insert("/backups/a", "a");
+        trie.insert("/backups/ab", "ab");
+
+        QCOMPARE(trie.value("/backups/a"), QString("a"));
+        QCOMPARE(trie.value("/backups/a/x/y.txt"), QString("a"));
+        QCOMPARE(trie.value("/backups/ab/x"), QString("ab"));
+        QCOMPARE(trie.value("/backups/abc/x"), QString());
+        QCOMPARE(trie.value("/backups"), QString());
+        QCOMPARE(trie.value("/other/a"), QString());
+    }
+
+    void testNestedDeepestWins()
+    {
+        PathTrie<QString> trie;
+        trie.insert("/data", "outer");
+        trie.insert("/data/projects/site", "inner");
+
+        QCOMPARE(trie.value("/data/photos/1.jpg"), QString("outer"));
+        QCOMPARE(trie.value("/data/projects"), QString("outer"));
+        QCOMPARE(trie.value("/data/projects/site/index.html"), QString("inner"));
+
+        // Removing the outer one leaves the nested one in place
+        QVERIFY(trie.remove("/data"));
+        QCOMPARE(trie.size(), 1);
+        QCOMPARE(trie.value("/data/photos/1.jpg"), QString());
+        QCOMPARE(trie.value("/data/projects/site/index.html"), QString("inner"));
+
+        QVERIFY(!trie.remove("/data"));
+        QVERIFY(!trie.remove("/data/projects"));
+        QVERIFY(trie.remove("/data/projects/site"));
+        QVERIFY(trie.isEmpty());
+        QCOMPARE(trie.value("/data/projects/site/index.html"), QString());
+    }
+
+    void testAllOwners()
+    {
+        PathTrie<QString> trie;
+        trie.insert("/data", "data");
+        trie.insert("/data/a", "a");
+        trie.insert("/data/ab", "ab");
+        trie.insert("/data/a/nested", "nested");
+
+        QCOMPARE(trie.findAll("/data/a/nested/x"), QVector<QString>({"data", "a", "nested"}));
+        QCOMPARE(trie.findAll("/data/a/x"), QVector<QString>({"data", "a"}));
+        QCOMPARE(trie.findAll("/data/ab/x"), QVector<QString>({"data", "ab"}));
+        QCOMPARE(trie.findAll("/data/abc"), QVector<QString>({"data"}));
+        QVERIFY(trie.findAll("/other/a").isEmpty());
+
+        trie.insert("/", "root");
+        QCOMPARE(trie.findAll("/data/ab"), QVector<QString>({"root", "data", "ab"}));
+    }
+
+    void testSpelling()
+    {
+        PathTrie<int> trie;
+        trie.insert("/backups/local/", 1);
+        trie.insert(QDir::toNativeSeparators("/mnt/backups/remote"), 2);
+
+        QCOMPARE(trie.value("/backups/local", 0), 1);
+        QCOMPARE(trie.value("/backups//local/./x", 0), 1);
+        QCOMPARE(trie.value("/mnt/backups/remote/file.zip", 0), 2);
+
+        // Replacing a path's value doesn't add an entry
+        trie.insert("/backups/local", 3);
+        QCOMPARE(trie.size(), 2);
+        QCOMPARE(trie.value("/backups/local/x", 0), 3);
+
+        // A share never matches a local directory of the same name
+        trie.insert("//server/share", 4);
+        QCOMPARE(trie.value("//server/share/x", 0), 4);
+        QCOMPARE(trie.value("/server/share/x", 0), 0);
+    }
+
+    void testRoot()
+    {
+        PathTrie<int> trie;
+        trie.insert("/", 1);
+        trie.insert("/home/user", 2);
+
+        QCOMPARE(trie.value("/etc/hosts", 0), 1);
+        QCOMPARE(trie.value("/home/user/notes.txt", 0), 2);
+
+        trie.clear();
+        QVERIFY(trie.isEmpty());
+        QCOMPARE(trie.value("/etc/hosts", 0), 0);
+    }
+
+    void testManyRoots()
+    {
+        PathTrie<int> trie;
+        const int count = 20000;
+        for (int i = 0; i < count; ++i) {
+            trie.insert(QString("/srv/backups/client%1/data").arg(i), i);
+        }
+        QCOMPARE(trie.size(), count);
+
+        QElapsedTimer timer;
+        timer.start();
+        for (int i = 0; i < count; ++i) {
+            QCOMPARE(trie.value(QString("/srv/backups/client%1/data/db/1.bin").arg(i), -1), i);
+        }
+        qDebug() << count << "lookups among" << count << "roots:" << timer.elapsed() << "ms";
+
+        QCOMPARE(trie.value("/srv/backups/client1/dat/x", -1), -1);
+    }
+};
+
+QTEST_MAIN(TestPathTrie)
+#include "test_pathtrie.moc"
@@ -0,0 +1,114 @@
+#include <QtTest/QtTest>
+#include "placementengine.h"
+
+class TestPlacementEngine : public QObject
+{
+    Q_OBJECT
+
+private:
+    static const qint64 MiB = 1024 * 1024;
+
+    static PlacementTarget target(double throughput, qint64 freeSpace = -1, int activeStreams = 0)
+    {
+        PlacementTarget t;
+        t.throughput = throughput;
+        t.freeSpace = freeSpace;
+        t.activeStreams = activeStreams;
+        return t;
+    }
+
+    static QVector<PlacementFile> files(const QVector<qint64> &sizes)
+    {
+        QVector<PlacementFile> result;
+        for (int i = 0; i < sizes.size(); ++i) {
+            result.append({QString("file%1").arg(i), sizes[i]});
+        }
+        return result;
+    }
+
+private slots:
+    void testEffectiveThroughput()
+    {
+        QCOMPARE(target(100 * MiB).effectiveThroughput(), 100.0 * MiB);
+        QCOMPARE(target(100 * MiB, -1, 3).effectiveThroughput(), 25.0 * MiB);
+        QCOMPARE(target(0).effectiveThroughput(), PlacementEngine::DefaultThroughput);
+    }
+
+    void testMirror()
+    {
+        const QVector<PlacementTarget> targets = {target(10 * MiB, 1), target(20 * MiB)};
+        const Placement placement = PlacementEngine::place(targets, files({10 * MiB, 30 * MiB}),
+                                                           PlacementEngine::Mode::Mirror);
+        QVERIFY(placement.isComplete());
+        QCOMPARE(placement.files[0], QStringList({"file0", "file1"}));
+        QCOMPARE(placement.files[1], QStringList({"file0", "file1"}));
+        QCOMPARE(placement.bytes[1], 40 * MiB);
+        QCOMPARE(placement.finishSeconds, 4.0);
+    }
+
+    void testFastest()
+    {
+        // The faster disk is already busy with another job
+        QVector<PlacementTarget> targets = {target(30 * MiB), target(50 * MiB, -1, 1)};
+        Placement placement = PlacementEngine::place(targets, files({20 * MiB, 10 * MiB}),
+                                                     PlacementEngine::Mode::Fastest);
+        QCOMPARE(placement.files[0].size(), 2);
+        QVERIFY(placement.files[1].isEmpty());
+        QCOMPARE(placement.finishSeconds, 1.0);
+
+        // Too little room on the fastest
+        targets = {target(30 * MiB, 100 * MiB), target(90 * MiB, 20 * MiB)};
+        placement = PlacementEngine::place(targets, files({20 * MiB, 10 * MiB}), PlacementEngine::Mode::Fastest);
+        QCOMPARE(placement.files[0].size(), 2);
+
+        // Room on neither for everything: striped instead
+        targets = {target(10 * MiB, 25 * MiB), target(10 * MiB, 25 * MiB)};
+        placement = PlacementEngine::place(targets, files({20 * MiB, 10 * MiB}), PlacementEngine::Mode::Fastest);
+        QVERIFY(placement.isComplete());
+        QCOMPARE(placement.files[0], QStringList({"file0"}));
+        QCOMPARE(placement.files[1], QStringList({"file1"}));
+    }
+
+    void testStripe()
+    {
+        // Three times as fast takes about three times as much
+        const QVector<PlacementTarget> targets = {target(30 * MiB), target(10 * MiB)};
+        const Placement placement = PlacementEngine::place(targets, files({10 * MiB, 40 * MiB, 20 * MiB, 10 * MiB}),
+                                                           PlacementEngine::Mode::Stripe);
+        QVERIFY(placement.isComplete());
+        QCOMPARE(placement.files[0], QStringList({"file1", "file2"}));
+        QCOMPARE(placement.files[1], QStringList({"file0", "file3"}));
+        QCOMPARE(placement.bytes[0], 60 * MiB);
+        QCOMPARE(placement.bytes[1], 20 * MiB);
+        QCOMPARE(placement.finishSeconds, 2.0);
+    }
+
+    void testStripeRespectsFreeSpace()
+    {
+        const QVector<PlacementTarget> targets = {target(100 * MiB, 15 * MiB), target(10 * MiB, 25 * MiB)};
+        const Placement placement = PlacementEngine::place(targets, files({10 * MiB, 20 * MiB, 10 * MiB, 30 * MiB}),
+                                                           PlacementEngine::Mode::Stripe);
+        QVERIFY(!placement.isComplete());
+        QCOMPARE(placement.unplaced, QStringList({"file3", "file2"}));
+        QCOMPARE(placement.files[0], QStringList({"file0"}));
+        QCOMPARE(placement.files[1], QStringList({"file1"}));
+    }
+
+    void testNoTargets()
+    {
+        const Placement placement = PlacementEngine::place({}, files({1, 2}), PlacementEngine::Mode::Stripe);
+        QCOMPARE(placement.unplaced.size(), 2);
+    }
+
+    void testModeNames()
+    {
+        for (PlacementEngine::Mode mode : {PlacementEngine::Mode::Mirror, PlacementEngine::Mode::Fastest,
+                                           PlacementEngine::Mode::Stripe}) {
+            QCOMPARE(PlacementEngine::modeFromString(PlacementEngine::modeToString(mode)), mode);
+        }
+        QCOMPARE(PlacementEngine::modeFromString("unknown"), PlacementEngine::Mode::Mirror);
+    }
+};
+
+QTEST_MAIN(TestPlacementEngine)
+#include "test_placementengine.moc"
@@ -5,6 +5,32 @@ class TestRetentionPolicy : public QObject
 {
     Q_OBJECT
 
+private:
+    // One generation a day at 22:00, newest first
+    static QList<BackupGeneration> dailyGenerations(const QDate &newest, int count, qint64 size = 100)
+    {
+        QList<BackupGeneration> generations;
+        for (int i = 0; i < count; ++i) {
+            BackupGeneration generation;
+            generation.timestamp = QDateTime(newest.addDays(-i), QTime(22, 0));
+            generation.name = BackupCatalog::generationName(generation.timestamp);
+            generation.size = size;
+            generations.append(generation);
+        }
+        return generations;
+    }
+
+    static QStringList namesOf(const RetentionPlan &plan, bool kept)
+    {
+        QStringList names;
+        for (const RetentionDecision &decision : plan.decisions) {
+            if (decision.keep() == kept) {
+                names.append(decision.generation.timestamp.date().toString(Qt::ISODate));
+            }
+        }
+        return names;
+    }
+
 private slots:
     void testDefaultConstructor()
     {
@@ -170,6 +196,100 @@ private slots:
         // Result depends on implementation
         policy.shouldDeleteBackup(veryOldBackup);
     }
+
+    void testPlanGrandfatherFatherSon()
+    {
+        RetentionPolicy policy;
+        policy.setRetentionDays(1);
+        
+        // Daily from Sunday 30 June back to 3 March
+        const QDateTime now(QDate(2024, 6, 30), QTime(23, 0));
+        const RetentionPlan plan = policy.plan(dailyGenerations(now.date(), 120), now);
+        QCOMPARE(plan.decisions.size(), 120);
+        
+        // Seven days, the newest of the three weeks before, and the newest
+        // of each month
+        QCOMPARE(namesOf(plan, true), QStringList({
+            "2024-06-30", "2024-06-29", "2024-06-28", "2024-06-27", "2024-06-26", "2024-06-25",
+            "2024-06-24", "2024-06-23", "2024-06-16", "2024-06-09", "2024-05-31", "2024-04-30",
+            "2024-03-31"}));
+        QVERIFY(plan.decisions.at(0).reason == RetentionDecision::Reason::Newest);
+        QVERIFY(plan.decisions.at(7).reason == RetentionDecision::Reason::Weekly);
+        QVERIFY(plan.decisions.at(30).reason == RetentionDecision::Reason::Monthly);
+        QVERIFY(plan.decisions.at(8).reason == RetentionDecision::Reason::Expired);
+        QCOMPARE(plan.deleteCount(), 107);
+        
+        // Without buckets only the age counts
+        policy.setKeepDailyBackups(false);
+        policy.setKeepWeeklyBackups(false);
+        policy.setKeepMonthlyBackups(false);
+        QCOMPARE(namesOf(policy.plan(dailyGenerations(now.date(), 120), now), true),
+                 QStringList({"2024-06-30", "2024-06-29"}));
+    }
+
+    void testPlanCountLimit()
+    {
+        const QDateTime now(QDate(2024, 6, 30), QTime(23, 0));
+        RetentionPolicy policy;
+        policy.setRetentionDays(365);
+        policy.setKeepWeeklyBackups(false);
+        policy.setKeepMonthlyBackups(false);
+        policy.setMaxBackupCount(8);
+        
+        // The two oldest that no bucket keeps go first, then nothing else
+        RetentionPlan plan = policy.plan(dailyGenerations(now.date(), 10), now);
+        QCOMPARE(namesOf(plan, false), QStringList({"2024-06-22", "2024-06-21"}));
+        QVERIFY(plan.decisions.at(9).reason == RetentionDecision::Reason::OverCount);
+        QVERIFY(plan.decisions.at(7).reason == RetentionDecision::Reason::WithinRetention);
+        
+        // Bucket generations too when those aren't enough, oldest first
+        policy.setMaxBackupCount(3);
+        plan = policy.plan(dailyGenerations(now.date(), 10), now);
+        QCOMPARE(namesOf(plan, true), QStringList({"2024-06-30", "2024-06-29", "2024-06-28"}));
+        QCOMPARE(plan.toDelete().first().name, BackupCatalog::generationName(QDateTime(QDate(2024, 6, 21), QTime(22, 0))));
+    }
+
+    void testPlanSizeLimit()
+    {
+        const QDateTime now(QDate(2024, 6, 30), QTime(23, 0));
+        RetentionPolicy policy;
+        policy.setRetentionDays(0);
+        policy.setKeepDailyBackups(false);
+        policy.setKeepWeeklyBackups(false);
+        policy.setKeepMonthlyBackups(false);
+        policy.setMaxStorageSize(250);
+        
+        const RetentionPlan plan = policy.plan(dailyGenerations(now.date(), 5), now);
+        QCOMPARE(plan.deleteCount(), 3);
+        QCOMPARE(plan.keptSize(), qint64(200));
+        QCOMPARE(plan.reclaimedSize(), qint64(300));
+        QVERIFY(plan.decisions.at(2).reason == RetentionDecision::Reason::OverSize);
+        
+        // The newest stays even when it alone is too large
+        policy.setMaxStorageSize(50);
+        QCOMPARE(namesOf(policy.plan(dailyGenerations(now.date(), 5), now), true), QStringList({"2024-06-30"}));
+    }
+
+    void testPlanReport()
+    {
+        const QDateTime now(QDate(2024, 6, 30), QTime(23, 0));
+        RetentionPolicy policy;
+        policy.setRetentionDays(2);
+        policy.setKeepDailyBackups(false);
+        policy.setKeepWeeklyBackups(false);
+        policy.setKeepMonthlyBackups(false);
+        
+        const RetentionPlan plan = policy.plan(dailyGenerations(now.date(), 4), now);
+        const QStringList lines = plan.report().split('\n');
+        QCOMPARE(lines.size(), 5);
+        QVERIFY(lines.at(0).startsWith("Keep"));
+        QVERIFY(lines.at(0).contains("20240630-220000"));
+        QVERIFY(lines.at(3).startsWith("Delete"));
+        QVERIFY(lines.at(3).contains("older than retention period"));
+        QVERIFY(lines.at(4).startsWith("1 of 4 backups to delete"));
+        
+        QVERIFY(policy.plan(QList<BackupGeneration>(), now).decisions.isEmpty());
+    }
 };
 
 QTEST_MAIN(TestRetentionPolicy)
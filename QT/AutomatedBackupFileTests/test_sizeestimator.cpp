@@ -0,0 +1,117 @@
+#include <QtTest/QtTest>
+#include "sizeestimator.h"
+#include "sourcestatistics.h"
+#include <QStorageInfo>
+#include <QTemporaryDir>
+
+class TestSizeEstimator : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir* tempDir;
+
+    void writeFile(const QString& relativePath, int size = 100)
+    {
+        const QString path = tempDir->filePath(relativePath);
+        QDir().mkpath(QFileInfo(path).absolutePath());
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(QByteArray(size, 'x'));
+    }
+
+private slots:
+    void init()
+    {
+        tempDir = new QTemporaryDir();
+        QVERIFY(tempDir->isValid());
+    }
+
+    void cleanup()
+    {
+        delete tempDir;
+    }
+
+    void testSmallTreeIsExact()
+    {
+        writeFile("a.txt", 10);
+        writeFile("docs/b.txt", 20);
+        writeFile("docs/old/c.txt", 30);
+        writeFile(".hidden", 1000);
+
+        SizeEstimator estimator;
+        const SizeEstimate estimate = estimator.estimate(tempDir->path());
+        QVERIFY(estimate.isExact());
+
+        SourceStatistics statistics;
+        QVERIFY(statistics.rebuild(tempDir->path()));
+        QCOMPARE(estimate.fileCount, statistics.fileCount());
+        QCOMPARE(estimate.totalSize, statistics.totalSize());
+        QCOMPARE(estimate.fileCountLow, estimate.fileCountHigh);
+        QCOMPARE(estimate.directoriesRead, 3);
+    }
+
+    void testUniformTreeIsExtrapolated()
+    {
+        // Four directories of two files and five subdirectories of ten
+        for (int i = 0; i < 4; ++i) {
+            writeFile(QString("dir%1/top1.bin").arg(i));
+            writeFile(QString("dir%1/top2.bin").arg(i));
+            for (int j = 0; j < 5; ++j) {
+                for (int k = 0; k < 10; ++k) {
+                    writeFile(QString("dir%1/sub%2/file%3.bin").arg(i).arg(j).arg(k));
+                }
+            }
+        }
+
+        // No budget: only the root is read, the rest comes from probes,
+        // and every probe of a uniform tree sees the same thing
+        SizeEstimator estimator(42);
+        const SizeEstimate estimate = estimator.estimate(tempDir->path(), 0);
+        QVERIFY(estimate.method == SizeEstimate::Method::Sampled);
+        QCOMPARE(estimate.fileCount, qint64(208));
+        QCOMPARE(estimate.totalSize, qint64(20800));
+        QCOMPARE(estimate.fileCountLow, estimate.fileCount);
+        QCOMPARE(estimate.fileCountHigh, estimate.fileCount);
+        QCOMPARE(estimate.directoriesRead, 1 + 2 * SizeEstimator::MinimumProbes);
+    }
+
+    void testSkewedTreeHasBounds()
+    {
+        writeFile("root.bin");
+        for (int i = 0; i < 3; ++i) {
+            writeFile(QString("small%1/file.bin").arg(i));
+        }
+        for (int k = 0; k < 50; ++k) {
+            writeFile(QString("large/deep/file%1.bin").arg(k));
+        }
+
+        SizeEstimator estimator(7);
+        const SizeEstimate estimate = estimator.estimate(tempDir->path(), 0);
+        QVERIFY(estimate.method == SizeEstimate::Method::Sampled);
+        QVERIFY(estimate.fileCountLow >= 1);  // At least what was read
+        QVERIFY(estimate.fileCountLow <= estimate.fileCount);
+        QVERIFY(estimate.fileCount <= estimate.fileCountHigh);
+        QVERIFY(estimate.totalSizeLow <= estimate.totalSize);
+        QVERIFY(estimate.totalSize <= estimate.totalSizeHigh);
+    }
+
+    void testFilesystemRoot()
+    {
+        QVERIFY(SizeEstimator::isFilesystemRoot(QStorageInfo::root().rootPath()));
+        QVERIFY(!SizeEstimator::isFilesystemRoot(tempDir->path()));
+    }
+
+    void testInvalid()
+    {
+        SizeEstimator estimator;
+        QVERIFY(!estimator.estimate(tempDir->filePath("missing")).isValid());
+
+        writeFile("a.txt");
+        std::atomic<bool> stop(true);
+        QVERIFY(!estimator.estimate(tempDir->path(), 500, &stop).isValid());
+    }
+};
+
+QTEST_MAIN(TestSizeEstimator)
+#include "test_sizeestimator.moc"
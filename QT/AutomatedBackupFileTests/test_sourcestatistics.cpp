@@ -0,0 +1,160 @@
+#include <QtTest/QtTest>
+#include "sourcestatistics.h"
+#include <QTemporaryDir>
+
+class TestSourceStatistics : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir* tempDir;
+
+    QString root() const
+    {
+        return tempDir->filePath("source");
+    }
+
+    void writeFile(const QString& relativePath, const QByteArray& data = "x")
+    {
+        const QString path = root() + "/" + relativePath;
+        QDir().mkpath(QFileInfo(path).absolutePath());
+        QFile file(path);
+        QVERIFY(file.open(QIODevice::WriteOnly));
+        file.write(data);
+    }
+
+    // What a walk from scratch counts now
+    void verifyMatchesRebuild(const SourceStatistics& statistics)
+    {
+        SourceStatistics fresh;
+        QVERIFY(fresh.rebuild(root()));
+        QCOMPARE(statistics.fileCount(), fresh.fileCount());
+        QCOMPARE(statistics.totalSize(), fresh.totalSize());
+        QCOMPARE(statistics.directoryCount(), fresh.directoryCount());
+    }
+
+private slots:
+    void init()
+    {
+        tempDir = new QTemporaryDir();
+        QVERIFY(tempDir->isValid());
+
+        writeFile("a.txt", QByteArray(10, 'a'));
+        writeFile("docs/b.txt", QByteArray(20, 'b'));
+        writeFile("docs/old/c.txt", QByteArray(30, 'c'));
+        writeFile("photos/2026/d.jpg", QByteArray(40, 'd'));
+        writeFile(".hidden", QByteArray(1000, 'h'));
+    }
+
+    void cleanup()
+    {
+        delete tempDir;
+    }
+
+    void testRebuild()
+    {
+        SourceStatistics statistics;
+        QVERIFY(statistics.isEmpty());
+        QVERIFY(statistics.rebuild(root() + "/"));
+        QCOMPARE(statistics.root(), root());
+        QCOMPARE(statistics.fileCount(), qint64(4));
+        QCOMPARE(statistics.totalSize(), qint64(100));
+        QCOMPARE(statistics.directoryCount(), 5);
+
+        // Symlinked directories aren't followed
+        if (QFile::link(root() + "/docs", root() + "/docs-link")) {
+            QVERIFY(statistics.rebuild(root()));
+            QCOMPARE(statistics.fileCount(), qint64(4));
+        }
+
+        QVERIFY(!statistics.rebuild(root() + "/missing"));
+        QCOMPARE(statistics.fileCount(), qint64(4));
+    }
+
+    void testUpdateDirectory()
+    {
+        SourceStatistics statistics;
+        QVERIFY(statistics.rebuild(root()));
+
+        // A file added, one grown and one removed
+        writeFile("docs/new.txt", QByteArray(5, 'n'));
+        writeFile("docs/b.txt", QByteArray(25, 'b'));
+        QVERIFY(QFile::remove(root() + "/a.txt"));
+        statistics.updateDirectory(root() + "/docs");
+        statistics.updateDirectory(root());
+        QCOMPARE(statistics.fileCount(), qint64(4));
+        QCOMPARE(statistics.totalSize(), qint64(100));
+        verifyMatchesRebuild(statistics);
+
+        // A new tree is walked through its parent
+        writeFile("music/rock/e.flac", QByteArray(50, 'e'));
+        writeFile("music/f.flac", QByteArray(60, 'f'));
+        statistics.updateDirectory(root() + "/music/rock");
+        QCOMPARE(statistics.fileCount(), qint64(6));
+        QCOMPARE(statistics.totalSize(), qint64(210));
+        verifyMatchesRebuild(statistics);
+
+        // A removed tree is dropped with everything below it
+        QVERIFY(QDir(root() + "/docs").removeRecursively());
+        statistics.updateDirectory(root() + "/docs/old");
+        QCOMPARE(statistics.fileCount(), qint64(3));
+        verifyMatchesRebuild(statistics);
+
+        // A renamed directory: gone under one name, new under another
+        QVERIFY(QDir().rename(root() + "/photos", root() + "/pictures"));
+        statistics.updateDirectory(root() + "/photos");
+        statistics.updateDirectory(root() + "/pictures");
+        QCOMPARE(statistics.fileCount(), qint64(3));
+        verifyMatchesRebuild(statistics);
+
+        // Paths outside the root change nothing
+        statistics.updateDirectory(tempDir->path());
+        statistics.updateDirectory(root() + "-other");
+        QCOMPARE(statistics.fileCount(), qint64(3));
+    }
+
+    void testSaveAndLoad()
+    {
+        SourceStatistics statistics;
+        QVERIFY(statistics.rebuild(root()));
+        const QString cachePath = tempDir->filePath("source.stats");
+        QVERIFY(statistics.save(cachePath));
+
+        SourceStatistics loaded;
+        QVERIFY(loaded.load(cachePath, root()));
+        QCOMPARE(loaded.fileCount(), qint64(4));
+        QCOMPARE(loaded.totalSize(), qint64(100));
+        QCOMPARE(loaded.directoryCount(), 5);
+
+        // Subdirectories are known again, so removing one drops its tree
+        QVERIFY(QDir(root() + "/photos").removeRecursively());
+        loaded.updateDirectory(root());
+        QCOMPARE(loaded.fileCount(), qint64(3));
+        verifyMatchesRebuild(loaded);
+
+        // Saved for another source
+        QVERIFY(!loaded.load(cachePath, tempDir->filePath("elsewhere")));
+        QVERIFY(loaded.isEmpty());
+
+        QFile file(cachePath);
+        QVERIFY(file.open(QIODevice::ReadWrite));
+        QVERIFY(file.resize(file.size() - 3));
+        file.close();
+        QVERIFY(!loaded.load(cachePath, root()));
+        QVERIFY(!loaded.load(tempDir->filePath("missing.stats"), root()));
+    }
+
+    void testStop()
+    {
+        SourceStatistics statistics;
+        QVERIFY(statistics.rebuild(root()));
+
+        std::atomic<bool> stop(true);
+        writeFile("more.txt");
+        QVERIFY(!statistics.rebuild(root(), &stop));
+        QCOMPARE(statistics.fileCount(), qint64(4));
+    }
+};
+
+QTEST_MAIN(TestSourceStatistics)
+#include "test_sourcestatistics.moc"